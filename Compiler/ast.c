@@ -49,6 +49,13 @@ ASTNode* create_func_def(ASTNode *ret_type, char *name, ASTNode *params, ASTNode
     return node;
 }
 
+ASTNode* create_func_call(char *name, ASTNode *args) {
+    ASTNode *node = create_node(NODE_FUNC_CALL);
+    node->data.func_call.name = strdup(name);
+    node->data.func_call.args = args;
+    return node;
+}
+
 ASTNode* create_if_stmt(ASTNode *cond, ASTNode *then_b, ASTNode *else_b) {
     ASTNode *node = create_node(NODE_IF_STMT);
     node->data.if_stmt.condition = cond;
@@ -57,6 +64,21 @@ ASTNode* create_if_stmt(ASTNode *cond, ASTNode *then_b, ASTNode *else_b) {
     return node;
 }
 
+ASTNode* create_loop_stmt(NodeType type, ASTNode *init, ASTNode *cond, ASTNode *step, ASTNode *body) {
+    ASTNode *node = create_node(type);
+    node->data.loop.init = init;
+    node->data.loop.condition = cond;
+    node->data.loop.step = step;
+    node->data.loop.body = body;
+    return node;
+}
+
+/* 复合赋值 (a += b, i++) 展开为 a = a op b */
+ASTNode* create_assign_op(OperatorType op, ASTNode *lhs, ASTNode *rhs) {
+    ASTNode *lhs_val = (lhs->type == NODE_VAR_REF) ? create_var_ref(lhs->data.str_val) : lhs;
+    return create_binary_expr(OP_ASSIGN, lhs, create_binary_expr(op, lhs_val, rhs));
+}
+
 ASTNode* append_node(ASTNode *list, ASTNode *new_node) {
     if (!list) return new_node;
     if (!new_node) return list;
@@ -71,9 +93,11 @@ const char* get_datatype_name(DataType dt) {
         case DT_INT: return "int";
         case DT_FLOAT: return "float";
         case DT_BOOL: return "bool";
+        case DT_VEC2: return "vec2";
         case DT_VEC3: return "vec3";
         case DT_VEC4: return "vec4";
         case DT_VOID: return "void";
+        case DT_SAMPLER2D: return "sampler2D";
         default: return "unknown";
     }
 }
\ No newline at end of file
@@ -12,6 +12,7 @@ typedef enum {
     DT_VEC3,
     DT_VEC4,
     DT_STRUCT,
+    DT_SAMPLER2D,
     DT_ERROR
 } DataType;
 
@@ -42,7 +43,8 @@ typedef enum {
 /* 3. Operators */
 typedef enum {
     OP_ADD, OP_SUB, OP_MUL, OP_DIV, 
-    OP_ASSIGN, OP_EQ, OP_NE, OP_GT, OP_LT
+    OP_ASSIGN, OP_EQ, OP_NE, OP_GT, OP_LT,
+    OP_LE, OP_GE
 } OperatorType;
 
 /* 4. AST Node Structure */
@@ -63,6 +65,8 @@ typedef struct ASTNode {
             struct ASTNode *type;
             char *name;
             struct ASTNode *initializer;
+            int is_spec_const;   /* layout(constant_id = N) 特化常量 */
+            int constant_id;
         } var_decl;
 
         struct {
@@ -77,6 +81,24 @@ typedef struct ASTNode {
             struct ASTNode *else_branch;
         } if_stmt;
 
+        /* NODE_WHILE_STMT 只使用 condition / body */
+        struct {
+            struct ASTNode *init;
+            struct ASTNode *condition;
+            struct ASTNode *step;
+            struct ASTNode *body;
+        } loop;
+
+        /* NODE_COMPOUND_STMT: 语句链表 (通过 next 串联) */
+        struct {
+            struct ASTNode *stmts;
+        } compound;
+
+        /* NODE_EXPR_STMT / NODE_RETURN_STMT */
+        struct {
+            struct ASTNode *expr;
+        } stmt;
+
         struct {
             char *name;
             struct ASTNode *args;
@@ -95,7 +117,10 @@ ASTNode* create_float_const(float val);
 ASTNode* create_var_ref(char *name);
 ASTNode* create_binary_expr(OperatorType op, ASTNode *left, ASTNode *right);
 ASTNode* create_func_def(ASTNode *ret_type, char *name, ASTNode *params, ASTNode *body);
+ASTNode* create_func_call(char *name, ASTNode *args);
 ASTNode* create_if_stmt(ASTNode *cond, ASTNode *then_b, ASTNode *else_b);
+ASTNode* create_loop_stmt(NodeType type, ASTNode *init, ASTNode *cond, ASTNode *step, ASTNode *body);
+ASTNode* create_assign_op(OperatorType op, ASTNode *lhs, ASTNode *rhs);
 ASTNode* append_node(ASTNode *list, ASTNode *new_node);
 const char* get_datatype_name(DataType dt);
 
@@ -1,57 +1,570 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include "gpu_ir.h"
 #include "pisa_defs.h"
 #include "gpu_linker.h"
 
-uint8_t reg(unsigned idx, int vec) { return vec ? idx % 8 : 10 + idx % 100; }
+#define UNIFORM_DWORDS (LINKER_MAX_UNIFORM_BYTES / 4)
 
-void compile_nir_to_machine(NirShader *s, LinkerProgram *p, MachineCode *mc) {
+/*
+ * 每个 SSA 值实际所在的寄存器 (以 def index 为下标)。
+ * 常量不占寄存器: 能内联的直接用内联常量编号, 其余为 PISA_LITERAL,
+ * 值记在 ssa_lit 中, 由使用它的指令在末尾附带。
+ */
+static uint8_t *ssa_reg;
+static uint32_t *ssa_lit;
+
+static uint8_t src_reg(NirDef *d) { return ssa_reg[d->index]; }
+
+static void set_const(NirInstr *i) {
+    int r = pisa_inline_const(i->const_value);
+    if (r >= 0) {
+        ssa_reg[i->def.index] = (uint8_t)r;
+    } else {
+        ssa_reg[i->def.index] = PISA_LITERAL;
+        memcpy(&ssa_lit[i->def.index], &i->const_value, sizeof(uint32_t));
+    }
+}
+
+static void print_lit(int has_lit, uint32_t lit) {
+    float f;
+    memcpy(&f, &lit, sizeof(f));
+    if (has_lit) printf("  ; lit = %g", f);
+    printf("\n");
+}
+
+/*
+ * 取 n 个源操作数的寄存器, 返回是否需要附带 literal (值写入 *lit)。
+ * 一条指令只能携带一个 literal, 第二个不同的 literal 先用 S_MOV
+ * 放进暂存寄存器 PISA_SGPR_SCRATCH (n 最大为 2, 暂存寄存器不会冲突)。
+ */
+static int resolve_srcs(MachineCode *mc, NirDef **srcs, int n, uint8_t *regs, uint32_t *lit) {
+    int has_lit = 0;
+    for (int k = 0; k < n; k++) {
+        regs[k] = src_reg(srcs[k]);
+        if (regs[k] != PISA_LITERAL) continue;
+        uint32_t v = ssa_lit[srcs[k]->index];
+        if (!has_lit || v == *lit) {
+            *lit = v;
+            has_lit = 1;
+            continue;
+        }
+        emit_word(mc, encode_r(OP_S_MOV, PISA_SGPR_SCRATCH, PISA_LITERAL, 0));
+        emit_word(mc, v);
+        printf("  S_MOV s%d, lit", PISA_SGPR_SCRATCH);
+        print_lit(1, v);
+        regs[k] = PISA_SGPR_SCRATCH;
+    }
+    return has_lit;
+}
+
+static void emit_instr(MachineCode *mc, uint32_t w, int has_lit, uint32_t lit) {
+    emit_word(mc, w);
+    if (has_lit) emit_word(mc, lit);
+}
+
+/*
+ * 局部变量 -> 寄存器: 只在 main 是单个基本块时成立 (见 compile_nir_to_machine
+ * 开头的检查), 变量的值就是最后一次 store 写入的寄存器。
+ */
+typedef struct VarReg { const char *name; uint8_t reg; uint32_t lit; } VarReg;
+static VarReg *var_regs;
+static int num_var_regs, cap_var_regs;
+
+static VarReg* var_reg_find(const char *name) {
+    for (int k = 0; k < num_var_regs; k++)
+        if (strcmp(var_regs[k].name, name) == 0) return &var_regs[k];
+    return NULL;
+}
+
+static void var_reg_set(const char *name, uint8_t r, uint32_t lit) {
+    VarReg *v = var_reg_find(name);
+    if (!v) {
+        if (num_var_regs == cap_var_regs) {
+            cap_var_regs = cap_var_regs ? cap_var_regs * 2 : 16;
+            var_regs = (VarReg*)realloc(var_regs, sizeof(VarReg) * cap_var_regs);
+        }
+        v = &var_regs[num_var_regs++];
+        v->name = name;
+    }
+    v->reg = r;
+    v->lit = lit;
+}
+
+/* main 的局部变量 (含内联产生的 "callee.N.x") 在结束时已经死亡, 其余被写过的变量是输出 */
+static int is_output_var(NirShader *s, const char *name) {
+    if (strchr(name, '.')) return 0;
+    for (int k = 0; k < s->entry->num_locals; k++)
+        if (strcmp(s->entry->locals[k], name) == 0) return 0;
+    return 1;
+}
+
+static void var_reg_reset(void) {
+    free(var_regs);
+    var_regs = NULL;
+    num_var_regs = cap_var_regs = 0;
+}
+
+/*
+ * 寄存器分配: 代码是直线型的, 先按指令顺序算出每个值最后一次被读的位置,
+ * 发射时从空闲的寄存器里分配, 值死亡后寄存器立即可以复用。
+ * 经过局部变量传递的值 (store 后 load) 和 mov 的结果与原值共用寄存器,
+ * 写入输出变量的最终值一直活到程序结束; attribute 寄存器在最后一次读之前保留。
+ */
+static unsigned *last_use;      /* 以 def index 为下标, UINT_MAX 表示活到结束 */
+static NirDef **alias;          /* load_var / mov 的结果与哪个值共用寄存器 */
+static unsigned reg_busy[PISA_SGPR_SCRATCH]; /* 寄存器被占用到第几条指令 (含) */
+static unsigned cur_pos;
+
+static NirDef* alias_root(NirDef *d) {
+    while (alias[d->index]) d = alias[d->index];
+    return d;
+}
+
+static void use_at(NirDef *d, unsigned pos) {
+    if (!d) return;
+    d = alias_root(d);
+    if (last_use[d->index] < pos) last_use[d->index] = pos;
+}
+
+static void compute_live_ranges(NirShader *s, LinkerProgram *p) {
+    typedef struct { const char *name; NirDef *def; } VarDef;
+    VarDef *vars = NULL;
+    int nvars = 0, cap = 0;
+    unsigned pos = 0;
+
+    for (NirBlock *b = s->start_block; b; b = b->next_block) {
+        for (NirInstr *i = b->start; i; i = i->next) {
+            pos++;
+            for (int k = 0; k < i->num_srcs; k++) use_at(i->srcs[k].ssa, pos);
+            /* 比较在使用它的 select 处才发射 */
+            if (i->op == nir_op_bcsel && i->srcs[0].ssa->parent_instr) {
+                NirInstr *ci = i->srcs[0].ssa->parent_instr;
+                for (int k = 0; k < ci->num_srcs; k++) use_at(ci->srcs[k].ssa, pos);
+            }
+
+            if (i->op == nir_op_mov && i->num_srcs == 1) {
+                alias[i->def.index] = alias_root(i->srcs[0].ssa);
+            } else if (i->op == nir_intrinsic_load_var && i->var_name) {
+                LinkerRes *r = linker_find(p, i->var_name);
+                if (r && r->type == RES_ATTR) {
+                    if (reg_busy[r->phys_reg] < pos) reg_busy[r->phys_reg] = pos;
+                    continue;
+                }
+                for (int k = 0; k < nvars && !r; k++)
+                    if (strcmp(vars[k].name, i->var_name) == 0) alias[i->def.index] = vars[k].def;
+            } else if (i->op == nir_intrinsic_store_var && i->var_name && i->srcs[0].ssa) {
+                int k;
+                for (k = 0; k < nvars; k++)
+                    if (strcmp(vars[k].name, i->var_name) == 0) break;
+                if (k == nvars) {
+                    if (nvars == cap) vars = (VarDef*)realloc(vars, sizeof(VarDef) * (cap = cap ? cap * 2 : 16));
+                    vars[nvars++].name = i->var_name;
+                }
+                vars[k].def = alias_root(i->srcs[0].ssa);
+            }
+        }
+    }
+
+    for (int k = 0; k < nvars; k++)
+        if (is_output_var(s, vars[k].name)) last_use[vars[k].def->index] = UINT_MAX;
+    free(vars);
+}
+
+static int regs_exhausted;       /* 分配失败, 本次编译不产生代码 */
+
+/*
+ * 为 d 分配一个当前空闲的寄存器。没有溢出 (spill) 支持:
+ * 压力超过寄存器数时报错并置 regs_exhausted, 返回值不可使用
+ */
+static uint8_t alloc_reg(NirDef *d, int vec) {
+    int lo = vec ? 0 : PISA_SGPR_BASE, hi = vec ? PISA_NUM_VGPRS : PISA_SGPR_SCRATCH;
+    for (int r = lo; r < hi; r++) {
+        if (reg_busy[r] > cur_pos) continue;
+        reg_busy[r] = last_use[d->index] > cur_pos ? last_use[d->index] : cur_pos;
+        return (uint8_t)r;
+    }
+    if (!regs_exhausted)
+        fprintf(stderr, "Error: out of %s registers for %%ssa_%d (%d live)\n",
+                vec ? "vector" : "scalar", d->index, hi - lo);
+    regs_exhausted = 1;
+    return (uint8_t)lo;
+}
+
+/* 二元 ALU: 按发散分析的结果选择标量或向量操作码 */
+typedef struct AluOp { NirOp op; uint8_t v_op; uint8_t s_op; const char *name; } AluOp;
+
+static const AluOp alu_ops[] = {
+    { nir_op_fadd, OP_V_ADD, OP_S_ADD, "ADD" },
+    { nir_op_fsub, OP_V_SUB, OP_S_SUB, "SUB" },
+    { nir_op_fmul, OP_V_MUL, OP_S_MUL, "MUL" },
+};
+
+static const AluOp* alu_lookup(NirOp op) {
+    for (size_t k = 0; k < sizeof(alu_ops) / sizeof(alu_ops[0]); k++)
+        if (alu_ops[k].op == op) return &alu_ops[k];
+    return NULL;
+}
+
+/* 单操作数的 SFU 运算 (PRECISE 模式下保留的 fsin / fcos, 除法降级出的 frcp) */
+static const AluOp sfu_ops[] = {
+    { nir_op_fsin, OP_V_SIN, OP_S_SIN, "SIN" },
+    { nir_op_fcos, OP_V_COS, OP_S_COS, "COS" },
+    { nir_op_frcp, OP_V_RCP, OP_S_RCP, "RCP" },
+};
+
+static const AluOp* sfu_lookup(NirOp op) {
+    for (size_t k = 0; k < sizeof(sfu_ops) / sizeof(sfu_ops[0]); k++)
+        if (sfu_ops[k].op == op) return &sfu_ops[k];
+    return NULL;
+}
+
+/*
+ * 比较: 只作为 select 条件时不单独生成代码, 在使用它的 select 之前写入 VCC / SCC;
+ * 作为数值使用 (写入变量、参与运算) 时生成 1.0 / 0.0, 见 cmp_value
+ */
+typedef struct CmpOp { NirOp op; uint8_t v_op; uint8_t s_op; const char *name; } CmpOp;
+
+static const CmpOp cmp_ops[] = {
+    { nir_op_flt, OP_V_CMP_LT, OP_S_CMP_LT, "LT" },
+    { nir_op_fge, OP_V_CMP_GE, OP_S_CMP_GE, "GE" },
+    { nir_op_feq, OP_V_CMP_EQ, OP_S_CMP_EQ, "EQ" },
+    { nir_op_fne, OP_V_CMP_NE, OP_S_CMP_NE, "NE" },
+};
+
+static const CmpOp* cmp_lookup(NirOp op) {
+    for (size_t k = 0; k < sizeof(cmp_ops) / sizeof(cmp_ops[0]); k++)
+        if (cmp_ops[k].op == op) return &cmp_ops[k];
+    return NULL;
+}
+
+/* 以 def index 为下标: 比较结果是否被当作数值使用 */
+static uint8_t *cmp_value;
+
+static void mark_cmp_values(NirShader *s) {
+    for (NirBlock *b = s->start_block; b; b = b->next_block)
+        for (NirInstr *i = b->start; i; i = i->next)
+            for (int k = 0; k < i->num_srcs; k++) {
+                NirDef *d = i->srcs[k].ssa;
+                if (!d || !d->parent_instr || !cmp_lookup(d->parent_instr->op)) continue;
+                if (i->op == nir_op_bcsel && k == 0) continue;
+                cmp_value[d->index] = 1;
+            }
+}
+
+/* VCC / SCC 当前保存的条件, 相同条件的连续 select 不必重新比较 */
+static NirDef *vcc_cond, *scc_cond;
+
+/* a cmp b 写入 VCC (vec) 或 SCC; b 为 NULL 时与 0.0 比较 */
+static void emit_cmp(MachineCode *mc, const CmpOp *cmp, int vec, NirDef *a, NirDef *b) {
+    NirDef *cs[2] = { a, b };
+    uint8_t r[2];
+    uint32_t lit = 0;
+    int has_lit = resolve_srcs(mc, cs, b ? 2 : 1, r, &lit);
+    if (!b) r[1] = (uint8_t)pisa_inline_const(0.0f);
+    emit_instr(mc, encode_r(vec ? cmp->v_op : cmp->s_op, 0, r[0], r[1]), has_lit, lit);
+    printf("  %c_CMP_%s %s, %s, %s", vec ? 'V' : 'S', cmp->name, vec ? "vcc" : "scc",
+           pisa_reg_name(r[0]), pisa_reg_name(r[1]));
+    print_lit(has_lit, lit);
+}
+
+/* def = 条件码 ? a : b, 条件已经写入 VCC (vec) 或 SCC */
+static void emit_cndmask(MachineCode *mc, NirDef *def, int vec, uint8_t a, uint8_t b,
+                         int has_lit, uint32_t lit) {
+    uint8_t d = alloc_reg(def, vec);
+    ssa_reg[def->index] = d;
+    emit_instr(mc, encode_r(vec ? OP_V_CNDMASK : OP_S_CSELECT, d, a, b), has_lit, lit);
+    printf("  %s %s, %s, %s", vec ? "V_CNDMASK" : "S_CSELECT",
+           pisa_reg_name(d), pisa_reg_name(a), pisa_reg_name(b));
+    print_lit(has_lit, lit);
+}
+
+/*
+ * cond ? a : b, 发散的 select 用 VCC + V_CNDMASK, uniform 的用 SCC + S_CSELECT。
+ * 条件不是比较 (例如读回的 bool 变量) 时按 cond != 0.0 处理
+ */
+static void emit_select(MachineCode *mc, NirInstr *i) {
+    NirDef *c = i->srcs[0].ssa;
+    NirInstr *ci = c->parent_instr;
+    const CmpOp *cmp = ci ? cmp_lookup(ci->op) : NULL;
+    int vec = i->def.divergent;
+    NirDef **held = vec ? &vcc_cond : &scc_cond;
+
+    if (*held != c) {
+        if (cmp) emit_cmp(mc, cmp, vec, ci->srcs[0].ssa, ci->srcs[1].ssa);
+        else emit_cmp(mc, cmp_lookup(nir_op_fne), vec, c, NULL);
+        *held = c;
+    }
+
+    NirDef *ss[2] = { i->srcs[1].ssa, i->srcs[2].ssa };
+    uint8_t r[2];
+    uint32_t lit = 0;
+    int has_lit = resolve_srcs(mc, ss, 2, r, &lit);
+    emit_cndmask(mc, &i->def, vec, r[0], r[1], has_lit, lit);
+}
+
+/* 作为数值使用的比较: 写入条件码后选择 1.0 / 0.0, 之后以它为条件的 select 不必重新比较 */
+static void emit_cmp_value(MachineCode *mc, NirInstr *i, const CmpOp *cmp) {
+    int vec = i->def.divergent;
+    emit_cmp(mc, cmp, vec, i->srcs[0].ssa, i->srcs[1].ssa);
+    *(vec ? &vcc_cond : &scc_cond) = &i->def;
+    emit_cndmask(mc, &i->def, vec, (uint8_t)pisa_inline_const(1.0f), (uint8_t)pisa_inline_const(0.0f), 0, 0);
+}
+
+/* fmax / fmin: 先比较 a < b, 再选择 (max 取 b : a, min 取 a : b); 条件码不再对应任何比较 */
+static void emit_minmax(MachineCode *mc, NirInstr *i) {
+    int vec = i->def.divergent;
+    NirDef *ss[2] = { i->srcs[0].ssa, i->srcs[1].ssa };
+    uint8_t r[2];
+    uint32_t lit = 0;
+
+    emit_cmp(mc, cmp_lookup(nir_op_flt), vec, ss[0], ss[1]);
+    *(vec ? &vcc_cond : &scc_cond) = NULL;
+    int has_lit = resolve_srcs(mc, ss, 2, r, &lit);
+    if (i->op == nir_op_fmax) emit_cndmask(mc, &i->def, vec, r[1], r[0], has_lit, lit);
+    else emit_cndmask(mc, &i->def, vec, r[0], r[1], has_lit, lit);
+}
+
+/* 纹理采样: 坐标可以是任意源操作数, 结果总在向量寄存器 */
+static void emit_sample(MachineCode *mc, LinkerProgram *p, NirInstr *i) {
+    LinkerRes *res = linker_find(p, i->var_name);
+    uint8_t d = alloc_reg(&i->def, 1), r[2];
+    ssa_reg[i->def.index] = d;
+    if (!res || res->type != RES_SAMPLER) {
+        printf("  ; Warning: '%s' is not a sampler\n", i->var_name);
+        return;
+    }
+
+    int comp = 0;
+    while (comp < 3 && !(i->write_mask & (1 << comp))) comp++;
+    NirDef *cs[2] = { i->srcs[0].ssa, i->srcs[1].ssa };
+    uint32_t lit = 0;
+    int has_lit = resolve_srcs(mc, cs, 2, r, &lit);
+    emit_word(mc, encode_r(OP_V_SAMPLE, d, r[0], r[1]));
+    emit_instr(mc, PISA_SAMPLE_WORD(res->tex_slot, comp), has_lit, lit);
+    printf("  V_SAMPLE %s, %s, %s, t%d.%c", pisa_reg_name(d), pisa_reg_name(r[0]),
+           pisa_reg_name(r[1]), res->tex_slot, "rgba"[comp]);
+    print_lit(has_lit, lit);
+}
+
+/* 输出变量必须落在寄存器里: 常量先用 S_MOV 放进标量临时寄存器 */
+static void materialize_const(MachineCode *mc, NirDef *def) {
+    uint8_t c = src_reg(def), d = alloc_reg(def, 0);
+    int has_lit = c == PISA_LITERAL;
+    emit_instr(mc, encode_r(OP_S_MOV, d, c, 0), has_lit, ssa_lit[def->index]);
+    printf("  S_MOV %s, %s", pisa_reg_name(d), pisa_reg_name(c));
+    print_lit(has_lit, ssa_lit[def->index]);
+    ssa_reg[def->index] = d;
+}
+
+/*
+ * 常量块预取: uniform 在整个 shader 内不变, 因此全部提到开头加载,
+ * 常量块的第 k 个 dword 固定放在 s(PISA_SGPR_UNIFORM + k)。
+ * 相邻 dword 合并为 S_LOAD_X8 / S_LOAD_X4, 不足 4 个的零头在不越过
+ * 常量块末尾的前提下也用 X4 多取, 否则退回单 dword 的 S_LOAD。
+ * 返回发射的加载指令条数。
+ */
+static int emit_uniform_loads(LinkerProgram *p, MachineCode *mc) {
+    uint8_t live[UNIFORM_DWORDS] = {0};
+    int total = (p->uniform_size + 3) / 4;
+    int loads = 0;
+
+    for (LinkerRes *r = p->resources; r; r = r->next) {
+        if (r->type != RES_UNIFORM) continue;
+        for (int k = r->offset / 4; k < (r->offset + r->size + 3) / 4; k++)
+            live[k] = 1;
+    }
+
+    int k = 0;
+    while (k < total) {
+        if (!live[k]) { k++; continue; }
+        int run = 0;
+        while (k + run < total && live[k + run]) run++;
+
+        uint8_t op = OP_S_LOAD;
+        int n = 1;
+        if (run >= 8) { op = OP_S_LOAD_X8; n = 8; }
+        else if (run >= 2 && k + 4 <= total) { op = OP_S_LOAD_X4; n = 4; }
+
+        emit_word(mc, encode_r(op, PISA_SGPR_UNIFORM + k, 0, k * 4));
+        printf("  %s s%d, s0, %d\n",
+               op == OP_S_LOAD_X8 ? "S_LOAD_X8" : op == OP_S_LOAD_X4 ? "S_LOAD_X4" : "S_LOAD",
+               PISA_SGPR_UNIFORM + k, k * 4);
+        loads++;
+        k += n;
+    }
+    return loads;
+}
+
+/*
+ * 后端没有跳转指令, 局部变量也只按最后一次 store 跟踪:
+ * main 必须只剩一个基本块 (循环完全展开、调用全部内联、if 全部被展平)
+ */
+static int check_straight_line(NirShader *s) {
+    int nblocks = 0;
+    for (NirBlock *b = s->start_block; b; b = b->next_block) {
+        nblocks++;
+        for (NirInstr *i = b->start; i; i = i->next) {
+            if (i->op == nir_branch || i->op == nir_jump || i->op == nir_call) {
+                fprintf(stderr, "Error: control flow remains in %s after optimization "
+                                "(%s in block B%d), the backend has no branch instructions\n",
+                        s->entry->name, i->op == nir_call ? "call" : "branch", b->index);
+                return -1;
+            }
+        }
+    }
+    if (nblocks != 1) {
+        fprintf(stderr, "Error: %s has %d blocks after optimization, the backend needs one\n",
+                s->entry->name, nblocks);
+        return -1;
+    }
+    return 0;
+}
+
+/* 返回 0; 无法生成正确代码时 (寄存器不够、后端不支持的操作) 报错并返回 -1 */
+int compile_nir_to_machine(NirShader *s, LinkerProgram *p, MachineCode *mc) {
     printf("\n=== Generating Machine Code ===\n");
 
     /* [修复] 增加防御性检查 */
     if (s == NULL) {
         fprintf(stderr, "Error: NirShader pointer (s) is NULL in backend!\n");
-        return;
+        return -1;
     }
     
     if (s->start_block == NULL) {
         fprintf(stderr, "Error: NirShader has no start_block!\n");
-        return;
+        return -1;
     }
 
+    if (check_straight_line(s) < 0) return -1;
+
+    int nscalar = 0, nvec = 0, unsupported = 0;
+    ssa_reg = (uint8_t*)calloc(s->num_ssa_defs + 1, 1);
+    cmp_value = (uint8_t*)calloc(s->num_ssa_defs + 1, 1);
+    ssa_lit = (uint32_t*)calloc(s->num_ssa_defs + 1, sizeof(uint32_t));
+    last_use = (unsigned*)calloc(s->num_ssa_defs + 1, sizeof(unsigned));
+    alias = (NirDef**)calloc(s->num_ssa_defs + 1, sizeof(NirDef*));
+    memset(reg_busy, 0, sizeof(reg_busy));
+    cur_pos = 0;
+    regs_exhausted = 0;
+    compute_live_ranges(s, p);
+    mark_cmp_values(s);
+    int nloads = emit_uniform_loads(p, mc);
+    printf("  ; %d scalar load(s) for %d byte uniform block\n", nloads, p->uniform_size);
+
     NirBlock *b = s->start_block;
-    while(b) {
+    while(b && !regs_exhausted) {
         NirInstr *i = b->start;
-        while(i) {
+        while(i && !regs_exhausted) {
+            cur_pos++;
             /* [修复] 增加对操作数的检查，防止空指针 */
             if (i->op == nir_intrinsic_load_var) {
                 if (i->var_name) {
                     LinkerRes *r = linker_find(p, i->var_name);
+                    VarReg *vr;
                     if(r) {
                         if(r->type == RES_ATTR) {
-                            emit_word(mc, encode_r(OP_V_MOV, reg(i->def.index, 1), r->phys_reg, 0));
-                            printf("  V_MOV v%d, v%d\n", reg(i->def.index, 1), r->phys_reg);
+                            uint8_t d = alloc_reg(&i->def, 1);
+                            ssa_reg[i->def.index] = d;
+                            emit_word(mc, encode_r(OP_V_MOV, d, r->phys_reg, 0));
+                            printf("  V_MOV v%d, v%d\n", d, r->phys_reg);
                         } else {
-                            emit_word(mc, encode_r(OP_S_LOAD, reg(i->def.index, 0), 0, r->offset));
-                            printf("  S_LOAD s%d, s0, %d\n", reg(i->def.index, 0), r->offset);
+                            /* 已由 emit_uniform_loads 预取, 直接引用对应的标量寄存器 */
+                            ssa_reg[i->def.index] = PISA_SGPR_UNIFORM + r->offset / 4;
                         }
+                    } else if ((vr = var_reg_find(i->var_name)) != NULL) {
+                        ssa_reg[i->def.index] = vr->reg;
+                        ssa_lit[i->def.index] = vr->lit;
                     } else {
                         printf("  ; Warning: Resource '%s' not found in linker\n", i->var_name);
                     }
                 }
-            } else if (i->op == nir_op_fadd) {
+            } else if (i->op == nir_intrinsic_store_var) {
+                NirDef *v = i->srcs[0].ssa;
+                if (i->var_name && v) {
+                    if (PISA_IS_CONST(src_reg(v)) && is_output_var(s, i->var_name)) materialize_const(mc, v);
+                    var_reg_set(i->var_name, src_reg(v), ssa_lit[v->index]);
+                }
+            } else if (alu_lookup(i->op)) {
+                const AluOp *a = alu_lookup(i->op);
                 if (i->num_srcs >= 2 && i->srcs[0].ssa && i->srcs[1].ssa) {
-                    emit_word(mc, encode_r(OP_V_ADD, reg(i->def.index, 1), reg(i->srcs[0].ssa->index, 1), reg(i->srcs[1].ssa->index, 1)));
-                    printf("  V_ADD v%d, v%d, v%d\n", reg(i->def.index, 1), reg(i->srcs[0].ssa->index, 1), reg(i->srcs[1].ssa->index, 1));
+                    /* uniform 值走标量 ALU, 结果放在标量临时寄存器 */
+                    NirDef *srcs[2] = { i->srcs[0].ssa, i->srcs[1].ssa };
+                    int vec = i->def.divergent;
+                    uint8_t d = alloc_reg(&i->def, vec), r[2];
+                    uint32_t lit = 0;
+                    int has_lit = resolve_srcs(mc, srcs, 2, r, &lit);
+                    ssa_reg[i->def.index] = d;
+                    emit_instr(mc, encode_r(vec ? a->v_op : a->s_op, d, r[0], r[1]), has_lit, lit);
+                    printf("  %c_%s %s, %s, %s", vec ? 'V' : 'S', a->name, pisa_reg_name(d),
+                           pisa_reg_name(r[0]), pisa_reg_name(r[1]));
+                    print_lit(has_lit, lit);
+                    if (vec) nvec++; else nscalar++;
                 } else {
-                    printf("  ; Skip Invalid FADD (missing src)\n");
+                    printf("  ; Skip Invalid %s (missing src)\n", a->name);
+                }
+            } else if (sfu_lookup(i->op) && i->num_srcs == 1 && i->srcs[0].ssa) {
+                const AluOp *a = sfu_lookup(i->op);
+                int vec = i->def.divergent;
+                uint8_t d = alloc_reg(&i->def, vec), r;
+                uint32_t lit = 0;
+                int has_lit = resolve_srcs(mc, &i->srcs[0].ssa, 1, &r, &lit);
+                ssa_reg[i->def.index] = d;
+                emit_instr(mc, encode_r(vec ? a->v_op : a->s_op, d, r, 0), has_lit, lit);
+                printf("  %c_%s %s, %s", vec ? 'V' : 'S', a->name, pisa_reg_name(d), pisa_reg_name(r));
+                print_lit(has_lit, lit);
+                if (vec) nvec++; else nscalar++;
+            } else if (i->op == nir_intrinsic_tex && i->num_srcs == 2) {
+                emit_sample(mc, p, i);
+                nvec++;
+            } else if (i->op == nir_op_bcsel && i->num_srcs == 3) {
+                emit_select(mc, i);
+                if (i->def.divergent) nvec++; else nscalar++;
+            } else if (cmp_lookup(i->op) && i->num_srcs == 2) {
+                if (cmp_value[i->def.index]) {
+                    emit_cmp_value(mc, i, cmp_lookup(i->op));
+                    if (i->def.divergent) nvec += 2; else nscalar += 2;
                 }
+            } else if ((i->op == nir_op_fmax || i->op == nir_op_fmin) && i->num_srcs == 2) {
+                emit_minmax(mc, i);
+                if (i->def.divergent) nvec += 2; else nscalar += 2;
+            } else if (i->op == nir_op_mov && i->num_srcs == 1) {
+                ssa_reg[i->def.index] = src_reg(i->srcs[0].ssa);
+                ssa_lit[i->def.index] = ssa_lit[i->srcs[0].ssa->index];
+            } else if (i->op == nir_load_const) {
+                set_const(i);
+            } else if (i->def.index != 0) {
+                fprintf(stderr, "Error: backend can not generate code for %s (%%ssa_%d)\n",
+                        nir_op_name(i->op), i->def.index);
+                unsupported++;
             }
             i = i->next;
         }
         b = b->next_block;
     }
+    printf("  ; %d scalar / %d vector ALU op(s)\n", nscalar, nvec);
+
+    /* 输出变量所在的寄存器, 光栅化器的 VS_OUT / FS_OUT 按此配置 */
+    for (int k = 0; k < num_var_regs; k++) {
+        if (!is_output_var(s, var_regs[k].name)) continue;
+        mark_live_out(mc, var_regs[k].reg);
+        printf("  ; output %s -> %s\n", var_regs[k].name, pisa_reg_name(var_regs[k].reg));
+    }
+    var_reg_reset();
+    vcc_cond = scc_cond = NULL;
+    free(ssa_reg);
+    free(cmp_value);
+    free(ssa_lit);
+    free(last_use);
+    free(alias);
+    ssa_reg = NULL;
+    cmp_value = NULL;
+    ssa_lit = NULL;
+    last_use = NULL;
+    alias = NULL;
+    return regs_exhausted || unsupported ? -1 : 0;
 }
 
 void dump_binary(MachineCode *mc, const char *f) {
@@ -63,4 +576,4 @@ void dump_binary(MachineCode *mc, const char *f) {
     } else {
         perror("Failed to write binary");
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,338 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "../pisa_defs.h"
+
+/*
+ * 编译器基准测试
+ *
+ * 语料库:
+ *   - LinuxApp/main.cpp 中内嵌的两个着色器 (R"( ... )" 原始字符串, 运行时提取)
+ *   - 合成着色器: 宽表达式树、深表达式树、大量 uniform、大量分支
+ * 每个着色器用编译器进程编译 -n 次 (编译器使用全局的解析器状态, 只能按进程测量),
+ * 统计吞吐 (shaders/sec, 源码 MB/s)、子进程峰值 RSS 和输出的指令数。
+ * 结果每行一个 JSON 对象, 最后一行是汇总 (只统计编译成功的着色器), 便于逐次提交对比。
+ * 有着色器编译失败时退出码为 1。
+ */
+
+#define BENCH_MAX_SHADERS 32
+#define BENCH_MAX_SOURCE  (1 << 20)
+
+typedef struct BenchShader {
+    char name[64];
+    char *source;
+    size_t size;
+} BenchShader;
+
+typedef struct BenchResult {
+    int ok;
+    int runs;
+    double seconds;
+    long peak_rss_kb;
+    int words;
+    int instrs;
+} BenchResult;
+
+static BenchShader shaders[BENCH_MAX_SHADERS];
+static int num_shaders;
+
+/* 追加格式化文本的简单字符串构造器 */
+typedef struct StrBuf { char *buf; size_t len, cap; } StrBuf;
+
+static void sb_printf(StrBuf *sb, const char *fmt, ...) {
+    va_list ap;
+    for (;;) {
+        size_t room = sb->cap - sb->len;
+        va_start(ap, fmt);
+        int n = vsnprintf(sb->buf ? sb->buf + sb->len : NULL, room, fmt, ap);
+        va_end(ap);
+        if (n < 0) return;
+        if ((size_t)n < room) { sb->len += n; return; }
+        sb->cap = sb->cap ? sb->cap * 2 : 4096;
+        while (sb->cap - sb->len <= (size_t)n) sb->cap *= 2;
+        sb->buf = (char*)realloc(sb->buf, sb->cap);
+    }
+}
+
+static void add_shader(const char *name, char *source) {
+    if (num_shaders == BENCH_MAX_SHADERS) {
+        fprintf(stderr, "bench: too many shaders, '%s' dropped\n", name);
+        free(source);
+        return;
+    }
+    BenchShader *s = &shaders[num_shaders++];
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    s->source = source;
+    s->size = strlen(source);
+}
+
+/* --- 语料库 --- */
+
+/* 依次提取文件中的 R"( ... )" 原始字符串, 名字取自前面的变量名 */
+static void load_embedded(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        fprintf(stderr, "bench: cannot open %s: %s\n", path, strerror(errno));
+        return;
+    }
+    char *text = (char*)malloc(BENCH_MAX_SOURCE + 1);
+    size_t n = fread(text, 1, BENCH_MAX_SOURCE, fp);
+    text[n] = '\0';
+    fclose(fp);
+
+    for (char *p = text; (p = strstr(p, "R\"(")) != NULL; ) {
+        char *body = p + 3, *end = strstr(body, ")\"");
+        if (!end) break;
+
+        /* 变量名: R"( 之前最近的 "identifier =" */
+        char name[64] = "embedded";
+        char *q = p;
+        while (q > text && *q != '=') q--;
+        while (q > text && (q[-1] == ' ' || q[-1] == '\t')) q--;
+        char *id_end = q;
+        while (q > text && (q[-1] == '_' || (q[-1] >= '0' && q[-1] <= '9') ||
+                            ((q[-1] | 0x20) >= 'a' && (q[-1] | 0x20) <= 'z'))) q--;
+        if (id_end > q && id_end - q < (long)sizeof(name) - 4)
+            snprintf(name, sizeof(name), "app_%.*s", (int)(id_end - q), q);
+
+        add_shader(name, strndup(body, end - body));
+        p = end + 2;
+    }
+    free(text);
+}
+
+/* out = u0*v0 + u1*v1 + ... : 一个语句中 terms 个乘加, 表达式树很宽 */
+static char* gen_wide(int terms) {
+    StrBuf sb = {0};
+    for (int k = 0; k < 8; k++) sb_printf(&sb, "uniform float u_w%d;\n", k);
+    sb_printf(&sb, "float v_x;\nfloat v_y;\nfloat out_c;\nvoid main() {\n    out_c = ");
+    for (int k = 0; k < terms; k++)
+        sb_printf(&sb, "%su_w%d * %s", k ? " + " : "", k % 8, k & 1 ? "v_y" : "v_x");
+    sb_printf(&sb, ";\n}\n");
+    return sb.buf;
+}
+
+/* ((((v_x * u0 + 0.5) * u1 + 0.5) ...): 嵌套 depth 层的括号 */
+static char* gen_deep(int depth) {
+    StrBuf sb = {0};
+    for (int k = 0; k < 8; k++) sb_printf(&sb, "uniform float u_d%d;\n", k);
+    sb_printf(&sb, "float v_x;\nfloat out_c;\nvoid main() {\n    out_c = ");
+    for (int k = 0; k < depth; k++) sb_printf(&sb, "(");
+    sb_printf(&sb, "v_x");
+    for (int k = 0; k < depth; k++) sb_printf(&sb, " * u_d%d + %d.5)", k % 8, k % 3);
+    sb_printf(&sb, ";\n}\n");
+    return sb.buf;
+}
+
+/* 占满整个常量块 (LINKER_MAX_UNIFORM_BYTES / 4 个 float), 每个都被引用 */
+static char* gen_uniforms(int count) {
+    StrBuf sb = {0};
+    for (int k = 0; k < count; k++) sb_printf(&sb, "uniform float u_c%d;\n", k);
+    sb_printf(&sb, "float v_x;\nfloat out_c;\nvoid main() {\n    float acc = v_x;\n");
+    for (int k = 0; k < count; k++) sb_printf(&sb, "    acc = acc * u_c%d + 1.0;\n", k);
+    sb_printf(&sb, "    out_c = acc;\n}\n");
+    return sb.buf;
+}
+
+/* count 个 if/else, 一半按 attribute (divergent) 一半按 uniform 分支, 带一层嵌套 */
+static char* gen_branchy(int count) {
+    StrBuf sb = {0};
+    sb_printf(&sb, "uniform float u_t;\nuniform float u_k;\nfloat v_x;\nfloat out_c;\n");
+    sb_printf(&sb, "void main() {\n    float c = v_x;\n    float t = u_t;\n");
+    for (int k = 0; k < count; k++) {
+        sb_printf(&sb, "    if (%s > %d.0) {\n", k & 1 ? "u_k" : "v_x", k % 4);
+        sb_printf(&sb, "        c = c * 2.0;\n");
+        if (k % 3 == 0) sb_printf(&sb, "        if (t < 1.0) {\n            t = t + 1.0;\n        }\n");
+        sb_printf(&sb, "    } else {\n        c = c - u_k;\n    }\n");
+    }
+    sb_printf(&sb, "    out_c = c + t;\n}\n");
+    return sb.buf;
+}
+
+static void load_synthetic(void) {
+    static const int sizes[] = { 16, 64, 256 };
+    char name[64];
+    for (size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+        snprintf(name, sizeof(name), "wide_%d", sizes[k]);
+        add_shader(name, gen_wide(sizes[k]));
+        snprintf(name, sizeof(name), "deep_%d", sizes[k]);
+        add_shader(name, gen_deep(sizes[k]));
+        snprintf(name, sizeof(name), "branchy_%d", sizes[k] / 4);
+        add_shader(name, gen_branchy(sizes[k] / 4));
+    }
+    add_shader("uniforms_64", gen_uniforms(64));
+}
+
+/* --- 测量 --- */
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* 在 workdir 中运行一次编译器, 返回退出码, 峰值 RSS 取最大值 */
+static int run_compiler(const char *compiler, const char *workdir, const char *src_path, long *rss_kb) {
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd >= 0) {
+            dup2(null_fd, STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+        }
+        if (chdir(workdir) != 0) _exit(127);
+        execl(compiler, compiler, src_path, (char*)NULL);
+        _exit(127);
+    }
+
+    int status;
+    struct rusage ru;
+    if (wait4(pid, &status, 0, &ru) < 0) return -1;
+    if (ru.ru_maxrss > *rss_kb) *rss_kb = ru.ru_maxrss;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/* 统计 shader.bin 的字数和指令数 (MAD 和 literal 占多个字) */
+static int count_instrs(const char *bin_path, int *words) {
+    FILE *fp = fopen(bin_path, "rb");
+    if (!fp) return -1;
+    uint32_t *code = (uint32_t*)malloc(BENCH_MAX_SOURCE);
+    size_t n = fread(code, 4, BENCH_MAX_SOURCE / 4, fp);
+    fclose(fp);
+
+    int instrs = 0;
+    for (size_t pc = 0; pc < n; instrs++)
+        pc += pisa_instr_words(&code[pc], n - pc);
+    free(code);
+    *words = (int)n;
+    return instrs;
+}
+
+static void bench_shader(const char *compiler, const char *workdir, BenchShader *s,
+                         int iterations, BenchResult *r) {
+    char src_path[4096 + 128], bin_path[4096 + 16];
+    snprintf(src_path, sizeof(src_path), "%s/%s.glsl", workdir, s->name);
+    snprintf(bin_path, sizeof(bin_path), "%s/shader.bin", workdir);
+
+    memset(r, 0, sizeof(*r));
+    FILE *fp = fopen(src_path, "wb");
+    if (!fp) return;
+    fwrite(s->source, 1, s->size, fp);
+    fclose(fp);
+
+    /* 编译器在语法错误时不写 shader.bin, 以此判断是否成功 */
+    r->ok = 1;
+    double t0 = now_sec();
+    for (int k = 0; k < iterations; k++) {
+        unlink(bin_path);
+        if (run_compiler(compiler, workdir, src_path, &r->peak_rss_kb) != 0 || access(bin_path, F_OK) != 0) {
+            r->ok = 0;
+            r->runs = k + 1;
+            break;
+        }
+        r->runs = k + 1;
+    }
+    r->seconds = now_sec() - t0;
+    if (r->ok) r->instrs = count_instrs(bin_path, &r->words);
+}
+
+/* 删除 bench_shader 在 workdir 中留下的文件 */
+static void clean_workdir(const char *workdir) {
+    char path[4096 + 128];
+    for (int k = 0; k < num_shaders; k++) {
+        snprintf(path, sizeof(path), "%s/%s.glsl", workdir, shaders[k].name);
+        unlink(path);
+    }
+    snprintf(path, sizeof(path), "%s/shader.bin", workdir);
+    unlink(path);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-c compiler] [-a main.cpp] [-n iterations] [-w workdir]\n", prog);
+}
+
+int main(int argc, char **argv) {
+    const char *compiler = "./compiler";
+    const char *app_source = "../LinuxApp/main.cpp";
+    const char *workdir = NULL;
+    int iterations = 20;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:a:n:w:")) != -1) {
+        switch (opt) {
+            case 'c': compiler = optarg; break;
+            case 'a': app_source = optarg; break;
+            case 'n': iterations = atoi(optarg); break;
+            case 'w': workdir = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (iterations < 1) iterations = 1;
+
+    /* 子进程会 chdir 到工作目录, 编译器路径必须是绝对路径 */
+    char compiler_abs[4096];
+    if (!realpath(compiler, compiler_abs)) {
+        fprintf(stderr, "bench: compiler '%s' not found\n", compiler);
+        return 1;
+    }
+    /* 没有指定 -w 时使用临时目录, 结束时删除 */
+    char tmpl[] = "/tmp/prism-bench-XXXXXX";
+    int tmp_workdir = !workdir;
+    if (tmp_workdir && !(workdir = mkdtemp(tmpl))) {
+        perror("bench: mkdtemp");
+        return 1;
+    }
+    mkdir(workdir, 0755);
+
+    load_embedded(app_source);
+    load_synthetic();
+
+    int passed = 0;
+    long peak_rss = 0;
+    double total_sec = 0, total_bytes = 0;
+    long total_runs = 0;
+
+    for (int k = 0; k < num_shaders; k++) {
+        BenchShader *s = &shaders[k];
+        BenchResult r;
+        bench_shader(compiler_abs, workdir, s, iterations, &r);
+
+        double sps = r.seconds > 0 ? r.runs / r.seconds : 0;
+        printf("{\"shader\":\"%s\",\"status\":\"%s\",\"source_bytes\":%zu,\"runs\":%d,"
+               "\"shaders_per_sec\":%.2f,\"mb_per_sec\":%.4f,\"peak_rss_kb\":%ld,"
+               "\"words\":%d,\"instrs\":%d}\n",
+               s->name, r.ok ? "ok" : "error", s->size, r.runs,
+               sps, sps * s->size / 1e6, r.peak_rss_kb, r.words, r.instrs);
+
+        free(s->source);
+
+        /* 失败的编译在中途退出, 计入吞吐会虚高 */
+        if (!r.ok) continue;
+        passed++;
+        if (r.peak_rss_kb > peak_rss) peak_rss = r.peak_rss_kb;
+        total_sec += r.seconds;
+        total_bytes += (double)s->size * r.runs;
+        total_runs += r.runs;
+    }
+
+    printf("{\"summary\":true,\"shaders\":%d,\"passed\":%d,\"iterations\":%d,"
+           "\"shaders_per_sec\":%.2f,\"mb_per_sec\":%.4f,\"peak_rss_kb\":%ld}\n",
+           num_shaders, passed, iterations,
+           total_sec > 0 ? total_runs / total_sec : 0,
+           total_sec > 0 ? total_bytes / total_sec / 1e6 : 0, peak_rss);
+
+    if (tmp_workdir) {
+        clean_workdir(workdir);
+        if (rmdir(workdir) != 0) fprintf(stderr, "bench: cannot remove %s: %s\n", workdir, strerror(errno));
+    }
+    return passed == num_shaders ? 0 : 1;
+}
@@ -76,6 +76,7 @@
 #include "pisa_defs.h"
 #include "gpu_ir.h"
 #include "gpu_linker.h"
+#include "preprocess.h"
 
 extern int yylex();
 extern FILE* yyin;
@@ -84,10 +85,11 @@ extern int yylineno;
 
 void yyerror(const char *s);
 ASTNode *root = NULL;
+Preprocessor *preproc = NULL;
 
 NirShader* generate_ssa_nir(ASTNode *root);
 void semantic_analysis(ASTNode *root);
-void compile_nir_to_machine(NirShader *shader, LinkerProgram *prog, MachineCode *mc);
+int compile_nir_to_machine(NirShader *shader, LinkerProgram *prog, MachineCode *mc);
 void dump_binary(MachineCode *mc, const char *filename);
 
 ASTNode* create_type_node(const char* name) {
@@ -96,7 +98,7 @@ ASTNode* create_type_node(const char* name) {
     return node;
 }
 
-#line 100 "glsl.tab.c"
+#line 102 "glsl.tab.c"
 
 # ifndef YY_CAST
 #  ifdef __cplusplus
@@ -189,27 +191,38 @@ enum yysymbol_kind_t
   YYSYMBOL_62_ = 62,                       /* '('  */
   YYSYMBOL_63_ = 63,                       /* ')'  */
   YYSYMBOL_LOWER_THAN_ELSE = 64,           /* LOWER_THAN_ELSE  */
-  YYSYMBOL_65_ = 65,                       /* ';'  */
-  YYSYMBOL_66_ = 66,                       /* '{'  */
-  YYSYMBOL_67_ = 67,                       /* '}'  */
-  YYSYMBOL_YYACCEPT = 68,                  /* $accept  */
-  YYSYMBOL_translation_unit = 69,          /* translation_unit  */
-  YYSYMBOL_external_declaration = 70,      /* external_declaration  */
-  YYSYMBOL_function_definition = 71,       /* function_definition  */
-  YYSYMBOL_declaration = 72,               /* declaration  */
-  YYSYMBOL_init_declarator_list = 73,      /* init_declarator_list  */
-  YYSYMBOL_single_declaration = 74,        /* single_declaration  */
-  YYSYMBOL_fully_specified_type = 75,      /* fully_specified_type  */
-  YYSYMBOL_type_qualifier = 76,            /* type_qualifier  */
-  YYSYMBOL_type_specifier = 77,            /* type_specifier  */
-  YYSYMBOL_statement = 78,                 /* statement  */
-  YYSYMBOL_compound_statement = 79,        /* compound_statement  */
-  YYSYMBOL_statement_list = 80,            /* statement_list  */
-  YYSYMBOL_expression = 81,                /* expression  */
-  YYSYMBOL_assignment_expression = 82,     /* assignment_expression  */
-  YYSYMBOL_additive_expression = 83,       /* additive_expression  */
-  YYSYMBOL_multiplicative_expression = 84, /* multiplicative_expression  */
-  YYSYMBOL_primary_expression = 85         /* primary_expression  */
+  YYSYMBOL_65_ = 65,                       /* ','  */
+  YYSYMBOL_66_ = 66,                       /* ';'  */
+  YYSYMBOL_67_ = 67,                       /* '{'  */
+  YYSYMBOL_68_ = 68,                       /* '}'  */
+  YYSYMBOL_YYACCEPT = 69,                  /* $accept  */
+  YYSYMBOL_translation_unit = 70,          /* translation_unit  */
+  YYSYMBOL_external_declaration = 71,      /* external_declaration  */
+  YYSYMBOL_function_definition = 72,       /* function_definition  */
+  YYSYMBOL_parameter_list = 73,            /* parameter_list  */
+  YYSYMBOL_parameter_declaration = 74,     /* parameter_declaration  */
+  YYSYMBOL_declaration = 75,               /* declaration  */
+  YYSYMBOL_init_declarator_list = 76,      /* init_declarator_list  */
+  YYSYMBOL_single_declaration = 77,        /* single_declaration  */
+  YYSYMBOL_layout_qualifier = 78,          /* layout_qualifier  */
+  YYSYMBOL_fully_specified_type = 79,      /* fully_specified_type  */
+  YYSYMBOL_type_qualifier = 80,            /* type_qualifier  */
+  YYSYMBOL_type_specifier = 81,            /* type_specifier  */
+  YYSYMBOL_statement = 82,                 /* statement  */
+  YYSYMBOL_for_init_statement = 83,        /* for_init_statement  */
+  YYSYMBOL_for_condition = 84,             /* for_condition  */
+  YYSYMBOL_for_step = 85,                  /* for_step  */
+  YYSYMBOL_compound_statement = 86,        /* compound_statement  */
+  YYSYMBOL_statement_list = 87,            /* statement_list  */
+  YYSYMBOL_expression = 88,                /* expression  */
+  YYSYMBOL_assignment_expression = 89,     /* assignment_expression  */
+  YYSYMBOL_equality_expression = 90,       /* equality_expression  */
+  YYSYMBOL_relational_expression = 91,     /* relational_expression  */
+  YYSYMBOL_additive_expression = 92,       /* additive_expression  */
+  YYSYMBOL_multiplicative_expression = 93, /* multiplicative_expression  */
+  YYSYMBOL_postfix_expression = 94,        /* postfix_expression  */
+  YYSYMBOL_primary_expression = 95,        /* primary_expression  */
+  YYSYMBOL_argument_list = 96              /* argument_list  */
 };
 typedef enum yysymbol_kind_t yysymbol_kind_t;
 
@@ -326,7 +339,7 @@ typedef int yytype_uint16;
 
 
 /* Stored state numbers (used for stacks). */
-typedef yytype_int8 yy_state_t;
+typedef yytype_uint8 yy_state_t;
 
 /* State numbers in computations.  */
 typedef int yy_state_fast_t;
@@ -538,18 +551,18 @@ union yyalloc
 #endif /* !YYCOPY_NEEDED */
 
 /* YYFINAL -- State number of the termination state.  */
-#define YYFINAL  21
+#define YYFINAL  25
 /* YYLAST -- Last index in YYTABLE.  */
-#define YYLAST   172
+#define YYLAST   332
 
 /* YYNTOKENS -- Number of terminals.  */
-#define YYNTOKENS  68
+#define YYNTOKENS  69
 /* YYNNTS -- Number of nonterminals.  */
-#define YYNNTS  18
+#define YYNNTS  28
 /* YYNRULES -- Number of rules.  */
-#define YYNRULES  47
+#define YYNRULES  86
 /* YYNSTATES -- Number of states.  */
-#define YYNSTATES  76
+#define YYNSTATES  151
 
 /* YYMAXUTOK -- Last valid token kind.  */
 #define YYMAXUTOK   306
@@ -570,15 +583,15 @@ static const yytype_int8 yytranslate[] =
        2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
        2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
        2,     2,     2,    58,     2,     2,     2,     2,     2,     2,
-      62,    63,    56,    54,     2,    55,    59,    57,     2,     2,
-       2,     2,     2,     2,     2,     2,     2,     2,     2,    65,
+      62,    63,    56,    54,    65,    55,    59,    57,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,    66,
       52,    51,    53,     2,     2,     2,     2,     2,     2,     2,
        2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
        2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
        2,    60,     2,    61,     2,     2,     2,     2,     2,     2,
        2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
        2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
-       2,     2,     2,    66,     2,    67,     2,     2,     2,     2,
+       2,     2,     2,    67,     2,    68,     2,     2,     2,     2,
        2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
        2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
        2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
@@ -601,13 +614,17 @@ static const yytype_int8 yytranslate[] =
 
 #if YYDEBUG
 /* YYRLINE[YYN] -- Source line where rule number YYN was defined.  */
-static const yytype_uint8 yyrline[] =
+static const yytype_int16 yyrline[] =
 {
-       0,    89,    89,    90,    94,    95,    99,   106,   110,   114,
-     120,   130,   131,   135,   136,   137,   138,   142,   143,   144,
-     145,   146,   147,   148,   153,   154,   155,   156,   157,   158,
-     162,   163,   167,   168,   172,   176,   177,   183,   184,   185,
-     189,   190,   191,   195,   196,   197,   198,   199
+       0,    95,    95,    96,   100,   101,   105,   109,   113,   120,
+     121,   125,   134,   138,   142,   148,   155,   163,   176,   183,
+     184,   186,   198,   199,   200,   201,   205,   206,   207,   208,
+     209,   210,   211,   212,   217,   218,   219,   220,   221,   222,
+     225,   226,   227,   231,   232,   233,   237,   238,   242,   243,
+     247,   248,   252,   253,   257,   261,   262,   265,   266,   267,
+     268,   272,   273,   274,   278,   279,   280,   281,   282,   286,
+     287,   288,   292,   293,   294,   299,   300,   301,   305,   306,
+     307,   308,   309,   310,   311,   315,   316
 };
 #endif
 
@@ -632,12 +649,16 @@ static const char *const yytname[] =
   "AND_OP", "OR_OP", "XOR_OP", "MUL_ASSIGN", "DIV_ASSIGN", "ADD_ASSIGN",
   "SUB_ASSIGN", "LEFT_OP", "RIGHT_OP", "'='", "'<'", "'>'", "'+'", "'-'",
   "'*'", "'/'", "'!'", "'.'", "'['", "']'", "'('", "')'",
-  "LOWER_THAN_ELSE", "';'", "'{'", "'}'", "$accept", "translation_unit",
-  "external_declaration", "function_definition", "declaration",
-  "init_declarator_list", "single_declaration", "fully_specified_type",
-  "type_qualifier", "type_specifier", "statement", "compound_statement",
+  "LOWER_THAN_ELSE", "','", "';'", "'{'", "'}'", "$accept",
+  "translation_unit", "external_declaration", "function_definition",
+  "parameter_list", "parameter_declaration", "declaration",
+  "init_declarator_list", "single_declaration", "layout_qualifier",
+  "fully_specified_type", "type_qualifier", "type_specifier", "statement",
+  "for_init_statement", "for_condition", "for_step", "compound_statement",
   "statement_list", "expression", "assignment_expression",
-  "additive_expression", "multiplicative_expression", "primary_expression", YY_NULLPTR
+  "equality_expression", "relational_expression", "additive_expression",
+  "multiplicative_expression", "postfix_expression", "primary_expression",
+  "argument_list", YY_NULLPTR
 };
 
 static const char *
@@ -647,7 +668,7 @@ yysymbol_name (yysymbol_kind_t yysymbol)
 }
 #endif
 
-#define YYPACT_NINF (-65)
+#define YYPACT_NINF (-61)
 
 #define yypact_value_is_default(Yyn) \
   ((Yyn) == YYPACT_NINF)
@@ -661,14 +682,22 @@ yysymbol_name (yysymbol_kind_t yysymbol)
    STATE-NUM.  */
 static const yytype_int16 yypact[] =
 {
-     129,   -65,   -65,   -65,   -65,   -65,   -65,   -65,   -65,   -65,
-     -65,   -65,   107,   -65,   -65,   -65,   -64,   -65,     3,   150,
-     -65,   -65,   -65,   -65,   -22,   -65,    62,   -53,   -65,   -65,
-     -65,   -65,    62,   -65,   -65,    16,    18,   -28,   -16,   -25,
-      62,    62,    62,    62,    62,    -3,   -65,   -65,    18,   -65,
-      18,   -65,   -65,   -65,    -9,    11,   -65,   -65,    53,   -65,
-     -65,    27,    -7,    62,   -65,    -5,    15,   -65,   -65,   -65,
-      -1,   -65,    76,    41,    76,   -65
+     245,   -61,   -61,   -61,   -61,   -61,   -61,   -61,   -61,   -61,
+     -61,   -61,   -61,   -55,   221,   -61,   -61,   -61,   -51,   -61,
+     267,    17,   290,   -61,    41,   -61,   -61,   -61,    46,   -45,
+     -61,   -61,     9,    11,    58,    82,    60,    58,    22,   -61,
+     -61,   -61,    58,   -61,   -61,   -22,   170,     4,   -21,   271,
+     -61,    30,    28,   -60,   -61,    96,    42,   -61,    67,    45,
+      58,    58,    58,    58,    58,    58,    58,    58,    58,    58,
+     -61,   -61,    58,    58,    58,    58,    58,    28,    18,   -61,
+      28,   267,   -61,   -61,   -61,   -61,   -34,   -61,   170,    32,
+     170,     4,     4,     4,     4,   -21,   -21,    32,    32,   -61,
+     -61,   -61,   -61,   -61,   -61,    51,    64,    66,     5,   -61,
+     -61,   129,   -61,   -61,   109,    69,   -61,   -61,   -61,    58,
+      58,    58,   190,   -61,    74,    93,   -61,   -61,   -61,   -61,
+      83,    84,   -61,   -61,    58,    86,   -61,   158,   158,    87,
+     -61,   -61,   117,   -61,    58,   158,    91,   -61,   -61,   158,
+     -61
 };
 
 /* YYDEFACT[STATE-NUM] -- Default reduction number in state STATE-NUM.
@@ -676,109 +705,167 @@ static const yytype_int16 yypact[] =
    means the default is an error.  */
 static const yytype_int8 yydefact[] =
 {
-       0,    17,    19,    18,    20,    21,    22,    23,    14,    15,
-      13,    16,     0,     2,     4,     5,     0,     8,     0,     0,
-      11,     1,     3,     7,     9,    12,     0,     0,    43,    45,
-      44,    46,     0,    10,    34,    35,    37,    40,     0,     0,
-       0,     0,     0,     0,     0,     0,     6,    47,    38,    40,
-      39,    41,    42,    36,     0,     0,    30,    27,     0,    32,
-      24,     0,     0,     0,    29,     0,     9,    31,    33,    25,
-       0,    28,     0,     0,     0,    26
+       0,    26,    27,    29,    28,    30,    31,    32,    33,    23,
+      24,    22,    25,     0,     0,     2,     4,     5,     0,    13,
+       0,     0,     0,    19,     0,     1,     3,    12,     0,    14,
+      21,    20,     0,    16,     0,     0,     0,     0,    78,    82,
+      81,    83,     0,    15,    54,    55,    61,    64,    69,    72,
+      75,    26,     0,     0,     9,     0,     0,    17,     0,     0,
+       0,     0,     0,     0,     0,     0,     0,     0,     0,     0,
+      76,    77,     0,     0,     0,     0,     0,     0,     0,     6,
+       0,     0,    11,    18,    79,    85,     0,    84,    62,    72,
+      63,    67,    68,    65,    66,    70,    71,    73,    74,    59,
+      60,    57,    58,    56,     7,     0,     0,     0,     0,    50,
+      40,     0,    52,    34,     0,     0,     8,    10,    80,     0,
+       0,     0,     0,    42,     0,    14,    51,    53,    35,    86,
+       0,     0,    45,    43,    47,     0,    41,     0,     0,     0,
+      46,    44,    36,    38,    49,     0,     0,    48,    37,     0,
+      39
 };
 
 /* YYPGOTO[NTERM-NUM].  */
-static const yytype_int8 yypgoto[] =
+static const yytype_int16 yypgoto[] =
 {
-     -65,   -65,    68,   -65,     8,   -65,   -65,    36,   -65,    66,
-     -46,    49,   -65,    70,    51,   -65,    37,     4
+     -61,   -61,   135,   -61,   -61,    75,     0,   -61,   -61,   -61,
+       2,   -61,   133,    13,   -61,   -61,   -61,   -39,   -61,   -33,
+     -19,   -61,    21,    14,    36,   263,   -61,   -61
 };
 
 /* YYDEFGOTO[NTERM-NUM].  */
-static const yytype_int8 yydefgoto[] =
+static const yytype_uint8 yydefgoto[] =
 {
-       0,    12,    13,    14,    57,    16,    17,    58,    19,    20,
-      59,    60,    61,    62,    34,    35,    36,    37
+       0,    14,    15,    16,    53,    54,   110,    18,    19,    20,
+     111,    22,    23,   112,   134,   139,   146,   113,   114,   115,
+      44,    45,    46,    47,    48,    49,    50,    86
 };
 
 /* YYTABLE[YYPACT[STATE-NUM]] -- What to do in state STATE-NUM.  If
    positive, shift that token.  If negative, reduce the rule whose
    number is the opposite.  If YYTABLE_NINF, syntax error.  */
-static const yytype_int8 yytable[] =
+static const yytype_uint8 yytable[] =
 {
-      28,    23,    29,    30,    31,     1,    24,     2,    15,     3,
-      38,     4,     5,     6,    28,    68,    29,    30,    31,     7,
-      15,     8,     9,    44,    10,    11,    73,    54,    75,    26,
-      28,    55,    29,    30,    31,     1,    18,     2,    47,     3,
-      27,     4,     5,     6,    49,    49,    51,    52,    18,     7,
-      45,     8,     9,    63,    10,    11,    66,    54,    69,    32,
-      71,    55,    72,    45,    56,    28,    26,    29,    30,    31,
-      40,    41,    74,    32,    42,    43,    64,    48,    50,    28,
-      22,    29,    30,    31,     1,    25,     2,    46,     3,    32,
-       4,     5,     6,    45,    67,    53,    33,     0,     7,     0,
-       8,     9,    39,    10,    11,     0,    54,    21,     0,     0,
-      55,     0,     0,     0,     0,     1,     0,     2,     0,     3,
-       0,     4,     5,     6,    32,    65,     0,     0,     0,     7,
-       0,     8,     9,    70,    10,    11,     0,     1,    32,     2,
-       0,     3,    45,     4,     5,     6,     0,     0,     0,     0,
-       0,     7,     0,     8,     9,     0,    10,    11,     1,     0,
-       2,     0,     3,     0,     4,     5,     6,     0,     0,     0,
-       0,     0,     7
+      17,    43,    21,    80,    57,    81,    34,    24,    38,    59,
+      39,    40,    41,    79,    17,    27,    21,    35,    60,    61,
+      29,    38,    28,    39,    40,    41,     1,     2,     3,   118,
+       4,   119,     5,     6,     7,    68,    69,    55,   104,    85,
+       8,   116,     9,    10,    32,    11,    12,    13,   105,    33,
+     106,   107,   108,    99,   100,   101,   102,   103,    66,    67,
+      36,    38,    37,    39,    40,    41,    56,    42,    70,    71,
+      38,   123,    39,    40,    41,   124,    91,    92,    93,    94,
+      42,    88,    90,    55,    58,    78,   109,   130,   131,   135,
+      51,     2,     3,    77,     4,    78,     5,     6,     7,    82,
+     129,   140,    95,    96,     8,    83,     9,    10,    87,    11,
+      12,   147,    38,   120,    39,    40,    41,     1,     2,     3,
+      42,     4,   133,     5,     6,     7,   121,   127,   122,    42,
+      84,     8,   125,     9,    10,   128,    11,    12,    13,   105,
+     136,   106,   107,   108,    34,    52,   137,   138,   145,    26,
+     142,   143,   141,   144,   149,    31,   117,     0,   148,     0,
+       0,    38,   150,    39,    40,    41,     1,     2,     3,     0,
+       4,    42,     5,     6,     7,     0,    78,   126,     0,     0,
+       8,     0,     9,    10,     0,    11,    12,    13,   105,     0,
+     106,   107,   108,    38,     0,    39,    40,    41,     1,     2,
+       3,     0,     4,     0,     5,     6,     7,     0,    62,    63,
+       0,     0,     8,     0,     9,    10,     0,    11,    12,    13,
+      42,    25,    64,    65,     0,    78,     0,     0,     0,     1,
+       2,     3,     0,     4,     0,     5,     6,     7,     0,     0,
+       0,     0,     0,     8,     0,     9,    10,     0,    11,    12,
+      13,     0,    42,     1,     2,     3,   132,     4,     0,     5,
+       6,     7,     0,     0,     0,     0,     0,     8,     0,     9,
+      10,     0,    11,    12,    13,     1,     2,     3,     0,     4,
+       0,     5,     6,     7,     0,     0,     0,     0,     0,     8,
+       0,     9,    10,    30,    11,    12,     0,     0,     1,     2,
+       3,     0,     4,     0,     5,     6,     7,    70,    71,     0,
+       0,     0,     8,     0,     0,     0,    72,    73,    74,    75,
+       0,     0,    76,    89,    89,    89,    89,    89,    89,    89,
+      89,    97,    98
 };
 
-static const yytype_int8 yycheck[] =
+static const yytype_int16 yycheck[] =
 {
-       3,    65,     5,     6,     7,     8,     3,    10,     0,    12,
-      63,    14,    15,    16,     3,    61,     5,     6,     7,    22,
-      12,    24,    25,    51,    27,    28,    72,    30,    74,    51,
-       3,    34,     5,     6,     7,     8,     0,    10,    63,    12,
-      62,    14,    15,    16,    40,    41,    42,    43,    12,    22,
-      66,    24,    25,    62,    27,    28,     3,    30,    65,    62,
-      65,    34,    63,    66,    67,     3,    51,     5,     6,     7,
-      54,    55,    31,    62,    56,    57,    65,    40,    41,     3,
-      12,     5,     6,     7,     8,    19,    10,    38,    12,    62,
-      14,    15,    16,    66,    67,    44,    26,    -1,    22,    -1,
-      24,    25,    32,    27,    28,    -1,    30,     0,    -1,    -1,
-      34,    -1,    -1,    -1,    -1,     8,    -1,    10,    -1,    12,
-      -1,    14,    15,    16,    62,    55,    -1,    -1,    -1,    22,
-      -1,    24,    25,    63,    27,    28,    -1,     8,    62,    10,
-      -1,    12,    66,    14,    15,    16,    -1,    -1,    -1,    -1,
-      -1,    22,    -1,    24,    25,    -1,    27,    28,     8,    -1,
-      10,    -1,    12,    -1,    14,    15,    16,    -1,    -1,    -1,
-      -1,    -1,    22
+       0,    34,     0,    63,    37,    65,    51,    62,     3,    42,
+       5,     6,     7,    52,    14,    66,    14,    62,    40,    41,
+       3,     3,    20,     5,     6,     7,     8,     9,    10,    63,
+      12,    65,    14,    15,    16,    56,    57,    35,    77,    58,
+      22,    80,    24,    25,     3,    27,    28,    29,    30,     3,
+      32,    33,    34,    72,    73,    74,    75,    76,    54,    55,
+      51,     3,    51,     5,     6,     7,     6,    62,    36,    37,
+       3,    66,     5,     6,     7,   108,    62,    63,    64,    65,
+      62,    60,    61,    81,    62,    67,    68,   120,   121,   122,
+       8,     9,    10,    63,    12,    67,    14,    15,    16,     3,
+     119,   134,    66,    67,    22,    63,    24,    25,    63,    27,
+      28,   144,     3,    62,     5,     6,     7,     8,     9,    10,
+      62,    12,   122,    14,    15,    16,    62,   114,    62,    62,
+      63,    22,     3,    24,    25,    66,    27,    28,    29,    30,
+      66,    32,    33,    34,    51,    63,    63,    63,    31,    14,
+     137,   138,    66,    66,    63,    22,    81,    -1,   145,    -1,
+      -1,     3,   149,     5,     6,     7,     8,     9,    10,    -1,
+      12,    62,    14,    15,    16,    -1,    67,    68,    -1,    -1,
+      22,    -1,    24,    25,    -1,    27,    28,    29,    30,    -1,
+      32,    33,    34,     3,    -1,     5,     6,     7,     8,     9,
+      10,    -1,    12,    -1,    14,    15,    16,    -1,    38,    39,
+      -1,    -1,    22,    -1,    24,    25,    -1,    27,    28,    29,
+      62,     0,    52,    53,    -1,    67,    -1,    -1,    -1,     8,
+       9,    10,    -1,    12,    -1,    14,    15,    16,    -1,    -1,
+      -1,    -1,    -1,    22,    -1,    24,    25,    -1,    27,    28,
+      29,    -1,    62,     8,     9,    10,    66,    12,    -1,    14,
+      15,    16,    -1,    -1,    -1,    -1,    -1,    22,    -1,    24,
+      25,    -1,    27,    28,    29,     8,     9,    10,    -1,    12,
+      -1,    14,    15,    16,    -1,    -1,    -1,    -1,    -1,    22,
+      -1,    24,    25,     3,    27,    28,    -1,    -1,     8,     9,
+      10,    -1,    12,    -1,    14,    15,    16,    36,    37,    -1,
+      -1,    -1,    22,    -1,    -1,    -1,    45,    46,    47,    48,
+      -1,    -1,    51,    60,    61,    62,    63,    64,    65,    66,
+      67,    68,    69
 };
 
 /* YYSTOS[STATE-NUM] -- The symbol kind of the accessing symbol of
    state STATE-NUM.  */
 static const yytype_int8 yystos[] =
 {
-       0,     8,    10,    12,    14,    15,    16,    22,    24,    25,
-      27,    28,    69,    70,    71,    72,    73,    74,    75,    76,
-      77,     0,    70,    65,     3,    77,    51,    62,     3,     5,
-       6,     7,    62,    81,    82,    83,    84,    85,    63,    81,
-      54,    55,    56,    57,    51,    66,    79,    63,    84,    85,
-      84,    85,    85,    82,    30,    34,    67,    72,    75,    78,
-      79,    80,    81,    62,    65,    81,     3,    67,    78,    65,
-      81,    65,    63,    78,    31,    78
+       0,     8,     9,    10,    12,    14,    15,    16,    22,    24,
+      25,    27,    28,    29,    70,    71,    72,    75,    76,    77,
+      78,    79,    80,    81,    62,     0,    71,    66,    79,     3,
+       3,    81,     3,     3,    51,    62,    51,    51,     3,     5,
+       6,     7,    62,    88,    89,    90,    91,    92,    93,    94,
+      95,     8,    63,    73,    74,    79,     6,    88,    62,    88,
+      40,    41,    38,    39,    52,    53,    54,    55,    56,    57,
+      36,    37,    45,    46,    47,    48,    51,    63,    67,    86,
+      63,    65,     3,    63,    63,    89,    96,    63,    91,    94,
+      91,    92,    92,    92,    92,    93,    93,    94,    94,    89,
+      89,    89,    89,    89,    86,    30,    32,    33,    34,    68,
+      75,    79,    82,    86,    87,    88,    86,    74,    63,    65,
+      62,    62,    62,    66,    88,     3,    68,    82,    66,    89,
+      88,    88,    66,    75,    83,    88,    66,    63,    63,    84,
+      88,    66,    82,    82,    66,    31,    85,    88,    82,    63,
+      82
 };
 
 /* YYR1[RULE-NUM] -- Symbol kind of the left-hand side of rule RULE-NUM.  */
 static const yytype_int8 yyr1[] =
 {
-       0,    68,    69,    69,    70,    70,    71,    72,    73,    74,
-      74,    75,    75,    76,    76,    76,    76,    77,    77,    77,
-      77,    77,    77,    77,    78,    78,    78,    78,    78,    78,
-      79,    79,    80,    80,    81,    82,    82,    83,    83,    83,
-      84,    84,    84,    85,    85,    85,    85,    85
+       0,    69,    70,    70,    71,    71,    72,    72,    72,    73,
+      73,    74,    75,    76,    77,    77,    77,    77,    78,    79,
+      79,    79,    80,    80,    80,    80,    81,    81,    81,    81,
+      81,    81,    81,    81,    82,    82,    82,    82,    82,    82,
+      82,    82,    82,    83,    83,    83,    84,    84,    85,    85,
+      86,    86,    87,    87,    88,    89,    89,    89,    89,    89,
+      89,    90,    90,    90,    91,    91,    91,    91,    91,    92,
+      92,    92,    93,    93,    93,    94,    94,    94,    95,    95,
+      95,    95,    95,    95,    95,    96,    96
 };
 
 /* YYR2[RULE-NUM] -- Number of symbols on the right-hand side of rule RULE-NUM.  */
 static const yytype_int8 yyr2[] =
 {
-       0,     2,     1,     2,     1,     1,     5,     2,     1,     2,
-       4,     1,     2,     1,     1,     1,     1,     1,     1,     1,
-       1,     1,     1,     1,     1,     2,     7,     1,     3,     2,
-       2,     3,     1,     2,     1,     1,     3,     1,     3,     3,
-       1,     3,     3,     1,     1,     1,     1,     3
+       0,     2,     1,     2,     1,     1,     5,     6,     6,     1,
+       3,     2,     2,     1,     2,     4,     3,     5,     6,     1,
+       2,     2,     1,     1,     1,     1,     1,     1,     1,     1,
+       1,     1,     1,     1,     1,     2,     5,     7,     5,     8,
+       1,     3,     2,     1,     2,     1,     1,     0,     1,     0,
+       2,     3,     1,     2,     1,     1,     3,     3,     3,     3,
+       3,     1,     3,     3,     1,     3,     3,     3,     3,     1,
+       3,     3,     1,     3,     3,     1,     2,     2,     1,     3,
+       4,     1,     1,     1,     3,     1,     3
 };
 
 
@@ -1355,63 +1442,104 @@ yyreduce:
   switch (yyn)
     {
   case 2: /* translation_unit: external_declaration  */
-#line 89 "glsl.y"
+#line 95 "glsl.y"
                            { root = (yyvsp[0].node); (yyval.node) = root; }
-#line 1361 "glsl.tab.c"
+#line 1448 "glsl.tab.c"
     break;
 
   case 3: /* translation_unit: translation_unit external_declaration  */
-#line 90 "glsl.y"
+#line 96 "glsl.y"
                                             { (yyval.node) = append_node((yyvsp[-1].node), (yyvsp[0].node)); }
-#line 1367 "glsl.tab.c"
+#line 1454 "glsl.tab.c"
     break;
 
   case 4: /* external_declaration: function_definition  */
-#line 94 "glsl.y"
+#line 100 "glsl.y"
                           { (yyval.node) = (yyvsp[0].node); }
-#line 1373 "glsl.tab.c"
+#line 1460 "glsl.tab.c"
     break;
 
   case 5: /* external_declaration: declaration  */
-#line 95 "glsl.y"
+#line 101 "glsl.y"
                   { (yyval.node) = (yyvsp[0].node); }
-#line 1379 "glsl.tab.c"
+#line 1466 "glsl.tab.c"
     break;
 
   case 6: /* function_definition: fully_specified_type IDENTIFIER '(' ')' compound_statement  */
-#line 99 "glsl.y"
+#line 105 "glsl.y"
                                                                  { 
         (yyval.node) = create_func_def((yyvsp[-4].node), (yyvsp[-3].sval), NULL, (yyvsp[0].node)); 
         free((yyvsp[-3].sval)); 
     }
-#line 1388 "glsl.tab.c"
+#line 1475 "glsl.tab.c"
+    break;
+
+  case 7: /* function_definition: fully_specified_type IDENTIFIER '(' VOID ')' compound_statement  */
+#line 109 "glsl.y"
+                                                                      { 
+        (yyval.node) = create_func_def((yyvsp[-5].node), (yyvsp[-4].sval), NULL, (yyvsp[0].node)); 
+        free((yyvsp[-4].sval)); 
+    }
+#line 1484 "glsl.tab.c"
+    break;
+
+  case 8: /* function_definition: fully_specified_type IDENTIFIER '(' parameter_list ')' compound_statement  */
+#line 113 "glsl.y"
+                                                                                { 
+        (yyval.node) = create_func_def((yyvsp[-5].node), (yyvsp[-4].sval), (yyvsp[-2].node), (yyvsp[0].node)); 
+        free((yyvsp[-4].sval)); 
+    }
+#line 1493 "glsl.tab.c"
+    break;
+
+  case 9: /* parameter_list: parameter_declaration  */
+#line 120 "glsl.y"
+                            { (yyval.node) = (yyvsp[0].node); }
+#line 1499 "glsl.tab.c"
+    break;
+
+  case 10: /* parameter_list: parameter_list ',' parameter_declaration  */
+#line 121 "glsl.y"
+                                               { (yyval.node) = append_node((yyvsp[-2].node), (yyvsp[0].node)); }
+#line 1505 "glsl.tab.c"
+    break;
+
+  case 11: /* parameter_declaration: fully_specified_type IDENTIFIER  */
+#line 125 "glsl.y"
+                                      { 
+        ASTNode* n = create_node(NODE_PARAM_DECL); 
+        n->data.var_decl.type = (yyvsp[-1].node); 
+        n->data.var_decl.name = (yyvsp[0].sval); 
+        (yyval.node) = n; 
+    }
+#line 1516 "glsl.tab.c"
     break;
 
-  case 7: /* declaration: init_declarator_list ';'  */
-#line 106 "glsl.y"
+  case 12: /* declaration: init_declarator_list ';'  */
+#line 134 "glsl.y"
                                { (yyval.node) = (yyvsp[-1].node); }
-#line 1394 "glsl.tab.c"
+#line 1522 "glsl.tab.c"
     break;
 
-  case 8: /* init_declarator_list: single_declaration  */
-#line 110 "glsl.y"
+  case 13: /* init_declarator_list: single_declaration  */
+#line 138 "glsl.y"
                          { (yyval.node) = (yyvsp[0].node); }
-#line 1400 "glsl.tab.c"
+#line 1528 "glsl.tab.c"
     break;
 
-  case 9: /* single_declaration: fully_specified_type IDENTIFIER  */
-#line 114 "glsl.y"
+  case 14: /* single_declaration: fully_specified_type IDENTIFIER  */
+#line 142 "glsl.y"
                                       { 
         ASTNode* n = create_node(NODE_VAR_DECL); 
         n->data.var_decl.type = (yyvsp[-1].node); 
         n->data.var_decl.name = (yyvsp[0].sval); 
         (yyval.node) = n; 
     }
-#line 1411 "glsl.tab.c"
+#line 1539 "glsl.tab.c"
     break;
 
-  case 10: /* single_declaration: fully_specified_type IDENTIFIER '=' expression  */
-#line 120 "glsl.y"
+  case 15: /* single_declaration: fully_specified_type IDENTIFIER '=' expression  */
+#line 148 "glsl.y"
                                                      { 
         ASTNode* n = create_node(NODE_VAR_DECL); 
         n->data.var_decl.type = (yyvsp[-3].node); 
@@ -1419,235 +1547,467 @@ yyreduce:
         n->data.var_decl.initializer = (yyvsp[0].node); 
         (yyval.node) = n; 
     }
-#line 1423 "glsl.tab.c"
+#line 1551 "glsl.tab.c"
+    break;
+
+  case 16: /* single_declaration: layout_qualifier fully_specified_type IDENTIFIER  */
+#line 155 "glsl.y"
+                                                       { 
+        ASTNode* n = create_node(NODE_VAR_DECL); 
+        n->data.var_decl.type = (yyvsp[-1].node); 
+        n->data.var_decl.name = (yyvsp[0].sval); 
+        n->data.var_decl.is_spec_const = ((yyvsp[-2].ival) >= 0); 
+        n->data.var_decl.constant_id = (yyvsp[-2].ival); 
+        (yyval.node) = n; 
+    }
+#line 1564 "glsl.tab.c"
+    break;
+
+  case 17: /* single_declaration: layout_qualifier fully_specified_type IDENTIFIER '=' expression  */
+#line 163 "glsl.y"
+                                                                      { 
+        ASTNode* n = create_node(NODE_VAR_DECL); 
+        n->data.var_decl.type = (yyvsp[-3].node); 
+        n->data.var_decl.name = (yyvsp[-2].sval); 
+        n->data.var_decl.initializer = (yyvsp[0].node); 
+        n->data.var_decl.is_spec_const = ((yyvsp[-4].ival) >= 0); 
+        n->data.var_decl.constant_id = (yyvsp[-4].ival); 
+        (yyval.node) = n; 
+    }
+#line 1578 "glsl.tab.c"
+    break;
+
+  case 18: /* layout_qualifier: LAYOUT '(' IDENTIFIER '=' INT_CONST ')'  */
+#line 176 "glsl.y"
+                                              { 
+        (yyval.ival) = (strcmp((yyvsp[-3].sval), "constant_id") == 0) ? (yyvsp[-1].ival) : -1; 
+        free((yyvsp[-3].sval)); 
+    }
+#line 1587 "glsl.tab.c"
     break;
 
-  case 11: /* fully_specified_type: type_specifier  */
-#line 130 "glsl.y"
+  case 19: /* fully_specified_type: type_specifier  */
+#line 183 "glsl.y"
                      { (yyval.node) = (yyvsp[0].node); }
-#line 1429 "glsl.tab.c"
+#line 1593 "glsl.tab.c"
     break;
 
-  case 12: /* fully_specified_type: type_qualifier type_specifier  */
-#line 131 "glsl.y"
+  case 20: /* fully_specified_type: type_qualifier type_specifier  */
+#line 184 "glsl.y"
                                     { (yyval.node) = (yyvsp[0].node); }
-#line 1435 "glsl.tab.c"
+#line 1599 "glsl.tab.c"
     break;
 
-  case 13: /* type_qualifier: UNIFORM  */
-#line 135 "glsl.y"
+  case 21: /* fully_specified_type: type_qualifier IDENTIFIER  */
+#line 186 "glsl.y"
+                                { 
+        if (strcmp((yyvsp[0].sval), "sampler2D") != 0) { 
+            yyerror("unknown type name"); 
+            free((yyvsp[0].sval)); 
+            YYERROR; 
+        } 
+        (yyval.node) = create_type_node((yyvsp[0].sval)); 
+        free((yyvsp[0].sval)); 
+    }
+#line 1613 "glsl.tab.c"
+    break;
+
+  case 22: /* type_qualifier: UNIFORM  */
+#line 198 "glsl.y"
               { (yyval.node) = NULL; }
-#line 1441 "glsl.tab.c"
+#line 1619 "glsl.tab.c"
     break;
 
-  case 14: /* type_qualifier: IN  */
-#line 136 "glsl.y"
+  case 23: /* type_qualifier: IN  */
+#line 199 "glsl.y"
          { (yyval.node) = NULL; }
-#line 1447 "glsl.tab.c"
+#line 1625 "glsl.tab.c"
     break;
 
-  case 15: /* type_qualifier: OUT  */
-#line 137 "glsl.y"
+  case 24: /* type_qualifier: OUT  */
+#line 200 "glsl.y"
           { (yyval.node) = NULL; }
-#line 1453 "glsl.tab.c"
+#line 1631 "glsl.tab.c"
     break;
 
-  case 16: /* type_qualifier: CONST  */
-#line 138 "glsl.y"
+  case 25: /* type_qualifier: CONST  */
+#line 201 "glsl.y"
             { (yyval.node) = NULL; }
-#line 1459 "glsl.tab.c"
+#line 1637 "glsl.tab.c"
     break;
 
-  case 17: /* type_specifier: VOID  */
-#line 142 "glsl.y"
+  case 26: /* type_specifier: VOID  */
+#line 205 "glsl.y"
            { (yyval.node) = create_type_node("void"); }
-#line 1465 "glsl.tab.c"
+#line 1643 "glsl.tab.c"
     break;
 
-  case 18: /* type_specifier: FLOAT  */
-#line 143 "glsl.y"
+  case 27: /* type_specifier: BOOL  */
+#line 206 "glsl.y"
+           { (yyval.node) = create_type_node("bool"); }
+#line 1649 "glsl.tab.c"
+    break;
+
+  case 28: /* type_specifier: FLOAT  */
+#line 207 "glsl.y"
             { (yyval.node) = create_type_node("float"); }
-#line 1471 "glsl.tab.c"
+#line 1655 "glsl.tab.c"
     break;
 
-  case 19: /* type_specifier: INT  */
-#line 144 "glsl.y"
+  case 29: /* type_specifier: INT  */
+#line 208 "glsl.y"
           { (yyval.node) = create_type_node("int"); }
-#line 1477 "glsl.tab.c"
+#line 1661 "glsl.tab.c"
     break;
 
-  case 20: /* type_specifier: VEC2  */
-#line 145 "glsl.y"
+  case 30: /* type_specifier: VEC2  */
+#line 209 "glsl.y"
            { (yyval.node) = create_type_node("vec2"); }
-#line 1483 "glsl.tab.c"
+#line 1667 "glsl.tab.c"
     break;
 
-  case 21: /* type_specifier: VEC3  */
-#line 146 "glsl.y"
+  case 31: /* type_specifier: VEC3  */
+#line 210 "glsl.y"
            { (yyval.node) = create_type_node("vec3"); }
-#line 1489 "glsl.tab.c"
+#line 1673 "glsl.tab.c"
     break;
 
-  case 22: /* type_specifier: VEC4  */
-#line 147 "glsl.y"
+  case 32: /* type_specifier: VEC4  */
+#line 211 "glsl.y"
            { (yyval.node) = create_type_node("vec4"); }
-#line 1495 "glsl.tab.c"
+#line 1679 "glsl.tab.c"
     break;
 
-  case 23: /* type_specifier: MAT4  */
-#line 148 "glsl.y"
+  case 33: /* type_specifier: MAT4  */
+#line 212 "glsl.y"
            { (yyval.node) = create_type_node("mat4"); }
-#line 1501 "glsl.tab.c"
+#line 1685 "glsl.tab.c"
     break;
 
-  case 24: /* statement: compound_statement  */
-#line 153 "glsl.y"
+  case 34: /* statement: compound_statement  */
+#line 217 "glsl.y"
                          { (yyval.node) = (yyvsp[0].node); }
-#line 1507 "glsl.tab.c"
+#line 1691 "glsl.tab.c"
     break;
 
-  case 25: /* statement: expression ';'  */
-#line 154 "glsl.y"
-                     { ASTNode* n = create_node(NODE_EXPR_STMT); n->next = (yyvsp[-1].node); (yyval.node) = n; }
-#line 1513 "glsl.tab.c"
+  case 35: /* statement: expression ';'  */
+#line 218 "glsl.y"
+                     { ASTNode* n = create_node(NODE_EXPR_STMT); n->data.stmt.expr = (yyvsp[-1].node); (yyval.node) = n; }
+#line 1697 "glsl.tab.c"
     break;
 
-  case 26: /* statement: IF '(' expression ')' statement ELSE statement  */
-#line 155 "glsl.y"
+  case 36: /* statement: IF '(' expression ')' statement  */
+#line 219 "glsl.y"
+                                                            { (yyval.node) = create_if_stmt((yyvsp[-2].node), (yyvsp[0].node), NULL); }
+#line 1703 "glsl.tab.c"
+    break;
+
+  case 37: /* statement: IF '(' expression ')' statement ELSE statement  */
+#line 220 "glsl.y"
                                                      { (yyval.node) = create_if_stmt((yyvsp[-4].node), (yyvsp[-2].node), (yyvsp[0].node)); }
-#line 1519 "glsl.tab.c"
+#line 1709 "glsl.tab.c"
+    break;
+
+  case 38: /* statement: WHILE '(' expression ')' statement  */
+#line 221 "glsl.y"
+                                         { (yyval.node) = create_loop_stmt(NODE_WHILE_STMT, NULL, (yyvsp[-2].node), NULL, (yyvsp[0].node)); }
+#line 1715 "glsl.tab.c"
     break;
 
-  case 27: /* statement: declaration  */
-#line 156 "glsl.y"
+  case 39: /* statement: FOR '(' for_init_statement for_condition ';' for_step ')' statement  */
+#line 222 "glsl.y"
+                                                                          { 
+        (yyval.node) = create_loop_stmt(NODE_FOR_STMT, (yyvsp[-5].node), (yyvsp[-4].node), (yyvsp[-2].node), (yyvsp[0].node)); 
+    }
+#line 1723 "glsl.tab.c"
+    break;
+
+  case 40: /* statement: declaration  */
+#line 225 "glsl.y"
                   { (yyval.node) = (yyvsp[0].node); }
-#line 1525 "glsl.tab.c"
+#line 1729 "glsl.tab.c"
     break;
 
-  case 28: /* statement: RETURN expression ';'  */
-#line 157 "glsl.y"
-                            { (yyval.node) = create_node(NODE_RETURN_STMT); /* 简化处理 */ }
-#line 1531 "glsl.tab.c"
+  case 41: /* statement: RETURN expression ';'  */
+#line 226 "glsl.y"
+                            { (yyval.node) = create_node(NODE_RETURN_STMT); (yyval.node)->data.stmt.expr = (yyvsp[-1].node); }
+#line 1735 "glsl.tab.c"
     break;
 
-  case 29: /* statement: RETURN ';'  */
-#line 158 "glsl.y"
+  case 42: /* statement: RETURN ';'  */
+#line 227 "glsl.y"
                  { (yyval.node) = create_node(NODE_RETURN_STMT); }
-#line 1537 "glsl.tab.c"
+#line 1741 "glsl.tab.c"
+    break;
+
+  case 43: /* for_init_statement: declaration  */
+#line 231 "glsl.y"
+                  { (yyval.node) = (yyvsp[0].node); }
+#line 1747 "glsl.tab.c"
+    break;
+
+  case 44: /* for_init_statement: expression ';'  */
+#line 232 "glsl.y"
+                     { ASTNode* n = create_node(NODE_EXPR_STMT); n->data.stmt.expr = (yyvsp[-1].node); (yyval.node) = n; }
+#line 1753 "glsl.tab.c"
+    break;
+
+  case 45: /* for_init_statement: ';'  */
+#line 233 "glsl.y"
+          { (yyval.node) = NULL; }
+#line 1759 "glsl.tab.c"
+    break;
+
+  case 46: /* for_condition: expression  */
+#line 237 "glsl.y"
+                 { (yyval.node) = (yyvsp[0].node); }
+#line 1765 "glsl.tab.c"
+    break;
+
+  case 47: /* for_condition: %empty  */
+#line 238 "glsl.y"
+                              { (yyval.node) = NULL; }
+#line 1771 "glsl.tab.c"
+    break;
+
+  case 48: /* for_step: expression  */
+#line 242 "glsl.y"
+                 { (yyval.node) = (yyvsp[0].node); }
+#line 1777 "glsl.tab.c"
+    break;
+
+  case 49: /* for_step: %empty  */
+#line 243 "glsl.y"
+                { (yyval.node) = NULL; }
+#line 1783 "glsl.tab.c"
     break;
 
-  case 30: /* compound_statement: '{' '}'  */
-#line 162 "glsl.y"
+  case 50: /* compound_statement: '{' '}'  */
+#line 247 "glsl.y"
               { (yyval.node) = create_node(NODE_COMPOUND_STMT); }
-#line 1543 "glsl.tab.c"
+#line 1789 "glsl.tab.c"
     break;
 
-  case 31: /* compound_statement: '{' statement_list '}'  */
-#line 163 "glsl.y"
-                             { ASTNode* n = create_node(NODE_COMPOUND_STMT); n->next = (yyvsp[-1].node); (yyval.node) = n; }
-#line 1549 "glsl.tab.c"
+  case 51: /* compound_statement: '{' statement_list '}'  */
+#line 248 "glsl.y"
+                             { ASTNode* n = create_node(NODE_COMPOUND_STMT); n->data.compound.stmts = (yyvsp[-1].node); (yyval.node) = n; }
+#line 1795 "glsl.tab.c"
     break;
 
-  case 32: /* statement_list: statement  */
-#line 167 "glsl.y"
+  case 52: /* statement_list: statement  */
+#line 252 "glsl.y"
                 { (yyval.node) = (yyvsp[0].node); }
-#line 1555 "glsl.tab.c"
+#line 1801 "glsl.tab.c"
     break;
 
-  case 33: /* statement_list: statement_list statement  */
-#line 168 "glsl.y"
+  case 53: /* statement_list: statement_list statement  */
+#line 253 "glsl.y"
                                { (yyval.node) = append_node((yyvsp[-1].node), (yyvsp[0].node)); }
-#line 1561 "glsl.tab.c"
+#line 1807 "glsl.tab.c"
     break;
 
-  case 34: /* expression: assignment_expression  */
-#line 172 "glsl.y"
+  case 54: /* expression: assignment_expression  */
+#line 257 "glsl.y"
                             { (yyval.node) = (yyvsp[0].node); }
-#line 1567 "glsl.tab.c"
+#line 1813 "glsl.tab.c"
     break;
 
-  case 35: /* assignment_expression: additive_expression  */
-#line 176 "glsl.y"
+  case 55: /* assignment_expression: equality_expression  */
+#line 261 "glsl.y"
                           { (yyval.node) = (yyvsp[0].node); }
-#line 1573 "glsl.tab.c"
+#line 1819 "glsl.tab.c"
     break;
 
-  case 36: /* assignment_expression: primary_expression '=' assignment_expression  */
-#line 177 "glsl.y"
+  case 56: /* assignment_expression: postfix_expression '=' assignment_expression  */
+#line 262 "glsl.y"
                                                    { 
         (yyval.node) = create_binary_expr(OP_ASSIGN, (yyvsp[-2].node), (yyvsp[0].node)); 
     }
-#line 1581 "glsl.tab.c"
+#line 1827 "glsl.tab.c"
     break;
 
-  case 37: /* additive_expression: multiplicative_expression  */
-#line 183 "glsl.y"
+  case 57: /* assignment_expression: postfix_expression ADD_ASSIGN assignment_expression  */
+#line 265 "glsl.y"
+                                                          { (yyval.node) = create_assign_op(OP_ADD, (yyvsp[-2].node), (yyvsp[0].node)); }
+#line 1833 "glsl.tab.c"
+    break;
+
+  case 58: /* assignment_expression: postfix_expression SUB_ASSIGN assignment_expression  */
+#line 266 "glsl.y"
+                                                          { (yyval.node) = create_assign_op(OP_SUB, (yyvsp[-2].node), (yyvsp[0].node)); }
+#line 1839 "glsl.tab.c"
+    break;
+
+  case 59: /* assignment_expression: postfix_expression MUL_ASSIGN assignment_expression  */
+#line 267 "glsl.y"
+                                                          { (yyval.node) = create_assign_op(OP_MUL, (yyvsp[-2].node), (yyvsp[0].node)); }
+#line 1845 "glsl.tab.c"
+    break;
+
+  case 60: /* assignment_expression: postfix_expression DIV_ASSIGN assignment_expression  */
+#line 268 "glsl.y"
+                                                          { (yyval.node) = create_assign_op(OP_DIV, (yyvsp[-2].node), (yyvsp[0].node)); }
+#line 1851 "glsl.tab.c"
+    break;
+
+  case 61: /* equality_expression: relational_expression  */
+#line 272 "glsl.y"
+                            { (yyval.node) = (yyvsp[0].node); }
+#line 1857 "glsl.tab.c"
+    break;
+
+  case 62: /* equality_expression: equality_expression EQ_OP relational_expression  */
+#line 273 "glsl.y"
+                                                      { (yyval.node) = create_binary_expr(OP_EQ, (yyvsp[-2].node), (yyvsp[0].node)); }
+#line 1863 "glsl.tab.c"
+    break;
+
+  case 63: /* equality_expression: equality_expression NE_OP relational_expression  */
+#line 274 "glsl.y"
+                                                      { (yyval.node) = create_binary_expr(OP_NE, (yyvsp[-2].node), (yyvsp[0].node)); }
+#line 1869 "glsl.tab.c"
+    break;
+
+  case 64: /* relational_expression: additive_expression  */
+#line 278 "glsl.y"
+                          { (yyval.node) = (yyvsp[0].node); }
+#line 1875 "glsl.tab.c"
+    break;
+
+  case 65: /* relational_expression: relational_expression '<' additive_expression  */
+#line 279 "glsl.y"
+                                                    { (yyval.node) = create_binary_expr(OP_LT, (yyvsp[-2].node), (yyvsp[0].node)); }
+#line 1881 "glsl.tab.c"
+    break;
+
+  case 66: /* relational_expression: relational_expression '>' additive_expression  */
+#line 280 "glsl.y"
+                                                    { (yyval.node) = create_binary_expr(OP_GT, (yyvsp[-2].node), (yyvsp[0].node)); }
+#line 1887 "glsl.tab.c"
+    break;
+
+  case 67: /* relational_expression: relational_expression LE_OP additive_expression  */
+#line 281 "glsl.y"
+                                                      { (yyval.node) = create_binary_expr(OP_LE, (yyvsp[-2].node), (yyvsp[0].node)); }
+#line 1893 "glsl.tab.c"
+    break;
+
+  case 68: /* relational_expression: relational_expression GE_OP additive_expression  */
+#line 282 "glsl.y"
+                                                      { (yyval.node) = create_binary_expr(OP_GE, (yyvsp[-2].node), (yyvsp[0].node)); }
+#line 1899 "glsl.tab.c"
+    break;
+
+  case 69: /* additive_expression: multiplicative_expression  */
+#line 286 "glsl.y"
                                 { (yyval.node) = (yyvsp[0].node); }
-#line 1587 "glsl.tab.c"
+#line 1905 "glsl.tab.c"
     break;
 
-  case 38: /* additive_expression: additive_expression '+' multiplicative_expression  */
-#line 184 "glsl.y"
+  case 70: /* additive_expression: additive_expression '+' multiplicative_expression  */
+#line 287 "glsl.y"
                                                         { (yyval.node) = create_binary_expr(OP_ADD, (yyvsp[-2].node), (yyvsp[0].node)); }
-#line 1593 "glsl.tab.c"
+#line 1911 "glsl.tab.c"
     break;
 
-  case 39: /* additive_expression: additive_expression '-' multiplicative_expression  */
-#line 185 "glsl.y"
+  case 71: /* additive_expression: additive_expression '-' multiplicative_expression  */
+#line 288 "glsl.y"
                                                         { (yyval.node) = create_binary_expr(OP_SUB, (yyvsp[-2].node), (yyvsp[0].node)); }
-#line 1599 "glsl.tab.c"
+#line 1917 "glsl.tab.c"
     break;
 
-  case 40: /* multiplicative_expression: primary_expression  */
-#line 189 "glsl.y"
+  case 72: /* multiplicative_expression: postfix_expression  */
+#line 292 "glsl.y"
                          { (yyval.node) = (yyvsp[0].node); }
-#line 1605 "glsl.tab.c"
+#line 1923 "glsl.tab.c"
     break;
 
-  case 41: /* multiplicative_expression: multiplicative_expression '*' primary_expression  */
-#line 190 "glsl.y"
+  case 73: /* multiplicative_expression: multiplicative_expression '*' postfix_expression  */
+#line 293 "glsl.y"
                                                        { (yyval.node) = create_binary_expr(OP_MUL, (yyvsp[-2].node), (yyvsp[0].node)); }
-#line 1611 "glsl.tab.c"
+#line 1929 "glsl.tab.c"
     break;
 
-  case 42: /* multiplicative_expression: multiplicative_expression '/' primary_expression  */
-#line 191 "glsl.y"
+  case 74: /* multiplicative_expression: multiplicative_expression '/' postfix_expression  */
+#line 294 "glsl.y"
                                                        { (yyval.node) = create_binary_expr(OP_DIV, (yyvsp[-2].node), (yyvsp[0].node)); }
-#line 1617 "glsl.tab.c"
+#line 1935 "glsl.tab.c"
+    break;
+
+  case 75: /* postfix_expression: primary_expression  */
+#line 299 "glsl.y"
+                         { (yyval.node) = (yyvsp[0].node); }
+#line 1941 "glsl.tab.c"
+    break;
+
+  case 76: /* postfix_expression: postfix_expression INC_OP  */
+#line 300 "glsl.y"
+                                { (yyval.node) = create_assign_op(OP_ADD, (yyvsp[-1].node), create_int_const(1)); }
+#line 1947 "glsl.tab.c"
     break;
 
-  case 43: /* primary_expression: IDENTIFIER  */
-#line 195 "glsl.y"
+  case 77: /* postfix_expression: postfix_expression DEC_OP  */
+#line 301 "glsl.y"
+                                { (yyval.node) = create_assign_op(OP_SUB, (yyvsp[-1].node), create_int_const(1)); }
+#line 1953 "glsl.tab.c"
+    break;
+
+  case 78: /* primary_expression: IDENTIFIER  */
+#line 305 "glsl.y"
                  { (yyval.node) = create_var_ref((yyvsp[0].sval)); free((yyvsp[0].sval)); }
-#line 1623 "glsl.tab.c"
+#line 1959 "glsl.tab.c"
     break;
 
-  case 44: /* primary_expression: INT_CONST  */
-#line 196 "glsl.y"
+  case 79: /* primary_expression: IDENTIFIER '(' ')'  */
+#line 306 "glsl.y"
+                         { (yyval.node) = create_func_call((yyvsp[-2].sval), NULL); free((yyvsp[-2].sval)); }
+#line 1965 "glsl.tab.c"
+    break;
+
+  case 80: /* primary_expression: IDENTIFIER '(' argument_list ')'  */
+#line 307 "glsl.y"
+                                       { (yyval.node) = create_func_call((yyvsp[-3].sval), (yyvsp[-1].node)); free((yyvsp[-3].sval)); }
+#line 1971 "glsl.tab.c"
+    break;
+
+  case 81: /* primary_expression: INT_CONST  */
+#line 308 "glsl.y"
                 { (yyval.node) = create_int_const((yyvsp[0].ival)); }
-#line 1629 "glsl.tab.c"
+#line 1977 "glsl.tab.c"
     break;
 
-  case 45: /* primary_expression: FLOAT_CONST  */
-#line 197 "glsl.y"
+  case 82: /* primary_expression: FLOAT_CONST  */
+#line 309 "glsl.y"
                   { (yyval.node) = create_float_const((yyvsp[0].fval)); }
-#line 1635 "glsl.tab.c"
+#line 1983 "glsl.tab.c"
     break;
 
-  case 46: /* primary_expression: BOOL_CONST  */
-#line 198 "glsl.y"
+  case 83: /* primary_expression: BOOL_CONST  */
+#line 310 "glsl.y"
                  { (yyval.node) = create_int_const((yyvsp[0].ival)); }
-#line 1641 "glsl.tab.c"
+#line 1989 "glsl.tab.c"
     break;
 
-  case 47: /* primary_expression: '(' expression ')'  */
-#line 199 "glsl.y"
+  case 84: /* primary_expression: '(' expression ')'  */
+#line 311 "glsl.y"
                          { (yyval.node) = (yyvsp[-1].node); }
-#line 1647 "glsl.tab.c"
+#line 1995 "glsl.tab.c"
+    break;
+
+  case 85: /* argument_list: assignment_expression  */
+#line 315 "glsl.y"
+                            { (yyval.node) = (yyvsp[0].node); }
+#line 2001 "glsl.tab.c"
     break;
 
+  case 86: /* argument_list: argument_list ',' assignment_expression  */
+#line 316 "glsl.y"
+                                              { (yyval.node) = append_node((yyvsp[-2].node), (yyvsp[0].node)); }
+#line 2007 "glsl.tab.c"
+    break;
 
-#line 1651 "glsl.tab.c"
+
+#line 2011 "glsl.tab.c"
 
       default: break;
     }
@@ -1845,33 +2205,96 @@ yyreturnlab:
   return yyresult;
 }
 
-#line 202 "glsl.y"
+#line 319 "glsl.y"
+
 
+void yyerror(const char *s) {
+    const char *file;
+    int line = pp_source_line(preproc, yylineno, &file);
+    fprintf(stderr, "Parse Error: %s:%d: %s\n", file, line, s);
+}
 
-void yyerror(const char *s) { fprintf(stderr, "Parse Error: %s line %d\n", s, yylineno); }
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-E] [-D NAME[=VALUE]] [-I DIR] [-S ID=VALUE] [-P fast|precise] [file.glsl]\n", prog);
+}
 
 int main(int argc, char **argv) {
-    if (argc > 1) yyin = fopen(argv[1], "r");
+    Preprocessor *pp = preproc = pp_create();
+    const char *input = NULL;
+    int preprocess_only = 0;
+    NirMathMode math_mode = NIR_MATH_PRECISE;
+
+    /* -D/-I/-S/-P 的参数可以紧跟选项, 也可以是下一个参数 */
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        if (a[0] != '-') { input = a; continue; }
+        if (a[1] == 'E' && !a[2]) { preprocess_only = 1; continue; }
+        if (!a[1] || !strchr("DISP", a[1]) || (!a[2] && i + 1 >= argc)) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char *arg = a[2] ? a + 2 : argv[++i];
+        if (a[1] == 'D') {
+            pp_define(pp, arg);
+        } else if (a[1] == 'I') {
+            pp_add_include_dir(pp, arg);
+        } else if (a[1] == 'P') {
+            /* 超越函数精度: fast 展开为多项式, precise 使用 SFU 指令 */
+            if (strcmp(arg, "fast") == 0) math_mode = NIR_MATH_FAST;
+            else if (strcmp(arg, "precise") == 0) math_mode = NIR_MATH_PRECISE;
+            else { usage(argv[0]); return 1; }
+        } else {
+            int id;
+            float value;
+            if (sscanf(arg, "%d=%f", &id, &value) != 2) { usage(argv[0]); return 1; }
+            nir_set_spec_constant(id, value);
+        }
+    }
+
+    char *source = pp_process_file(pp, input);
+    if (!source) return 1;
+    if (preprocess_only) {
+        fputs(source, stdout);
+        return 0;
+    }
+    printf("0. Preprocessing Successful! (#version %d)\n", pp->version);
+    if (!*source) source = "\n";
+    yyin = fmemopen(source, strlen(source), "r");
+
     if (yyparse() == 0) {
         printf("1. Parsing Successful!\n");
         
         semantic_analysis(root);
         
-        printf("2. Linking...\n");
         LinkerProgram *lp = linker_create(); 
         linker_add(lp, root); 
-        linker_link(lp); 
-        linker_print(lp);
         
-        printf("3. NIR Generation...\n");
+        printf("2. NIR Generation...\n");
         NirShader *ns = generate_ssa_nir(root);
-        
-        if (ns) {
+        if (!ns) return 1;
+
+        {
+            int nlow = nir_lower_transcendentals(ns, math_mode);
+            if (nlow) printf("  Lowered %d transcendental op(s) to polynomials\n", nlow);
+            if (nir_optimize(ns) < 0) return 1;
+            int ndiv = nir_divergence_analysis(ns);
+            printf("  Divergence: %d divergent value(s)\n", ndiv);
+            nir_print_shader(ns);
+
+
+            printf("3. Linking...\n");
+            int n = linker_strip_unused(lp, ns);
+            printf("  %d unused resource(s) stripped\n", n);
+            if (!linker_link(lp)) return 1;
+            linker_print(lp);
+
             printf("4. Backend CodeGen...\n");
             MachineCode *mc = create_code_buffer();
-            compile_nir_to_machine(ns, lp, mc);
+            if (compile_nir_to_machine(ns, lp, mc) < 0) return 1;
+            pisa_peephole(mc);
             dump_binary(mc, "shader.bin");
         }
+        return 0;
     }
-    return 0;
+    return 1;
 }
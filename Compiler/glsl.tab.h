@@ -111,7 +111,7 @@ extern int yydebug;
 #if ! defined YYSTYPE && ! defined YYSTYPE_IS_DECLARED
 union YYSTYPE
 {
-#line 33 "glsl.y"
+#line 35 "glsl.y"
  
     int ival; 
     float fval; 
@@ -6,6 +6,7 @@
 #include "pisa_defs.h"
 #include "gpu_ir.h"
 #include "gpu_linker.h"
+#include "preprocess.h"
 
 extern int yylex();
 extern FILE* yyin;
@@ -14,10 +15,11 @@ extern int yylineno;
 
 void yyerror(const char *s);
 ASTNode *root = NULL;
+Preprocessor *preproc = NULL;
 
 NirShader* generate_ssa_nir(ASTNode *root);
 void semantic_analysis(ASTNode *root);
-void compile_nir_to_machine(NirShader *shader, LinkerProgram *prog, MachineCode *mc);
+int compile_nir_to_machine(NirShader *shader, LinkerProgram *prog, MachineCode *mc);
 void dump_binary(MachineCode *mc, const char *filename);
 
 ASTNode* create_type_node(const char* name) {
@@ -78,8 +80,12 @@ ASTNode* create_type_node(const char* name) {
 /* --- 类型绑定 --- */
 %type <node> translation_unit external_declaration function_definition declaration
 %type <node> statement compound_statement statement_list expression assignment_expression
-%type <node> additive_expression multiplicative_expression primary_expression
+%type <node> additive_expression multiplicative_expression primary_expression postfix_expression
+%type <node> relational_expression equality_expression
+%type <node> for_init_statement for_condition for_step
+%type <node> parameter_list parameter_declaration argument_list
 %type <node> type_specifier fully_specified_type init_declarator_list single_declaration type_qualifier
+%type <ival> layout_qualifier
 
 %%
 
@@ -100,6 +106,28 @@ function_definition
         $$ = create_func_def($1, $2, NULL, $5); 
         free($2); 
     } 
+    | fully_specified_type IDENTIFIER '(' VOID ')' compound_statement { 
+        $$ = create_func_def($1, $2, NULL, $6); 
+        free($2); 
+    } 
+    | fully_specified_type IDENTIFIER '(' parameter_list ')' compound_statement { 
+        $$ = create_func_def($1, $2, $4, $6); 
+        free($2); 
+    } 
+    ;
+
+parameter_list 
+    : parameter_declaration { $$ = $1; } 
+    | parameter_list ',' parameter_declaration { $$ = append_node($1, $3); } 
+    ;
+
+parameter_declaration 
+    : fully_specified_type IDENTIFIER { 
+        ASTNode* n = create_node(NODE_PARAM_DECL); 
+        n->data.var_decl.type = $1; 
+        n->data.var_decl.name = $2; 
+        $$ = n; 
+    } 
     ;
 
 declaration 
@@ -124,11 +152,46 @@ single_declaration
         n->data.var_decl.initializer = $4; 
         $$ = n; 
     } 
+    | layout_qualifier fully_specified_type IDENTIFIER { 
+        ASTNode* n = create_node(NODE_VAR_DECL); 
+        n->data.var_decl.type = $2; 
+        n->data.var_decl.name = $3; 
+        n->data.var_decl.is_spec_const = ($1 >= 0); 
+        n->data.var_decl.constant_id = $1; 
+        $$ = n; 
+    }
+    | layout_qualifier fully_specified_type IDENTIFIER '=' expression { 
+        ASTNode* n = create_node(NODE_VAR_DECL); 
+        n->data.var_decl.type = $2; 
+        n->data.var_decl.name = $3; 
+        n->data.var_decl.initializer = $5; 
+        n->data.var_decl.is_spec_const = ($1 >= 0); 
+        n->data.var_decl.constant_id = $1; 
+        $$ = n; 
+    } 
+    ;
+
+/* 只识别 constant_id, 其他 layout 参数 (location 等) 接受但忽略, 返回 -1 */
+layout_qualifier 
+    : LAYOUT '(' IDENTIFIER '=' INT_CONST ')' { 
+        $$ = (strcmp($3, "constant_id") == 0) ? $5 : -1; 
+        free($3); 
+    } 
     ;
 
 fully_specified_type 
     : type_specifier { $$ = $1; } 
     | type_qualifier type_specifier { $$ = $2; } 
+    /* 词法分析不认识 sampler2D, 按标识符读入; 只允许出现在限定符之后, 避免与表达式语句冲突 */
+    | type_qualifier IDENTIFIER { 
+        if (strcmp($2, "sampler2D") != 0) { 
+            yyerror("unknown type name"); 
+            free($2); 
+            YYERROR; 
+        } 
+        $$ = create_type_node($2); 
+        free($2); 
+    } 
     ;
 
 type_qualifier 
@@ -140,6 +203,7 @@ type_qualifier
 
 type_specifier 
     : VOID { $$ = create_type_node("void"); } 
+    | BOOL { $$ = create_type_node("bool"); } 
     | FLOAT { $$ = create_type_node("float"); } 
     | INT { $$ = create_type_node("int"); } 
     | VEC2 { $$ = create_type_node("vec2"); } 
@@ -151,16 +215,37 @@ type_specifier
 
 statement 
     : compound_statement { $$ = $1; } 
-    | expression ';' { ASTNode* n = create_node(NODE_EXPR_STMT); n->next = $1; $$ = n; } 
+    | expression ';' { ASTNode* n = create_node(NODE_EXPR_STMT); n->data.stmt.expr = $1; $$ = n; } 
+    | IF '(' expression ')' statement %prec LOWER_THAN_ELSE { $$ = create_if_stmt($3, $5, NULL); } 
     | IF '(' expression ')' statement ELSE statement { $$ = create_if_stmt($3, $5, $7); } 
+    | WHILE '(' expression ')' statement { $$ = create_loop_stmt(NODE_WHILE_STMT, NULL, $3, NULL, $5); } 
+    | FOR '(' for_init_statement for_condition ';' for_step ')' statement { 
+        $$ = create_loop_stmt(NODE_FOR_STMT, $3, $4, $6, $8); 
+    } 
     | declaration { $$ = $1; } 
-    | RETURN expression ';' { $$ = create_node(NODE_RETURN_STMT); /* 简化处理 */ }
+    | RETURN expression ';' { $$ = create_node(NODE_RETURN_STMT); $$->data.stmt.expr = $2; }
     | RETURN ';' { $$ = create_node(NODE_RETURN_STMT); }
     ;
 
+for_init_statement 
+    : declaration { $$ = $1; } 
+    | expression ';' { ASTNode* n = create_node(NODE_EXPR_STMT); n->data.stmt.expr = $1; $$ = n; } 
+    | ';' { $$ = NULL; } 
+    ;
+
+for_condition 
+    : expression { $$ = $1; } 
+    | /* 空: 无限循环 */ { $$ = NULL; } 
+    ;
+
+for_step 
+    : expression { $$ = $1; } 
+    | /* 空 */ { $$ = NULL; } 
+    ;
+
 compound_statement 
     : '{' '}' { $$ = create_node(NODE_COMPOUND_STMT); } 
-    | '{' statement_list '}' { ASTNode* n = create_node(NODE_COMPOUND_STMT); n->next = $2; $$ = n; } 
+    | '{' statement_list '}' { ASTNode* n = create_node(NODE_COMPOUND_STMT); n->data.compound.stmts = $2; $$ = n; } 
     ;
 
 statement_list 
@@ -173,10 +258,28 @@ expression
     ;
 
 assignment_expression 
-    : additive_expression { $$ = $1; } 
-    | primary_expression '=' assignment_expression { 
+    : equality_expression { $$ = $1; } 
+    | postfix_expression '=' assignment_expression { 
         $$ = create_binary_expr(OP_ASSIGN, $1, $3); 
     } 
+    | postfix_expression ADD_ASSIGN assignment_expression { $$ = create_assign_op(OP_ADD, $1, $3); } 
+    | postfix_expression SUB_ASSIGN assignment_expression { $$ = create_assign_op(OP_SUB, $1, $3); } 
+    | postfix_expression MUL_ASSIGN assignment_expression { $$ = create_assign_op(OP_MUL, $1, $3); } 
+    | postfix_expression DIV_ASSIGN assignment_expression { $$ = create_assign_op(OP_DIV, $1, $3); } 
+    ;
+
+equality_expression 
+    : relational_expression { $$ = $1; } 
+    | equality_expression EQ_OP relational_expression { $$ = create_binary_expr(OP_EQ, $1, $3); } 
+    | equality_expression NE_OP relational_expression { $$ = create_binary_expr(OP_NE, $1, $3); } 
+    ;
+
+relational_expression 
+    : additive_expression { $$ = $1; } 
+    | relational_expression '<' additive_expression { $$ = create_binary_expr(OP_LT, $1, $3); } 
+    | relational_expression '>' additive_expression { $$ = create_binary_expr(OP_GT, $1, $3); } 
+    | relational_expression LE_OP additive_expression { $$ = create_binary_expr(OP_LE, $1, $3); } 
+    | relational_expression GE_OP additive_expression { $$ = create_binary_expr(OP_GE, $1, $3); } 
     ;
 
 additive_expression 
@@ -186,45 +289,122 @@ additive_expression
     ;
 
 multiplicative_expression 
+    : postfix_expression { $$ = $1; } 
+    | multiplicative_expression '*' postfix_expression { $$ = create_binary_expr(OP_MUL, $1, $3); } 
+    | multiplicative_expression '/' postfix_expression { $$ = create_binary_expr(OP_DIV, $1, $3); } 
+    ;
+
+/* i++ / i-- 简化为 i = i + 1 (表达式的值为自增后的值) */
+postfix_expression 
     : primary_expression { $$ = $1; } 
-    | multiplicative_expression '*' primary_expression { $$ = create_binary_expr(OP_MUL, $1, $3); } 
-    | multiplicative_expression '/' primary_expression { $$ = create_binary_expr(OP_DIV, $1, $3); } 
+    | postfix_expression INC_OP { $$ = create_assign_op(OP_ADD, $1, create_int_const(1)); } 
+    | postfix_expression DEC_OP { $$ = create_assign_op(OP_SUB, $1, create_int_const(1)); } 
     ;
 
 primary_expression 
     : IDENTIFIER { $$ = create_var_ref($1); free($1); } 
+    | IDENTIFIER '(' ')' { $$ = create_func_call($1, NULL); free($1); } 
+    | IDENTIFIER '(' argument_list ')' { $$ = create_func_call($1, $3); free($1); } 
     | INT_CONST { $$ = create_int_const($1); } 
     | FLOAT_CONST { $$ = create_float_const($1); } 
     | BOOL_CONST { $$ = create_int_const($1); }
     | '(' expression ')' { $$ = $2; }
     ;
 
+argument_list 
+    : assignment_expression { $$ = $1; } 
+    | argument_list ',' assignment_expression { $$ = append_node($1, $3); } 
+    ;
+
 %%
 
-void yyerror(const char *s) { fprintf(stderr, "Parse Error: %s line %d\n", s, yylineno); }
+void yyerror(const char *s) {
+    const char *file;
+    int line = pp_source_line(preproc, yylineno, &file);
+    fprintf(stderr, "Parse Error: %s:%d: %s\n", file, line, s);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-E] [-D NAME[=VALUE]] [-I DIR] [-S ID=VALUE] [-P fast|precise] [file.glsl]\n", prog);
+}
 
 int main(int argc, char **argv) {
-    if (argc > 1) yyin = fopen(argv[1], "r");
+    Preprocessor *pp = preproc = pp_create();
+    const char *input = NULL;
+    int preprocess_only = 0;
+    NirMathMode math_mode = NIR_MATH_PRECISE;
+
+    /* -D/-I/-S/-P 的参数可以紧跟选项, 也可以是下一个参数 */
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        if (a[0] != '-') { input = a; continue; }
+        if (a[1] == 'E' && !a[2]) { preprocess_only = 1; continue; }
+        if (!a[1] || !strchr("DISP", a[1]) || (!a[2] && i + 1 >= argc)) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char *arg = a[2] ? a + 2 : argv[++i];
+        if (a[1] == 'D') {
+            pp_define(pp, arg);
+        } else if (a[1] == 'I') {
+            pp_add_include_dir(pp, arg);
+        } else if (a[1] == 'P') {
+            /* 超越函数精度: fast 展开为多项式, precise 使用 SFU 指令 */
+            if (strcmp(arg, "fast") == 0) math_mode = NIR_MATH_FAST;
+            else if (strcmp(arg, "precise") == 0) math_mode = NIR_MATH_PRECISE;
+            else { usage(argv[0]); return 1; }
+        } else {
+            int id;
+            float value;
+            if (sscanf(arg, "%d=%f", &id, &value) != 2) { usage(argv[0]); return 1; }
+            nir_set_spec_constant(id, value);
+        }
+    }
+
+    char *source = pp_process_file(pp, input);
+    if (!source) return 1;
+    if (preprocess_only) {
+        fputs(source, stdout);
+        return 0;
+    }
+    printf("0. Preprocessing Successful! (#version %d)\n", pp->version);
+    if (!*source) source = "\n";
+    yyin = fmemopen(source, strlen(source), "r");
+
     if (yyparse() == 0) {
         printf("1. Parsing Successful!\n");
         
         semantic_analysis(root);
         
-        printf("2. Linking...\n");
         LinkerProgram *lp = linker_create(); 
         linker_add(lp, root); 
-        linker_link(lp); 
-        linker_print(lp);
         
-        printf("3. NIR Generation...\n");
+        printf("2. NIR Generation...\n");
         NirShader *ns = generate_ssa_nir(root);
-        
-        if (ns) {
+        if (!ns) return 1;
+
+        {
+            int nlow = nir_lower_transcendentals(ns, math_mode);
+            if (nlow) printf("  Lowered %d transcendental op(s) to polynomials\n", nlow);
+            if (nir_optimize(ns) < 0) return 1;
+            int ndiv = nir_divergence_analysis(ns);
+            printf("  Divergence: %d divergent value(s)\n", ndiv);
+            nir_print_shader(ns);
+
+
+            printf("3. Linking...\n");
+            int n = linker_strip_unused(lp, ns);
+            printf("  %d unused resource(s) stripped\n", n);
+            if (!linker_link(lp)) return 1;
+            linker_print(lp);
+
             printf("4. Backend CodeGen...\n");
             MachineCode *mc = create_code_buffer();
-            compile_nir_to_machine(ns, lp, mc);
+            if (compile_nir_to_machine(ns, lp, mc) < 0) return 1;
+            pisa_peephole(mc);
             dump_binary(mc, "shader.bin");
         }
+        return 0;
     }
-    return 0;
+    return 1;
 }
\ No newline at end of file
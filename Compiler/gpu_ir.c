@@ -8,9 +8,37 @@ NirShader* nir_create_shader() {
     s->num_ssa_defs = 0;
     s->num_blocks = 0;
     s->start_block = NULL;
+    s->functions = NULL;
+    s->entry = NULL;
+    s->impl = NULL;
+    s->spec_consts = NULL;
     return s;
 }
 
+NirFunction* nir_create_function(NirShader *shader, const char *name) {
+    NirFunction *fn = (NirFunction*)calloc(1, sizeof(NirFunction));
+    fn->name = strdup(name);
+
+    NirFunction **tail = &shader->functions;
+    while (*tail) tail = &(*tail)->next;
+    *tail = fn;
+    return fn;
+}
+
+NirFunction* nir_find_function(NirShader *shader, const char *name) {
+    for (NirFunction *fn = shader->functions; fn; fn = fn->next)
+        if (strcmp(fn->name, name) == 0) return fn;
+    return NULL;
+}
+
+/* 记录函数内声明的局部变量名 (去重) */
+void nir_function_add_local(NirFunction *fn, const char *name) {
+    for (int i = 0; i < fn->num_locals; i++)
+        if (strcmp(fn->locals[i], name) == 0) return;
+    fn->locals = (char**)realloc(fn->locals, sizeof(char*) * (fn->num_locals + 1));
+    fn->locals[fn->num_locals++] = strdup(name);
+}
+
 NirBlock* nir_create_block(NirShader *shader) {
     NirBlock *b = (NirBlock*)malloc(sizeof(NirBlock));
     b->index = shader->num_blocks++;
@@ -20,17 +48,36 @@ NirBlock* nir_create_block(NirShader *shader) {
     b->successors[1] = NULL;
     b->next_block = NULL;
     
-    // 简单的链表插入，维护块的线性顺序
-    if (shader->start_block == NULL) {
-        shader->start_block = b;
+    // 简单的链表插入，维护块的线性顺序 (挂到正在构建的函数下)
+    NirBlock **head = shader->impl ? &shader->impl->start_block : &shader->start_block;
+    if (*head == NULL) {
+        *head = b;
     } else {
-        NirBlock *curr = shader->start_block;
+        NirBlock *curr = *head;
         while(curr->next_block) curr = curr->next_block;
         curr->next_block = b;
     }
     return b;
 }
 
+/* 在线性布局中 after 之后插入一个新块 */
+NirBlock* nir_insert_block_after(NirShader *shader, NirBlock *after) {
+    NirBlock *b = (NirBlock*)calloc(1, sizeof(NirBlock));
+    b->index = shader->num_blocks++;
+    b->next_block = after->next_block;
+    after->next_block = b;
+    return b;
+}
+
+/* 按线性布局重新编号所有块 */
+void nir_index_blocks(NirShader *shader) {
+    unsigned idx = 0;
+    for (NirFunction *fn = shader->functions; fn; fn = fn->next)
+        for (NirBlock *b = fn->start_block; b; b = b->next_block)
+            b->index = idx++;
+    shader->num_blocks = idx;
+}
+
 /* 将指令追加到块末尾 */
 void block_append_instr(NirBlock *block, NirInstr *instr) {
     instr->block = block;
@@ -44,11 +91,33 @@ void block_append_instr(NirBlock *block, NirInstr *instr) {
     block->end = instr;
 }
 
+/* 将指令从所属块中摘除 */
+void nir_instr_remove(NirInstr *instr) {
+    NirBlock *block = instr->block;
+    if (instr->prev) instr->prev->next = instr->next;
+    else block->start = instr->next;
+    if (instr->next) instr->next->prev = instr->prev;
+    else block->end = instr->prev;
+    instr->prev = instr->next = NULL;
+}
+
+/* 将 (已摘除的) 指令插入到 pos 之前 */
+void nir_instr_insert_before(NirInstr *pos, NirInstr *instr) {
+    NirBlock *block = pos->block;
+    instr->block = block;
+    instr->next = pos;
+    instr->prev = pos->prev;
+    if (pos->prev) pos->prev->next = instr;
+    else block->start = instr;
+    pos->prev = instr;
+}
+
 /* 初始化 SSA 定义 */
 void nir_def_init(NirShader *shader, NirInstr *instr, int num_comp) {
     instr->def.index = ++shader->num_ssa_defs;
     instr->def.num_components = num_comp;
     instr->def.bit_size = 32;
+    instr->def.divergent = false;
     instr->def.parent_instr = instr;
 }
 
@@ -79,6 +148,28 @@ NirInstr* nir_build_alu(NirShader *shader, NirBlock *block, NirOp op, NirDef *sr
     return instr;
 }
 
+/* 构建选择指令 cond ? a : b */
+NirInstr* nir_build_bcsel(NirShader *shader, NirBlock *block, NirDef *cond, NirDef *a, NirDef *b) {
+    NirInstr *instr = nir_build_alu(shader, block, nir_op_bcsel, cond, a);
+    instr->num_srcs = 3;
+    instr->srcs[2].ssa = b;
+    for (int i = 0; i < 4; i++) instr->srcs[2].swizzle[i] = i;
+    instr->def.num_components = a->num_components;
+    return instr;
+}
+
+/* 构建立即数 */
+NirInstr* nir_build_const(NirShader *shader, NirBlock *block, float value) {
+    NirInstr *instr = (NirInstr*)malloc(sizeof(NirInstr));
+    memset(instr, 0, sizeof(NirInstr));
+    instr->op = nir_load_const;
+    instr->const_value = value;
+
+    nir_def_init(shader, instr, 1);
+    block_append_instr(block, instr);
+    return instr;
+}
+
 /* 构建 Load 变量 */
 NirInstr* nir_build_load(NirShader *shader, NirBlock *block, char *var_name, int num_comp) {
     NirInstr *instr = (NirInstr*)malloc(sizeof(NirInstr));
@@ -110,6 +201,24 @@ void nir_build_store(NirShader *shader, NirBlock *block, char *var_name, NirDef
     block_append_instr(block, instr);
 }
 
+/* 构建纹理采样, 结果为一个分量 */
+NirInstr* nir_build_tex(NirShader *shader, NirBlock *block, char *sampler, NirDef *u, NirDef *v, int comp) {
+    NirInstr *instr = (NirInstr*)malloc(sizeof(NirInstr));
+    memset(instr, 0, sizeof(NirInstr));
+    instr->op = nir_intrinsic_tex;
+    instr->var_name = strdup(sampler);
+    instr->write_mask = 1 << comp;
+
+    instr->num_srcs = 2;
+    instr->srcs[0].ssa = u;
+    instr->srcs[1].ssa = v;
+    for (int i = 0; i < 4; i++) instr->srcs[0].swizzle[i] = instr->srcs[1].swizzle[i] = i;
+
+    nir_def_init(shader, instr, 1);
+    block_append_instr(block, instr);
+    return instr;
+}
+
 void nir_build_branch(NirBlock *from, NirDef *cond, NirBlock *then_block, NirBlock *else_block) {
     NirInstr *instr = (NirInstr*)malloc(sizeof(NirInstr));
     memset(instr, 0, sizeof(NirInstr));
@@ -134,16 +243,60 @@ void nir_build_jump(NirBlock *from, NirBlock *to) {
     block_append_instr(from, instr);
 }
 
+/* 构建函数调用, 返回值作为调用指令的 def */
+NirInstr* nir_build_call(NirShader *shader, NirBlock *block, NirFunction *callee, NirDef **args, int num_args) {
+    NirInstr *instr = (NirInstr*)malloc(sizeof(NirInstr));
+    memset(instr, 0, sizeof(NirInstr));
+    instr->op = nir_call;
+    instr->callee = callee;
+
+    for (int a = 0; a < num_args && a < NIR_MAX_PARAMS; a++) {
+        instr->srcs[a].ssa = args[a];
+        for (int i = 0; i < 4; i++) instr->srcs[a].swizzle[i] = i;
+        instr->num_srcs++;
+    }
+
+    nir_def_init(shader, instr, 1);
+    block_append_instr(block, instr);
+    return instr;
+}
+
+void nir_build_return(NirBlock *block, NirDef *value) {
+    NirInstr *instr = (NirInstr*)malloc(sizeof(NirInstr));
+    memset(instr, 0, sizeof(NirInstr));
+    instr->op = nir_return;
+    if (value) {
+        instr->num_srcs = 1;
+        instr->srcs[0].ssa = value;
+        for (int i = 0; i < 4; i++) instr->srcs[0].swizzle[i] = i;
+    }
+    block_append_instr(block, instr);
+}
+
 /* --- 打印逻辑 --- */
 const char* nir_op_name(NirOp op) {
     switch(op) {
         case nir_op_fadd: return "fadd";
+        case nir_op_fsub: return "fsub";
         case nir_op_fmul: return "fmul";
+        case nir_op_fdiv: return "fdiv";
+        case nir_op_fsin: return "fsin";
+        case nir_op_fcos: return "fcos";
+        case nir_op_frcp: return "frcp";
+        case nir_op_flt:  return "flt";
+        case nir_op_fge:  return "fge";
+        case nir_op_feq:  return "feq";
+        case nir_op_fne:  return "fne";
+        case nir_op_bcsel: return "bcsel";
         case nir_op_mov:  return "mov";
+        case nir_load_const: return "load_const";
         case nir_intrinsic_load_var: return "load_var";
         case nir_intrinsic_store_var: return "store_var";
+        case nir_intrinsic_tex: return "tex";
         case nir_branch: return "br";
         case nir_jump: return "jump";
+        case nir_call: return "call";
+        case nir_return: return "return";
         default: return "unknown";
     }
 }
@@ -158,11 +311,20 @@ void nir_print_instr(NirInstr *instr) {
     printf("    ");
     if (instr->def.index != 0) {
         // 打印结果: %1 (vec3) = ...
-        printf("%%ssa_%d (v%d) = ", instr->def.index, instr->def.num_components);
+        printf("%%ssa_%d (v%d%s) = ", instr->def.index, instr->def.num_components,
+               instr->def.divergent ? " div" : "");
     }
     
     printf("%s ", nir_op_name(instr->op));
     
+    if (instr->op == nir_call && instr->callee) {
+        printf("%s ", instr->callee->name);
+    }
+
+    if (instr->op == nir_load_const) {
+        printf("%g ", instr->const_value);
+    }
+
     if (instr->var_name) {
         printf("%s ", instr->var_name);
         if (instr->write_mask) printf("(mask:0x%x) ", instr->write_mask);
@@ -184,9 +346,7 @@ void nir_print_instr(NirInstr *instr) {
     }
 }
 
-void nir_print_shader(NirShader *shader) {
-    printf("\n=== NIR SSA IR ===\n");
-    NirBlock *curr = shader->start_block;
+static void nir_print_blocks(NirBlock *curr) {
     while (curr) {
         printf("Block B%d:\n", curr->index);
         NirInstr *instr = curr->start;
@@ -196,5 +356,22 @@ void nir_print_shader(NirShader *shader) {
         }
         curr = curr->next_block;
     }
+}
+
+void nir_print_shader(NirShader *shader) {
+    printf("\n=== NIR SSA IR ===\n");
+    for (NirSpecConst *sc = shader->spec_consts; sc; sc = sc->next) {
+        printf("spec_const %d: %s = %g%s\n", sc->id, sc->name, sc->value,
+               sc->overridden ? " (overridden)" : "");
+    }
+    if (!shader->functions) {
+        nir_print_blocks(shader->start_block);
+    }
+    for (NirFunction *fn = shader->functions; fn; fn = fn->next) {
+        printf("function %s(", fn->name);
+        for (int i = 0; i < fn->num_params; i++) printf(i ? ", %s" : "%s", fn->params[i]);
+        printf("):\n");
+        nir_print_blocks(fn->start_block);
+    }
     printf("==================\n");
 }
\ No newline at end of file
@@ -12,18 +12,31 @@ typedef enum {
     nir_op_iadd, nir_op_isub, nir_op_imul,
     nir_op_fmax, nir_op_fmin,
     nir_op_fsin, nir_op_fcos,
+    nir_op_frcp,    /* 1 / x: fdiv 降级为 fmul(a, frcp(b)) */
+
+    /* 比较 (结果为布尔) */
+    nir_op_flt, nir_op_fge, nir_op_feq, nir_op_fne,
+
+    /* 选择: srcs[0] ? srcs[1] : srcs[2] (由 if-conversion 生成) */
+    nir_op_bcsel,
     
     /* 移动与修饰 */
     nir_op_mov,
+    nir_load_const, /* 立即数: 值在 const_value 中 */
     nir_op_vec2, nir_op_vec3, nir_op_vec4, /* 构造向量 */
 
     /* 内存/变量操作 (Intrinsic) */
     nir_intrinsic_load_var,
     nir_intrinsic_store_var,
+    /* 纹理采样: var_name 为 sampler, srcs[0] / srcs[1] 为 u / v,
+     * write_mask 的单个位选择返回的分量 (rgba) */
+    nir_intrinsic_tex,
     
     /* 控制流 */
     nir_jump,
-    nir_branch /* 条件跳转 */
+    nir_branch, /* 条件跳转 */
+    nir_call,   /* 函数调用: srcs 为实参, def 为返回值 */
+    nir_return  /* 函数返回: 可选 srcs[0] 为返回值 */
 } NirOp;
 
 /* SSA 定义 (Definition)
@@ -33,6 +46,7 @@ typedef struct NirDef {
     unsigned index;         // 全局唯一的 SSA ID (例如 %1, %2)
     uint8_t num_components; // 向量分量数 (1=scalar, 3=vec3)
     uint8_t bit_size;       // 位宽 (32 for float/int)
+    bool divergent;         // 各 lane 的值可能不同 (由发散分析设置)
     
     // 简单的链表用于以后做 Use-Def 链分析
     struct NirInstr *parent_instr; 
@@ -76,6 +90,12 @@ typedef struct NirInstr {
 
     /* 对于 Load/Store 指令，需要指向变量名 */
     char *var_name;
+
+    /* 对于 Call 指令，指向被调函数 */
+    struct NirFunction *callee;
+
+    /* 对于 load_const 指令，常量值 (比较结果用 1.0 / 0.0 表示真假) */
+    float const_value;
 } NirInstr;
 
 /* 基本块 (Basic Block)
@@ -93,22 +113,91 @@ typedef struct NirBlock {
     struct NirBlock *next_block; // 线性布局的下一个块 (用于打印顺序)
 } NirBlock;
 
-/* 函数 / Shader */
-typedef struct NirShader {
+/* 调用的实参个数上限 (受 NirInstr::srcs 大小限制) */
+#define NIR_MAX_PARAMS 4
+
+/* 函数 */
+typedef struct NirFunction {
+    char *name;
     NirBlock *start_block;
+    int num_params;
+    char *params[NIR_MAX_PARAMS]; // 形参变量名
+    int num_locals;
+    char **locals;                // 局部变量名 (内联时需要重命名)
+    bool has_return_value;
+    struct NirFunction *next;
+} NirFunction;
+
+/* 特化常量: layout(constant_id = N) const T name = default;
+ * 生成 NIR 时每次引用都替换为 load_const, 值可在编译时覆盖。
+ */
+#define NIR_MAX_SPEC_OVERRIDES 64
+
+typedef struct NirSpecConst {
+    int id;
+    char *name;
+    float value;
+    bool overridden;
+    struct NirSpecConst *next;
+} NirSpecConst;
+
+/* Shader */
+typedef struct NirShader {
+    NirBlock *start_block; // 入口函数 main 的第一个块
     unsigned num_ssa_defs; // 计数器，用于生成唯一 ID
     unsigned num_blocks;
+    NirFunction *functions; // 所有函数 (含 main)
+    NirFunction *entry;     // main
+    NirFunction *impl;      // 正在构建的函数, 新建的块挂在它下面
+    NirSpecConst *spec_consts;
 } NirShader;
 
 /* --- API --- */
 NirShader* nir_create_shader();
+NirFunction* nir_create_function(NirShader *shader, const char *name);
+NirFunction* nir_find_function(NirShader *shader, const char *name);
+void nir_function_add_local(NirFunction *fn, const char *name);
 NirBlock* nir_create_block(NirShader *shader);
+NirBlock* nir_insert_block_after(NirShader *shader, NirBlock *after);
+void nir_index_blocks(NirShader *shader);
+void block_append_instr(NirBlock *block, NirInstr *instr);
+void nir_def_init(NirShader *shader, NirInstr *instr, int num_comp);
+void nir_instr_remove(NirInstr *instr);
+void nir_instr_insert_before(NirInstr *pos, NirInstr *instr);
 NirInstr* nir_build_alu(NirShader *shader, NirBlock *block, NirOp op, NirDef *src0, NirDef *src1);
+NirInstr* nir_build_bcsel(NirShader *shader, NirBlock *block, NirDef *cond, NirDef *a, NirDef *b);
+NirInstr* nir_build_const(NirShader *shader, NirBlock *block, float value);
 NirInstr* nir_build_load(NirShader *shader, NirBlock *block, char *var_name, int num_comp);
 void nir_build_store(NirShader *shader, NirBlock *block, char *var_name, NirDef *value, uint8_t mask);
+NirInstr* nir_build_tex(NirShader *shader, NirBlock *block, char *sampler, NirDef *u, NirDef *v, int comp);
 void nir_build_jump(NirBlock *from, NirBlock *to);
 void nir_build_branch(NirBlock *from, NirDef *cond, NirBlock *then_block, NirBlock *else_block);
+NirInstr* nir_build_call(NirShader *shader, NirBlock *block, NirFunction *callee, NirDef **args, int num_args);
+void nir_build_return(NirBlock *block, NirDef *value);
+
+/* 编译时覆盖特化常量的默认值 (在 generate_ssa_nir 之前调用) */
+void nir_set_spec_constant(int id, float value);
 
+/* 超越函数 (fsin / fcos) 的精度模式 */
+typedef enum {
+    NIR_MATH_PRECISE,   /* 保留为 SFU 指令 V_SIN / V_COS */
+    NIR_MATH_FAST       /* 展开为范围归约 + 多项式, 只用 ALU 指令 */
+} NirMathMode;
+
+/* --- 优化 Pass (返回值为改动的数量) --- */
+int nir_lower_transcendentals(NirShader *shader, NirMathMode mode);
+int nir_inline_functions(NirShader *shader);
+int nir_opt_cleanup_cfg(NirFunction *fn);
+int nir_opt_copy_prop_vars(NirFunction *fn);
+int nir_opt_constant_folding(NirFunction *fn);
+int nir_opt_if_convert(NirShader *shader, NirFunction *fn);
+int nir_opt_dce(NirFunction *fn);
+int nir_optimize(NirShader *shader);
+
+/* --- 分析 --- */
+int nir_divergence_analysis(NirShader *shader);
+
+const char* nir_op_name(NirOp op);
 void nir_print_shader(NirShader *shader);
 
 #endif
\ No newline at end of file
@@ -7,20 +7,34 @@ LinkerProgram* linker_create() {
     return (LinkerProgram*)calloc(1, sizeof(LinkerProgram));
 }
 
+/* FNV-1a 字符串哈希 */
+static unsigned linker_hash(const char *s) {
+    unsigned h = 2166136261u;
+    while (*s) { h ^= (unsigned char)*s++; h *= 16777619u; }
+    return h & (LINKER_HASH_SIZE - 1);
+}
+
 void collect(LinkerProgram *p, ASTNode *n) {
     if (!n) return;
     if (n->type == NODE_VAR_DECL) {
         char *name = n->data.var_decl.name;
         ResType t = -1;
-        if (strncmp(name, "u_", 2) == 0) t = RES_UNIFORM;
+        if (n->data_type == DT_SAMPLER2D) t = RES_SAMPLER;
+        else if (strncmp(name, "u_", 2) == 0) t = RES_UNIFORM;
         else if (strncmp(name, "v_", 2) == 0) t = RES_ATTR;
         
-        if (t != -1) {
+        if (t != -1 && !linker_find(p, name)) {
             LinkerRes *r = (LinkerRes*)calloc(1, sizeof(LinkerRes));
-            strcpy(r->name, name); 
+            unsigned h = linker_hash(name);
+            strncpy(r->name, name, sizeof(r->name) - 1); 
             r->type = t; 
-            r->next = p->resources; 
-            p->resources = r;
+            r->dtype = n->data_type;
+            /* 按声明顺序追加, std140 布局依赖声明顺序 */
+            LinkerRes **tail = &p->resources;
+            while (*tail) tail = &(*tail)->next;
+            *tail = r;
+            r->hash_next = p->buckets[h];
+            p->buckets[h] = r;
         }
     }
 }
@@ -30,28 +44,109 @@ void linker_add(LinkerProgram *p, ASTNode *root) {
     while (c) { collect(p, c); c = c->next; }
 }
 
+/* 从哈希桶中摘除资源 */
+static void linker_unhash(LinkerProgram *p, LinkerRes *r) {
+    LinkerRes **pp = &p->buckets[linker_hash(r->name)];
+    while (*pp) {
+        if (*pp == r) { *pp = r->hash_next; return; }
+        pp = &(*pp)->hash_next;
+    }
+}
+
+/*
+ * 死资源剥离: 在 NIR 生成之后、linker_link 分配槽位之前运行。
+ * 没有任何指令引用的 uniform / attribute 不占用常量空间和寄存器。
+ * 返回被剥离的资源数。
+ */
+int linker_strip_unused(LinkerProgram *p, NirShader *s) {
+    int stripped = 0;
+
+    for (NirFunction *fn = s->functions; fn; fn = fn->next) {
+        for (NirBlock *b = fn->start_block; b; b = b->next_block) {
+            for (NirInstr *i = b->start; i; i = i->next) {
+                if (!i->var_name) continue;
+                LinkerRes *r = linker_find(p, i->var_name);
+                if (r) r->used = 1;
+            }
+        }
+    }
+
+    LinkerRes **pp = &p->resources;
+    while (*pp) {
+        LinkerRes *r = *pp;
+        if (!r->used) {
+            *pp = r->next;
+            linker_unhash(p, r);
+            printf("  Strip unused resource '%s'\n", r->name);
+            free(r);
+            stripped++;
+        } else {
+            pp = &r->next;
+        }
+    }
+    return stripped;
+}
+
+/*
+ * std140 基本对齐规则:
+ *   float/int/bool : 大小 4,  对齐 4
+ *   vec2           : 大小 8,  对齐 8
+ *   vec3           : 大小 12, 对齐 16 (尾部 4 字节可以被后面的标量复用)
+ *   vec4 及未知类型 : 大小 16, 对齐 16
+ */
+static void linker_type_layout(DataType dt, int *size, int *align) {
+    switch (dt) {
+        case DT_INT:
+        case DT_FLOAT:
+        case DT_BOOL: *size = 4;  *align = 4;  break;
+        case DT_VEC2: *size = 8;  *align = 8;  break;
+        case DT_VEC3: *size = 12; *align = 16; break;
+        default:      *size = 16; *align = 16; break;
+    }
+}
+
 int linker_link(LinkerProgram *p) {
-    int off = 0, vgpr = 0;
+    int off = 0, vgpr = 0, slot = 0;
+    int size, align;
     LinkerRes *r = p->resources;
     while (r) { 
         if (r->type == RES_ATTR) { 
             r->phys_reg = vgpr++; 
             r->offset = -1; 
+        } else if (r->type == RES_SAMPLER) {
+            /* sampler 不占常量块, 按声明顺序分配描述符槽 */
+            r->tex_slot = slot++;
+            r->offset = -1;
+            r->phys_reg = -1;
         } else { 
+            linker_type_layout(r->dtype, &size, &align);
+            off = (off + align - 1) & ~(align - 1);
             r->offset = off; 
-            off += 16; 
+            r->size = size;
+            off += size; 
             r->phys_reg = -1; 
         } 
         r = r->next; 
     }
+    p->uniform_size = off;
+    p->num_samplers = slot;
+    if (slot > LINKER_MAX_SAMPLERS) {
+        fprintf(stderr, "Link Error: %d samplers, limit is %d\n", slot, LINKER_MAX_SAMPLERS);
+        return 0;
+    }
+    if (off > LINKER_MAX_UNIFORM_BYTES) {
+        fprintf(stderr, "Link Error: uniform block is %d bytes, limit is %d\n",
+                off, LINKER_MAX_UNIFORM_BYTES);
+        return 0;
+    }
     return 1;
 }
 
 LinkerRes* linker_find(LinkerProgram *p, const char *n) {
-    LinkerRes *r = p->resources;
+    LinkerRes *r = p->buckets[linker_hash(n)];
     while (r) { 
         if (!strcmp(r->name, n)) return r; 
-        r = r->next; 
+        r = r->hash_next; 
     }
     return NULL;
 }
@@ -60,8 +155,10 @@ void linker_print(LinkerProgram *p) {
     printf("\n=== Linker Layout ===\n");
     LinkerRes *r = p->resources;
     while (r) { 
-        printf("Res %s: Off %d Reg %d\n", r->name, r->offset, r->phys_reg); 
+        if (r->type == RES_SAMPLER) printf("Res %s: Tex %d\n", r->name, r->tex_slot);
+        else printf("Res %s: Off %d Reg %d\n", r->name, r->offset, r->phys_reg); 
         r = r->next; 
     }
+    printf("Uniform block: %d bytes\n", p->uniform_size);
     printf("=====================\n");
-}
\ No newline at end of file
+}
@@ -2,26 +2,45 @@
 #define GPU_LINKER_H
 
 #include "ast.h"
+#include "gpu_ir.h"
 
-typedef enum { RES_ATTR, RES_UNIFORM } ResType;
+/* 资源哈希表桶数 (2 的幂, 便于取模) */
+#define LINKER_HASH_SIZE 64
+
+/* 常量块上限: S_LOAD 的偏移字段只有 8 位 (字节) */
+#define LINKER_MAX_UNIFORM_BYTES 256
+
+/* sampler 绑定到纹理单元的描述符槽, 槽数与模拟器一致 */
+#define LINKER_MAX_SAMPLERS 4
+
+typedef enum { RES_ATTR, RES_UNIFORM, RES_SAMPLER } ResType;
 
 typedef struct LinkerRes {
     char name[64];
     ResType type;
+    DataType dtype;
+    int size;                     /* 常量块中占用的字节数 */
     int offset;
     int phys_reg;
-    struct LinkerRes *next;
+    int tex_slot;                 /* sampler 的纹理描述符槽 */
+    int used;                     /* NIR 中是否有指令引用该资源 */
+    struct LinkerRes *next;       /* 声明顺序链表 */
+    struct LinkerRes *hash_next;  /* 同一哈希桶中的下一个资源 */
 } LinkerRes;
 
 /* 必须定义这个结构体，glsl.y 才能识别 LinkerProgram 类型 */
 typedef struct LinkerProgram {
     LinkerRes *resources;
+    LinkerRes *buckets[LINKER_HASH_SIZE];
+    int uniform_size;             /* 打包后常量块的总字节数 */
+    int num_samplers;
 } LinkerProgram;
 
 LinkerProgram* linker_create();
 void linker_add(LinkerProgram *p, ASTNode *root);
+int linker_strip_unused(LinkerProgram *p, NirShader *s);
 int linker_link(LinkerProgram *p);
 LinkerRes* linker_find(LinkerProgram *p, const char *name);
 void linker_print(LinkerProgram *p);
 
-#endif
\ No newline at end of file
+#endif
@@ -620,6 +620,8 @@ char *yytext;
 #include <string.h>
 #include "ast.h"    /* 引用 AST 定义 */
 #include "glsl.tab.h"  /* 引用 Bison 生成的 Token 定义 */
+#include "preprocess.h"
+extern Preprocessor *preproc;  /* 报错时把输出行号映射回源文件 */
 
 /* 维护行列号 */
 int current_column = 1;
@@ -865,10 +867,10 @@ YY_DECL
 		}
 
 	{
-#line 44 "glsl.l"
+#line 46 "glsl.l"
 
 
-#line 47 "glsl.l"
+#line 49 "glsl.l"
     /* --- 空白与注释 --- */
 #line 873 "lex.yy.c"
 
@@ -940,350 +942,350 @@ do_action:	/* This label is used only to access EOF actions. */
 
 case 1:
 YY_RULE_SETUP
-#line 48 "glsl.l"
+#line 50 "glsl.l"
 { /* 忽略空白 */ }
 	YY_BREAK
 case 2:
 /* rule 2 can match eol */
 YY_RULE_SETUP
-#line 49 "glsl.l"
+#line 51 "glsl.l"
 { current_column = 1; } /* 换行重置列号 */
 	YY_BREAK
 case 3:
 YY_RULE_SETUP
-#line 50 "glsl.l"
+#line 52 "glsl.l"
 { /* 忽略单行注释 */ }
 	YY_BREAK
 /* --- 预处理指令 (简化处理：忽略) --- */
 case 4:
 YY_RULE_SETUP
-#line 53 "glsl.l"
+#line 55 "glsl.l"
 { /* ignore */ }
 	YY_BREAK
 case 5:
 YY_RULE_SETUP
-#line 54 "glsl.l"
+#line 56 "glsl.l"
 { /* ignore */ }
 	YY_BREAK
 case 6:
 YY_RULE_SETUP
-#line 55 "glsl.l"
+#line 57 "glsl.l"
 { /* ignore */ }
 	YY_BREAK
 /* --- 关键字：基本类型 --- */
 case 7:
 YY_RULE_SETUP
-#line 58 "glsl.l"
+#line 60 "glsl.l"
 { return VOID; }
 	YY_BREAK
 case 8:
 YY_RULE_SETUP
-#line 59 "glsl.l"
+#line 61 "glsl.l"
 { return BOOL; }
 	YY_BREAK
 case 9:
 YY_RULE_SETUP
-#line 60 "glsl.l"
+#line 62 "glsl.l"
 { return INT; }
 	YY_BREAK
 case 10:
 YY_RULE_SETUP
-#line 61 "glsl.l"
+#line 63 "glsl.l"
 { return UINT; }
 	YY_BREAK
 case 11:
 YY_RULE_SETUP
-#line 62 "glsl.l"
+#line 64 "glsl.l"
 { return FLOAT; }
 	YY_BREAK
 case 12:
 YY_RULE_SETUP
-#line 63 "glsl.l"
+#line 65 "glsl.l"
 { return DOUBLE; }
 	YY_BREAK
 case 13:
 YY_RULE_SETUP
-#line 64 "glsl.l"
+#line 66 "glsl.l"
 { return VEC2; }
 	YY_BREAK
 case 14:
 YY_RULE_SETUP
-#line 65 "glsl.l"
+#line 67 "glsl.l"
 { return VEC3; }
 	YY_BREAK
 case 15:
 YY_RULE_SETUP
-#line 66 "glsl.l"
+#line 68 "glsl.l"
 { return VEC4; }
 	YY_BREAK
 case 16:
 YY_RULE_SETUP
-#line 67 "glsl.l"
+#line 69 "glsl.l"
 { return IVEC2; }
 	YY_BREAK
 case 17:
 YY_RULE_SETUP
-#line 68 "glsl.l"
+#line 70 "glsl.l"
 { return IVEC3; }
 	YY_BREAK
 case 18:
 YY_RULE_SETUP
-#line 69 "glsl.l"
+#line 71 "glsl.l"
 { return IVEC4; }
 	YY_BREAK
 case 19:
 YY_RULE_SETUP
-#line 70 "glsl.l"
+#line 72 "glsl.l"
 { return MAT3; }
 	YY_BREAK
 case 20:
 YY_RULE_SETUP
-#line 71 "glsl.l"
+#line 73 "glsl.l"
 { return MAT4; }
 	YY_BREAK
 case 21:
 YY_RULE_SETUP
-#line 72 "glsl.l"
+#line 74 "glsl.l"
 { return STRUCT; }
 	YY_BREAK
 /* --- 关键字：限定符 --- */
 case 22:
 YY_RULE_SETUP
-#line 75 "glsl.l"
+#line 77 "glsl.l"
 { return IN; }
 	YY_BREAK
 case 23:
 YY_RULE_SETUP
-#line 76 "glsl.l"
+#line 78 "glsl.l"
 { return OUT; }
 	YY_BREAK
 case 24:
 YY_RULE_SETUP
-#line 77 "glsl.l"
+#line 79 "glsl.l"
 { return INOUT; }
 	YY_BREAK
 case 25:
 YY_RULE_SETUP
-#line 78 "glsl.l"
+#line 80 "glsl.l"
 { return UNIFORM; }
 	YY_BREAK
 case 26:
 YY_RULE_SETUP
-#line 79 "glsl.l"
+#line 81 "glsl.l"
 { return CONST; }
 	YY_BREAK
 case 27:
 YY_RULE_SETUP
-#line 80 "glsl.l"
+#line 82 "glsl.l"
 { return LAYOUT; }
 	YY_BREAK
 /* --- 关键字：控制流 --- */
 case 28:
 YY_RULE_SETUP
-#line 83 "glsl.l"
+#line 85 "glsl.l"
 { return IF; }
 	YY_BREAK
 case 29:
 YY_RULE_SETUP
-#line 84 "glsl.l"
+#line 86 "glsl.l"
 { return ELSE; }
 	YY_BREAK
 case 30:
 YY_RULE_SETUP
-#line 85 "glsl.l"
+#line 87 "glsl.l"
 { return WHILE; }
 	YY_BREAK
 case 31:
 YY_RULE_SETUP
-#line 86 "glsl.l"
+#line 88 "glsl.l"
 { return FOR; }
 	YY_BREAK
 case 32:
 YY_RULE_SETUP
-#line 87 "glsl.l"
+#line 89 "glsl.l"
 { return RETURN; }
 	YY_BREAK
 case 33:
 YY_RULE_SETUP
-#line 88 "glsl.l"
+#line 90 "glsl.l"
 { return DISCARD; }
 	YY_BREAK
 /* --- 字面量 --- */
 case 34:
 YY_RULE_SETUP
-#line 91 "glsl.l"
+#line 93 "glsl.l"
 { yylval.ival = 1; return BOOL_CONST; }
 	YY_BREAK
 case 35:
 YY_RULE_SETUP
-#line 92 "glsl.l"
+#line 94 "glsl.l"
 { yylval.ival = 0; return BOOL_CONST; }
 	YY_BREAK
 case 36:
 YY_RULE_SETUP
-#line 94 "glsl.l"
+#line 96 "glsl.l"
 { yylval.fval = strtof(yytext, NULL); return FLOAT_CONST; }
 	YY_BREAK
 case 37:
 YY_RULE_SETUP
-#line 95 "glsl.l"
+#line 97 "glsl.l"
 { yylval.ival = (int)strtol(yytext, NULL, 0); return INT_CONST; }
 	YY_BREAK
 case 38:
 YY_RULE_SETUP
-#line 96 "glsl.l"
+#line 98 "glsl.l"
 { yylval.ival = (int)strtol(yytext, NULL, 16); return INT_CONST; }
 	YY_BREAK
 /* --- 运算符 --- */
 case 39:
 YY_RULE_SETUP
-#line 99 "glsl.l"
+#line 101 "glsl.l"
 { return INC_OP; }
 	YY_BREAK
 case 40:
 YY_RULE_SETUP
-#line 100 "glsl.l"
+#line 102 "glsl.l"
 { return DEC_OP; }
 	YY_BREAK
 case 41:
 YY_RULE_SETUP
-#line 101 "glsl.l"
+#line 103 "glsl.l"
 { return LE_OP; }
 	YY_BREAK
 case 42:
 YY_RULE_SETUP
-#line 102 "glsl.l"
+#line 104 "glsl.l"
 { return GE_OP; }
 	YY_BREAK
 case 43:
 YY_RULE_SETUP
-#line 103 "glsl.l"
+#line 105 "glsl.l"
 { return EQ_OP; }
 	YY_BREAK
 case 44:
 YY_RULE_SETUP
-#line 104 "glsl.l"
+#line 106 "glsl.l"
 { return NE_OP; }
 	YY_BREAK
 case 45:
 YY_RULE_SETUP
-#line 105 "glsl.l"
+#line 107 "glsl.l"
 { return '>'; }
 	YY_BREAK
 case 46:
 YY_RULE_SETUP
-#line 106 "glsl.l"
+#line 108 "glsl.l"
 { return '<'; }
 	YY_BREAK
 case 47:
 YY_RULE_SETUP
-#line 107 "glsl.l"
+#line 109 "glsl.l"
 { return '!'; }
 	YY_BREAK
 case 48:
 YY_RULE_SETUP
-#line 108 "glsl.l"
+#line 110 "glsl.l"
 { return AND_OP; }
 	YY_BREAK
 case 49:
 YY_RULE_SETUP
-#line 109 "glsl.l"
+#line 111 "glsl.l"
 { return OR_OP; }
 	YY_BREAK
 case 50:
 YY_RULE_SETUP
-#line 110 "glsl.l"
+#line 112 "glsl.l"
 { return MUL_ASSIGN; }
 	YY_BREAK
 case 51:
 YY_RULE_SETUP
-#line 111 "glsl.l"
+#line 113 "glsl.l"
 { return DIV_ASSIGN; }
 	YY_BREAK
 case 52:
 YY_RULE_SETUP
-#line 112 "glsl.l"
+#line 114 "glsl.l"
 { return ADD_ASSIGN; }
 	YY_BREAK
 case 53:
 YY_RULE_SETUP
-#line 113 "glsl.l"
+#line 115 "glsl.l"
 { return SUB_ASSIGN; }
 	YY_BREAK
 case 54:
 YY_RULE_SETUP
-#line 114 "glsl.l"
+#line 116 "glsl.l"
 { return '='; }
 	YY_BREAK
 case 55:
 YY_RULE_SETUP
-#line 115 "glsl.l"
+#line 117 "glsl.l"
 { return '+'; }
 	YY_BREAK
 case 56:
 YY_RULE_SETUP
-#line 116 "glsl.l"
+#line 118 "glsl.l"
 { return '-'; }
 	YY_BREAK
 case 57:
 YY_RULE_SETUP
-#line 117 "glsl.l"
+#line 119 "glsl.l"
 { return '*'; }
 	YY_BREAK
 case 58:
 YY_RULE_SETUP
-#line 118 "glsl.l"
+#line 120 "glsl.l"
 { return '/'; }
 	YY_BREAK
 case 59:
 YY_RULE_SETUP
-#line 119 "glsl.l"
+#line 121 "glsl.l"
 { return '('; }
 	YY_BREAK
 case 60:
 YY_RULE_SETUP
-#line 120 "glsl.l"
+#line 122 "glsl.l"
 { return ')'; }
 	YY_BREAK
 case 61:
 YY_RULE_SETUP
-#line 121 "glsl.l"
+#line 123 "glsl.l"
 { return '{'; }
 	YY_BREAK
 case 62:
 YY_RULE_SETUP
-#line 122 "glsl.l"
+#line 124 "glsl.l"
 { return '}'; }
 	YY_BREAK
 case 63:
 YY_RULE_SETUP
-#line 123 "glsl.l"
+#line 125 "glsl.l"
 { return '['; }
 	YY_BREAK
 case 64:
 YY_RULE_SETUP
-#line 124 "glsl.l"
+#line 126 "glsl.l"
 { return ']'; }
 	YY_BREAK
 case 65:
 YY_RULE_SETUP
-#line 125 "glsl.l"
+#line 127 "glsl.l"
 { return ';'; }
 	YY_BREAK
 case 66:
 YY_RULE_SETUP
-#line 126 "glsl.l"
+#line 128 "glsl.l"
 { return ','; }
 	YY_BREAK
 case 67:
 YY_RULE_SETUP
-#line 127 "glsl.l"
+#line 129 "glsl.l"
 { return '.'; }
 	YY_BREAK
 /* --- 标识符 (Lexer Hack) --- */
 case 68:
 YY_RULE_SETUP
-#line 130 "glsl.l"
+#line 132 "glsl.l"
 {
     yylval.sval = strdup(yytext);
     return check_type();
@@ -1291,15 +1293,17 @@ YY_RULE_SETUP
 	YY_BREAK
 case 69:
 YY_RULE_SETUP
-#line 135 "glsl.l"
+#line 137 "glsl.l"
 {
-    fprintf(stderr, "Lexical Error: Unexpected character '%s' at line %d\n", yytext, yylineno);
+    const char *file;
+    int line = pp_source_line(preproc, yylineno, &file);
+    fprintf(stderr, "Lexical Error: %s:%d: Unexpected character '%s'\n", file, line, yytext);
     exit(1);
 }
 	YY_BREAK
 case 70:
 YY_RULE_SETUP
-#line 140 "glsl.l"
+#line 144 "glsl.l"
 ECHO;
 	YY_BREAK
 #line 1305 "lex.yy.c"
@@ -2321,5 +2325,5 @@ void yyfree (void * ptr )
 
 #define YYTABLES_NAME "yytables"
 
-#line 140 "glsl.l"
+#line 144 "glsl.l"
 
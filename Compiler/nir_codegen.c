@@ -1,24 +1,296 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "ast.h"
 #include "gpu_ir.h"
 
-typedef struct Builder { NirShader *s; NirBlock *b; } Builder;
+typedef struct Builder { NirShader *s; NirBlock *b; NirFunction *fn; int errors; } Builder;
+
+/* 循环展开参数 */
+#define UNROLL_BUDGET         256   /* 展开后循环体 (含步进) 的 AST 节点数上限 */
+#define UNROLL_MAX_TRIP       4096  /* 试算 trip count 的迭代上限 */
+
+NirDef* gen(Builder *bd, ASTNode *n);
+
+/* --- 特化常量 --- */
+
+/* 命令行覆盖的值, 按 constant_id 查找 */
+static struct { int id; float value; } spec_overrides[NIR_MAX_SPEC_OVERRIDES];
+static int num_spec_overrides;
+
+void nir_set_spec_constant(int id, float value) {
+    for (int k = 0; k < num_spec_overrides; k++) {
+        if (spec_overrides[k].id == id) { spec_overrides[k].value = value; return; }
+    }
+    if (num_spec_overrides == NIR_MAX_SPEC_OVERRIDES) {
+        printf("  ; Warning: too many specialization constant overrides\n");
+        return;
+    }
+    spec_overrides[num_spec_overrides].id = id;
+    spec_overrides[num_spec_overrides].value = value;
+    num_spec_overrides++;
+}
+
+static NirSpecConst* find_spec_const(NirShader *s, const char *name) {
+    for (NirSpecConst *sc = s->spec_consts; sc; sc = sc->next)
+        if (strcmp(sc->name, name) == 0) return sc;
+    return NULL;
+}
+
+/* 收集全局特化常量, 取默认值或命令行覆盖值 */
+static void collect_spec_consts(NirShader *s, ASTNode *root) {
+    NirSpecConst **tail = &s->spec_consts;
+
+    for (ASTNode *g = root; g; g = g->next) {
+        if (g->type != NODE_VAR_DECL || !g->data.var_decl.is_spec_const) continue;
+        NirSpecConst *sc = (NirSpecConst*)calloc(1, sizeof(NirSpecConst));
+        ASTNode *init = g->data.var_decl.initializer;
+        sc->id = g->data.var_decl.constant_id;
+        sc->name = strdup(g->data.var_decl.name);
+        if (init && init->type == NODE_INT_CONST) sc->value = init->data.int_val;
+        else if (init && init->type == NODE_FLOAT_CONST) sc->value = init->data.float_val;
+
+        for (NirSpecConst *o = s->spec_consts; o; o = o->next) {
+            if (o->id == sc->id)
+                printf("  ; Warning: constant_id %d used by both '%s' and '%s'\n", sc->id, o->name, sc->name);
+        }
+        for (int k = 0; k < num_spec_overrides; k++) {
+            if (spec_overrides[k].id == sc->id) {
+                sc->value = spec_overrides[k].value;
+                sc->overridden = true;
+            }
+        }
+        *tail = sc;
+        tail = &sc->next;
+    }
+}
+
+/* --- AST 遍历辅助 --- */
+
+/* 对子树中每个节点调用 fn, fn 返回非 0 时提前结束并返回该值 */
+static int ast_visit(ASTNode *n, int (*fn)(ASTNode*, void*), void *ctx) {
+    int r;
+    if (!n) return 0;
+    if ((r = fn(n, ctx))) return r;
+    switch (n->type) {
+        case NODE_VAR_DECL:
+            return ast_visit(n->data.var_decl.initializer, fn, ctx);
+        case NODE_BINARY_EXPR:
+            if ((r = ast_visit(n->data.binary.left, fn, ctx))) return r;
+            return ast_visit(n->data.binary.right, fn, ctx);
+        case NODE_IF_STMT:
+            if ((r = ast_visit(n->data.if_stmt.condition, fn, ctx))) return r;
+            if ((r = ast_visit(n->data.if_stmt.then_branch, fn, ctx))) return r;
+            return ast_visit(n->data.if_stmt.else_branch, fn, ctx);
+        case NODE_WHILE_STMT:
+        case NODE_FOR_STMT:
+            if ((r = ast_visit(n->data.loop.init, fn, ctx))) return r;
+            if ((r = ast_visit(n->data.loop.condition, fn, ctx))) return r;
+            if ((r = ast_visit(n->data.loop.step, fn, ctx))) return r;
+            return ast_visit(n->data.loop.body, fn, ctx);
+        case NODE_COMPOUND_STMT:
+            for (ASTNode *c = n->data.compound.stmts; c; c = c->next)
+                if ((r = ast_visit(c, fn, ctx))) return r;
+            return 0;
+        case NODE_EXPR_STMT:
+        case NODE_RETURN_STMT:
+            return ast_visit(n->data.stmt.expr, fn, ctx);
+        default:
+            return 0;
+    }
+}
+
+static int count_fn(ASTNode *n, void *ctx) { (void)n; (*(int*)ctx)++; return 0; }
+
+static int ast_size(ASTNode *n) {
+    int count = 0;
+    ast_visit(n, count_fn, &count);
+    return count;
+}
+
+/* 子树中是否写入 (或重新声明) 了变量 name */
+static int writes_fn(ASTNode *n, void *ctx) {
+    const char *name = ctx;
+    if (n->type == NODE_VAR_DECL) return strcmp(n->data.var_decl.name, name) == 0;
+    if (n->type == NODE_BINARY_EXPR && n->data.binary.op == OP_ASSIGN &&
+        n->data.binary.left->type == NODE_VAR_REF)
+        return strcmp(n->data.binary.left->data.str_val, name) == 0;
+    return 0;
+}
+
+static int ast_const_value(ASTNode *n, double *v) {
+    if (!n) return 0;
+    if (n->type == NODE_INT_CONST)   { *v = n->data.int_val;   return 1; }
+    if (n->type == NODE_FLOAT_CONST) { *v = n->data.float_val; return 1; }
+    return 0;
+}
+
+static int is_var_ref(ASTNode *n, const char *name) {
+    return n && n->type == NODE_VAR_REF && strcmp(n->data.str_val, name) == 0;
+}
+
+/*
+ * Trip count 分析: 识别规范形式
+ *     for (i = C0; i <op> C1; i = i +/- C2) body
+ * 且 body 中不写 i, 通过试算得到迭代次数。无法确定时返回 -1。
+ */
+static int loop_trip_count(ASTNode *loop) {
+    ASTNode *init = loop->data.loop.init;
+    ASTNode *cond = loop->data.loop.condition;
+    ASTNode *step = loop->data.loop.step;
+    const char *iv;
+    double start, limit, inc;
+
+    if (loop->type != NODE_FOR_STMT || !init || !cond || !step) return -1;
+
+    /* 初始化: int i = C0; 或 i = C0; */
+    if (init->type == NODE_VAR_DECL) {
+        iv = init->data.var_decl.name;
+        if (!ast_const_value(init->data.var_decl.initializer, &start)) return -1;
+    } else if (init->type == NODE_EXPR_STMT && init->data.stmt.expr &&
+               init->data.stmt.expr->type == NODE_BINARY_EXPR &&
+               init->data.stmt.expr->data.binary.op == OP_ASSIGN &&
+               init->data.stmt.expr->data.binary.left->type == NODE_VAR_REF) {
+        iv = init->data.stmt.expr->data.binary.left->data.str_val;
+        if (!ast_const_value(init->data.stmt.expr->data.binary.right, &start)) return -1;
+    } else {
+        return -1;
+    }
+
+    /* 条件: i <op> C1 */
+    if (cond->type != NODE_BINARY_EXPR || !is_var_ref(cond->data.binary.left, iv) ||
+        !ast_const_value(cond->data.binary.right, &limit))
+        return -1;
+
+    /* 步进: i = i + C2 / i = i - C2 */
+    if (step->type != NODE_BINARY_EXPR || step->data.binary.op != OP_ASSIGN ||
+        !is_var_ref(step->data.binary.left, iv))
+        return -1;
+    ASTNode *rhs = step->data.binary.right;
+    if (rhs->type != NODE_BINARY_EXPR || !is_var_ref(rhs->data.binary.left, iv) ||
+        !ast_const_value(rhs->data.binary.right, &inc))
+        return -1;
+    if (rhs->data.binary.op == OP_SUB) inc = -inc;
+    else if (rhs->data.binary.op != OP_ADD) return -1;
+
+    if (ast_visit(loop->data.loop.body, writes_fn, (void*)iv)) return -1;
+
+    int trip = 0;
+    double v = start;
+    for (;;) {
+        int taken;
+        switch (cond->data.binary.op) {
+            case OP_LT: taken = v <  limit; break;
+            case OP_LE: taken = v <= limit; break;
+            case OP_GT: taken = v >  limit; break;
+            case OP_GE: taken = v >= limit; break;
+            case OP_NE: taken = v != limit; break;
+            default: return -1;
+        }
+        if (!taken) return trip;
+        if (++trip > UNROLL_MAX_TRIP) return -1;
+        v += inc;
+    }
+}
+
+/* 生成一次迭代: 循环体 + 步进 */
+static void gen_iteration(Builder *bd, ASTNode *loop) {
+    gen(bd, loop->data.loop.body);
+    gen(bd, loop->data.loop.step);
+}
+
+/*
+ * 循环构造: 后端没有跳转指令, 循环只能完全展开。
+ * trip count 必须能在编译期算出, 且展开后的大小不超过 UNROLL_BUDGET,
+ * 否则报错, 绝不把循环体当作直线代码只发射一次。
+ */
+static void gen_loop(Builder *bd, ASTNode *n) {
+    gen(bd, n->data.loop.init);
+
+    int trip = loop_trip_count(n);
+    int size = ast_size(n->data.loop.body) + ast_size(n->data.loop.step);
+    if (size < 1) size = 1;
+
+    if (trip < 0) {
+        fprintf(stderr, "Error: loop trip count is not a compile-time constant, "
+                        "loops must be fully unrolled\n");
+        bd->errors++;
+        return;
+    }
+    if ((long)trip * size > UNROLL_BUDGET) {
+        fprintf(stderr, "Error: loop of %d iteration(s) x %d node(s) exceeds the unroll budget (%d)\n",
+                trip, size, UNROLL_BUDGET);
+        bd->errors++;
+        return;
+    }
+    printf("  Loop: trip count %d, fully unrolled\n", trip);
+    for (int k = 0; k < trip; k++) gen_iteration(bd, n);
+}
+
+/* 内置函数 (没有同名的用户函数时) -> 单操作数 ALU */
+static int builtin_op(const char *name, NirOp *op) {
+    if (strcmp(name, "sin") == 0) { *op = nir_op_fsin; return 1; }
+    if (strcmp(name, "cos") == 0) { *op = nir_op_fcos; return 1; }
+    return 0;
+}
+
+/* texture2D(sampler, u, v [, c]): sampler 必须直接引用全局变量, 不生成 load */
+static NirDef* gen_texture(Builder *bd, ASTNode *n) {
+    ASTNode *s = n->data.func_call.args;
+    if (!s || s->type != NODE_VAR_REF || !s->next || !s->next->next) {
+        printf("  ; Warning: texture2D expects (sampler, u, v)\n");
+        return NULL;
+    }
+    ASTNode *c = s->next->next->next;
+    int comp = 0;
+    if (c && c->type == NODE_INT_CONST && c->data.int_val >= 0 && c->data.int_val < 4)
+        comp = c->data.int_val;
+    NirDef *u = gen(bd, s->next);
+    NirDef *v = gen(bd, s->next->next);
+    if (!u || !v) return NULL;
+    return &nir_build_tex(bd->s, bd->b, s->data.str_val, u, v, comp)->def;
+}
+
+/* AST 运算符 -> NIR 操作码; a > b 和 a <= b 通过交换操作数实现 */
+static NirOp binop_to_nir(OperatorType op, int *swap) {
+    *swap = 0;
+    switch (op) {
+        case OP_SUB: return nir_op_fsub;
+        case OP_MUL: return nir_op_fmul;
+        case OP_DIV: return nir_op_fdiv;
+        case OP_LT:  return nir_op_flt;
+        case OP_GT:  *swap = 1; return nir_op_flt;
+        case OP_GE:  return nir_op_fge;
+        case OP_LE:  *swap = 1; return nir_op_fge;
+        case OP_EQ:  return nir_op_feq;
+        case OP_NE:  return nir_op_fne;
+        default:     return nir_op_fadd;
+    }
+}
 
 NirDef* gen(Builder *bd, ASTNode *n) {
     if(!n) return NULL;
 
     switch(n->type) {
-        case NODE_INT_CONST: 
+        case NODE_INT_CONST: { 
+            NirInstr *i = nir_build_const(bd->s, bd->b, (float)n->data.int_val); 
+            return &i->def; 
+        }
         case NODE_FLOAT_CONST: { 
-            NirInstr *i = nir_build_alu(bd->s, bd->b, nir_op_mov, NULL, NULL); 
+            NirInstr *i = nir_build_const(bd->s, bd->b, n->data.float_val); 
             return &i->def; 
         }
         case NODE_VAR_REF: { 
             if (!n->data.str_val) return NULL;
-            NirInstr *i = nir_build_load(bd->s, bd->b, n->data.str_val, 1); 
+            /* 特化常量直接替换为立即数, 交给常量折叠 */
+            NirSpecConst *sc = find_spec_const(bd->s, n->data.str_val);
+            NirInstr *i = sc ? nir_build_const(bd->s, bd->b, sc->value)
+                             : nir_build_load(bd->s, bd->b, n->data.str_val, 1); 
             return &i->def; 
         }
         case NODE_VAR_DECL: 
+            if (n->data.var_decl.is_spec_const) return NULL;
+            if (bd->fn) nir_function_add_local(bd->fn, n->data.var_decl.name);
             if(n->data.var_decl.initializer) {
                 NirDef *v = gen(bd, n->data.var_decl.initializer);
                 if (v && n->data.var_decl.name) {
@@ -26,7 +298,7 @@ NirDef* gen(Builder *bd, ASTNode *n) {
                 }
             } 
             return NULL;
-        case NODE_BINARY_EXPR:
+        case NODE_BINARY_EXPR: {
             if(n->data.binary.op == OP_ASSIGN) {
                 NirDef *v = gen(bd, n->data.binary.right);
                 if (v && n->data.binary.left->type == NODE_VAR_REF) {
@@ -34,21 +306,76 @@ NirDef* gen(Builder *bd, ASTNode *n) {
                 }
                 return v;
             }
-            // 普通算术
+            // 普通算术 / 比较
+            int swap;
+            NirOp op = binop_to_nir(n->data.binary.op, &swap);
             NirDef *s0 = gen(bd, n->data.binary.left);
             NirDef *s1 = gen(bd, n->data.binary.right);
             if (s0 && s1) {
-                NirInstr *i = nir_build_alu(bd->s, bd->b, nir_op_fadd, s0, s1);
+                NirInstr *i = swap ? nir_build_alu(bd->s, bd->b, op, s1, s0)
+                                   : nir_build_alu(bd->s, bd->b, op, s0, s1);
                 return &i->def;
             }
             return NULL;
+        }
         case NODE_COMPOUND_STMT: { 
-             ASTNode *c = n->next; 
+             ASTNode *c = n->data.compound.stmts; 
              while(c){ gen(bd,c); c=c->next; } 
              return NULL; 
         }
         case NODE_EXPR_STMT: 
-            gen(bd, n->next); 
+            gen(bd, n->data.stmt.expr); 
+            return NULL;
+        case NODE_FUNC_CALL: {
+            NirFunction *callee = nir_find_function(bd->s, n->data.func_call.name);
+            NirDef *args[NIR_MAX_PARAMS];
+            int nargs = 0;
+            NirOp builtin;
+            if (!callee && strcmp(n->data.func_call.name, "texture2D") == 0) return gen_texture(bd, n);
+            if (!callee && builtin_op(n->data.func_call.name, &builtin)) {
+                NirDef *v = gen(bd, n->data.func_call.args);
+                if (!v) return NULL;
+                if (n->data.func_call.args->next) {
+                    fprintf(stderr, "Error: '%s' expects 1 argument\n", n->data.func_call.name);
+                    bd->errors++;
+                    return NULL;
+                }
+                return &nir_build_alu(bd->s, bd->b, builtin, v, NULL)->def;
+            }
+            if (!callee) {
+                fprintf(stderr, "Error: call to unknown function '%s'\n", n->data.func_call.name);
+                bd->errors++;
+                return NULL;
+            }
+            for (ASTNode *a = n->data.func_call.args; a; a = a->next) {
+                NirDef *v = gen(bd, a);
+                if (!v) {
+                    fprintf(stderr, "Error: argument %d of '%s' has no value\n", nargs + 1, callee->name);
+                    bd->errors++;
+                    return NULL;
+                }
+                if (nargs < NIR_MAX_PARAMS) args[nargs] = v;
+                nargs++;
+            }
+            if (nargs != callee->num_params) {
+                fprintf(stderr, "Error: '%s' expects %d argument(s), got %d\n",
+                        callee->name, callee->num_params, nargs);
+                bd->errors++;
+                return NULL;
+            }
+            NirInstr *i = nir_build_call(bd->s, bd->b, callee, args, nargs);
+            return &i->def;
+        }
+        case NODE_RETURN_STMT: {
+            NirDef *v = gen(bd, n->data.stmt.expr);
+            nir_build_return(bd->b, v);
+            /* return 之后的语句不可达, 放进新块, 由 CFG 清理删除 */
+            bd->b = nir_create_block(bd->s);
+            return NULL;
+        }
+        case NODE_WHILE_STMT:
+        case NODE_FOR_STMT:
+            gen_loop(bd, n);
             return NULL;
         case NODE_IF_STMT: {
             NirDef *c = gen(bd, n->data.if_stmt.condition);
@@ -63,12 +390,12 @@ NirDef* gen(Builder *bd, ASTNode *n) {
             // Then
             bd->b = t; 
             gen(bd, n->data.if_stmt.then_branch); 
-            nir_build_jump(t, m);
+            nir_build_jump(bd->b, m);
             
             // Else
             bd->b = e; 
             if(n->data.if_stmt.else_branch) gen(bd, n->data.if_stmt.else_branch); 
-            nir_build_jump(e, m);
+            nir_build_jump(bd->b, m);
             
             // Merge
             bd->b = m; 
@@ -78,27 +405,61 @@ NirDef* gen(Builder *bd, ASTNode *n) {
     }
 }
 
+/* 块是否以控制流指令结尾 */
+static int block_terminated(NirBlock *b) {
+    return b->end && (b->end->op == nir_jump || b->end->op == nir_branch || b->end->op == nir_return);
+}
+
 NirShader* generate_ssa_nir(ASTNode *root) {
     printf("DEBUG: Starting generate_ssa_nir...\n");
     NirShader *s = nir_create_shader();
     if (!s) { printf("DEBUG: Failed to create shader!\n"); return NULL; }
 
-    NirBlock *entry = nir_create_block(s);
-    Builder bd = {s, entry};
-    
-    ASTNode *curr = root;
-    while(curr) {
-        if(curr->type == NODE_FUNC_DEF) {
-            // 生成函数体
-            gen(&bd, curr->data.func_def.body);
-        } else {
-            // 生成全局变量或其他
-            gen(&bd, curr);
+    collect_spec_consts(s, root);
+
+    /* 先为所有函数建立签名, 调用可以出现在被调函数定义之前 */
+    int errors = 0;
+    for (ASTNode *curr = root; curr; curr = curr->next) {
+        if (curr->type != NODE_FUNC_DEF) continue;
+        NirFunction *fn = nir_create_function(s, curr->data.func_def.name);
+        ASTNode *ret = curr->data.func_def.return_type;
+        fn->has_return_value = ret && ret->data.str_val && strcmp(ret->data.str_val, "void") != 0;
+        for (ASTNode *p = curr->data.func_def.params; p; p = p->next) {
+            if (fn->num_params >= NIR_MAX_PARAMS) {
+                fprintf(stderr, "Error: '%s' has more than %d parameters\n", fn->name, NIR_MAX_PARAMS);
+                errors++;
+                break;
+            }
+            fn->params[fn->num_params++] = strdup(p->data.var_decl.name);
+        }
+    }
+
+    s->entry = nir_find_function(s, "main");
+    if (!s->entry) { fprintf(stderr, "Error: shader has no main()\n"); return NULL; }
+    if (errors) return NULL;
+
+    for (ASTNode *curr = root; curr; curr = curr->next) {
+        if (curr->type != NODE_FUNC_DEF) continue;
+        NirFunction *fn = nir_find_function(s, curr->data.func_def.name);
+        s->impl = fn;
+        Builder bd = {s, nir_create_block(s), NULL, 0};
+
+        /* 全局变量的初始化放在 main 的开头 */
+        if (fn == s->entry) {
+            for (ASTNode *g = root; g; g = g->next)
+                if (g->type != NODE_FUNC_DEF) gen(&bd, g);
         }
-        curr = curr->next;
+
+        // 生成函数体
+        bd.fn = fn;
+        gen(&bd, curr->data.func_def.body);
+        if (!block_terminated(bd.b)) nir_build_return(bd.b, NULL);
+        errors += bd.errors;
     }
+    s->impl = NULL;
+    if (errors) return NULL;
+    s->start_block = s->entry->start_block;
     
-    nir_print_shader(s);
     printf("DEBUG: NIR Generation Done. Shader ptr: %p\n", (void*)s);
     return s;
-}
\ No newline at end of file
+}
@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gpu_ir.h"
+
+/*
+ * 发散分析 (Divergence Analysis)
+ *
+ * 一个 wave 的所有 lane 执行同一条指令。如果某个值在所有 lane 上都相同
+ * (uniform), 它只需要一个标量寄存器和一次标量 ALU 运算; 否则 (divergent)
+ * 需要向量寄存器, 每个 lane 各算一份。
+ *
+ * 规则:
+ *   - load_const、uniform (u_ 前缀) 的 load 是 uniform
+ *   - attribute (v_ 前缀) 以及从未被写过的其他全局变量的 load 是 divergent
+ *   - ALU/call 只要有一个操作数 divergent, 结果就是 divergent
+ *   - 纹理采样总是 divergent: 纹理单元只写向量寄存器
+ *   - 局部变量: 任何一次 store 写入 divergent 值, 或者 store 位于受
+ *     divergent 分支控制的块中 (不同 lane 可能写也可能不写), 该变量的
+ *     所有 load 都是 divergent
+ * 变量和控制依赖相互影响, 迭代到不动点。
+ */
+
+typedef struct DivVar { const char *name; int stored; int divergent; } DivVar;
+
+typedef struct DivState {
+    NirFunction *fn;
+    int nblocks;
+    NirBlock **blocks;      /* 按 index 排列 */
+    uint8_t *pdom;          /* pdom[a * nblocks + b]: b 后支配 a */
+    uint8_t *ctrl_div;      /* 块是否受 divergent 分支控制 */
+    uint8_t *branch_done;   /* 块末尾的 divergent 分支已处理 */
+    DivVar *vars;
+    int nvars, cap;
+} DivState;
+
+static DivVar* div_var(DivState *st, const char *name) {
+    for (int k = 0; k < st->nvars; k++)
+        if (strcmp(st->vars[k].name, name) == 0) return &st->vars[k];
+    if (st->nvars == st->cap) {
+        st->cap = st->cap ? st->cap * 2 : 16;
+        st->vars = (DivVar*)realloc(st->vars, sizeof(DivVar) * st->cap);
+    }
+    DivVar *v = &st->vars[st->nvars++];
+    v->name = name;
+    v->stored = 0;
+    v->divergent = 0;
+    return v;
+}
+
+static int num_succs(NirBlock *b) {
+    if (!b->end) return 0;
+    if (b->end->op == nir_branch) return 2;
+    if (b->end->op == nir_jump) return 1;
+    return 0;
+}
+
+/* 后支配集合: pdom(b) = {b} ∪ ∩ pdom(后继), 出口块只有自己 */
+static void compute_post_dominators(DivState *st) {
+    int n = st->nblocks, changed = 1;
+    st->pdom = (uint8_t*)malloc(n * n);
+    for (int a = 0; a < n; a++) {
+        int exit = num_succs(st->blocks[a]) == 0;
+        for (int b = 0; b < n; b++) st->pdom[a * n + b] = exit ? (a == b) : 1;
+    }
+
+    while (changed) {
+        changed = 0;
+        for (int a = n - 1; a >= 0; a--) {
+            NirBlock *blk = st->blocks[a];
+            int ns = num_succs(blk);
+            if (ns == 0) continue;
+            for (int b = 0; b < n; b++) {
+                uint8_t v = 1;
+                for (int s = 0; s < ns; s++) v &= st->pdom[blk->successors[s]->index * n + b];
+                if (a == b) v = 1;
+                if (v != st->pdom[a * n + b]) { st->pdom[a * n + b] = v; changed = 1; }
+            }
+        }
+    }
+}
+
+/*
+ * 从 divergent 分支 b 的后继出发, 在到达 b 的后支配块之前经过的块
+ * 都是控制依赖于 b 的, 其中的 store 只在部分 lane 上执行。
+ */
+static void mark_control_dependent(DivState *st, NirBlock *b) {
+    int n = st->nblocks;
+    int *stack = (int*)malloc(sizeof(int) * (2 * n + 2));  /* 每个块最多压入两个后继 */
+    uint8_t *seen = (uint8_t*)calloc(n, 1);
+    int sp = 0;
+
+    for (int s = 0; s < num_succs(b); s++) stack[sp++] = b->successors[s]->index;
+    while (sp) {
+        int x = stack[--sp];
+        if (seen[x] || st->pdom[b->index * n + x]) continue;
+        seen[x] = 1;
+        st->ctrl_div[x] = 1;
+        NirBlock *xb = st->blocks[x];
+        for (int s = 0; s < num_succs(xb); s++) stack[sp++] = xb->successors[s]->index;
+    }
+    free(seen);
+    free(stack);
+}
+
+static int load_is_divergent(DivState *st, NirInstr *i) {
+    if (strncmp(i->var_name, "u_", 2) == 0) return 0;
+    if (strncmp(i->var_name, "v_", 2) == 0) return 1;
+    DivVar *v = div_var(st, i->var_name);
+    return v->divergent || !v->stored;
+}
+
+static int instr_is_divergent(DivState *st, NirInstr *i) {
+    switch (i->op) {
+        case nir_load_const:
+            return 0;
+        case nir_intrinsic_load_var:
+            return load_is_divergent(st, i);
+        case nir_intrinsic_tex:
+            return 1;
+        default:
+            for (int k = 0; k < i->num_srcs; k++)
+                if (i->srcs[k].ssa && i->srcs[k].ssa->divergent) return 1;
+            return 0;
+    }
+}
+
+/* 分析 main, 设置每个 NirDef 的 divergent 标记, 返回 divergent 值的个数 */
+int nir_divergence_analysis(NirShader *s) {
+    DivState st = {0};
+    int changed = 1, count = 0;
+
+    /*
+     * nir_index_blocks 跨所有函数编号, main 不一定从 0 开始;
+     * 分析期间只给 main 的块从 0 重新编号, 结束后恢复全局编号
+     */
+    st.fn = s->entry;
+    for (NirBlock *b = st.fn->start_block; b; b = b->next_block) b->index = st.nblocks++;
+    st.blocks = (NirBlock**)malloc(sizeof(NirBlock*) * st.nblocks);
+    for (NirBlock *b = st.fn->start_block; b; b = b->next_block) st.blocks[b->index] = b;
+    st.ctrl_div = (uint8_t*)calloc(st.nblocks, 1);
+    st.branch_done = (uint8_t*)calloc(st.nblocks, 1);
+    compute_post_dominators(&st);
+
+    /* 先登记所有被写过的变量 */
+    for (NirBlock *b = st.fn->start_block; b; b = b->next_block)
+        for (NirInstr *i = b->start; i; i = i->next)
+            if (i->op == nir_intrinsic_store_var) div_var(&st, i->var_name)->stored = 1;
+
+    while (changed) {
+        changed = 0;
+        for (NirBlock *b = st.fn->start_block; b; b = b->next_block) {
+            for (NirInstr *i = b->start; i; i = i->next) {
+                if (i->def.index != 0) {
+                    int d = instr_is_divergent(&st, i);
+                    if (d != i->def.divergent) { i->def.divergent = d; changed = 1; }
+                }
+                if (i->op == nir_intrinsic_store_var) {
+                    DivVar *v = div_var(&st, i->var_name);
+                    if (!v->divergent && (i->srcs[0].ssa->divergent || st.ctrl_div[b->index])) {
+                        v->divergent = 1;
+                        changed = 1;
+                    }
+                }
+                if (i->op == nir_branch && i->srcs[0].ssa->divergent && !st.branch_done[b->index]) {
+                    st.branch_done[b->index] = 1;
+                    mark_control_dependent(&st, b);
+                    changed = 1;
+                }
+            }
+        }
+    }
+
+    for (NirBlock *b = st.fn->start_block; b; b = b->next_block)
+        for (NirInstr *i = b->start; i; i = i->next)
+            if (i->def.index != 0 && i->def.divergent) count++;
+
+    nir_index_blocks(s);
+    free(st.blocks);
+    free(st.pdom);
+    free(st.ctrl_div);
+    free(st.branch_done);
+    free(st.vars);
+    return count;
+}
@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gpu_ir.h"
+
+/*
+ * 函数内联
+ *
+ * 设备上没有廉价的 call/return: 调用需要保存寄存器、传参和跳转。
+ * 这里把 main 中的调用展开成被调函数体的副本, 之后的 CFG 清理和
+ * 变量拷贝传播就可以跨越原来的调用边界进行优化。
+ */
+
+/*
+ * 代价模型: 后端没有 call 指令, 所有调用最终都必须内联,
+ * 代价只决定内联的先后顺序
+ */
+#define INLINE_CALL_OVERHEAD 6    /* call/return 与寄存器保存恢复的估计指令数 */
+#define INLINE_MAX_COST      48   /* 不大于此值的被调函数优先内联 */
+
+/* 函数体的指令数 (不计跳转和返回) */
+static int function_cost(NirFunction *fn) {
+    int cost = 0;
+    for (NirBlock *b = fn->start_block; b; b = b->next_block)
+        for (NirInstr *i = b->start; i; i = i->next)
+            if (i->op != nir_jump && i->op != nir_return) cost++;
+    return cost;
+}
+
+static int count_call_sites(NirShader *s, NirFunction *callee) {
+    int sites = 0;
+    for (NirFunction *fn = s->functions; fn; fn = fn->next)
+        for (NirBlock *b = fn->start_block; b; b = b->next_block)
+            for (NirInstr *i = b->start; i; i = i->next)
+                if (i->op == nir_call && i->callee == callee) sites++;
+    return sites;
+}
+
+/*
+ * 优先内联的调用:
+ *   - 只有一个调用点: 内联不会增加代码量
+ *   - 函数体不大于调用本身的开销: 内联只会变小
+ *   - 函数体不超过 INLINE_MAX_COST
+ * 其余的调用在这些都完成之后再内联。
+ */
+static int inline_first(NirShader *s, NirInstr *call, int *cost_out) {
+    NirFunction *callee = call->callee;
+    int cost = function_cost(callee);
+    int sites = count_call_sites(s, callee);
+
+    *cost_out = cost;
+    if (sites == 1) return 1;
+    if (cost <= INLINE_CALL_OVERHEAD + callee->num_params) return 1;
+    return cost <= INLINE_MAX_COST;
+}
+
+static int is_callee_var(NirFunction *fn, const char *name) {
+    for (int i = 0; i < fn->num_params; i++)
+        if (strcmp(fn->params[i], name) == 0) return 1;
+    for (int i = 0; i < fn->num_locals; i++)
+        if (strcmp(fn->locals[i], name) == 0) return 1;
+    return 0;
+}
+
+/* 被调函数的形参/局部变量重命名为 "callee.序号.name", 避免与调用者冲突 */
+static char* inline_var_name(NirFunction *callee, int serial, const char *name) {
+    size_t len = strlen(callee->name) + strlen(name) + 16;
+    char *buf = (char*)malloc(len);
+    snprintf(buf, len, "%s.%d.%s", callee->name, serial, name);
+    return buf;
+}
+
+static NirBlock* map_block(NirBlock **from, NirBlock **to, int n, NirBlock *b) {
+    for (int k = 0; k < n; k++)
+        if (from[k] == b) return to[k];
+    return NULL;
+}
+
+static void inline_call(NirShader *s, NirInstr *call, int serial) {
+    NirFunction *callee = call->callee;
+    NirBlock *a = call->block;
+    char *ret_name = callee->has_return_value ? inline_var_name(callee, serial, "retval") : NULL;
+
+    /* 1. 拆分: call 及其之后的指令移入续块 c, c 继承 a 的后继 */
+    NirBlock *c = nir_insert_block_after(s, a);
+    for (NirInstr *i = call; i; ) {
+        NirInstr *next = i->next;
+        nir_instr_remove(i);
+        block_append_instr(c, i);
+        i = next;
+    }
+    c->successors[0] = a->successors[0];
+    c->successors[1] = a->successors[1];
+    a->successors[0] = a->successors[1] = NULL;
+
+    /* 2. 实参写入重命名后的形参变量 */
+    for (int k = 0; k < callee->num_params && k < call->num_srcs; k++) {
+        char *pname = inline_var_name(callee, serial, callee->params[k]);
+        nir_build_store(s, a, pname, call->srcs[k].ssa, 0xF);
+        free(pname);
+    }
+
+    /* 3. 复制被调函数的块, 放在 a 与 c 之间 */
+    int nblocks = 0;
+    for (NirBlock *b = callee->start_block; b; b = b->next_block) nblocks++;
+    NirBlock **old_blocks = (NirBlock**)malloc(sizeof(NirBlock*) * nblocks);
+    NirBlock **new_blocks = (NirBlock**)malloc(sizeof(NirBlock*) * nblocks);
+    NirDef **defmap = (NirDef**)calloc(s->num_ssa_defs + 1, sizeof(NirDef*));
+
+    NirBlock *prev = a;
+    int k = 0;
+    for (NirBlock *b = callee->start_block; b; b = b->next_block, k++) {
+        old_blocks[k] = b;
+        new_blocks[k] = prev = nir_insert_block_after(s, prev);
+    }
+
+    for (k = 0; k < nblocks; k++) {
+        NirBlock *ob = old_blocks[k], *nb = new_blocks[k];
+
+        for (NirInstr *oi = ob->start; oi; oi = oi->next) {
+            NirDef *srcs[4] = {NULL};
+            for (int j = 0; j < oi->num_srcs; j++) {
+                NirDef *d = oi->srcs[j].ssa;
+                srcs[j] = (d && defmap[d->index]) ? defmap[d->index] : d;
+            }
+
+            /* return -> 写返回值变量并跳到续块 */
+            if (oi->op == nir_return) {
+                if (ret_name && srcs[0]) nir_build_store(s, nb, ret_name, srcs[0], 0xF);
+                nir_build_jump(nb, c);
+                break;
+            }
+
+            NirInstr *ni = (NirInstr*)malloc(sizeof(NirInstr));
+            *ni = *oi;
+            for (int j = 0; j < oi->num_srcs; j++) ni->srcs[j].ssa = srcs[j];
+            if (oi->var_name) {
+                ni->var_name = is_callee_var(callee, oi->var_name)
+                    ? inline_var_name(callee, serial, oi->var_name)
+                    : strdup(oi->var_name);
+            }
+            if (oi->def.index != 0) {
+                nir_def_init(s, ni, oi->def.num_components);
+                defmap[oi->def.index] = &ni->def;
+            }
+            block_append_instr(nb, ni);
+        }
+
+        if (!nb->successors[0]) {
+            nb->successors[0] = map_block(old_blocks, new_blocks, nblocks, ob->successors[0]);
+            nb->successors[1] = map_block(old_blocks, new_blocks, nblocks, ob->successors[1]);
+        }
+    }
+
+    /* 4. a 跳到副本入口 */
+    nir_build_jump(a, new_blocks[0]);
+
+    /* 5. call 原地改为读取返回值变量, 保持 def 指针不变, 使用者无需改写 */
+    if (ret_name) {
+        call->op = nir_intrinsic_load_var;
+        call->var_name = ret_name;
+        call->callee = NULL;
+        call->num_srcs = 0;
+    } else {
+        nir_instr_remove(call);
+        free(call);
+    }
+
+    free(old_blocks);
+    free(new_blocks);
+    free(defmap);
+}
+
+/* 删除不再被任何函数调用的函数 (main 除外) */
+static void remove_dead_functions(NirShader *s) {
+    int progress = 1;
+    while (progress) {
+        progress = 0;
+        NirFunction **pp = &s->functions;
+        while (*pp) {
+            NirFunction *fn = *pp;
+            if (fn != s->entry && count_call_sites(s, fn) == 0) {
+                *pp = fn->next;
+                progress = 1;
+            } else {
+                pp = &fn->next;
+            }
+        }
+    }
+}
+
+/* main 中第一个满足 cheap 条件的调用 (cheap 为 0 时取第一个调用) */
+static NirInstr* find_call(NirShader *s, int cheap, int *cost) {
+    for (NirBlock *b = s->entry->start_block; b; b = b->next_block)
+        for (NirInstr *i = b->start; i; i = i->next)
+            if (i->op == nir_call && (!cheap || inline_first(s, i, cost))) {
+                if (!cheap) *cost = function_cost(i->callee);
+                return i;
+            }
+    return NULL;
+}
+
+/*
+ * 调用图上从 fn 出发的深度优先搜索, state: 0 未访问, 1 在当前路径上, 2 已完成。
+ * 遇到当前路径上的函数说明有环 (递归, 包括调用 main), 报错并返回 -1。
+ */
+static int check_calls_acyclic(NirFunction *fn, NirFunction **fns, char *state, int nfns) {
+    int k = 0;
+    while (fns[k] != fn) k++;
+    state[k] = 1;
+    for (NirBlock *b = fn->start_block; b; b = b->next_block)
+        for (NirInstr *i = b->start; i; i = i->next) {
+            if (i->op != nir_call) continue;
+            int j = 0;
+            while (j < nfns && fns[j] != i->callee) j++;
+            if (j == nfns) continue;
+            if (state[j] == 1) {
+                fprintf(stderr, "Error: recursive call to '%s' in '%s', calls can not be inlined\n",
+                        i->callee->name, fn->name);
+                return -1;
+            }
+            if (state[j] == 0 && check_calls_acyclic(i->callee, fns, state, nfns) < 0) return -1;
+        }
+    state[k] = 2;
+    return 0;
+}
+
+/* 返回内联的调用数; main 可达的调用图中有递归时报错并返回 -1 */
+int nir_inline_functions(NirShader *s) {
+    int inlined = 0, nfns = 0, k = 0;
+
+    /* 调用图无环, 每次内联都让 main 更接近没有调用, 循环必然结束 */
+    for (NirFunction *fn = s->functions; fn; fn = fn->next) nfns++;
+    NirFunction **fns = (NirFunction**)malloc(sizeof(NirFunction*) * nfns);
+    char *state = (char*)calloc(nfns, 1);
+    for (NirFunction *fn = s->functions; fn; fn = fn->next) fns[k++] = fn;
+    int acyclic = check_calls_acyclic(s->entry, fns, state, nfns);
+    free(fns);
+    free(state);
+    if (acyclic < 0) return -1;
+
+    for (;;) {
+        int cost = 0;
+        NirInstr *target = find_call(s, 1, &cost);
+        if (!target) target = find_call(s, 0, &cost);
+        if (!target) break;
+
+        printf("  Inline: %s into %s (cost %d)\n", target->callee->name, s->entry->name, cost);
+        inline_call(s, target, ++inlined);
+    }
+
+    remove_dead_functions(s);
+    nir_index_blocks(s);
+    return inlined;
+}
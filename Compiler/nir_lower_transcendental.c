@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gpu_ir.h"
+
+/*
+ * 超越函数降级 (fsin / fcos)
+ *
+ * PRECISE 模式保留 fsin / fcos, 由后端发射 SFU 指令, 模拟器用宿主数学库计算。
+ * FAST 模式在 NIR 上展开成只含 fadd / fsub / fmul 的序列, 走普通 ALU
+ * (uniform 的 sin(u_time) 走标量 ALU), 之后的 MAD 合并会把乘加对合成一条:
+ *
+ *   r = x / 2π              (fcos 再加 0.25 个周期)
+ *   f = r - round(r)        f ∈ [-0.5, 0.5]
+ *   sin(2πf) = f * P(f²)    P 为 5 次, 在 [0, 0.5] 上的极小极大逼近
+ *
+ * round 用 (r + 1.5·2^23) - 1.5·2^23 实现, 要求 |r| < 2^22, 即 |x| < 2.6e7。
+ * 在 float 精度下多项式的最大绝对误差约 7.5e-7。
+ *
+ * 设备没有除法指令, 两种模式下 fdiv(a, b) 都改写为 fmul(a, frcp(b)),
+ * frcp 由 SFU 计算, 除数为常量时由常量折叠算出倒数。
+ */
+
+#define TRIG_INV_2PI      0.15915494309189535f
+#define TRIG_ROUND_MAGIC  12582912.0f           /* 1.5 * 2^23 */
+
+/* sin(2πf) / f 关于 f² 的系数, 从常数项开始 */
+static const float trig_sin_coeffs[] = {
+    6.283182621002197f,
+    -41.34142303466797f,
+    81.59618377685547f,
+    -76.5801010131836f,
+    41.20539474487305f,
+    -12.271263122558594f,
+};
+
+#define TRIG_NUM_COEFFS (sizeof(trig_sin_coeffs) / sizeof(trig_sin_coeffs[0]))
+
+/* 在 pos 之前插入一条 ALU / 常量指令 */
+static NirDef* lower_alu(NirShader *s, NirInstr *pos, NirOp op, NirDef *a, NirDef *b) {
+    NirInstr *i = nir_build_alu(s, pos->block, op, a, b);
+    nir_instr_remove(i);
+    nir_instr_insert_before(pos, i);
+    return &i->def;
+}
+
+static NirDef* lower_const(NirShader *s, NirInstr *pos, float value) {
+    NirInstr *i = nir_build_const(s, pos->block, value);
+    nir_instr_remove(i);
+    nir_instr_insert_before(pos, i);
+    return &i->def;
+}
+
+/* 把 fsin / fcos 原地改写为 fmul(f, P(f²)), 使用者不需要改动 */
+static void lower_trig_fast(NirShader *s, NirInstr *i) {
+    NirDef *x = i->srcs[0].ssa;
+    NirDef *r = lower_alu(s, i, nir_op_fmul, x, lower_const(s, i, TRIG_INV_2PI));
+    if (i->op == nir_op_fcos) r = lower_alu(s, i, nir_op_fadd, r, lower_const(s, i, 0.25f));
+
+    NirDef *magic = lower_const(s, i, TRIG_ROUND_MAGIC);
+    NirDef *k = lower_alu(s, i, nir_op_fsub, lower_alu(s, i, nir_op_fadd, r, magic), magic);
+    NirDef *f = lower_alu(s, i, nir_op_fsub, r, k);
+    NirDef *u = lower_alu(s, i, nir_op_fmul, f, f);
+
+    /* Horner: p = c5; p = p * u + c4; ... */
+    NirDef *p = lower_const(s, i, trig_sin_coeffs[TRIG_NUM_COEFFS - 1]);
+    for (int c = (int)TRIG_NUM_COEFFS - 2; c >= 0; c--) {
+        p = lower_alu(s, i, nir_op_fmul, p, u);
+        p = lower_alu(s, i, nir_op_fadd, p, lower_const(s, i, trig_sin_coeffs[c]));
+    }
+
+    i->op = nir_op_fmul;
+    i->num_srcs = 2;
+    i->srcs[0].ssa = f;
+    i->srcs[1].ssa = p;
+    for (int c = 0; c < 4; c++) i->srcs[1].swizzle[c] = c;
+}
+
+/* fdiv(a, b) 原地改写为 fmul(a, frcp(b)) */
+static void lower_fdiv(NirShader *s, NirInstr *i) {
+    i->op = nir_op_fmul;
+    i->srcs[1].ssa = lower_alu(s, i, nir_op_frcp, i->srcs[1].ssa, NULL);
+}
+
+/* 处理所有函数 (内联之前调用也可以), 返回展开的超越函数个数 */
+int nir_lower_transcendentals(NirShader *s, NirMathMode mode) {
+    int lowered = 0;
+
+    for (NirFunction *fn = s->functions; fn; fn = fn->next) {
+        for (NirBlock *b = fn->start_block; b; b = b->next_block) {
+            for (NirInstr *i = b->start; i; i = i->next) {
+                if (i->op == nir_op_fdiv && i->num_srcs == 2) {
+                    lower_fdiv(s, i);
+                    continue;
+                }
+                if (mode != NIR_MATH_FAST) continue;
+                if (i->op != nir_op_fsin && i->op != nir_op_fcos) continue;
+                lower_trig_fast(s, i);
+                lowered++;
+            }
+        }
+    }
+    return lowered;
+}
@@ -0,0 +1,420 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "gpu_ir.h"
+
+/* 块的结尾控制流指令, 没有则返回 NULL (函数的最后一个块) */
+static NirInstr* block_terminator(NirBlock *b) {
+    if (b->end && (b->end->op == nir_jump || b->end->op == nir_branch || b->end->op == nir_return))
+        return b->end;
+    return NULL;
+}
+
+static int count_preds(NirFunction *fn, NirBlock *target) {
+    int preds = 0;
+    for (NirBlock *b = fn->start_block; b; b = b->next_block) {
+        NirInstr *t = block_terminator(b);
+        if (!t || t->op == nir_return) continue;
+        if (b->successors[0] == target) preds++;
+        if (t->op == nir_branch && b->successors[1] == target) preds++;
+    }
+    return preds;
+}
+
+static void unlink_block(NirFunction *fn, NirBlock *victim) {
+    NirBlock **pp = &fn->start_block;
+    while (*pp && *pp != victim) pp = &(*pp)->next_block;
+    if (*pp) *pp = victim->next_block;
+}
+
+/*
+ * CFG 清理:
+ *   1. 删除从入口不可达的块 (例如 return 之后的语句)
+ *   2. 如果 A 以无条件跳转结尾, 目标 B 只有 A 一个前驱,
+ *      把 B 并入 A。内联产生的 "调用者 -> 函数体 -> 续块" 链会合成一个块。
+ * 返回删除的块数。
+ */
+int nir_opt_cleanup_cfg(NirFunction *fn) {
+    int removed = 0, progress = 1;
+
+    while (progress) {
+        progress = 0;
+
+        for (NirBlock *b = fn->start_block->next_block; b; ) {
+            NirBlock *next = b->next_block;
+            if (count_preds(fn, b) == 0) {
+                unlink_block(fn, b);
+                removed++;
+                progress = 1;
+            }
+            b = next;
+        }
+
+        for (NirBlock *a = fn->start_block; a; a = a->next_block) {
+            NirInstr *t = block_terminator(a);
+            if (!t || t->op != nir_jump) continue;
+            NirBlock *b = a->successors[0];
+            if (b == a || b == fn->start_block || count_preds(fn, b) != 1)
+                continue;
+
+            nir_instr_remove(t);
+            free(t);
+            for (NirInstr *i = b->start; i; ) {
+                NirInstr *next = i->next;
+                nir_instr_remove(i);
+                block_append_instr(a, i);
+                i = next;
+            }
+            a->successors[0] = b->successors[0];
+            a->successors[1] = b->successors[1];
+            unlink_block(fn, b);
+            removed++;
+            progress = 1;
+        }
+    }
+    return removed;
+}
+
+/* 把函数中对 from 的所有使用改为 to */
+static void replace_uses(NirFunction *fn, NirDef *from, NirDef *to) {
+    for (NirBlock *b = fn->start_block; b; b = b->next_block)
+        for (NirInstr *i = b->start; i; i = i->next)
+            for (int k = 0; k < i->num_srcs; k++)
+                if (i->srcs[k].ssa == from) i->srcs[k].ssa = to;
+}
+
+typedef struct VarValue { const char *name; NirDef *value; } VarValue;
+
+static VarValue* var_lookup(VarValue *tab, int n, const char *name) {
+    for (int k = 0; k < n; k++)
+        if (strcmp(tab[k].name, name) == 0) return &tab[k];
+    return NULL;
+}
+
+/*
+ * 块内变量拷贝传播:
+ *   store x, %a; ... load x      -> 直接使用 %a
+ *   load x (%b); ... load x      -> 第二次使用 %b
+ * 遇到无法内联的调用时清空, 被调函数可能写全局变量。
+ * 返回消除的 load 数。
+ */
+int nir_opt_copy_prop_vars(NirFunction *fn) {
+    int removed = 0;
+
+    for (NirBlock *b = fn->start_block; b; b = b->next_block) {
+        int n = 0, cap = 16;
+        VarValue *tab = (VarValue*)malloc(sizeof(VarValue) * cap);
+
+        for (NirInstr *i = b->start; i; ) {
+            NirInstr *next = i->next;
+            if (i->op == nir_call) {
+                n = 0;
+            } else if (i->op == nir_intrinsic_store_var || i->op == nir_intrinsic_load_var) {
+                NirDef *value = (i->op == nir_intrinsic_store_var) ? i->srcs[0].ssa : &i->def;
+                VarValue *v = var_lookup(tab, n, i->var_name);
+
+                if (i->op == nir_intrinsic_load_var && v) {
+                    replace_uses(fn, &i->def, v->value);
+                    nir_instr_remove(i);
+                    free(i);
+                    removed++;
+                } else if (v) {
+                    v->value = value;
+                } else {
+                    if (n == cap) tab = (VarValue*)realloc(tab, sizeof(VarValue) * (cap *= 2));
+                    tab[n].name = i->var_name;
+                    tab[n].value = value;
+                    n++;
+                }
+            }
+            i = next;
+        }
+        free(tab);
+    }
+    return removed;
+}
+
+static int def_has_uses(NirFunction *fn, NirDef *d);
+
+static int is_const(NirDef *d, float *v) {
+    NirInstr *i = d ? d->parent_instr : NULL;
+    if (!i || i->op != nir_load_const) return 0;
+    *v = i->const_value;
+    return 1;
+}
+
+/* 计算 ALU 指令在常量操作数上的结果, 不支持的操作返回 0 */
+static int fold_alu(NirOp op, float a, float b, float *r) {
+    switch (op) {
+        case nir_op_fadd: *r = a + b; return 1;
+        case nir_op_fsub: *r = a - b; return 1;
+        case nir_op_fmul: *r = a * b; return 1;
+        case nir_op_fdiv: if (b == 0.0f) return 0; *r = a / b; return 1;
+        case nir_op_fmax: *r = a > b ? a : b; return 1;
+        case nir_op_fmin: *r = a < b ? a : b; return 1;
+        case nir_op_flt:  *r = a <  b; return 1;
+        case nir_op_fge:  *r = a >= b; return 1;
+        case nir_op_feq:  *r = a == b; return 1;
+        case nir_op_fne:  *r = a != b; return 1;
+        default: return 0;
+    }
+}
+
+/*
+ * 常量折叠:
+ *   - 操作数全为常量的 ALU 指令原地改为 load_const (def 不变, 使用者无需改写)
+ *   - 条件为常量的分支改为无条件跳转, 另一侧由 CFG 清理删除
+ * 特化常量在生成 NIR 时已经是 load_const, 关闭的功能分支在这里整段消失。
+ * 返回折叠的指令数。
+ */
+int nir_opt_constant_folding(NirFunction *fn) {
+    int folded = 0;
+
+    for (NirBlock *b = fn->start_block; b; b = b->next_block) {
+        for (NirInstr *i = b->start; i; i = i->next) {
+            float a, c, r;
+            if (i->op == nir_branch) {
+                if (!is_const(i->srcs[0].ssa, &a)) continue;
+                i->op = nir_jump;
+                i->num_srcs = 0;
+                if (a == 0.0f) b->successors[0] = b->successors[1];
+                b->successors[1] = NULL;
+                folded++;
+            } else if (i->op == nir_op_bcsel) {
+                /* 条件为常量或两侧相同: 使用者直接改用被选中的值, 原指令由 DCE 删除 */
+                NirDef *pick = NULL;
+                if (is_const(i->srcs[0].ssa, &a)) pick = (a != 0.0f) ? i->srcs[1].ssa : i->srcs[2].ssa;
+                else if (i->srcs[1].ssa == i->srcs[2].ssa) pick = i->srcs[1].ssa;
+                if (!pick || !def_has_uses(fn, &i->def)) continue;
+                replace_uses(fn, &i->def, pick);
+                folded++;
+            } else if (i->op == nir_op_mov && i->num_srcs == 1) {
+                if (!is_const(i->srcs[0].ssa, &a)) continue;
+                i->op = nir_load_const;
+                i->const_value = a;
+                i->num_srcs = 0;
+                folded++;
+            } else if ((i->op == nir_op_fsin || i->op == nir_op_fcos || i->op == nir_op_frcp) &&
+                       i->num_srcs == 1) {
+                if (!is_const(i->srcs[0].ssa, &a)) continue;
+                if (i->op == nir_op_frcp && a == 0.0f) continue;
+                i->const_value = i->op == nir_op_fsin ? sinf(a) : i->op == nir_op_fcos ? cosf(a) : 1.0f / a;
+                i->op = nir_load_const;
+                i->num_srcs = 0;
+                folded++;
+            } else if (i->num_srcs == 2 && i->def.index != 0) {
+                if (!is_const(i->srcs[0].ssa, &a) || !is_const(i->srcs[1].ssa, &c)) continue;
+                if (!fold_alu(i->op, a, c, &r)) continue;
+                i->op = nir_load_const;
+                i->const_value = r;
+                i->num_srcs = 0;
+                folded++;
+            }
+        }
+    }
+    return folded;
+}
+
+static int def_has_uses(NirFunction *fn, NirDef *d) {
+    for (NirBlock *b = fn->start_block; b; b = b->next_block)
+        for (NirInstr *i = b->start; i; i = i->next)
+            for (int k = 0; k < i->num_srcs; k++)
+                if (i->srcs[k].ssa == d) return 1;
+    return 0;
+}
+
+static int var_is_loaded(NirFunction *fn, const char *name) {
+    for (NirBlock *b = fn->start_block; b; b = b->next_block)
+        for (NirInstr *i = b->start; i; i = i->next)
+            if (i->op == nir_intrinsic_load_var && strcmp(i->var_name, name) == 0) return 1;
+    return 0;
+}
+
+/* 只有 ALU 与 load 可以在结果无人使用时删除 */
+static int instr_is_pure(NirInstr *i) {
+    switch (i->op) {
+        case nir_intrinsic_store_var:
+        case nir_jump:
+        case nir_branch:
+        case nir_call:
+        case nir_return:
+            return 0;
+        default:
+            return i->def.index != 0;
+    }
+}
+
+/*
+ * 死代码删除:
+ *   - 内联临时变量 (名字含 '.') 的 store, 如果函数中不再有对应的 load
+ *   - 结果无人使用的纯指令
+ * 迭代到不动点, 返回删除的指令数。
+ */
+int nir_opt_dce(NirFunction *fn) {
+    int removed = 0, progress = 1;
+
+    while (progress) {
+        progress = 0;
+        for (NirBlock *b = fn->start_block; b; b = b->next_block) {
+            for (NirInstr *i = b->start; i; ) {
+                NirInstr *next = i->next;
+                int dead = 0;
+                if (i->op == nir_intrinsic_store_var)
+                    dead = strchr(i->var_name, '.') && !var_is_loaded(fn, i->var_name);
+                else if (instr_is_pure(i))
+                    dead = !def_has_uses(fn, &i->def);
+                if (dead) {
+                    nir_instr_remove(i);
+                    free(i);
+                    removed++;
+                    progress = 1;
+                }
+                i = next;
+            }
+        }
+    }
+    return removed;
+}
+
+/* --- If-conversion --- */
+
+typedef struct SideStore { const char *name; NirDef *then_val, *else_val; } SideStore;
+
+/*
+ * 检查 if 的一侧能否被展平: x == m 表示该侧为空;
+ * 否则 x 只能有 a 一个前驱、以跳到 m 结尾, 且只含 ALU / 常量 / 变量读写。
+ * 返回该侧的指令数, 不能展平返回 -1。
+ */
+static int side_cost(NirFunction *fn, NirBlock *x, NirBlock *m) {
+    int cost = 0;
+    if (x == m) return 0;
+    if (count_preds(fn, x) != 1) return -1;
+    NirInstr *t = block_terminator(x);
+    if (!t || t->op != nir_jump || x->successors[0] != m) return -1;
+    for (NirInstr *i = x->start; i != t; i = i->next) {
+        if (i->op == nir_call || i->op == nir_return || i->op == nir_branch) return -1;
+        cost++;
+    }
+    return cost;
+}
+
+static NirDef* side_value(SideStore *tab, int n, const char *name, int is_then) {
+    for (int k = 0; k < n; k++)
+        if (strcmp(tab[k].name, name) == 0) return is_then ? tab[k].then_val : tab[k].else_val;
+    return NULL;
+}
+
+static SideStore* side_store(SideStore *tab, int *n, const char *name) {
+    for (int k = 0; k < *n; k++)
+        if (strcmp(tab[k].name, name) == 0) return &tab[k];
+    tab[*n].name = name;
+    tab[*n].then_val = tab[*n].else_val = NULL;
+    return &tab[(*n)++];
+}
+
+/*
+ * 把 x 中的指令 (除结尾跳转) 移到 a 的末尾。
+ * store 不移动, 只记录每个变量最后写入的值; 之后对同一变量的 load
+ * 直接使用记录的值。
+ */
+static void hoist_side(NirFunction *fn, NirBlock *a, NirBlock *x, NirBlock *m,
+                       SideStore *tab, int *n, int is_then) {
+    if (x == m) return;
+    NirInstr *t = block_terminator(x);
+    for (NirInstr *i = x->start; i != t; ) {
+        NirInstr *next = i->next;
+        nir_instr_remove(i);
+        if (i->op == nir_intrinsic_store_var) {
+            SideStore *st = side_store(tab, n, i->var_name);
+            if (is_then) st->then_val = i->srcs[0].ssa;
+            else st->else_val = i->srcs[0].ssa;
+            free(i);
+        } else if (i->op == nir_intrinsic_load_var && side_value(tab, *n, i->var_name, is_then)) {
+            replace_uses(fn, &i->def, side_value(tab, *n, i->var_name, is_then));
+            free(i);
+        } else {
+            block_append_instr(a, i);
+        }
+        i = next;
+    }
+}
+
+/*
+ * If-conversion: 把 if/else 区域
+ *     a: br c -> t, e      t: ...; jump m      e: ...; jump m
+ * 展平为 a 中的直线代码, 两侧都执行, 每个被写入的变量用
+ *     store x, bcsel(c, x_then, x_else)
+ * 选出结果。SIMD 上 divergent 分支本来就要串行执行两侧, 展平后省掉
+ * 分支和掩码切换。后端没有分支指令, 没有可以退回的分支形式, 所以
+ * 不设代价上限, uniform 分支同样展平; 两侧没有副作用 (调用已全部内联),
+ * 多执行一侧只多花时间。嵌套的 if 从内向外逐层展平。
+ * t、e 变为不可达, 由 CFG 清理删除并把 m 并入 a。返回展平的 if 数。
+ */
+int nir_opt_if_convert(NirShader *s, NirFunction *fn) {
+    int converted = 0;
+
+    for (NirBlock *a = fn->start_block; a; a = a->next_block) {
+        NirInstr *br = block_terminator(a);
+        if (!br || br->op != nir_branch) continue;
+
+        NirBlock *t = a->successors[0], *e = a->successors[1], *m;
+        if (t == e || t == a || e == a) continue;
+        NirInstr *tt = block_terminator(t);
+        if (!tt || tt->op != nir_jump) continue;
+        m = t->successors[0];
+        if (m == a) continue;
+
+        int ct = side_cost(fn, t, m), ce = side_cost(fn, e, m);
+        if (ct < 0 || ce < 0) continue;
+
+        NirDef *cond = br->srcs[0].ssa;
+        SideStore *tab = (SideStore*)malloc(sizeof(SideStore) * (ct + ce + 1));
+        int n = 0;
+
+        nir_instr_remove(br);
+        free(br);
+        hoist_side(fn, a, t, m, tab, &n, 1);
+        hoist_side(fn, a, e, m, tab, &n, 0);
+
+        for (int k = 0; k < n; k++) {
+            NirDef *tv = tab[k].then_val, *ev = tab[k].else_val;
+            char *name = (char*)tab[k].name;
+            if (!tv) tv = &nir_build_load(s, a, name, ev->num_components)->def;
+            if (!ev) ev = &nir_build_load(s, a, name, tv->num_components)->def;
+            NirInstr *sel = nir_build_bcsel(s, a, cond, tv, ev);
+            nir_build_store(s, a, name, &sel->def, 0xF);
+        }
+        free(tab);
+
+        /* t / e 只剩跳转, 不再可达 */
+        a->successors[1] = NULL;
+        nir_build_jump(a, m);
+        converted++;
+    }
+    return converted;
+}
+
+/* 标准优化流水线: 内联之后反复做 CFG 清理、拷贝传播和死代码删除; 内联失败返回 -1 */
+int nir_optimize(NirShader *s) {
+    int inlined = nir_inline_functions(s);
+    if (inlined < 0) return -1;
+    int blocks = 0, loads = 0, consts = 0, ifs = 0, instrs = 0, progress = 1;
+
+    while (progress) {
+        int b = nir_opt_cleanup_cfg(s->entry);
+        int l = nir_opt_copy_prop_vars(s->entry);
+        int c = nir_opt_constant_folding(s->entry);
+        int f = nir_opt_if_convert(s, s->entry);
+        int d = nir_opt_dce(s->entry);
+        blocks += b; loads += l; consts += c; ifs += f; instrs += d;
+        progress = b || l || c || f || d;
+    }
+    nir_index_blocks(s);
+    s->start_block = s->entry->start_block;
+
+    printf("  Opt: %d call(s) inlined, %d block(s) merged/removed, %d load(s) forwarded, "
+           "%d constant(s) folded, %d if(s) flattened, %d dead instr(s)\n",
+           inlined, blocks, loads, consts, ifs, instrs);
+    return 0;
+}
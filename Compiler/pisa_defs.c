@@ -1,12 +1,14 @@
 #include "pisa_defs.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 MachineCode* create_code_buffer() {
     MachineCode *mc = (MachineCode*)malloc(sizeof(MachineCode));
     mc->size = 0; 
     mc->capacity = 1024; /* 修复：使用 capacity */
     mc->buffer = (uint32_t*)malloc(sizeof(uint32_t) * mc->capacity);
+    memset(mc->live_out, 0, sizeof(mc->live_out));
     return mc;
 }
 
@@ -18,6 +20,105 @@ void emit_word(MachineCode *mc, uint32_t w) {
     mc->buffer[mc->size++] = w;
 }
 
+void mark_live_out(MachineCode *mc, uint8_t r) {
+    mc->live_out[r / 32] |= 1u << (r % 32);
+}
+
+int is_live_out(const MachineCode *mc, uint8_t r) {
+    return (mc->live_out[r / 32] >> (r % 32)) & 1;
+}
+
 uint32_t encode_r(uint8_t op, uint8_t d, uint8_t s0, uint8_t s1) {
     return (op << 24) | (d << 16) | (s0 << 8) | s1;
-}
\ No newline at end of file
+}
+
+static const PisaOpInfo pisa_ops[] = {
+    /* op            name          unit            ndst nsrc imm cw   cr  lat issue */
+    { OP_S_MOV,      "S_MOV",      PISA_UNIT_SALU, 1,   1,   0,  0,   0,   1, 1 },
+    { OP_S_LOAD,     "S_LOAD",     PISA_UNIT_SMEM, 1,   2,   1,  0,   0,  20, 1 },
+    { OP_S_LOAD_X4,  "S_LOAD_X4",  PISA_UNIT_SMEM, 4,   2,   1,  0,   0,  22, 2 },
+    { OP_S_LOAD_X8,  "S_LOAD_X8",  PISA_UNIT_SMEM, 8,   2,   1,  0,   0,  24, 4 },
+    { OP_S_ADD,      "S_ADD",      PISA_UNIT_SALU, 1,   2,   0,  0,   0,   1, 1 },
+    { OP_S_SUB,      "S_SUB",      PISA_UNIT_SALU, 1,   2,   0,  0,   0,   1, 1 },
+    { OP_S_MUL,      "S_MUL",      PISA_UNIT_SALU, 1,   2,   0,  0,   0,   2, 1 },
+    { OP_S_MAD,      "S_MAD",      PISA_UNIT_SALU, 1,   3,   0,  0,   0,   2, 1 },
+    { OP_S_CMP_LT,   "S_CMP_LT",   PISA_UNIT_SALU, 0,   2,   0,  's', 0,   1, 1 },
+    { OP_S_CMP_GE,   "S_CMP_GE",   PISA_UNIT_SALU, 0,   2,   0,  's', 0,   1, 1 },
+    { OP_S_CMP_EQ,   "S_CMP_EQ",   PISA_UNIT_SALU, 0,   2,   0,  's', 0,   1, 1 },
+    { OP_S_CMP_NE,   "S_CMP_NE",   PISA_UNIT_SALU, 0,   2,   0,  's', 0,   1, 1 },
+    { OP_S_CSELECT,  "S_CSELECT",  PISA_UNIT_SALU, 1,   2,   0,  0,   's', 1, 1 },
+    { OP_V_ADD,      "V_ADD",      PISA_UNIT_VALU, 1,   2,   0,  0,   0,   4, 4 },
+    { OP_V_SUB,      "V_SUB",      PISA_UNIT_VALU, 1,   2,   0,  0,   0,   4, 4 },
+    { OP_V_MUL,      "V_MUL",      PISA_UNIT_VALU, 1,   2,   0,  0,   0,   4, 4 },
+    { OP_V_MAD,      "V_MAD",      PISA_UNIT_VALU, 1,   3,   0,  0,   0,   4, 4 },
+    { OP_V_CMP_LT,   "V_CMP_LT",   PISA_UNIT_VALU, 0,   2,   0,  'v', 0,   4, 4 },
+    { OP_V_CMP_GE,   "V_CMP_GE",   PISA_UNIT_VALU, 0,   2,   0,  'v', 0,   4, 4 },
+    { OP_V_CMP_EQ,   "V_CMP_EQ",   PISA_UNIT_VALU, 0,   2,   0,  'v', 0,   4, 4 },
+    { OP_V_CMP_NE,   "V_CMP_NE",   PISA_UNIT_VALU, 0,   2,   0,  'v', 0,   4, 4 },
+    { OP_V_CNDMASK,  "V_CNDMASK",  PISA_UNIT_VALU, 1,   2,   0,  0,   'v', 4, 4 },
+    { OP_V_MOV,      "V_MOV",      PISA_UNIT_VALU, 1,   1,   0,  0,   0,   4, 4 },
+    /* SFU 每周期处理一个 lane */
+    { OP_S_SIN,      "S_SIN",      PISA_UNIT_SFU,  1,   1,   0,  0,   0,   8, 1 },
+    { OP_S_COS,      "S_COS",      PISA_UNIT_SFU,  1,   1,   0,  0,   0,   8, 1 },
+    { OP_S_RCP,      "S_RCP",      PISA_UNIT_SFU,  1,   1,   0,  0,   0,   8, 1 },
+    { OP_V_SIN,      "V_SIN",      PISA_UNIT_SFU,  1,   1,   0,  0,   0,  24, 16 },
+    { OP_V_COS,      "V_COS",      PISA_UNIT_SFU,  1,   1,   0,  0,   0,  24, 16 },
+    { OP_V_RCP,      "V_RCP",      PISA_UNIT_SFU,  1,   1,   0,  0,   0,  24, 16 },
+    /* 纹理单元每周期过滤 4 个 lane, 延迟按纹理 cache 命中估计 */
+    { OP_V_SAMPLE,   "V_SAMPLE",   PISA_UNIT_TEX,  1,   2,   0,  0,   0,  40, 4 },
+};
+
+/* 不认识的操作码返回 NULL */
+const PisaOpInfo* pisa_op_info(uint8_t op) {
+    for (size_t k = 0; k < sizeof(pisa_ops) / sizeof(pisa_ops[0]); k++)
+        if (pisa_ops[k].op == op) return &pisa_ops[k];
+    return NULL;
+}
+
+/* 内联常量表, 必须与 QemuSim/prism_shader.c 中的表保持一致 */
+static const float pisa_inline_consts[PISA_NUM_INLINE_CONSTS] = {
+    0.0f, 0.5f, -0.5f, 1.0f, -1.0f, 2.0f, -2.0f, 4.0f, -4.0f
+};
+
+/* 值可以内联时返回操作数编号, 否则返回 -1 (按位比较, -0.0 不算 0.0) */
+int pisa_inline_const(float v) {
+    for (int k = 0; k < PISA_NUM_INLINE_CONSTS; k++)
+        if (memcmp(&v, &pisa_inline_consts[k], sizeof(float)) == 0) return PISA_INLINE_CONST + k;
+    return -1;
+}
+
+float pisa_inline_value(uint8_t r) {
+    return pisa_inline_consts[r - PISA_INLINE_CONST];
+}
+
+/*
+ * 一条指令占用的字数:
+ *   MAD 的第二个字携带 SRC_C, V_SAMPLE 的第二个字携带纹理槽和分量;
+ *   任何源操作数为 PISA_LITERAL 时, 末尾再跟一个 literal 字。
+ * avail 为 code 之后可读的字数, 只在需要时读取第二个字。
+ */
+int pisa_instr_words(const uint32_t *code, size_t avail) {
+    uint8_t op = code[0] >> 24, a = (code[0] >> 8) & 0xff, b = code[0] & 0xff;
+    int words = 1;
+
+    if (op == OP_S_LOAD || op == OP_S_LOAD_X4 || op == OP_S_LOAD_X8) return 1;
+    if (op == OP_V_MAD || op == OP_S_MAD) {
+        words = 2;
+        if (avail >= 2 && (code[1] & 0xff) == PISA_LITERAL) return 3;
+    }
+    if (op == OP_V_SAMPLE) words = 2;
+    if (a == PISA_LITERAL || b == PISA_LITERAL) words++;
+    return words;
+}
+
+/* 寄存器编号转可读名字 (v3 / s64 / 0.5 / lit), 使用轮转缓冲区以便在同一个 printf 中多次调用 */
+const char* pisa_reg_name(uint8_t r) {
+    static char bufs[4][16];
+    static int next = 0;
+    char *b = bufs[next++ & 3];
+    if (r == PISA_LITERAL) snprintf(b, 16, "lit");
+    else if (r >= PISA_INLINE_CONST && r < PISA_INLINE_CONST + PISA_NUM_INLINE_CONSTS)
+        snprintf(b, 16, "%g", pisa_inline_value(r));
+    else snprintf(b, 16, "%c%d", r < PISA_SGPR_BASE ? 'v' : 's', r);
+    return b;
+}
@@ -5,20 +5,113 @@
 
 /* 修复：统一使用短命名，与 backend.c 保持一致 */
 #define OP_S_LOAD 0x42
+#define OP_S_LOAD_X4 0x43 /* 连续加载 4 个 dword 到 sD..sD+3 */
+#define OP_S_LOAD_X8 0x44 /* 连续加载 8 个 dword 到 sD..sD+7 */
 #define OP_V_ADD  0x82
+#define OP_V_SUB  0x83
 #define OP_V_MOV  0xC0
 #define OP_S_MOV  0x40
 #define OP_V_MUL  0x8A
+/* V_MAD 占两个字: [OP][DEST][SRC_A][SRC_B] [0][0][0][SRC_C], vD = a * b + c */
+#define OP_V_MAD  0x8B
+
+/* 比较与选择: V_CMP_* 按 lane 写条件掩码 VCC (DEST 字段不用),
+ * V_CNDMASK vD, a, b: vD = VCC ? a : b */
+#define OP_V_CMP_LT  0x90
+#define OP_V_CMP_GE  0x91
+#define OP_V_CMP_EQ  0x92
+#define OP_V_CMP_NE  0x93
+#define OP_V_CNDMASK 0x94
+
+/* 标量 ALU: 操作码 = 对应向量操作码 - 0x30, 操作数和结果都在标量寄存器;
+ * S_CMP_* 写标量条件位 SCC, S_CSELECT 按 SCC 选择 */
+#define OP_S_ADD     0x52
+#define OP_S_SUB     0x53
+#define OP_S_MUL     0x5A
+#define OP_S_MAD     0x5B
+#define OP_S_CMP_LT  0x60
+#define OP_S_CMP_GE  0x61
+#define OP_S_CMP_EQ  0x62
+#define OP_S_CMP_NE  0x63
+#define OP_S_CSELECT 0x64
+
+/* 特殊函数单元 (SFU): 单操作数, 精度由模拟器的宿主数学库保证; RCP 为倒数 1 / x */
+#define OP_V_SIN     0xA0
+#define OP_V_COS     0xA1
+#define OP_V_RCP     0xA2
+#define OP_S_SIN     0x70
+#define OP_S_COS     0x71
+#define OP_S_RCP     0x72
+
+/* 纹理采样占两个字: [OP][DEST][U][V] [0][0][COMP][SLOT],
+ * 按描述符槽 SLOT 对归一化坐标 (u, v) 做双线性过滤, vD = 分量 COMP (0-3 即 rgba) */
+#define OP_V_SAMPLE  0xB0
+#define PISA_SAMPLE_WORD(slot, comp) ((uint32_t)(((comp) & 3) << 8 | ((slot) & 0xff)))
+#define PISA_SAMPLE_SLOT(w)          ((w) & 0xff)
+#define PISA_SAMPLE_COMP(w)          (((w) >> 8) & 3)
+
+/*
+ * 寄存器编号 (8 位操作数字段):
+ *   0  - 7   : 向量寄存器 v0-v7
+ *   10 - 62  : 标量临时寄存器
+ *   63       : 标量暂存寄存器, 放置一条指令放不下的第二个 literal
+ *   64 - 127 : 标量寄存器, 存放打包后的常量块 (每个 dword 一个)
+ *   128 - 136: 内联常量 (只能作源操作数), 见 pisa_inline_const()
+ *   255      : literal, 值在指令之后的下一个字 (每条指令最多一个)
+ * 向量指令的源操作数可以直接引用标量寄存器 (对所有 lane 广播)。
+ */
+#define PISA_NUM_VGPRS        8
+#define PISA_SGPR_BASE        10
+#define PISA_SGPR_SCRATCH     63
+#define PISA_SGPR_UNIFORM     64
+#define PISA_NUM_SGPRS        128
+#define PISA_INLINE_CONST     128
+#define PISA_NUM_INLINE_CONSTS 9
+#define PISA_LITERAL          255
+
+/* 操作数是否为常量 (内联常量或 literal) */
+#define PISA_IS_CONST(r)      ((r) >= PISA_INLINE_CONST)
+
+/*
+ * 指令描述表 (反汇编和静态周期估计共用)。
+ * 周期模型: 每个 wave 顺序单发射, 指令在源操作数就绪且所在单元空闲时发射;
+ * 向量单元每周期处理 4 个 lane, 一条 16 lane 的 VALU 指令占用 4 个周期。
+ */
+enum { PISA_UNIT_SALU, PISA_UNIT_VALU, PISA_UNIT_SMEM, PISA_UNIT_SFU, PISA_UNIT_TEX, PISA_NUM_UNITS };
+
+typedef struct PisaOpInfo {
+    uint8_t op;
+    const char *name;
+    uint8_t unit;
+    uint8_t ndst;           /* 从 DEST 开始连续写入的寄存器数, 0 表示不写 */
+    uint8_t nsrc;           /* 源操作数个数: a, b, c (MAD) */
+    uint8_t imm_b;          /* S_LOAD*: SRC_A 是常量块基址 s0 (不参与分析), SRC_B 是字节偏移 */
+    uint8_t cond_w, cond_r; /* 写 / 读 VCC ('v') 或 SCC ('s') */
+    uint8_t latency;        /* 发射到结果可用的周期数 */
+    uint8_t issue;          /* 占用执行单元的周期数 */
+} PisaOpInfo;
+
+const PisaOpInfo* pisa_op_info(uint8_t op);
 
 /* 机器码缓冲区 */
 typedef struct MachineCode {
     uint32_t *buffer;
     size_t size;
     size_t capacity; /* [修复] 从 cap 改为 capacity 以匹配 pisa_defs.c */
+    uint32_t live_out[8]; /* 程序结束时仍需保留的寄存器 (输出变量), 按寄存器号置位 */
 } MachineCode;
 
 MachineCode* create_code_buffer();
 void emit_word(MachineCode *mc, uint32_t w);
+void mark_live_out(MachineCode *mc, uint8_t r);
+int is_live_out(const MachineCode *mc, uint8_t r);
 uint32_t encode_r(uint8_t op, uint8_t d, uint8_t s0, uint8_t s1);
+const char* pisa_reg_name(uint8_t r);
+int pisa_inline_const(float v);
+float pisa_inline_value(uint8_t r);
+int pisa_instr_words(const uint32_t *code, size_t avail);
+
+/* 窥孔优化 (pisa_peephole.c) */
+int pisa_peephole(MachineCode *mc);
 
-#endif
\ No newline at end of file
+#endif
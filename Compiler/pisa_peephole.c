@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pisa_defs.h"
+
+/*
+ * 机器码窥孔优化 (寄存器分配之后)
+ *
+ * 直接在编码后的指令字上工作: 先按操作码表解码, 反复套用模式表中的规则
+ * 直到没有变化, 最后重新编码并压缩缓冲区。程序结束时只有 mc->live_out
+ * 中的寄存器 (输出变量) 是活跃的, 其余寄存器的最后一次写可以删除。
+ * 源操作数可以是常量 (PISA_IS_CONST), 改写操作数时要保证每条指令
+ * 最多只带一个 literal。
+ */
+
+/* 条件寄存器在分析中的编号 (8 位寄存器号之外) */
+#define PEEP_VCC 256
+#define PEEP_SCC 257
+
+/* 操作数字段的含义 */
+enum { F_NONE, F_REG, F_IMM };
+
+typedef struct PeepOpInfo {
+    uint8_t op;
+    uint8_t ndst;           /* DEST 开始连续写入的寄存器数, 0 表示不写 */
+    uint8_t src_a, src_b;   /* F_REG / F_IMM / F_NONE */
+    uint8_t src_c;          /* 第二个字中的 SRC_C 是否为寄存器 */
+    uint16_t cond_w, cond_r;/* 写 / 读的条件寄存器 (PEEP_VCC / PEEP_SCC) */
+    uint8_t ext;            /* 第二个字不含操作数 (V_SAMPLE 的纹理槽), 原样保留 */
+} PeepOpInfo;
+
+static const PeepOpInfo peep_ops[] = {
+    { OP_S_MOV,      1, F_REG, F_NONE, 0, 0,        0        },
+    { OP_S_LOAD,     1, F_REG, F_IMM,  0, 0,        0        },
+    { OP_S_LOAD_X4,  4, F_REG, F_IMM,  0, 0,        0        },
+    { OP_S_LOAD_X8,  8, F_REG, F_IMM,  0, 0,        0        },
+    { OP_S_ADD,      1, F_REG, F_REG,  0, 0,        0        },
+    { OP_S_SUB,      1, F_REG, F_REG,  0, 0,        0        },
+    { OP_S_MUL,      1, F_REG, F_REG,  0, 0,        0        },
+    { OP_S_MAD,      1, F_REG, F_REG,  1, 0,        0        },
+    { OP_S_CMP_LT,   0, F_REG, F_REG,  0, PEEP_SCC, 0        },
+    { OP_S_CMP_GE,   0, F_REG, F_REG,  0, PEEP_SCC, 0        },
+    { OP_S_CMP_EQ,   0, F_REG, F_REG,  0, PEEP_SCC, 0        },
+    { OP_S_CMP_NE,   0, F_REG, F_REG,  0, PEEP_SCC, 0        },
+    { OP_S_CSELECT,  1, F_REG, F_REG,  0, 0,        PEEP_SCC },
+    { OP_V_ADD,      1, F_REG, F_REG,  0, 0,        0        },
+    { OP_V_SUB,      1, F_REG, F_REG,  0, 0,        0        },
+    { OP_V_MUL,      1, F_REG, F_REG,  0, 0,        0        },
+    { OP_V_MAD,      1, F_REG, F_REG,  1, 0,        0        },
+    { OP_V_CMP_LT,   0, F_REG, F_REG,  0, PEEP_VCC, 0        },
+    { OP_V_CMP_GE,   0, F_REG, F_REG,  0, PEEP_VCC, 0        },
+    { OP_V_CMP_EQ,   0, F_REG, F_REG,  0, PEEP_VCC, 0        },
+    { OP_V_CMP_NE,   0, F_REG, F_REG,  0, PEEP_VCC, 0        },
+    { OP_V_CNDMASK,  1, F_REG, F_REG,  0, 0,        PEEP_VCC },
+    { OP_V_MOV,      1, F_REG, F_NONE, 0, 0,        0        },
+    { OP_S_SIN,      1, F_REG, F_NONE, 0, 0,        0        },
+    { OP_S_COS,      1, F_REG, F_NONE, 0, 0,        0        },
+    { OP_S_RCP,      1, F_REG, F_NONE, 0, 0,        0        },
+    { OP_V_SIN,      1, F_REG, F_NONE, 0, 0,        0        },
+    { OP_V_COS,      1, F_REG, F_NONE, 0, 0,        0        },
+    { OP_V_RCP,      1, F_REG, F_NONE, 0, 0,        0        },
+    { OP_V_SAMPLE,   1, F_REG, F_REG,  0, 0,        0,       1 },
+};
+
+static const PeepOpInfo* peep_op_info(uint8_t op) {
+    for (size_t k = 0; k < sizeof(peep_ops) / sizeof(peep_ops[0]); k++)
+        if (peep_ops[k].op == op) return &peep_ops[k];
+    return NULL;
+}
+
+typedef struct PeepInstr {
+    const PeepOpInfo *info;
+    uint8_t op, d, a, b, c;
+    uint32_t lit;           /* 某个源操作数为 PISA_LITERAL 时的值 */
+    uint32_t ext;
+    int dead;
+} PeepInstr;
+
+static int peep_has_lit(const PeepInstr *p) {
+    return (p->info->src_a == F_REG && p->a == PISA_LITERAL) ||
+           (p->info->src_b == F_REG && p->b == PISA_LITERAL) ||
+           (p->info->src_c && p->c == PISA_LITERAL);
+}
+
+/* 源操作数能否换成常量 r: 加载指令的基址必须是寄存器, literal 不能与已有的不同 */
+static int peep_accepts_const(const PeepInstr *p, uint8_t r, uint32_t lit) {
+    if (p->info->src_b == F_IMM) return 0;
+    return r != PISA_LITERAL || !peep_has_lit(p) || p->lit == lit;
+}
+
+static int peep_reads(const PeepInstr *p, int r) {
+    if (p->info->src_a == F_REG && p->a == r) return 1;
+    if (p->info->src_b == F_REG && p->b == r) return 1;
+    if (p->info->src_c && p->c == r) return 1;
+    return p->info->cond_r && p->info->cond_r == r;
+}
+
+static int peep_writes(const PeepInstr *p, int r) {
+    if (p->info->ndst && r >= p->d && r < p->d + p->info->ndst) return 1;
+    return p->info->cond_w && p->info->cond_w == r;
+}
+
+static int is_mov(const PeepInstr *p) { return p->op == OP_V_MOV || p->op == OP_S_MOV; }
+
+/* --- 模式 --- */
+
+/* V_MOV vN, vN / S_MOV sN, sN */
+static int peep_mov_self(const MachineCode *mc, PeepInstr *code, int n, int i) {
+    (void)mc; (void)n;
+    if (!is_mov(&code[i]) || code[i].d != code[i].a) return 0;
+    code[i].dead = 1;
+    return 1;
+}
+
+/*
+ * 拷贝传播: MOV d, a 之后读 d 的指令改为直接读 a, 直到 a 或 d 被改写。
+ * 如果在 d 被覆盖之前所有读都已改写, MOV 本身也删除。
+ */
+static int peep_copy_prop(const MachineCode *mc, PeepInstr *code, int n, int i) {
+    PeepInstr *mov = &code[i];
+    int changed = 0, kept = 0;
+    if (!is_mov(mov) || mov->d == mov->a) return 0;
+
+    for (int j = i + 1; j < n; j++) {
+        PeepInstr *p = &code[j];
+        if (p->dead) continue;
+        if (peep_reads(p, mov->d)) {
+            if (PISA_IS_CONST(mov->a) && !peep_accepts_const(p, mov->a, mov->lit)) {
+                kept = 1;
+            } else {
+                if (p->info->src_a == F_REG && p->a == mov->d) p->a = mov->a;
+                if (p->info->src_b == F_REG && p->b == mov->d) p->b = mov->a;
+                if (p->info->src_c && p->c == mov->d) p->c = mov->a;
+                if (mov->a == PISA_LITERAL) p->lit = mov->lit;
+                changed = 1;
+            }
+        }
+        if (peep_writes(p, mov->d)) {
+            if (kept) return changed;
+            mov->dead = 1;
+            return 1;
+        }
+        if (peep_writes(p, mov->a)) return changed;
+    }
+    /* 所有读都已改写, d 也不是输出 */
+    if (!kept && !is_live_out(mc, mov->d)) {
+        mov->dead = 1;
+        return 1;
+    }
+    return changed;
+}
+
+/*
+ * MUL t, x, y ; ADD d, t, c  ->  MAD d, x, y, c
+ * 要求 ADD 是 t 的唯一读者, x / y 在两条指令之间不变, t 在 ADD 之后不再活跃。
+ * t 可以与 x / y 是同一个寄存器: 删除 MUL 后该寄存器保留 x 的原值, 正是 MAD 要读的。
+ */
+static int peep_mad(const MachineCode *mc, PeepInstr *code, int n, int i) {
+    PeepInstr *mul = &code[i];
+    uint8_t add_op, mad_op;
+    if (mul->op == OP_V_MUL)      { add_op = OP_V_ADD; mad_op = OP_V_MAD; }
+    else if (mul->op == OP_S_MUL) { add_op = OP_S_ADD; mad_op = OP_S_MAD; }
+    else return 0;
+
+    int j;
+    for (j = i + 1; j < n; j++) {
+        PeepInstr *p = &code[j];
+        if (p->dead) continue;
+        if (peep_reads(p, mul->d) || peep_writes(p, mul->d) ||
+            peep_writes(p, mul->a) || peep_writes(p, mul->b)) break;
+    }
+    if (j == n) return 0;
+
+    PeepInstr *add = &code[j];
+    if (add->op != add_op || (add->a == mul->d) == (add->b == mul->d)) return 0;
+
+    /* t 在 ADD 之后不能再被读到 */
+    if (add->d != mul->d) {
+        int k;
+        for (k = j + 1; k < n; k++) {
+            if (code[k].dead) continue;
+            if (peep_reads(&code[k], mul->d)) return 0;
+            if (peep_writes(&code[k], mul->d)) break;
+        }
+        if (k == n && is_live_out(mc, mul->d)) return 0;
+    }
+
+    /* MAD 同样只能带一个 literal */
+    uint8_t c = (add->a == mul->d) ? add->b : add->a;
+    if (c == PISA_LITERAL && peep_has_lit(mul) && mul->lit != add->lit) return 0;
+    if (peep_has_lit(mul)) add->lit = mul->lit;
+    add->op = mad_op;
+    add->info = peep_op_info(mad_op);
+    add->a = mul->a;
+    add->b = mul->b;
+    add->c = c;
+    mul->dead = 1;
+    return 1;
+}
+
+/* 写入的寄存器在被读之前又被覆盖, 或者之后不再被读且不是输出: 删除这条写 */
+static int peep_dead_write(const MachineCode *mc, PeepInstr *code, int n, int i) {
+    PeepInstr *w = &code[i];
+    int r;
+    if (w->info->ndst == 1 && !w->info->cond_w) r = w->d;
+    else if (w->info->ndst == 0 && w->info->cond_w) r = w->info->cond_w;
+    else return 0;
+
+    for (int j = i + 1; j < n; j++) {
+        if (code[j].dead) continue;
+        if (peep_reads(&code[j], r)) return 0;
+        if (peep_writes(&code[j], r)) {
+            w->dead = 1;
+            return 1;
+        }
+    }
+    if (r >= PEEP_VCC || is_live_out(mc, r)) return 0;
+    w->dead = 1;
+    return 1;
+}
+
+typedef int (*PeepFn)(const MachineCode *mc, PeepInstr *code, int n, int i);
+
+static const struct { const char *name; PeepFn fn; } peep_patterns[] = {
+    { "mov-self",  peep_mov_self   },
+    { "copy-prop", peep_copy_prop  },
+    { "mad",       peep_mad        },
+    { "dead",      peep_dead_write },
+};
+
+#define PEEP_NUM_PATTERNS (sizeof(peep_patterns) / sizeof(peep_patterns[0]))
+
+/* 返回删除的字数, 遇到不认识的操作码时不做任何修改 */
+int pisa_peephole(MachineCode *mc) {
+    PeepInstr *code = (PeepInstr*)calloc(mc->size + 1, sizeof(PeepInstr));
+    int hits[PEEP_NUM_PATTERNS] = {0};
+    int n = 0, progress = 1;
+
+    for (size_t pc = 0; pc < mc->size; ) {
+        uint32_t w = mc->buffer[pc];
+        PeepInstr *p = &code[n++];
+        p->op = w >> 24;
+        p->d = (w >> 16) & 0xff;
+        p->a = (w >> 8) & 0xff;
+        p->b = w & 0xff;
+        p->info = peep_op_info(p->op);
+        int words = pisa_instr_words(&mc->buffer[pc], mc->size - pc);
+        if (!p->info || pc + words > mc->size) {
+            printf("  ; Peephole: unknown instruction 0x%08x, skipped\n", w);
+            free(code);
+            return 0;
+        }
+        if (p->info->src_c) p->c = mc->buffer[pc + 1] & 0xff;
+        if (p->info->ext) p->ext = mc->buffer[pc + 1];
+        if (peep_has_lit(p)) p->lit = mc->buffer[pc + words - 1];
+        pc += words;
+    }
+
+    while (progress) {
+        progress = 0;
+        for (int i = 0; i < n; i++) {
+            for (size_t k = 0; k < PEEP_NUM_PATTERNS && !code[i].dead; k++) {
+                if (peep_patterns[k].fn(mc, code, n, i)) {
+                    hits[k]++;
+                    progress = 1;
+                }
+            }
+        }
+    }
+
+    size_t old_size = mc->size;
+    mc->size = 0;
+    for (int i = 0; i < n; i++) {
+        if (code[i].dead) continue;
+        emit_word(mc, encode_r(code[i].op, code[i].d, code[i].a, code[i].b));
+        if (code[i].info->src_c) emit_word(mc, code[i].c);
+        if (code[i].info->ext) emit_word(mc, code[i].ext);
+        if (peep_has_lit(&code[i])) emit_word(mc, code[i].lit);
+    }
+    free(code);
+
+    int removed = (int)(old_size - mc->size);
+    printf("  ; Peephole: %d word(s) removed (", removed);
+    for (size_t k = 0; k < PEEP_NUM_PATTERNS; k++)
+        printf("%s%s %d", k ? ", " : "", peep_patterns[k].name, hits[k]);
+    printf(")\n");
+    return removed;
+}
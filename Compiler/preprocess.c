@@ -0,0 +1,873 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include "preprocess.h"
+
+/* 引擎支持的扩展, 每个扩展同时预定义一个同名宏 */
+static const char *pp_extensions[] = {
+    "GL_GOOGLE_include_directive",
+    NULL
+};
+
+/* --- 输出缓冲 --- */
+
+typedef struct PPBuf { char *data; size_t len, cap; } PPBuf;
+
+static void buf_putn(PPBuf *b, const char *s, size_t n) {
+    if (b->len + n + 1 > b->cap) {
+        while (b->len + n + 1 > b->cap) b->cap = b->cap ? b->cap * 2 : 256;
+        b->data = (char*)realloc(b->data, b->cap);
+    }
+    memcpy(b->data + b->len, s, n);
+    b->len += n;
+    b->data[b->len] = '\0';
+}
+
+static void buf_puts(PPBuf *b, const char *s) { buf_putn(b, s, strlen(s)); }
+static void buf_putc(PPBuf *b, char c) { buf_putn(b, &c, 1); }
+
+static void pp_error(Preprocessor *pp, const char *fmt, ...) {
+    va_list ap;
+    fprintf(stderr, "Preprocess Error: %s:%d: ", pp->file, pp->line);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+    pp->errors++;
+}
+
+static void pp_warning(Preprocessor *pp, const char *fmt, ...) {
+    va_list ap;
+    fprintf(stderr, "Preprocess Warning: %s:%d: ", pp->file, pp->line);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+}
+
+static int is_ident_start(int c) { return isalpha(c) || c == '_'; }
+static int is_ident_char(int c)  { return isalnum(c) || c == '_'; }
+
+static const char* skip_space(const char *p) {
+    while (*p == ' ' || *p == '\t' || *p == '\r') p++;
+    return p;
+}
+
+static const char* skip_ident(const char *p) {
+    while (is_ident_char((unsigned char)*p)) p++;
+    return p;
+}
+
+/* pp-number: 1, 1.5, .5e-3, 0x1F, 2.0f ... 作为整体跳过, 避免把后缀当成标识符 */
+static const char* skip_number(const char *p) {
+    while (is_ident_char((unsigned char)*p) || *p == '.') {
+        if ((*p == 'e' || *p == 'E') && (p[1] == '+' || p[1] == '-')) p++;
+        p++;
+    }
+    return p;
+}
+
+static char* dup_range(const char *s, size_t n) {
+    char *r = (char*)malloc(n + 1);
+    memcpy(r, s, n);
+    r[n] = '\0';
+    return r;
+}
+
+/* 文件名在 pp 中只保存一份, 行号表可以一直引用 */
+static const char* intern_name(Preprocessor *pp, const char *name, size_t len) {
+    for (int i = 0; i < pp->num_names; i++)
+        if (strlen(pp->names[i]) == len && strncmp(pp->names[i], name, len) == 0) return pp->names[i];
+    pp->names = (char**)realloc(pp->names, sizeof(char*) * (pp->num_names + 1));
+    return pp->names[pp->num_names++] = dup_range(name, len);
+}
+
+/* 输出一个换行, 并记录该输出行对应的源位置 */
+static void put_newline(Preprocessor *pp, PPBuf *out) {
+    if (pp->num_lines == pp->cap_lines) {
+        pp->cap_lines = pp->cap_lines ? pp->cap_lines * 2 : 256;
+        pp->line_files = (const char**)realloc(pp->line_files, sizeof(const char*) * pp->cap_lines);
+        pp->line_nums = (int*)realloc(pp->line_nums, sizeof(int) * pp->cap_lines);
+    }
+    pp->line_files[pp->num_lines] = pp->file;
+    pp->line_nums[pp->num_lines++] = pp->line;
+    buf_putc(out, '\n');
+}
+
+/* --- 宏表 --- */
+
+static PPMacro* find_macro(Preprocessor *pp, const char *name, size_t len) {
+    for (PPMacro *m = pp->macros; m; m = m->next)
+        if (strlen(m->name) == len && strncmp(m->name, name, len) == 0) return m;
+    return NULL;
+}
+
+static void free_macro(PPMacro *m) {
+    for (int i = 0; i < m->num_params; i++) free(m->params[i]);
+    free(m->name);
+    free(m->body);
+    free(m);
+}
+
+static void undef_macro(Preprocessor *pp, const char *name, size_t len) {
+    for (PPMacro **pp_m = &pp->macros; *pp_m; pp_m = &(*pp_m)->next) {
+        PPMacro *m = *pp_m;
+        if (strlen(m->name) == len && strncmp(m->name, name, len) == 0) {
+            *pp_m = m->next;
+            free_macro(m);
+            return;
+        }
+    }
+}
+
+/* 解析 "NAME body" 或 "NAME(a, b) body" 并定义宏 */
+static void define_macro(Preprocessor *pp, const char *p) {
+    p = skip_space(p);
+    if (!is_ident_start((unsigned char)*p)) {
+        pp_error(pp, "#define expects a macro name");
+        return;
+    }
+    const char *name = p;
+    p = skip_ident(p);
+    size_t len = p - name;
+    if (strncmp(name, "GL_", 3) == 0 || (len == 7 && strncmp(name, "defined", 7) == 0)) {
+        pp_error(pp, "macro name '%.*s' is reserved", (int)len, name);
+        return;
+    }
+
+    PPMacro *m = (PPMacro*)calloc(1, sizeof(PPMacro));
+    m->name = dup_range(name, len);
+    m->num_params = -1;
+
+    /* 名字后紧跟 '(' 才是函数宏 */
+    if (*p == '(') {
+        m->num_params = 0;
+        p = skip_space(p + 1);
+        while (*p != ')') {
+            if (!is_ident_start((unsigned char)*p) || m->num_params == PP_MAX_PARAMS) {
+                pp_error(pp, "bad parameter list for macro '%s'", m->name);
+                free_macro(m);
+                return;
+            }
+            const char *pn = p;
+            p = skip_ident(p);
+            m->params[m->num_params++] = dup_range(pn, p - pn);
+            p = skip_space(p);
+            if (*p == ',') p = skip_space(p + 1);
+            else if (*p != ')') {
+                pp_error(pp, "bad parameter list for macro '%s'", m->name);
+                free_macro(m);
+                return;
+            }
+        }
+        p++;
+    }
+
+    p = skip_space(p);
+    size_t blen = strlen(p);
+    while (blen && isspace((unsigned char)p[blen - 1])) blen--;
+    m->body = dup_range(p, blen);
+
+    PPMacro *old = find_macro(pp, m->name, len);
+    if (old) {
+        if (old->num_params != m->num_params || strcmp(old->body, m->body) != 0)
+            pp_warning(pp, "macro '%s' redefined", m->name);
+        undef_macro(pp, m->name, len);
+    }
+    m->next = pp->macros;
+    pp->macros = m;
+}
+
+/* --- 宏展开 --- */
+
+/* 正在展开的宏 (禁止递归展开自身) */
+typedef struct PPHide { const char *name; const struct PPHide *up; } PPHide;
+
+static int is_hidden(const PPHide *h, const char *name, size_t len) {
+    for (; h; h = h->up)
+        if (strlen(h->name) == len && strncmp(h->name, name, len) == 0) return 1;
+    return 0;
+}
+
+static void expand(Preprocessor *pp, const char *s, PPBuf *out, const PPHide *hide);
+
+/* 删除 "##" 及其两侧的空白, 把两边的记号拼接起来 */
+static void paste_tokens(PPBuf *b) {
+    char *r = b->data, *w = b->data;
+    if (!r) return;
+    while (*r) {
+        if (r[0] == '#' && r[1] == '#') {
+            while (w > b->data && (w[-1] == ' ' || w[-1] == '\t')) w--;
+            r = (char*)skip_space(r + 2);
+        } else {
+            *w++ = *r++;
+        }
+    }
+    *w = '\0';
+    b->len = w - b->data;
+}
+
+static int param_index(PPMacro *m, const char *name, size_t len) {
+    for (int i = 0; i < m->num_params; i++)
+        if (strlen(m->params[i]) == len && strncmp(m->params[i], name, len) == 0) return i;
+    return -1;
+}
+
+/* 形参替换: 与 ## 相邻的形参用原始实参, 其余用展开后的实参 */
+static void substitute(Preprocessor *pp, PPMacro *m, char **args, PPBuf *out, const PPHide *hide) {
+    const char *p = m->body;
+    while (*p) {
+        if (is_ident_start((unsigned char)*p)) {
+            const char *id = p;
+            p = skip_ident(p);
+            int k = param_index(m, id, p - id);
+            if (k < 0) {
+                buf_putn(out, id, p - id);
+                continue;
+            }
+            const char *before = id;
+            while (before > m->body && (before[-1] == ' ' || before[-1] == '\t')) before--;
+            const char *after = skip_space(p);
+            int pasted = (before - m->body >= 2 && before[-1] == '#' && before[-2] == '#') ||
+                         (after[0] == '#' && after[1] == '#');
+            if (pasted) buf_puts(out, args[k]);
+            else expand(pp, args[k], out, hide);
+        } else if (isdigit((unsigned char)*p)) {
+            const char *num = p;
+            p = skip_number(p);
+            buf_putn(out, num, p - num);
+        } else {
+            buf_putc(out, *p++);
+        }
+    }
+}
+
+/*
+ * 收集函数宏的实参, p 指向 '(' 。
+ * 返回 ')' 之后的位置, 出错返回 NULL。
+ */
+static const char* collect_args(Preprocessor *pp, PPMacro *m, const char *p, char **args, int *nargs) {
+    int depth = 0;
+    const char *start = p + 1;
+    *nargs = 0;
+    for (p++; ; p++) {
+        if (*p == '\0') {
+            pp_error(pp, "unterminated call to macro '%s'", m->name);
+            return NULL;
+        }
+        if (*p == '(') { depth++; continue; }
+        if ((*p == ',' && depth == 0) || (*p == ')' && depth == 0)) {
+            if (*nargs == PP_MAX_PARAMS) {
+                pp_error(pp, "too many arguments to macro '%s'", m->name);
+                return NULL;
+            }
+            const char *a = skip_space(start), *e = p;
+            while (e > a && isspace((unsigned char)e[-1])) e--;
+            args[(*nargs)++] = dup_range(a, e - a);
+            start = p + 1;
+            if (*p == ')') return p + 1;
+            continue;
+        }
+        if (*p == ')') depth--;
+    }
+}
+
+/*
+ * s 是否以未闭合的函数宏调用结尾 (实参跨越多行), 包括宏名在行尾、
+ * '(' 在下一行的情况。这时需要拼接下一行再展开。
+ */
+static int open_macro_call(Preprocessor *pp, const char *s) {
+    const char *p = s;
+    while (*p) {
+        if (isdigit((unsigned char)*p) || (*p == '.' && isdigit((unsigned char)p[1]))) {
+            p = skip_number(p);
+            continue;
+        }
+        if (!is_ident_start((unsigned char)*p)) { p++; continue; }
+        const char *id = p;
+        p = skip_ident(p);
+        PPMacro *m = find_macro(pp, id, p - id);
+        if (!m || m->num_params < 0) continue;
+        const char *q = skip_space(p);
+        if (*q == '\0') return 1;
+        if (*q != '(') continue;
+        int depth = 0;
+        for (; *q; q++) {
+            if (*q == '(') depth++;
+            else if (*q == ')' && --depth == 0) break;
+        }
+        if (!*q) return 1;
+        p = q + 1;
+    }
+    return 0;
+}
+
+static int expand_builtin(Preprocessor *pp, const char *name, size_t len, PPBuf *out) {
+    char tmp[32];
+    if (len == 8 && strncmp(name, "__LINE__", 8) == 0)         snprintf(tmp, sizeof(tmp), "%d", pp->line);
+    else if (len == 8 && strncmp(name, "__FILE__", 8) == 0)    snprintf(tmp, sizeof(tmp), "%d", pp->source);
+    else if (len == 11 && strncmp(name, "__VERSION__", 11) == 0) snprintf(tmp, sizeof(tmp), "%d", pp->version);
+    else return 0;
+    buf_puts(out, tmp);
+    return 1;
+}
+
+/* 展开 s 中的宏, 结果追加到 out */
+static void expand(Preprocessor *pp, const char *s, PPBuf *out, const PPHide *hide) {
+    const char *p = s;
+    while (*p) {
+        if (isdigit((unsigned char)*p) || (*p == '.' && isdigit((unsigned char)p[1]))) {
+            const char *num = p;
+            p = skip_number(p);
+            buf_putn(out, num, p - num);
+            continue;
+        }
+        if (!is_ident_start((unsigned char)*p)) {
+            buf_putc(out, *p++);
+            continue;
+        }
+
+        const char *id = p;
+        p = skip_ident(p);
+        size_t len = p - id;
+        if (expand_builtin(pp, id, len, out)) continue;
+
+        PPMacro *m = find_macro(pp, id, len);
+        if (!m || is_hidden(hide, id, len)) {
+            buf_putn(out, id, len);
+            continue;
+        }
+
+        char *args[PP_MAX_PARAMS] = {NULL};
+        int nargs = 0;
+        if (m->num_params >= 0) {
+            const char *q = skip_space(p);
+            if (*q != '(') {                /* 没有实参列表, 不是调用 */
+                buf_putn(out, id, len);
+                continue;
+            }
+            p = collect_args(pp, m, q, args, &nargs);
+            if (!p) return;
+            if (m->num_params == 0 && nargs == 1 && args[0][0] == '\0') {
+                free(args[0]);
+                nargs = 0;
+            }
+            if (nargs != m->num_params) {
+                pp_error(pp, "macro '%s' expects %d argument(s), got %d", m->name, m->num_params, nargs);
+                for (int i = 0; i < nargs; i++) free(args[i]);
+                continue;
+            }
+        }
+
+        PPBuf body = {0};
+        if (m->num_params > 0) substitute(pp, m, args, &body, hide);
+        else buf_puts(&body, m->body);
+        paste_tokens(&body);
+
+        /* 重新扫描替换结果, 此时 m 自身不再展开 */
+        PPHide h = { m->name, hide };
+        if (body.data) expand(pp, body.data, out, &h);
+
+        free(body.data);
+        for (int i = 0; i < nargs; i++) free(args[i]);
+    }
+}
+
+/* --- #if 表达式求值 --- */
+
+typedef struct PPExpr { Preprocessor *pp; const char *p; int failed; } PPExpr;
+
+static long ex_binary(PPExpr *e, int min_prec);
+
+static long ex_unary(PPExpr *e) {
+    e->p = skip_space(e->p);
+    char c = *e->p;
+    if (c == '(') {
+        e->p++;
+        long v = ex_binary(e, 1);
+        e->p = skip_space(e->p);
+        if (*e->p != ')') { e->failed = 1; return 0; }
+        e->p++;
+        return v;
+    }
+    if (c == '!') { e->p++; return !ex_unary(e); }
+    if (c == '~') { e->p++; return ~ex_unary(e); }
+    if (c == '-') { e->p++; return -ex_unary(e); }
+    if (c == '+') { e->p++; return ex_unary(e); }
+    if (isdigit((unsigned char)c)) {
+        char *end;
+        long v = strtol(e->p, &end, 0);
+        e->p = end;
+        if (*e->p == 'u' || *e->p == 'U') e->p++;
+        return v;
+    }
+    if (is_ident_start((unsigned char)c)) {   /* 展开后仍未定义的标识符为 0 */
+        e->p = skip_ident(e->p);
+        return 0;
+    }
+    e->failed = 1;
+    return 0;
+}
+
+static const struct { const char *op; int prec; } ex_ops[] = {
+    {"||", 1}, {"&&", 2}, {"==", 6}, {"!=", 6}, {"<=", 7}, {">=", 7},
+    {"<<", 8}, {">>", 8}, {"|", 3}, {"^", 4}, {"&", 5}, {"<", 7}, {">", 7},
+    {"+", 9}, {"-", 9}, {"*", 10}, {"/", 10}, {"%", 10},
+    {NULL, 0}
+};
+
+static long ex_binary(PPExpr *e, int min_prec) {
+    long lhs = ex_unary(e);
+    for (;;) {
+        e->p = skip_space(e->p);
+        int k;
+        for (k = 0; ex_ops[k].op; k++)
+            if (strncmp(e->p, ex_ops[k].op, strlen(ex_ops[k].op)) == 0) break;
+        if (!ex_ops[k].op || ex_ops[k].prec < min_prec) return lhs;
+
+        const char *op = ex_ops[k].op;
+        e->p += strlen(op);
+        long rhs = ex_binary(e, ex_ops[k].prec + 1);
+        switch (op[0]) {
+            case '|': lhs = op[1] ? (lhs || rhs) : (lhs | rhs); break;
+            case '&': lhs = op[1] ? (lhs && rhs) : (lhs & rhs); break;
+            case '^': lhs = lhs ^ rhs; break;
+            case '=': lhs = lhs == rhs; break;
+            case '!': lhs = lhs != rhs; break;
+            case '<': lhs = op[1] == '=' ? lhs <= rhs : op[1] == '<' ? lhs << rhs : lhs < rhs; break;
+            case '>': lhs = op[1] == '=' ? lhs >= rhs : op[1] == '>' ? lhs >> rhs : lhs > rhs; break;
+            case '+': lhs = lhs + rhs; break;
+            case '-': lhs = lhs - rhs; break;
+            case '*': lhs = lhs * rhs; break;
+            case '/':
+            case '%':
+                if (rhs == 0) { pp_error(e->pp, "division by zero in #if"); return 0; }
+                lhs = op[0] == '/' ? lhs / rhs : lhs % rhs;
+                break;
+        }
+    }
+}
+
+/* 先把 defined X / defined(X) 替换为 0/1, 再展开宏, 最后求值 */
+static int eval_condition(Preprocessor *pp, const char *s) {
+    PPBuf pre = {0}, exp = {0};
+    const char *p = s;
+
+    while (*p) {
+        if (!is_ident_start((unsigned char)*p)) { buf_putc(&pre, *p++); continue; }
+        const char *id = p;
+        p = skip_ident(p);
+        if (p - id != 7 || strncmp(id, "defined", 7) != 0) {
+            buf_putn(&pre, id, p - id);
+            continue;
+        }
+        p = skip_space(p);
+        int paren = (*p == '(');
+        if (paren) p = skip_space(p + 1);
+        const char *name = p;
+        p = skip_ident(p);
+        if (p == name) {
+            pp_error(pp, "'defined' expects a macro name");
+            break;
+        }
+        buf_putc(&pre, find_macro(pp, name, p - name) ? '1' : '0');
+        if (paren) {
+            p = skip_space(p);
+            if (*p == ')') p++;
+            else pp_error(pp, "missing ')' after 'defined'");
+        }
+    }
+
+    if (pre.data) expand(pp, pre.data, &exp, NULL);
+    PPExpr e = { pp, exp.data ? exp.data : "", 0 };
+    long v = ex_binary(&e, 1);
+    if (e.failed || *skip_space(e.p) != '\0') {
+        pp_error(pp, "invalid #if expression '%s'", s);
+        v = 0;
+    }
+    free(pre.data);
+    free(exp.data);
+    return v != 0;
+}
+
+/* --- 源文件处理 --- */
+
+static char* read_file(const char *path) {
+    FILE *f = path ? fopen(path, "rb") : stdin;
+    PPBuf b = {0};
+    char chunk[4096];
+    size_t n;
+
+    if (!f) return NULL;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) buf_putn(&b, chunk, n);
+    if (path) fclose(f);
+    if (!b.data) buf_puts(&b, "");
+    return b.data;
+}
+
+/*
+ * 续行拼接与注释删除。
+ * "\\\n" 被删除, 在下一个换行处补回同样多的换行, 保持后续行号不变;
+ * 注释替换为一个空格, 块注释中的换行保留。
+ */
+static char* clean_source(const char *src) {
+    PPBuf b = {0};
+    int pending = 0;
+    const char *p = src;
+
+    while (*p) {
+        if (p[0] == '\\' && (p[1] == '\n' || (p[1] == '\r' && p[2] == '\n'))) {
+            p += (p[1] == '\r') ? 3 : 2;
+            pending++;
+        } else if (p[0] == '/' && p[1] == '/') {
+            while (*p && *p != '\n') {
+                if (p[0] == '\\' && p[1] == '\n') { pending++; p++; }
+                p++;
+            }
+            buf_putc(&b, ' ');
+        } else if (p[0] == '/' && p[1] == '*') {
+            p += 2;
+            while (*p && !(p[0] == '*' && p[1] == '/')) {
+                if (*p == '\n') pending++;
+                p++;
+            }
+            if (*p) p += 2;
+            buf_putc(&b, ' ');
+        } else if (*p == '\n') {
+            buf_putc(&b, '\n');
+            for (; pending; pending--) buf_putc(&b, '\n');
+            p++;
+        } else {
+            buf_putc(&b, *p++);
+        }
+    }
+    for (; pending; pending--) buf_putc(&b, '\n');
+    if (!b.data) buf_puts(&b, "");
+    return b.data;
+}
+
+/* 条件编译栈的一层 */
+typedef struct PPCond {
+    int parent_active;  /* 外层是否在输出 */
+    int active;         /* 当前分支是否输出 */
+    int taken;          /* 是否已有分支被选中 */
+    int seen_else;
+} PPCond;
+
+static void process_source(Preprocessor *pp, const char *path, const char *text, PPBuf *out);
+
+static char* resolve_include(Preprocessor *pp, const char *name, int quoted) {
+    char path[1024];
+
+    /* "file" 先相对当前文件所在目录查找 */
+    if (quoted) {
+        const char *slash = strrchr(pp->file, '/');
+        if (slash) snprintf(path, sizeof(path), "%.*s/%s", (int)(slash - pp->file), pp->file, name);
+        else snprintf(path, sizeof(path), "%s", name);
+        FILE *f = fopen(path, "rb");
+        if (f) { fclose(f); return strdup(path); }
+    }
+    for (int i = 0; i < pp->num_include_dirs; i++) {
+        snprintf(path, sizeof(path), "%s/%s", pp->include_dirs[i], name);
+        FILE *f = fopen(path, "rb");
+        if (f) { fclose(f); return strdup(path); }
+    }
+    return NULL;
+}
+
+static void do_include(Preprocessor *pp, const char *p, PPBuf *out) {
+    p = skip_space(p);
+    char close = (*p == '"') ? '"' : (*p == '<') ? '>' : 0;
+    const char *end = close ? strchr(p + 1, close) : NULL;
+    if (!end) {
+        pp_error(pp, "#include expects \"file\" or <file>");
+        return;
+    }
+    if (pp->depth + 1 >= PP_MAX_INCLUDE_DEPTH) {
+        pp_error(pp, "#include nested too deeply");
+        return;
+    }
+
+    char *name = dup_range(p + 1, end - p - 1);
+    char *path = resolve_include(pp, name, close == '"');
+    char *src = path ? read_file(path) : NULL;
+    if (!src) {
+        pp_error(pp, "cannot open include file '%s'", name);
+    } else {
+        char *clean = clean_source(src);
+        pp->depth++;
+        process_source(pp, path, clean, out);
+        pp->depth--;
+        free(clean);
+    }
+    free(src);
+    free(path);
+    free(name);
+}
+
+static void do_extension(Preprocessor *pp, const char *p) {
+    char name[128], behavior[32];
+    if (sscanf(p, " %127[A-Za-z0-9_] : %31[a-z]", name, behavior) != 2) {
+        pp_error(pp, "#extension expects 'name : behavior'");
+        return;
+    }
+    if (strcmp(behavior, "require") && strcmp(behavior, "enable") &&
+        strcmp(behavior, "warn") && strcmp(behavior, "disable")) {
+        pp_error(pp, "unknown extension behavior '%s'", behavior);
+        return;
+    }
+    if (strcmp(name, "all") == 0) {
+        if (!strcmp(behavior, "require") || !strcmp(behavior, "enable"))
+            pp_error(pp, "'#extension all' only allows warn or disable");
+        return;
+    }
+
+    int supported = 0;
+    for (int i = 0; pp_extensions[i]; i++)
+        if (strcmp(pp_extensions[i], name) == 0) supported = 1;
+    if (supported) return;
+    if (!strcmp(behavior, "require")) pp_error(pp, "required extension '%s' is not supported", name);
+    else if (!strcmp(behavior, "enable")) pp_warning(pp, "extension '%s' is not supported", name);
+}
+
+/*
+ * #line N [S] / #line N "file" (GL_GOOGLE_include_directive):
+ * 下一行的行号为 N, 整数 S 修改源字符串编号 (__FILE__), 字符串修改文件名
+ */
+static void do_line(Preprocessor *pp, const char *p) {
+    PPBuf e = {0};
+    expand(pp, p, &e, NULL);
+    const char *s = skip_space(e.data ? e.data : "");
+    char *end;
+
+    if (!isdigit((unsigned char)*s)) {
+        pp_error(pp, "#line expects a line number");
+        free(e.data);
+        return;
+    }
+    long n = strtol(s, &end, 10);
+    s = skip_space(end);
+    if (*s == '"') {
+        const char *q = strchr(s + 1, '"');
+        if (!q) {
+            pp_error(pp, "missing '\"' in #line");
+            free(e.data);
+            return;
+        }
+        pp->file = intern_name(pp, s + 1, q - s - 1);
+        s = skip_space(q + 1);
+    } else if (isdigit((unsigned char)*s)) {
+        pp->source = (int)strtol(s, &end, 10);
+        s = skip_space(end);
+    }
+    if (*s) pp_error(pp, "unexpected '%s' after #line", s);
+    else pp->line = (int)n - 1;
+    free(e.data);
+}
+
+static void process_source(Preprocessor *pp, const char *path, const char *text, PPBuf *out) {
+    PPCond conds[PP_MAX_COND_DEPTH];
+    int ncond = 0;
+    int seen_code = 0;
+    const char *saved_file = pp->file;
+    int saved_line = pp->line;
+    int saved_source = pp->source;
+    const char *p = text;
+
+    pp->file = intern_name(pp, path, strlen(path));
+    pp->line = 0;
+    pp->source = pp->depth;
+
+    while (*p) {
+        const char *eol = strchr(p, '\n');
+        size_t len = eol ? (size_t)(eol - p) : strlen(p);
+        char *line = dup_range(p, len);
+        p += len + (eol ? 1 : 0);
+        pp->line++;
+
+        int active = ncond ? conds[ncond - 1].active : 1;
+        const char *d = skip_space(line);
+
+        if (*d != '#') {
+            int joined = 0;
+            if (active) {
+                /* 函数宏的实参跨越多行: 把后续行拼进来 (指令行除外), 每拼一行补一个空行 */
+                while (*p && open_macro_call(pp, line) && *skip_space(p) != '#') {
+                    eol = strchr(p, '\n');
+                    len = eol ? (size_t)(eol - p) : strlen(p);
+                    size_t old = strlen(line);
+                    line = (char*)realloc(line, old + len + 2);
+                    line[old] = ' ';
+                    memcpy(line + old + 1, p, len);
+                    line[old + 1 + len] = '\0';
+                    p += len + (eol ? 1 : 0);
+                    joined++;
+                }
+                d = skip_space(line);
+                expand(pp, line, out, NULL);
+                if (*d) seen_code = 1;
+            }
+            put_newline(pp, out);
+            for (; joined; joined--) {
+                pp->line++;
+                put_newline(pp, out);
+            }
+            free(line);
+            continue;
+        }
+
+        /* 预处理指令 */
+        d = skip_space(d + 1);
+        const char *name = d;
+        d = skip_ident(d);
+        size_t nlen = d - name;
+        const char *rest = skip_space(d);
+        #define IS(s) (nlen == strlen(s) && strncmp(name, s, nlen) == 0)
+
+        if (IS("if") || IS("ifdef") || IS("ifndef")) {
+            if (ncond == PP_MAX_COND_DEPTH) {
+                pp_error(pp, "conditionals nested too deeply");
+            } else {
+                int v = 0;
+                if (active) {
+                    if (IS("if")) {
+                        v = eval_condition(pp, rest);
+                    } else {
+                        const char *e = skip_ident(rest);
+                        if (e == rest) pp_error(pp, "#%.*s expects a macro name", (int)nlen, name);
+                        v = find_macro(pp, rest, e - rest) != NULL;
+                        if (IS("ifndef")) v = !v;
+                    }
+                }
+                PPCond c = { active, active && v, active && v, 0 };
+                conds[ncond++] = c;
+            }
+        } else if (IS("elif")) {
+            PPCond *c = ncond ? &conds[ncond - 1] : NULL;
+            if (!c || c->seen_else) {
+                pp_error(pp, "#elif without matching #if");
+            } else {
+                c->active = c->parent_active && !c->taken && eval_condition(pp, rest);
+                c->taken |= c->active;
+            }
+        } else if (IS("else")) {
+            PPCond *c = ncond ? &conds[ncond - 1] : NULL;
+            if (!c || c->seen_else) {
+                pp_error(pp, "#else without matching #if");
+            } else {
+                c->active = c->parent_active && !c->taken;
+                c->taken = 1;
+                c->seen_else = 1;
+            }
+        } else if (IS("endif")) {
+            if (!ncond) pp_error(pp, "#endif without matching #if");
+            else ncond--;
+        } else if (!active) {
+            /* 被跳过的分支中只处理条件指令 */
+        } else if (IS("define")) {
+            define_macro(pp, rest);
+        } else if (IS("undef")) {
+            const char *e = skip_ident(rest);
+            undef_macro(pp, rest, e - rest);
+        } else if (IS("include")) {
+            do_include(pp, rest, out);
+        } else if (IS("version")) {
+            if (pp->depth > 0 || seen_code) pp_error(pp, "#version must occur before anything else");
+            else pp->version = atoi(rest);
+        } else if (IS("extension")) {
+            do_extension(pp, rest);
+        } else if (IS("error")) {
+            pp_error(pp, "#error %s", rest);
+        } else if (IS("line")) {
+            do_line(pp, rest);
+        } else if (IS("pragma") || nlen == 0) {
+            /* 忽略 */
+        } else {
+            pp_error(pp, "unknown directive '#%.*s'", (int)nlen, name);
+        }
+        #undef IS
+
+        seen_code = 1;
+        put_newline(pp, out);
+        free(line);
+    }
+
+    if (ncond) pp_error(pp, "unterminated conditional (%d #endif missing)", ncond);
+    pp->file = saved_file;
+    pp->line = saved_line;
+    pp->source = saved_source;
+}
+
+/* --- API --- */
+
+Preprocessor* pp_create(void) {
+    Preprocessor *pp = (Preprocessor*)calloc(1, sizeof(Preprocessor));
+    pp->version = 110;
+    pp->file = "<command line>";
+    for (int i = 0; pp_extensions[i]; i++) {
+        PPMacro *m = (PPMacro*)calloc(1, sizeof(PPMacro));
+        m->name = strdup(pp_extensions[i]);
+        m->num_params = -1;
+        m->body = strdup("1");
+        m->next = pp->macros;
+        pp->macros = m;
+    }
+    return pp;
+}
+
+void pp_define(Preprocessor *pp, const char *def) {
+    const char *eq = strchr(def, '=');
+    PPBuf b = {0};
+    if (eq) {
+        buf_putn(&b, def, eq - def);
+        buf_putc(&b, ' ');
+        buf_puts(&b, eq + 1);
+    } else {
+        buf_puts(&b, def);
+        buf_puts(&b, " 1");
+    }
+    define_macro(pp, b.data);
+    free(b.data);
+}
+
+void pp_add_include_dir(Preprocessor *pp, const char *dir) {
+    if (pp->num_include_dirs < PP_MAX_INCLUDE_DIRS) pp->include_dirs[pp->num_include_dirs++] = dir;
+}
+
+char* pp_process_file(Preprocessor *pp, const char *path) {
+    char *src = read_file(path);
+    if (!src) {
+        fprintf(stderr, "Preprocess Error: cannot open '%s'\n", path);
+        return NULL;
+    }
+
+    char *clean = clean_source(src);
+    PPBuf out = {0};
+    process_source(pp, path ? path : "<stdin>", clean, &out);
+    free(clean);
+    free(src);
+
+    if (pp->errors) {
+        free(out.data);
+        return NULL;
+    }
+    if (!out.data) buf_puts(&out, "");
+    return out.data;
+}
+
+int pp_source_line(const Preprocessor *pp, int out_line, const char **file) {
+    if (pp->num_lines == 0) {
+        *file = pp->file;
+        return out_line;
+    }
+    if (out_line < 1) out_line = 1;
+    /* 超出末尾 (文件末尾的错误) 时按最后一行顺延 */
+    if (out_line > pp->num_lines) {
+        *file = pp->line_files[pp->num_lines - 1];
+        return pp->line_nums[pp->num_lines - 1] + out_line - pp->num_lines;
+    }
+    *file = pp->line_files[out_line - 1];
+    return pp->line_nums[out_line - 1];
+}
@@ -0,0 +1,56 @@
+#ifndef PREPROCESS_H
+#define PREPROCESS_H
+
+/*
+ * GLSL 预处理器
+ *
+ * 在词法分析之前运行, 处理 #define / #undef / #if / #ifdef / #ifndef /
+ * #elif / #else / #endif / #include / #line / #version / #extension / #error,
+ * 展开宏并删除注释。指令行和被跳过的行输出为空行, 每个输出行记录对应的
+ * 源文件和行号, 词法/语法错误通过 pp_source_line 报告源位置。
+ */
+
+#define PP_MAX_PARAMS        8
+#define PP_MAX_INCLUDE_DIRS  8
+#define PP_MAX_INCLUDE_DEPTH 16
+#define PP_MAX_COND_DEPTH    64
+
+typedef struct PPMacro {
+    char *name;
+    int num_params;              /* -1: 对象宏 */
+    char *params[PP_MAX_PARAMS];
+    char *body;
+    struct PPMacro *next;
+} PPMacro;
+
+typedef struct Preprocessor {
+    PPMacro *macros;
+    const char *include_dirs[PP_MAX_INCLUDE_DIRS];
+    int num_include_dirs;
+    int version;                 /* #version 的值, 未声明时为 110 */
+    int errors;
+
+    /* 当前位置 (用于 __LINE__ / __FILE__ 和错误信息), #line 可以修改 */
+    const char *file;
+    int line;
+    int source;                  /* 源字符串编号, 默认为 include 深度 */
+    int depth;
+
+    /* 输出行 -> 源位置 */
+    const char **line_files;
+    int *line_nums;
+    int num_lines, cap_lines;
+    char **names;                /* 文件名, 与 pp 同生命周期 */
+    int num_names;
+} Preprocessor;
+
+Preprocessor* pp_create(void);
+/* "NAME" 或 "NAME=VALUE" (命令行 -D) */
+void pp_define(Preprocessor *pp, const char *def);
+void pp_add_include_dir(Preprocessor *pp, const char *dir);
+/* 预处理整个文件 (path 为 NULL 时读 stdin), 返回 malloc 的文本, 出错返回 NULL */
+char* pp_process_file(Preprocessor *pp, const char *path);
+/* 输出文本第 out_line 行 (从 1 开始) 对应的源行号, *file 为源文件名 */
+int pp_source_line(const Preprocessor *pp, int out_line, const char **file);
+
+#endif
@@ -8,12 +8,39 @@ DataType resolve_type_from_string(const char *type_str) {
     if (strcmp(type_str, "int") == 0) return DT_INT;
     if (strcmp(type_str, "float") == 0) return DT_FLOAT;
     if (strcmp(type_str, "bool") == 0) return DT_BOOL;
+    if (strcmp(type_str, "vec2") == 0) return DT_VEC2;
     if (strcmp(type_str, "vec3") == 0) return DT_VEC3;
     if (strcmp(type_str, "vec4") == 0) return DT_VEC4;
     if (strcmp(type_str, "void") == 0) return DT_VOID;
+    if (strcmp(type_str, "sampler2D") == 0) return DT_SAMPLER2D;
     return DT_UNKNOWN; 
 }
 
+/* 内置函数 (sin / cos): 返回类型与参数相同 */
+static int is_builtin_function(const char *name) {
+    return strcmp(name, "sin") == 0 || strcmp(name, "cos") == 0;
+}
+
+/*
+ * texture2D(sampler, u, v [, c]): 语言只有标量, 坐标拆成两个 float,
+ * 返回一个分量 (默认 r, 可选的整数常量 c 选择 0-3 即 rgba)
+ */
+static void check_texture_call(ASTNode *node) {
+    ASTNode *s = node->data.func_call.args;
+    int nargs = 0;
+    for (ASTNode *a = s; a; a = a->next) nargs++;
+    if (nargs < 3 || nargs > 4) {
+        fprintf(stderr, "Semantic Warning: texture2D expects 3 or 4 arguments, got %d.\n", nargs);
+    } else if (s->type != NODE_VAR_REF || s->data_type != DT_SAMPLER2D) {
+        fprintf(stderr, "Semantic Warning: First argument of texture2D must be a sampler2D.\n");
+    } else if (nargs == 4) {
+        ASTNode *c = s->next->next->next;
+        if (c->type != NODE_INT_CONST || c->data.int_val < 0 || c->data.int_val > 3)
+            fprintf(stderr, "Semantic Warning: texture2D component must be a constant 0-3.\n");
+    }
+    node->data_type = DT_FLOAT;
+}
+
 /* [Fixed] Removed duplicate definition of get_datatype_name. 
    It is linked from ast.c */
 
@@ -23,7 +50,7 @@ void analyze_node(ASTNode *node) {
         case NODE_TRANSLATION_UNIT:
         case NODE_COMPOUND_STMT: {
             if (node->type == NODE_COMPOUND_STMT) enter_scope();
-            ASTNode *current = (node->type == NODE_COMPOUND_STMT) ? node->next : node;
+            ASTNode *current = (node->type == NODE_COMPOUND_STMT) ? node->data.compound.stmts : node;
             
             while (current) {
                 if (current->type == NODE_TRANSLATION_UNIT) {
@@ -50,16 +77,47 @@ void analyze_node(ASTNode *node) {
             }
             node->data_type = decl_type;
             if (node->data.var_decl.initializer) analyze_node(node->data.var_decl.initializer);
+            if (node->data.var_decl.is_spec_const) {
+                ASTNode *init = node->data.var_decl.initializer;
+                if (!init || (init->type != NODE_INT_CONST && init->type != NODE_FLOAT_CONST)) {
+                    fprintf(stderr, "Semantic Warning: Specialization constant '%s' needs a literal default value.\n",
+                            node->data.var_decl.name);
+                }
+            }
             break;
         }
         case NODE_FUNC_DEF: {
             char *ret_type = node->data.func_def.return_type->data.str_val;
             define_symbol(node->data.func_def.name, resolve_type_from_string(ret_type));
             enter_scope();
+            for (ASTNode *p = node->data.func_def.params; p; p = p->next) analyze_node(p);
             analyze_node(node->data.func_def.body);
             exit_scope();
             break;
         }
+        case NODE_PARAM_DECL: {
+            DataType t = resolve_type_from_string(node->data.var_decl.type->data.str_val);
+            if (!define_symbol(node->data.var_decl.name, t)) {
+                fprintf(stderr, "Semantic Warning: Parameter '%s' redefinition.\n", node->data.var_decl.name);
+            }
+            node->data_type = t;
+            break;
+        }
+        case NODE_FUNC_CALL: {
+            for (ASTNode *a = node->data.func_call.args; a; a = a->next) analyze_node(a);
+            Symbol *sym = lookup_symbol(node->data.func_call.name);
+            if (sym) node->data_type = sym->type;
+            else if (strcmp(node->data.func_call.name, "texture2D") == 0) check_texture_call(node);
+            else if (is_builtin_function(node->data.func_call.name)) {
+                ASTNode *arg = node->data.func_call.args;
+                node->data_type = arg ? arg->data_type : DT_FLOAT;
+            } else {
+                fprintf(stderr, "Semantic Warning: Call to undeclared function '%s'.\n", node->data.func_call.name);
+                node->data_type = DT_ERROR;
+            }
+            break;
+        }
+        case NODE_RETURN_STMT: analyze_node(node->data.stmt.expr); break;
         case NODE_VAR_REF: {
             Symbol *sym = lookup_symbol(node->data.str_val);
             if (sym) node->data_type = sym->type;
@@ -69,12 +127,29 @@ void analyze_node(ASTNode *node) {
         case NODE_BINARY_EXPR: {
             analyze_node(node->data.binary.left);
             analyze_node(node->data.binary.right);
-            node->data_type = node->data.binary.left->data_type; 
+            switch (node->data.binary.op) {
+                case OP_EQ: case OP_NE: case OP_LT: case OP_GT: case OP_LE: case OP_GE:
+                    node->data_type = DT_BOOL;
+                    break;
+                default:
+                    node->data_type = node->data.binary.left->data_type; 
+                    break;
+            }
             break;
         }
         case NODE_INT_CONST: node->data_type = DT_INT; break;
         case NODE_FLOAT_CONST: node->data_type = DT_FLOAT; break;
-        case NODE_EXPR_STMT: analyze_node(node->next); break;
+        case NODE_EXPR_STMT: analyze_node(node->data.stmt.expr); break;
+        case NODE_WHILE_STMT:
+        case NODE_FOR_STMT:
+            /* for 初始化语句中声明的变量只在循环内可见 */
+            enter_scope();
+            analyze_node(node->data.loop.init);
+            analyze_node(node->data.loop.condition);
+            analyze_node(node->data.loop.step);
+            analyze_node(node->data.loop.body);
+            exit_scope();
+            break;
         case NODE_IF_STMT: 
             analyze_node(node->data.if_stmt.condition);
             analyze_node(node->data.if_stmt.then_branch);
@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../pisa_defs.h"
+
+/*
+ * prism-objdump: 反汇编 shader.bin
+ *
+ * 逐条解码 Type-R 指令 (MAD / V_SAMPLE 的第二个字和 literal 字一并显示), 按
+ * pisa_op_info() 的延迟 / 占用周期模型估计一个 wave 的执行周期,
+ * 并用反向活跃分析给出每条指令处同时活跃的向量 / 标量寄存器数。
+ * 不需要运行模拟器就能比较两次编译的代码质量。
+ */
+
+#define OBJDUMP_LANES 16
+
+/* 条件寄存器在分析中的编号 (8 位寄存器号之外) */
+#define REG_VCC   256
+#define REG_SCC   257
+#define NUM_REGS  258
+
+typedef struct Instr {
+    size_t pc;
+    int words;
+    const PisaOpInfo *info;
+    uint32_t w;
+    uint8_t op, d, src[3];
+    int has_lit;
+    uint32_t lit;
+} Instr;
+
+typedef struct RegSet { uint32_t bits[(NUM_REGS + 31) / 32]; } RegSet;
+
+static void rs_add(RegSet *s, int r) { s->bits[r / 32] |= 1u << (r % 32); }
+static void rs_del(RegSet *s, int r) { s->bits[r / 32] &= ~(1u << (r % 32)); }
+static int rs_has(const RegSet *s, int r) { return (s->bits[r / 32] >> (r % 32)) & 1; }
+
+static int is_vgpr(int r) { return r < PISA_NUM_VGPRS; }
+static int is_sgpr(int r) { return r >= PISA_SGPR_BASE && r < PISA_NUM_SGPRS; }
+
+static void rs_count(const RegSet *s, int *nv, int *ns) {
+    *nv = *ns = 0;
+    for (int r = 0; r < PISA_NUM_SGPRS; r++) {
+        if (!rs_has(s, r)) continue;
+        if (is_vgpr(r)) (*nv)++;
+        else if (is_sgpr(r)) (*ns)++;
+    }
+}
+
+/* 读的寄存器 (常量操作数不算), 包括条件寄存器 */
+static void instr_reads(const Instr *in, RegSet *s) {
+    for (int k = 0; k < in->info->nsrc && !in->info->imm_b; k++)
+        if (!PISA_IS_CONST(in->src[k])) rs_add(s, in->src[k]);
+    if (in->info->cond_r) rs_add(s, in->info->cond_r == 'v' ? REG_VCC : REG_SCC);
+}
+
+static void instr_writes(const Instr *in, RegSet *s) {
+    for (int k = 0; k < in->info->ndst; k++) rs_add(s, (in->d + k) & 0xff);
+    if (in->info->cond_w) rs_add(s, in->info->cond_w == 'v' ? REG_VCC : REG_SCC);
+}
+
+/* 解码整个程序, 遇到未知操作码或截断的指令时报错并返回 -1 */
+static int decode(const uint32_t *code, size_t n, Instr **out) {
+    Instr *ins = (Instr*)calloc(n + 1, sizeof(Instr));
+    int count = 0;
+
+    for (size_t pc = 0; pc < n; ) {
+        Instr *in = &ins[count++];
+        in->pc = pc;
+        in->w = code[pc];
+        in->op = code[pc] >> 24;
+        in->d = (code[pc] >> 16) & 0xff;
+        in->src[0] = (code[pc] >> 8) & 0xff;
+        in->src[1] = code[pc] & 0xff;
+        in->info = pisa_op_info(in->op);
+        in->words = pisa_instr_words(&code[pc], n - pc);
+        if (!in->info) {
+            fprintf(stderr, "prism-objdump: unknown opcode 0x%02x at word %zu\n", in->op, pc);
+            free(ins);
+            return -1;
+        }
+        if (pc + in->words > n) {
+            fprintf(stderr, "prism-objdump: truncated %s at word %zu\n", in->info->name, pc);
+            free(ins);
+            return -1;
+        }
+        if (in->info->nsrc == 3) in->src[2] = code[pc + 1] & 0xff;
+        for (int k = 0; k < in->info->nsrc && !in->info->imm_b; k++)
+            if (in->src[k] == PISA_LITERAL) in->has_lit = 1;
+        if (in->has_lit) in->lit = code[pc + in->words - 1];
+        pc += in->words;
+    }
+    *out = ins;
+    return count;
+}
+
+static const char* operand(const Instr *in, int k) {
+    static char bufs[3][32];
+    char *b = bufs[k];
+    uint8_t r = in->src[k];
+    if (in->info->imm_b) {
+        snprintf(b, sizeof(bufs[k]), k ? "%d" : "s%d", r);
+    } else if (r == PISA_LITERAL) {
+        float f;
+        memcpy(&f, &in->lit, sizeof(f));
+        snprintf(b, sizeof(bufs[k]), "%g", f);
+    } else {
+        snprintf(b, sizeof(bufs[k]), "%s", pisa_reg_name(r));
+    }
+    return b;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-s] [shader.bin]\n"
+                    "  -s  summary only\n", prog);
+}
+
+int main(int argc, char **argv) {
+    const char *path = "shader.bin";
+    int summary_only = 0, opt;
+
+    while ((opt = getopt(argc, argv, "s")) != -1) {
+        if (opt == 's') summary_only = 1;
+        else { usage(argv[0]); return 1; }
+    }
+    if (optind < argc) path = argv[optind];
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp) { perror(path); return 1; }
+    size_t cap = 1024, n = 0;
+    uint32_t *code = (uint32_t*)malloc(cap * 4);
+    size_t got;
+    while ((got = fread(code + n, 4, cap - n, fp)) > 0) {
+        n += got;
+        if (n == cap) code = (uint32_t*)realloc(code, (cap *= 2) * 4);
+    }
+    fclose(fp);
+
+    Instr *ins;
+    int count = decode(code, n, &ins);
+    if (count < 0) return 1;
+
+    /* 反向活跃分析: live_after[i] 为第 i 条指令之后仍会被读的寄存器 */
+    RegSet *live_after = (RegSet*)calloc(count + 1, sizeof(RegSet));
+    RegSet live = {{0}};
+    for (int i = count - 1; i >= 0; i--) {
+        RegSet w = {{0}};
+        live_after[i] = live;
+        instr_writes(&ins[i], &w);
+        for (int r = 0; r < NUM_REGS; r++) if (rs_has(&w, r)) rs_del(&live, r);
+        instr_reads(&ins[i], &live);
+    }
+    RegSet live_in = live, used = live;
+
+    /*
+     * 周期估计: 顺序发射, 每条指令等待源操作数就绪 (记分牌) 和执行单元空闲,
+     * 额外的字 (MAD 第二个字、literal) 各占一个取指周期。
+     */
+    unsigned ready[NUM_REGS] = {0}, unit_free[PISA_NUM_UNITS] = {0}, unit_busy[PISA_NUM_UNITS] = {0};
+    unsigned next_issue = 0, end = 0, stalls = 0;
+    int max_v = 0, max_s = 0;
+
+    if (!summary_only) printf("%s: %d instruction(s), %zu word(s)\n\n", path, count, n);
+    for (int i = 0; i < count; i++) {
+        Instr *in = &ins[i];
+        const PisaOpInfo *info = in->info;
+        RegSet rd = {{0}}, wr = {{0}};
+        instr_reads(in, &rd);
+        instr_writes(in, &wr);
+
+        unsigned start = next_issue;
+        if (unit_free[info->unit] > start) start = unit_free[info->unit];
+        for (int r = 0; r < NUM_REGS; r++)
+            if (rs_has(&rd, r) && ready[r] > start) start = ready[r];
+        unsigned stall = start - next_issue;
+        stalls += stall;
+
+        unit_free[info->unit] = start + info->issue;
+        unit_busy[info->unit] += info->issue;
+        for (int r = 0; r < NUM_REGS; r++) {
+            if (!rs_has(&wr, r)) continue;
+            ready[r] = start + info->latency;
+            rs_add(&used, r);
+        }
+        next_issue = start + in->words;
+        if (start + info->latency > end) end = start + info->latency;
+
+        /* 指令处的压力: 之后仍活跃的寄存器加上本条写入的寄存器 */
+        RegSet p = live_after[i];
+        for (int r = 0; r < NUM_REGS; r++) if (rs_has(&wr, r)) rs_add(&p, r);
+        int nv, ns;
+        rs_count(&p, &nv, &ns);
+        if (nv > max_v) max_v = nv;
+        if (ns > max_s) max_s = ns;
+
+        if (summary_only) continue;
+
+        char text[64], hex[32];
+        int len;
+        if (info->ndst == 0 && info->cond_w)
+            len = snprintf(text, sizeof(text), "%-10s %s", info->name, info->cond_w == 'v' ? "vcc" : "scc");
+        else
+            len = snprintf(text, sizeof(text), "%-10s %s", info->name, pisa_reg_name(in->d));
+        for (int k = 0; k < info->nsrc && len < (int)sizeof(text); k++)
+            len += snprintf(text + len, sizeof(text) - len, ", %s", operand(in, k));
+        if (in->op == OP_V_SAMPLE && len < (int)sizeof(text)) {
+            uint32_t w1 = code[in->pc + 1];
+            snprintf(text + len, sizeof(text) - len, ", t%u.%c",
+                     PISA_SAMPLE_SLOT(w1), "rgba"[PISA_SAMPLE_COMP(w1)]);
+        }
+
+        len = snprintf(hex, sizeof(hex), "%08x", in->w);
+        for (int k = 1; k < in->words && len < (int)sizeof(hex); k++)
+            len += snprintf(hex + len, sizeof(hex) - len, " %08x", code[in->pc + k]);
+
+        printf("%04zx: %-26s %-32s ; @%-4u +%-2u live %dv %ds%s\n",
+               in->pc * 4, hex, text, start, info->latency, nv, ns, stall ? "  (stall)" : "");
+    }
+
+    int in_v, in_s, used_v, used_s;
+    rs_count(&live_in, &in_v, &in_s);
+    rs_count(&used, &used_v, &used_s);
+    for (int u = 0; u < PISA_NUM_UNITS; u++)
+        if (unit_free[u] > end) end = unit_free[u];
+
+    if (!summary_only) printf("\n");
+    printf("; %d instruction(s), %zu word(s)\n", count, n);
+    printf("; estimated %u cycle(s) per wave, %.2f per invocation (%d lanes), %u stall cycle(s)\n",
+           end, (double)end / OBJDUMP_LANES, OBJDUMP_LANES, stalls);
+    printf("; unit busy: salu %u, valu %u, smem %u, sfu %u, tex %u\n",
+           unit_busy[PISA_UNIT_SALU], unit_busy[PISA_UNIT_VALU], unit_busy[PISA_UNIT_SMEM],
+           unit_busy[PISA_UNIT_SFU], unit_busy[PISA_UNIT_TEX]);
+    printf("; register pressure: max %d vgpr / %d sgpr live, %d vgpr / %d sgpr used, "
+           "%d vgpr / %d sgpr live-in\n", max_v, max_s, used_v, used_s, in_v, in_s);
+
+    free(live_after);
+    free(ins);
+    free(code);
+    return 0;
+}
@@ -20,6 +20,55 @@
 #include "prism_drv.h"
 
 
+/*
+ * vblank 定时器: 设备的 vblank 计数前进时上报一次 vblank;
+ * 提交 (START) 读回 0 说明设备已在 vblank 锁存, 此时才完成翻页事件,
+ * 用户空间拿到事件后旧的前缓冲区已经不再被扫描输出
+ */
+static enum hrtimer_restart prism_vblank_timer(struct hrtimer *timer)
+{
+	struct prism_pipe *pipe = container_of(timer, struct prism_pipe, vblank_timer);
+	struct drm_crtc *crtc = &pipe->crtc;
+	unsigned long flags;
+	u32 count;
+
+	hrtimer_forward_now(timer, ns_to_ktime(PRISM_VBLANK_POLL_NS));
+
+	count = ioread32(pipe->regs + PRISM_REG_VBLANK);
+	if (count != pipe->vblank_seen) {
+		pipe->vblank_seen = count;
+		/* disable_vblank 没能取消正在运行的定时器时, 在这里停下 */
+		if (!drm_crtc_handle_vblank(crtc))
+			return HRTIMER_NORESTART;
+	}
+
+	spin_lock_irqsave(&crtc->dev->event_lock, flags);
+	if (pipe->event && !ioread32(pipe->regs + PRISM_REG_START)) {
+		drm_crtc_send_vblank_event(crtc, pipe->event);
+		pipe->event = NULL;
+		drm_crtc_vblank_put(crtc);
+	}
+	spin_unlock_irqrestore(&crtc->dev->event_lock, flags);
+
+	return HRTIMER_RESTART;
+}
+
+static int prism_crtc_enable_vblank(struct drm_crtc *crtc)
+{
+	struct prism_pipe *pipe = to_prism_pipe(crtc);
+
+	pipe->vblank_seen = ioread32(pipe->regs + PRISM_REG_VBLANK);
+	hrtimer_start(&pipe->vblank_timer, ns_to_ktime(PRISM_VBLANK_POLL_NS),
+		      HRTIMER_MODE_REL);
+	return 0;
+}
+
+/* 在 vblank_time_lock 下调用, 不能等待回调结束 */
+static void prism_crtc_disable_vblank(struct drm_crtc *crtc)
+{
+	hrtimer_try_to_cancel(&to_prism_pipe(crtc)->vblank_timer);
+}
+
 static const struct drm_crtc_funcs prism_crtc_funcs = {
     .reset = drm_atomic_helper_crtc_reset,
     .destroy = drm_crtc_cleanup,
@@ -27,6 +76,8 @@ static const struct drm_crtc_funcs prism_crtc_funcs = {
     .page_flip = drm_atomic_helper_page_flip,
     .atomic_duplicate_state = drm_atomic_helper_crtc_duplicate_state,
     .atomic_destroy_state = drm_atomic_helper_crtc_destroy_state,
+    .enable_vblank = prism_crtc_enable_vblank,
+    .disable_vblank = prism_crtc_disable_vblank,
 };
 
 static int prism_crtc_atomic_check(struct drm_crtc *crtc,
@@ -45,6 +96,18 @@ static void prism_crtc_atomic_enable(struct drm_crtc *crtc,
 static void prism_crtc_atomic_disable(struct drm_crtc *crtc,
 				     struct drm_atomic_state *state)
 {
+	struct prism_pipe *pipe = to_prism_pipe(crtc);
+	unsigned long flags;
+
+	/* 关闭后不会再有 vblank, 还在等待的翻页事件直接完成 */
+	spin_lock_irqsave(&crtc->dev->event_lock, flags);
+	if (pipe->event) {
+		drm_crtc_send_vblank_event(crtc, pipe->event);
+		pipe->event = NULL;
+		drm_crtc_vblank_put(crtc);
+	}
+	spin_unlock_irqrestore(&crtc->dev->event_lock, flags);
+
 	drm_crtc_vblank_off(crtc);
 }
 
@@ -58,26 +121,32 @@ static void prism_crtc_atomic_flush(struct drm_crtc *crtc,
                                     struct drm_atomic_state *state)
 {
     struct drm_crtc_state *crtc_state = drm_atomic_get_new_crtc_state(state, crtc);
+    struct prism_pipe *pipe = to_prism_pipe(crtc);
     struct drm_device *dev = crtc->dev;
     unsigned long flags;
 
-    // 1. 检查是否有待处理的事件
+    /* 所有平面的寄存器都已写入影子寄存器, 一次提交, 下一个 vblank 生效 */
+    iowrite32(1, pipe->regs + PRISM_REG_START);
+
     if (crtc_state->event) {
-        
-        // 2. 获取自旋锁 (因为事件发送通常设计为在中断上下文中运行，需要保护)
         spin_lock_irqsave(&dev->event_lock, flags);
 
-        // 3. 发送事件告诉用户空间“这种子完成了”
-        // 注意：如果是真实硬件，这里通常只把 event 存起来，等到 VBLANK 中断来了再发送
-        // 但对于虚拟/简单硬件，我们假装 VBLANK 已经发生了，直接发送。
-        if (drm_crtc_vblank_get(crtc) == 0)
+        /*
+         * 提交要到下一个 vblank 才被设备锁存, 现在发送事件用户空间就会
+         * 开始往仍在扫描输出的旧前缓冲区里画。事件交给 vblank 定时器,
+         * 由它在 START 读回 0 之后发送; 持有的 vblank 引用保证定时器不停。
+         * CRTC 已关闭 (拿不到 vblank) 时没有可等的 vblank, 直接完成。
+         */
+        if (drm_crtc_vblank_get(crtc) == 0) {
+            WARN_ON(pipe->event);
+            pipe->event = crtc_state->event;
+        } else {
             drm_crtc_send_vblank_event(crtc, crtc_state->event);
-        else
-            drm_crtc_arm_vblank_event(crtc, crtc->state->event);
+        }
 
         spin_unlock_irqrestore(&dev->event_lock, flags);
 
-        // 4. 重要！一定要把指针置空，告诉内核“我处理完了”
+        // 一定要把指针置空，告诉内核“我处理完了”
         crtc_state->event = NULL;
     }
 }
@@ -89,6 +158,10 @@ static const struct drm_crtc_helper_funcs prism_crtc_helper_funcs = {
 	.atomic_disable	= prism_crtc_atomic_disable,
 };
 
+static const struct drm_encoder_funcs prism_encoder_funcs = {
+    .destroy = drm_encoder_cleanup,
+};
+
 static const struct drm_mode_config_funcs prism_mode_config_funcs = {
     .fb_create = drm_gem_fb_create,
     .atomic_check = drm_atomic_helper_check,
@@ -165,87 +238,113 @@ static struct drm_driver prism_driver = {
 };
 
 
-static int prism_modeset_init(struct prism_device *pdev)
+/*
+ * 初始化一个显示头: 主平面 + overlay + 光标 -> CRTC -> encoder -> connector,
+ * 平面只能挂在本显示头的 CRTC 上, 它们写的是这个显示头的寄存器组
+ */
+static int prism_pipe_init(struct prism_device *pdev, unsigned int index)
 {
     struct drm_device *dev = &pdev->drm;
-    struct drm_plane *primary, *cursor;
-    struct prism_plane *priplane, *overplane = NULL, *cursorplane = NULL;
-    struct drm_crtc *crtc;
-    struct drm_encoder *encoder;
-    struct drm_connector *connector;
-    int ret;
+    struct prism_pipe *pipe = &pdev->pipes[index];
+    struct prism_plane *priplane, *overplane, *cursorplane;
+    int ret, i;
 
-    /* 1. 初始化 Mode Config */
-    ret = drmm_mode_config_init(dev);
-    if (ret) return ret;
+    pipe->index = index;
+    pipe->regs = pdev->mmio + PRISM_REG_HEAD(index);
+    hrtimer_init(&pipe->vblank_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    pipe->vblank_timer.function = prism_vblank_timer;
 
-    dev->mode_config.min_width = 0;
-    dev->mode_config.min_height = 0;
-    dev->mode_config.max_width = 4096;
-    dev->mode_config.max_height = 4096;
-    dev->mode_config.funcs = &prism_mode_config_funcs;
-
-    ret = drm_vblank_init(dev, 1);
-    if (ret) {
-        DRM_ERROR("Failed to init vblank\n");
-        return ret;
-    }
-
-    priplane = prism_plane_init(pdev, DRM_PLANE_TYPE_PRIMARY, 0); // this index set zero because only one CRTC
+    priplane = prism_plane_init(pdev, DRM_PLANE_TYPE_PRIMARY, index);
 	if (IS_ERR(priplane))
 		return PTR_ERR(priplane);
-    primary = &priplane->base;
 
-	overplane = prism_plane_init(pdev, DRM_PLANE_TYPE_OVERLAY, 0);
-	if (IS_ERR(overplane))
-		return PTR_ERR(overplane);
-    
-	cursorplane = prism_plane_init(pdev, DRM_PLANE_TYPE_CURSOR, 0);
+	/* 每个 overlay 占用设备的一组平面寄存器 */
+	for (i = 0; i < PRISM_OVERLAYS; i++) {
+		overplane = prism_plane_init(pdev, DRM_PLANE_TYPE_OVERLAY, index);
+		if (IS_ERR(overplane))
+			return PTR_ERR(overplane);
+	}
+
+	cursorplane = prism_plane_init(pdev, DRM_PLANE_TYPE_CURSOR, index);
 	if (IS_ERR(cursorplane))
 		return PTR_ERR(cursorplane);
-    cursor = &cursorplane->base;
-
-
-
-    crtc = devm_kzalloc(dev->dev, sizeof(*crtc), GFP_KERNEL);
-    if (!crtc) return -ENOMEM;
 
-    ret = drm_crtc_init_with_planes(dev, crtc,
-                                    primary, cursor, 
+    ret = drm_crtc_init_with_planes(dev, &pipe->crtc,
+                                    &priplane->base, &cursorplane->base,
                                     &prism_crtc_funcs,
                                     NULL);
     if (ret) {
-        DRM_ERROR("Failed to init CRTC\n");
+        DRM_ERROR("Failed to init CRTC %u\n", index);
         return ret;
     }
-    drm_crtc_helper_add(crtc, &prism_crtc_helper_funcs);
+    drm_crtc_helper_add(&pipe->crtc, &prism_crtc_helper_funcs);
 
+    ret = drm_encoder_init(dev, &pipe->encoder, &prism_encoder_funcs,
+                           DRM_MODE_ENCODER_VIRTUAL, NULL);
+    if (ret) return ret;
+    pipe->encoder.possible_crtcs = drm_crtc_mask(&pipe->crtc);
 
-    if (!overplane->base.possible_crtcs)
-		overplane->base.possible_crtcs = drm_crtc_mask(crtc);
+    /* 经典的 connector 初始化 */
+    ret = drm_connector_init(dev, &pipe->connector, &prism_conn_funcs,
+                             DRM_MODE_CONNECTOR_VIRTUAL);
+    if (ret) return ret;
 
+    /* 注册 helper (这一步必须有) */
+    drm_connector_helper_add(&pipe->connector, &prism_conn_helper_funcs);
 
-    /* 4. 初始化 Encoder */
-    encoder = drmm_encoder_alloc(dev, struct drm_encoder, dev,
-                                 NULL, DRM_MODE_ENCODER_VIRTUAL, NULL);
-    if (IS_ERR(encoder)) return PTR_ERR(encoder);
-    encoder->possible_crtcs = 1;
+    return drm_connector_attach_encoder(&pipe->connector, &pipe->encoder);
+}
 
-    /* * 5. [FIX] 手动分配并初始化 Connector 
-     * 替代 drmm_connector_init
-     */
-    connector = devm_kzalloc(dev->dev, sizeof(*connector), GFP_KERNEL);
-    if (!connector) return -ENOMEM;
+/*
+ * 卸载时停下每个显示头的 vblank 定时器: 回调读写 MMIO, 必须在 pcim_iomap
+ * 的映射 (devm) 解除之前等它结束; disable_vblank 只是尝试取消
+ */
+static void prism_vblank_timers_cancel(void *data)
+{
+    struct prism_device *pdev = data;
+    unsigned int i;
 
-    /* 经典的 connector 初始化 */
-    ret = drm_connector_init(dev, connector, &prism_conn_funcs, DRM_MODE_CONNECTOR_VIRTUAL);
+    for (i = 0; i < pdev->num_heads; i++)
+        hrtimer_cancel(&pdev->pipes[i].vblank_timer);
+}
+
+static int prism_modeset_init(struct prism_device *pdev)
+{
+    struct drm_device *dev = &pdev->drm;
+    unsigned int i;
+    int ret;
+
+    /* 1. 初始化 Mode Config */
+    ret = drmm_mode_config_init(dev);
     if (ret) return ret;
 
-    /* 注册 helper (这一步必须有) */
-    drm_connector_helper_add(connector, &prism_conn_helper_funcs);
+    dev->mode_config.min_width = 0;
+    dev->mode_config.min_height = 0;
+    dev->mode_config.max_width = 4096;
+    dev->mode_config.max_height = 4096;
+    dev->mode_config.cursor_width = PRISM_CURSOR_SIZE;
+    dev->mode_config.cursor_height = PRISM_CURSOR_SIZE;
+    dev->mode_config.funcs = &prism_mode_config_funcs;
 
-    /* 6. 连接 Connector 和 Encoder */
-    ret = drm_connector_attach_encoder(connector, encoder);
+    /* 2. 设备报告显示头的数量, 旧设备读到 0, 按一个处理 */
+    pdev->num_heads = clamp(ioread32(pdev->mmio + PRISM_REG_HEAD(0) + PRISM_REG_HEADS),
+                            1u, (u32)PRISM_MAX_HEADS);
+
+    /* 每个显示头一个 vblank 计数器 */
+    ret = drm_vblank_init(dev, pdev->num_heads);
+    if (ret) {
+        DRM_ERROR("Failed to init vblank\n");
+        return ret;
+    }
+
+    /* 3. 每个显示头一条完整的 CRTC -> encoder -> connector 管线 */
+    for (i = 0; i < pdev->num_heads; i++) {
+        ret = prism_pipe_init(pdev, i);
+        if (ret) return ret;
+    }
+
+    /* 在 MMIO 映射之后注册, devm 倒序释放时先于解除映射执行 */
+    ret = devm_add_action_or_reset(dev->dev, prism_vblank_timers_cancel, pdev);
     if (ret) return ret;
 
     drm_mode_config_reset(&pdev->drm);
@@ -280,11 +379,15 @@ static int prism_pci_probe(struct pci_dev *pdev, const struct pci_device_id *ent
     }
 
     /* 3. Init VRAM (BAR 0) */
-    resource_size_t vram_base = pci_resource_start(pdev, 0);
-    resource_size_t vram_len = pci_resource_len(pdev, 0);
+    prism->vram_base = pci_resource_start(pdev, 0);
+    prism->vram_size = pci_resource_len(pdev, 0);
+    if (!prism->vram_size) {
+        DRM_ERROR("BAR 0 (VRAM) is empty\n");
+        return -ENODEV;
+    }
 
     /* 2. 映射 VRAM 到内核空间 (为了 io_mem_reserve 的静态映射优化) 可有可无 */
-    prism->vram_virt = devm_ioremap_wc(&pdev->dev, vram_base, vram_len);
+    prism->vram_virt = devm_ioremap_wc(&pdev->dev, prism->vram_base, prism->vram_size);
     if (!prism->vram_virt) {
         DRM_ERROR("Failed to map VRAM\n");
         return -ENOMEM;
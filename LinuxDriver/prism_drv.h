@@ -12,8 +12,59 @@
 #include <drm/ttm/ttm_placement.h>
 #include <drm/ttm/ttm_device.h>
 
+/* ------------------------------------------------------------------
+ * 1. 硬件寄存器定义 (BAR 2)
+ *
+ * 每个显示头 (pipe) 有一组 0x100 字节的寄存器, 位于 PRISM_REG_HEAD(n);
+ * 下面的模式/光标/overlay 寄存器都是相对于这组寄存器的偏移
+ * ------------------------------------------------------------------ */
+#define PRISM_MAX_HEADS     4
+#define PRISM_REG_HEAD(n)   (0x400 + (n) * 0x100)
+
+#define PRISM_REG_FORMAT    0x00
+#define PRISM_REG_BYTEPP    0x04
+#define PRISM_REG_WIDTH     0x08
+#define PRISM_REG_HEIGHT    0x0C
+#define PRISM_REG_STRIDE    0x10
+#define PRISM_REG_OFFSET    0x14
+#define PRISM_REG_SIZE      0x18
+#define PRISM_REG_START     0x1c
+#define PRISM_REG_VBLANK    0x20    /* 只读: vblank 计数 */
+#define PRISM_REG_HEADS     0x24    /* 只读: 显示头的数量 */
+
+/* 硬件光标寄存器 */
+#define PRISM_REG_CURSOR_BASE   0x40
+#define PRISM_REG_CURSOR_SIZE   0x44    /* width | height << 16 */
+#define PRISM_REG_CURSOR_HOT    0x48    /* hot_x | hot_y << 16 */
+#define PRISM_REG_CURSOR_POS    0x4c    /* x | y << 16, 有符号 16 位 */
+#define PRISM_REG_CURSOR_CTRL   0x50
+#define PRISM_REG_CURSOR_UPDATE 0x54    /* 写: 重新读取光标图像 */
+
+#define PRISM_CURSOR_ENABLE     (1 << 0)
 
-#define PRISM_MEM_VRAM_SIZE (64 * 1024 * 1024) // 64MB
+/*
+ * overlay 平面寄存器组, 每组 0x20 字节, 按组号顺序叠加到主平面之上;
+ * 与模式寄存器一样写 START 提交, vblank 生效
+ */
+#define PRISM_OVERLAYS              2
+#define PRISM_REG_PLANE(bank)       (0x80 + (bank) * 0x20)
+#define PRISM_REG_PLANE_BASE        0x00
+#define PRISM_REG_PLANE_PITCH       0x04
+#define PRISM_REG_PLANE_FORMAT      0x08
+#define PRISM_REG_PLANE_POS         0x0c    /* x | y << 16, 有符号 16 位 */
+#define PRISM_REG_PLANE_SIZE        0x10    /* width | height << 16 */
+#define PRISM_REG_PLANE_ALPHA       0x14    /* 0 - 255 */
+#define PRISM_REG_PLANE_CTRL        0x18
+
+#define PRISM_PLANE_ENABLE          (1 << 0)
+
+#define PRISM_FMT_XRGB8888  0x20020888
+#define PRISM_FMT_ARGB8888  0x20028888
+/* 以下格式由设备在扫描输出时转换, 只转换有变化的区域 */
+#define PRISM_FMT_RGB565        0x10020565
+#define PRISM_FMT_XRGB2101010   0x20020aaa
+#define PRISM_FMT_YUYV          0x10060000
+#define PRISM_FMT_NV12          0x0c3f0000  /* CbCr 平面紧跟在 Y 平面之后 */
 
 #define PRISM_PL_FLAG_SYSTEM  (1 << 0) // 系统内存
 #define PRISM_PL_FLAG_VRAM    (1 << 1) // 你的 64MB 显存
@@ -25,6 +76,17 @@ static const u32 prism_plane_formats[] = {
 
 static const u32 prism_formats[] = {
 	DRM_FORMAT_XRGB8888,
+	DRM_FORMAT_RGB565,
+	DRM_FORMAT_XRGB2101010,
+	DRM_FORMAT_YUYV,
+	DRM_FORMAT_NV12,
+};
+
+/* 硬件光标: 最大 64x64 的 ARGB8888 图像 */
+#define PRISM_CURSOR_SIZE 64
+
+static const u32 prism_cursor_formats[] = {
+	DRM_FORMAT_ARGB8888,
 };
 
 struct prism_bo {
@@ -36,20 +98,46 @@ struct prism_bo {
 };
 
 
+/*
+ * 设备没有中断: vblank 由 hrtimer 轮询 PRISM_REG_VBLANK 得到,
+ * 轮询间隔远小于设备的刷新周期 (60Hz)
+ */
+#define PRISM_VBLANK_POLL_NS    (4 * NSEC_PER_MSEC)
+
+/* 一个显示头: CRTC -> encoder -> connector, 使用自己的一组寄存器 */
+struct prism_pipe {
+    unsigned int index;
+    void __iomem *regs;         /* mmio + PRISM_REG_HEAD(index) */
+    unsigned int num_overlays;  /* 已分配的 overlay 寄存器组 */
+    struct hrtimer vblank_timer;
+    u32 vblank_seen;            /* 上次看到的 PRISM_REG_VBLANK */
+    struct drm_pending_vblank_event *event; /* 等设备锁存提交后发送, 受 event_lock 保护 */
+    struct drm_crtc crtc;
+    struct drm_encoder encoder;
+    struct drm_connector connector;
+};
+
 struct prism_device {
     struct drm_device drm;
     void __iomem *mmio;
-    void __iomem *vram_virt
+    void __iomem *vram_virt;
     resource_size_t vram_base;
+    resource_size_t vram_size;  // BAR 0 大小，由设备的 vram-size 属性决定
     struct ttm_device ttm;
+    unsigned int num_heads;
+    struct prism_pipe pipes[PRISM_MAX_HEADS];
 };
 
 struct prism_plane {
     struct drm_plane base;
+    void __iomem *regs; /* 所属显示头的寄存器组 */
+    unsigned int bank;  /* overlay 寄存器组号 */
 };
 
 
 #define to_prism(dev) container_of(dev, struct prism_device, drm)
+#define to_prism_plane(p) container_of(p, struct prism_plane, base)
+#define to_prism_pipe(c) container_of(c, struct prism_pipe, crtc)
 #define to_prism_bo(obj) container_of(obj, struct prism_bo, gem)
 #define ttm_to_prism_bo(tbo) container_of(tbo, struct prism_bo, tbo)
 
@@ -4,6 +4,7 @@
 
 #include <drm/drm_atomic.h>
 #include <drm/drm_atomic_helper.h>
+#include <drm/drm_blend.h>
 #include <drm/drm_fourcc.h>
 #include <drm/drm_gem_atomic_helper.h>
 #include <drm/drm_gem_framebuffer_helper.h>
@@ -12,26 +13,11 @@
 
 #include "prism_drv.h"
 
-/* ------------------------------------------------------------------
- * 1. 硬件寄存器定义 (BAR 2)
- * ------------------------------------------------------------------ */
-#define PRISM_REG_FORMAT    0x00
-#define PRISM_REG_BYTEPP    0x04
-#define PRISM_REG_WIDTH     0x08
-#define PRISM_REG_HEIGHT    0x0C
-#define PRISM_REG_STRIDE    0x10
-#define PRISM_REG_OFFSET    0x14
-#define PRISM_REG_SIZE      0x18
-#define PRISM_REG_START     0x1c
-
-#define PRISM_FMT_XRGB8888  0x20020888
-#define PRISM_FMT_ARGB8888  0x20028888
-
 static void prism_primary_atomic_update(struct drm_plane *plane,
                                         struct drm_atomic_state *state)
 {
     struct drm_plane_state *new_state = drm_atomic_get_new_plane_state(state, plane);
-    struct prism_device *pdev = to_prism(plane->dev);
+    void __iomem *regs = to_prism_plane(plane)->regs;
     struct drm_framebuffer *fb = new_state->fb;
     struct drm_gem_vram_object *gbo;
     u64 vram_offset;
@@ -50,28 +36,46 @@ static void prism_primary_atomic_update(struct drm_plane *plane,
     switch (fb->format->format) {
     case DRM_FORMAT_XRGB8888: hw_fmt = PRISM_FMT_XRGB8888; break;
     case DRM_FORMAT_ARGB8888: hw_fmt = PRISM_FMT_ARGB8888; break;
+    case DRM_FORMAT_RGB565: hw_fmt = PRISM_FMT_RGB565; break;
+    case DRM_FORMAT_XRGB2101010: hw_fmt = PRISM_FMT_XRGB2101010; break;
+    case DRM_FORMAT_YUYV: hw_fmt = PRISM_FMT_YUYV; break;
+    case DRM_FORMAT_NV12: hw_fmt = PRISM_FMT_NV12; break;
     default: hw_fmt = PRISM_FMT_XRGB8888; break;
     }
 
-    iowrite32(hw_fmt,           pdev->mmio + PRISM_REG_FORMAT);
-    iowrite32(fb->format->cpp[0], pdev->mmio + PRISM_REG_BYTEPP);
-    iowrite32(fb->width,        pdev->mmio + PRISM_REG_WIDTH);
-    iowrite32(fb->height,       pdev->mmio + PRISM_REG_HEIGHT);
-    iowrite32(fb->pitches[0],   pdev->mmio + PRISM_REG_STRIDE);
-    iowrite32((u32)vram_offset, pdev->mmio + PRISM_REG_OFFSET);
-    iowrite32(gbo->bo.base.size, pdev->mmio + PRISM_REG_SIZE);
-    iowrite32(1,   pdev->mmio + PRISM_REG_START);
+    /*
+     * 以下寄存器写入的是影子寄存器, 写 START 时一次性提交,
+     * 在下一个 vblank 才生效, 显示端不会看到只写了一半的模式
+     */
+    iowrite32(hw_fmt,           regs + PRISM_REG_FORMAT);
+    iowrite32(fb->format->cpp[0], regs + PRISM_REG_BYTEPP);
+    iowrite32(fb->width,        regs + PRISM_REG_WIDTH);
+    iowrite32(fb->height,       regs + PRISM_REG_HEIGHT);
+    iowrite32(fb->pitches[0],   regs + PRISM_REG_STRIDE);
+    iowrite32((u32)vram_offset, regs + PRISM_REG_OFFSET);
+    iowrite32(gbo->bo.base.size, regs + PRISM_REG_SIZE);
+    /* START 由 CRTC 的 atomic_flush 统一写入, 与 overlay 一起提交 */
 }
 
 static int prism_plane_atomic_check(struct drm_plane *plane,
                                     struct drm_atomic_state *state)
 {
     struct drm_plane_state *new_plane_state = drm_atomic_get_new_plane_state(state, plane);
+    struct drm_framebuffer *fb = new_plane_state->fb;
     struct drm_crtc_state *new_crtc_state;
 
     if (!new_plane_state->crtc)
         return 0;
 
+    /* YUV 按色度对扫描; NV12 的 CbCr 平面必须在同一个 BO 里紧跟 Y 平面 */
+    if (fb && fb->format->is_yuv && (fb->width % 2 || fb->height % fb->format->vsub))
+        return -EINVAL;
+    if (fb && fb->format->format == DRM_FORMAT_NV12 &&
+        (fb->obj[1] != fb->obj[0] || fb->offsets[0] ||
+         fb->pitches[1] != fb->pitches[0] ||
+         fb->offsets[1] != fb->pitches[0] * fb->height))
+        return -EINVAL;
+
     new_crtc_state = drm_atomic_get_new_crtc_state(state, new_plane_state->crtc);
     
     return drm_atomic_helper_check_plane_state(new_plane_state, new_crtc_state,
@@ -106,6 +110,192 @@ static int prism_plane_prepare_fb(struct drm_plane *plane,
 }
 
 
+/* ------------------------------------------------------------------
+ * 2. 光标平面: 图像交给 QEMU 的 UI 作为鼠标指针, 移动只写 POS 寄存器,
+ *    不会修改主平面的 framebuffer
+ * ------------------------------------------------------------------ */
+static void prism_cursor_set_position(void __iomem *regs,
+                                      struct drm_plane_state *state)
+{
+    iowrite32(((u32)state->crtc_x & 0xffff) | ((u32)state->crtc_y << 16),
+              regs + PRISM_REG_CURSOR_POS);
+}
+
+static int prism_cursor_atomic_check(struct drm_plane *plane,
+                                     struct drm_atomic_state *state)
+{
+    struct drm_plane_state *new_state = drm_atomic_get_new_plane_state(state, plane);
+    struct drm_framebuffer *fb = new_state->fb;
+    struct drm_crtc_state *crtc_state;
+    int ret;
+
+    if (!new_state->crtc)
+        return 0;
+
+    crtc_state = drm_atomic_get_new_crtc_state(state, new_state->crtc);
+    ret = drm_atomic_helper_check_plane_state(new_state, crtc_state,
+                                              DRM_PLANE_NO_SCALING,
+                                              DRM_PLANE_NO_SCALING,
+                                              true, true);
+    if (ret || !fb)
+        return ret;
+
+    /* 设备按紧密排列读取图像 */
+    if (fb->width > PRISM_CURSOR_SIZE || fb->height > PRISM_CURSOR_SIZE ||
+        fb->pitches[0] != fb->width * 4)
+        return -EINVAL;
+
+    return 0;
+}
+
+static void prism_cursor_atomic_update(struct drm_plane *plane,
+                                       struct drm_atomic_state *state)
+{
+    struct drm_plane_state *old_state = drm_atomic_get_old_plane_state(state, plane);
+    struct drm_plane_state *new_state = drm_atomic_get_new_plane_state(state, plane);
+    void __iomem *regs = to_prism_plane(plane)->regs;
+    struct drm_framebuffer *fb = new_state->fb;
+    struct drm_gem_vram_object *gbo;
+    s64 vram_offset;
+
+    if (!fb || !new_state->visible) {
+        iowrite32(0, regs + PRISM_REG_CURSOR_CTRL);
+        return;
+    }
+
+    if (fb != old_state->fb) {
+        gbo = drm_gem_vram_of_gem(fb->obj[0]);
+        vram_offset = drm_gem_vram_offset(gbo);
+        if (vram_offset < 0)
+            return;
+
+        iowrite32((u32)vram_offset, regs + PRISM_REG_CURSOR_BASE);
+        iowrite32(fb->width | fb->height << 16, regs + PRISM_REG_CURSOR_SIZE);
+        /* crtc_x/y 就是图像左上角, 热点取 (0, 0) 时指针与左上角重合 */
+        iowrite32(0, regs + PRISM_REG_CURSOR_HOT);
+        prism_cursor_set_position(regs, new_state);
+        iowrite32(1, regs + PRISM_REG_CURSOR_UPDATE);
+    } else {
+        prism_cursor_set_position(regs, new_state);
+    }
+    iowrite32(PRISM_CURSOR_ENABLE, regs + PRISM_REG_CURSOR_CTRL);
+}
+
+/* 只有位置变化 (同一个 fb, 同一个 CRTC) 才走异步路径 */
+static int prism_cursor_atomic_async_check(struct drm_plane *plane,
+                                           struct drm_atomic_state *state)
+{
+    struct drm_plane_state *new_state = drm_atomic_get_new_plane_state(state, plane);
+
+    if (!plane->state || !new_state->fb || !new_state->crtc ||
+        new_state->fb != plane->state->fb ||
+        new_state->crtc != plane->state->crtc ||
+        new_state->crtc_w != plane->state->crtc_w ||
+        new_state->crtc_h != plane->state->crtc_h)
+        return -EINVAL;
+
+    return 0;
+}
+
+static void prism_cursor_atomic_async_update(struct drm_plane *plane,
+                                             struct drm_atomic_state *state)
+{
+    struct drm_plane_state *new_state = drm_atomic_get_new_plane_state(state, plane);
+    void __iomem *regs = to_prism_plane(plane)->regs;
+
+    plane->state->crtc_x = new_state->crtc_x;
+    plane->state->crtc_y = new_state->crtc_y;
+    plane->state->src_x = new_state->src_x;
+    plane->state->src_y = new_state->src_y;
+    swap(plane->state->fb, new_state->fb);
+
+    prism_cursor_set_position(regs, plane->state);
+}
+
+static const struct drm_plane_helper_funcs prism_cursor_helper_funcs = {
+    .prepare_fb = drm_gem_vram_plane_helper_prepare_fb,
+    .cleanup_fb = drm_gem_vram_plane_helper_cleanup_fb,
+    .atomic_check = prism_cursor_atomic_check,
+    .atomic_update = prism_cursor_atomic_update,
+    .atomic_async_check = prism_cursor_atomic_async_check,
+    .atomic_async_update = prism_cursor_atomic_async_update,
+};
+
+/* ------------------------------------------------------------------
+ * 3. overlay 平面: 设备在扫描输出时把它混合到主平面之上,
+ *    只重新合成有变化的区域, 主平面的 framebuffer 不需要重画
+ * ------------------------------------------------------------------ */
+static int prism_overlay_atomic_check(struct drm_plane *plane,
+                                      struct drm_atomic_state *state)
+{
+    struct drm_plane_state *new_state = drm_atomic_get_new_plane_state(state, plane);
+    struct drm_crtc_state *crtc_state;
+
+    if (!new_state->crtc)
+        return 0;
+
+    crtc_state = drm_atomic_get_new_crtc_state(state, new_state->crtc);
+    return drm_atomic_helper_check_plane_state(new_state, crtc_state,
+                                               DRM_PLANE_NO_SCALING,
+                                               DRM_PLANE_NO_SCALING,
+                                               true, true);
+}
+
+static void prism_overlay_atomic_update(struct drm_plane *plane,
+                                        struct drm_atomic_state *state)
+{
+    struct drm_plane_state *new_state = drm_atomic_get_new_plane_state(state, plane);
+    struct prism_plane *pplane = to_prism_plane(plane);
+    void __iomem *bank = pplane->regs + PRISM_REG_PLANE(pplane->bank);
+    struct drm_framebuffer *fb = new_state->fb;
+    struct drm_gem_vram_object *gbo;
+    s64 vram_offset;
+    u32 hw_fmt;
+
+    if (!fb || !new_state->visible) {
+        iowrite32(0, bank + PRISM_REG_PLANE_CTRL);
+        return;
+    }
+
+    gbo = drm_gem_vram_of_gem(fb->obj[0]);
+    vram_offset = drm_gem_vram_offset(gbo);
+    if (vram_offset < 0)
+        return;
+
+    /* 设备不做裁剪: BASE 直接指向源矩形的左上角 */
+    vram_offset += fb->offsets[0] +
+                   (new_state->src.y1 >> 16) * fb->pitches[0] +
+                   (new_state->src.x1 >> 16) * fb->format->cpp[0];
+    hw_fmt = fb->format->format == DRM_FORMAT_ARGB8888 ?
+             PRISM_FMT_ARGB8888 : PRISM_FMT_XRGB8888;
+
+    iowrite32((u32)vram_offset, bank + PRISM_REG_PLANE_BASE);
+    iowrite32(fb->pitches[0], bank + PRISM_REG_PLANE_PITCH);
+    iowrite32(hw_fmt, bank + PRISM_REG_PLANE_FORMAT);
+    iowrite32(((u32)new_state->dst.x1 & 0xffff) | ((u32)new_state->dst.y1 << 16),
+              bank + PRISM_REG_PLANE_POS);
+    iowrite32(drm_rect_width(&new_state->dst) | drm_rect_height(&new_state->dst) << 16,
+              bank + PRISM_REG_PLANE_SIZE);
+    iowrite32(new_state->alpha >> 8, bank + PRISM_REG_PLANE_ALPHA);
+    iowrite32(PRISM_PLANE_ENABLE, bank + PRISM_REG_PLANE_CTRL);
+}
+
+static void prism_overlay_atomic_disable(struct drm_plane *plane,
+                                         struct drm_atomic_state *state)
+{
+    struct prism_plane *pplane = to_prism_plane(plane);
+
+    iowrite32(0, pplane->regs + PRISM_REG_PLANE(pplane->bank) + PRISM_REG_PLANE_CTRL);
+}
+
+static const struct drm_plane_helper_funcs prism_overlay_helper_funcs = {
+    .prepare_fb = drm_gem_vram_plane_helper_prepare_fb,
+    .cleanup_fb = drm_gem_vram_plane_helper_cleanup_fb,
+    .atomic_check = prism_overlay_atomic_check,
+    .atomic_update = prism_overlay_atomic_update,
+    .atomic_disable = prism_overlay_atomic_disable,
+};
+
 static const struct drm_plane_helper_funcs prism_primary_helper_funcs = {
     .prepare_fb = drm_gem_vram_plane_helper_prepare_fb,
     .cleanup_fb = drm_gem_vram_plane_helper_cleanup_fb,
@@ -128,6 +318,7 @@ struct prism_plane *prism_plane_init(struct prism_device *pdev,
 				   enum drm_plane_type type, int index)
 {
 	struct drm_device *dev = &pdev->drm;
+	struct prism_pipe *pipe = &pdev->pipes[index];
 	const struct drm_plane_helper_funcs *funcs;
 	struct prism_plane *plane;
 	const u32 *formats;
@@ -140,10 +331,16 @@ struct prism_plane *prism_plane_init(struct prism_device *pdev,
 		funcs = &prism_primary_helper_funcs;
 		break;
 	case DRM_PLANE_TYPE_CURSOR:
+		formats = prism_cursor_formats;
+		nformats = ARRAY_SIZE(prism_cursor_formats);
+		funcs = &prism_cursor_helper_funcs;
+		break;
 	case DRM_PLANE_TYPE_OVERLAY:
+		if (pipe->num_overlays >= PRISM_OVERLAYS)
+			return ERR_PTR(-ENOSPC);
 		formats = prism_plane_formats;
 		nformats = ARRAY_SIZE(prism_plane_formats);
-		funcs = &prism_primary_helper_funcs;
+		funcs = &prism_overlay_helper_funcs;
 		break;
 	default:
 		formats = prism_formats;
@@ -160,6 +357,12 @@ struct prism_plane *prism_plane_init(struct prism_device *pdev,
 		return plane;
 
 	drm_plane_helper_add(&plane->base, funcs);
+	plane->regs = pipe->regs;
+
+	if (type == DRM_PLANE_TYPE_OVERLAY) {
+		plane->bank = pipe->num_overlays++;
+		drm_plane_create_alpha_property(&plane->base);
+	}
 
 	return plane;
 }
@@ -174,9 +174,9 @@ int prism_ttm_init(struct prism_device *pdev)
                           false, true);
     if (ret) return ret;
 
-    /* 2. 注册 VRAM 管理器 (64MB) */
+    /* 2. 注册 VRAM 管理器，大小取 BAR 0 的长度 */
     ret = ttm_range_man_init(&pdev->ttm, TTM_PL_VRAM, false,
-                             PRISM_MEM_VRAM_SIZE >> PAGE_SHIFT);
+                             pdev->vram_size >> PAGE_SHIFT);
     if (ret) return ret;
     
     return 0;
@@ -0,0 +1,186 @@
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include "../prism_compute.h"
+
+/*
+ * compute dispatch scaling benchmark
+ *
+ * Runs an embarrassingly parallel shader (a chain of dependent MADs per
+ * invocation, no shared state) through the compute pool at 1..N host
+ * threads and measures the time from DISPATCH to the fence appearing in
+ * VRAM. Output is compared against the single threaded run so a scheduling
+ * bug shows up as a checksum mismatch rather than a fast wrong answer.
+ * One JSON object per line, the last line is a summary.
+ */
+
+#define BENCH_VRAM_SIZE     (64u << 20)
+#define BENCH_CODE_BASE     0x0
+#define BENCH_FENCE_ADDR    0x10000
+#define BENCH_OUT_BASE      0x100000
+
+#define BENCH_OP(op, d, a, b) \
+    ((uint32_t)(op) << 24 | (uint32_t)(d) << 16 | (uint32_t)(a) << 8 | (b))
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * v4 = float(x) * 0.5 + y, then chain times v4 = v4 * 1.0001 + v3,
+ * output v4
+ */
+static uint32_t build_shader(uint32_t *code, int chain)
+{
+    const float scale = 1.0001f;
+    uint32_t n = 0, lit;
+    int i;
+
+    memcpy(&lit, &scale, sizeof(lit));
+    code[n++] = BENCH_OP(PRISM_OP_V_MAD, 4, 0, PRISM_ISA_INLINE_CONST + 1);
+    code[n++] = 1;
+    for (i = 0; i < chain; i++) {
+        code[n++] = BENCH_OP(PRISM_OP_V_MAD, 4, 4, PRISM_ISA_LITERAL);
+        code[n++] = 3;
+        code[n++] = lit;
+    }
+    return n;
+}
+
+static uint64_t checksum(const uint8_t *p, uint64_t size)
+{
+    uint64_t h = 1469598103934665603ull;
+    uint64_t i;
+
+    for (i = 0; i < size; i++) {
+        h = (h ^ p[i]) * 1099511628211ull;
+    }
+    return h;
+}
+
+/* kick the dispatch and poll the fence like a guest driver would */
+static double run_once(PrismCompute *c, uint8_t *vram, uint32_t fence)
+{
+    double t0;
+
+    c->reg[PRISM_COMPUTE_REG_FENCE_VALUE] = fence;
+    t0 = now_sec();
+    if (prism_compute_dispatch(c) < 0) {
+        return -1;
+    }
+    while (ldl_le_p(vram + BENCH_FENCE_ADDR) != fence) {
+        sched_yield();
+    }
+    smp_rmb();
+    return now_sec() - t0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-t max threads] [-g workgroups] [-l group size] "
+            "[-k mad chain] [-n iterations]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = ncpu > 0 ? MIN(ncpu, PRISM_COMPUTE_MAX_THREADS) : 1;
+    uint32_t workgroups = 4096, group = 64;
+    int chain = 64, iterations = 5;
+    PrismTextureUnit tex;
+    PrismCompute c;
+    uint8_t *vram;
+    uint32_t code_size, fence = 0;
+    uint64_t out_size, ref = 0;
+    double base_sec = 0;
+    bool all_ok = true;
+    int opt, t, k;
+
+    while ((opt = getopt(argc, argv, "t:g:l:k:n:")) != -1) {
+        switch (opt) {
+        case 't': max_threads = atoi(optarg); break;
+        case 'g': workgroups = atoi(optarg); break;
+        case 'l': group = atoi(optarg); break;
+        case 'k': chain = atoi(optarg); break;
+        case 'n': iterations = atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    max_threads = MAX(1, MIN(max_threads, PRISM_COMPUTE_MAX_THREADS));
+    iterations = MAX(iterations, 1);
+    out_size = (uint64_t)workgroups * group * 4;
+    if (!workgroups || !group || group > PRISM_COMPUTE_MAX_GROUP || chain < 0 ||
+        (uint64_t)chain * 12 + 8 > BENCH_FENCE_ADDR ||
+        BENCH_OUT_BASE + out_size > BENCH_VRAM_SIZE) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    vram = g_new0(uint8_t, BENCH_VRAM_SIZE);
+    code_size = build_shader((uint32_t *)(vram + BENCH_CODE_BASE), chain);
+    prism_tex_init(&tex, vram, BENCH_VRAM_SIZE);
+
+    for (t = 1; t <= max_threads; t++) {
+        double best = 0, sec;
+        uint64_t sum;
+        bool ok = true;
+
+        prism_compute_init(&c, vram, BENCH_VRAM_SIZE, &tex, t, NULL, NULL);
+        c.reg[PRISM_COMPUTE_REG_CS_BASE] = BENCH_CODE_BASE;
+        c.reg[PRISM_COMPUTE_REG_CS_SIZE] = code_size;
+        c.reg[PRISM_COMPUTE_REG_GROUP_X] = group;
+        c.reg[PRISM_COMPUTE_REG_GROUP_Y] = 1;
+        c.reg[PRISM_COMPUTE_REG_GROUP_Z] = 1;
+        c.reg[PRISM_COMPUTE_REG_GRID_X] = workgroups;
+        c.reg[PRISM_COMPUTE_REG_GRID_Y] = 1;
+        c.reg[PRISM_COMPUTE_REG_GRID_Z] = 1;
+        c.reg[PRISM_COMPUTE_REG_OUT_BASE] = BENCH_OUT_BASE;
+        c.reg[PRISM_COMPUTE_REG_OUT_REGS] = 0xffffff04;
+        c.reg[PRISM_COMPUTE_REG_FENCE_ADDR] = BENCH_FENCE_ADDR;
+
+        for (k = 0; k < iterations; k++) {
+            memset(vram + BENCH_OUT_BASE, 0, out_size);
+            sec = run_once(&c, vram, ++fence);
+            if (sec < 0 || (c.reg[PRISM_COMPUTE_REG_STATUS] &
+                            PRISM_COMPUTE_STATUS_ERROR)) {
+                ok = false;
+                break;
+            }
+            if (k == 0 || sec < best) {
+                best = sec;
+            }
+        }
+        prism_compute_wait(&c);
+
+        sum = checksum(vram + BENCH_OUT_BASE, out_size);
+        if (t == 1) {
+            ref = sum;
+            base_sec = best;
+        }
+        ok = ok && sum == ref;
+        all_ok = all_ok && ok;
+
+        printf("{\"threads\":%d,\"status\":\"%s\",\"workgroups\":%u,\"group_size\":%u,"
+               "\"seconds\":%.6f,\"minvocations_per_sec\":%.3f,\"speedup\":%.3f,"
+               "\"efficiency\":%.3f,\"steals\":%u}\n",
+               t, ok ? "ok" : "error", workgroups, group, best,
+               best > 0 ? workgroups * (double)group / best / 1e6 : 0,
+               best > 0 ? base_sec / best : 0,
+               best > 0 ? base_sec / best / t : 0,
+               c.reg[PRISM_COMPUTE_REG_STEALS]);
+        fflush(stdout);
+        prism_compute_exit(&c);
+    }
+
+    printf("{\"summary\":true,\"max_threads\":%d,\"host_cpus\":%ld,\"mad_chain\":%d,"
+           "\"iterations\":%d,\"status\":\"%s\"}\n",
+           max_threads, ncpu, chain, iterations, all_ok ? "ok" : "error");
+    g_free(vram);
+    return all_ok ? 0 : 1;
+}
@@ -0,0 +1,11 @@
+#ifndef PRISM_BENCH_ATOMIC_H
+#define PRISM_BENCH_ATOMIC_H
+
+#define qatomic_read(p)         __atomic_load_n((p), __ATOMIC_RELAXED)
+#define qatomic_set(p, v)       __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#define qatomic_fetch_inc(p)    __atomic_fetch_add((p), 1, __ATOMIC_SEQ_CST)
+#define smp_wmb()               __atomic_thread_fence(__ATOMIC_RELEASE)
+#define smp_rmb()               __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define smp_mb()                __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#endif /* PRISM_BENCH_ATOMIC_H */
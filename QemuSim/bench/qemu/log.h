@@ -0,0 +1,9 @@
+#ifndef PRISM_BENCH_LOG_H
+#define PRISM_BENCH_LOG_H
+
+#define LOG_GUEST_ERROR 1
+#define LOG_UNIMP       2
+
+#define qemu_log_mask(mask, ...) fprintf(stderr, __VA_ARGS__)
+
+#endif /* PRISM_BENCH_LOG_H */
@@ -0,0 +1,44 @@
+#ifndef PRISM_BENCH_OSDEP_H
+#define PRISM_BENCH_OSDEP_H
+
+/*
+ * host shim
+ *
+ * just enough of QEMU's osdep.h to build the shader engine and the
+ * compute pool outside QEMU for benchmarking
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
+
+#define g_new(t, n)         ((t *)malloc(sizeof(t) * (n)))
+#define g_new0(t, n)        ((t *)calloc((n), sizeof(t)))
+#define g_renew(t, p, n)    ((t *)realloc((p), sizeof(t) * (n)))
+#define g_free              free
+
+static inline uint32_t ldl_le_p(const void *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void stl_le_p(void *p, uint32_t v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+#endif /* PRISM_BENCH_OSDEP_H */
@@ -0,0 +1,25 @@
+#ifndef PRISM_BENCH_THREAD_H
+#define PRISM_BENCH_THREAD_H
+
+#include <pthread.h>
+
+typedef pthread_mutex_t QemuMutex;
+typedef pthread_cond_t QemuCond;
+typedef pthread_t QemuThread;
+
+#define QEMU_THREAD_JOINABLE 0
+
+#define qemu_mutex_init(m)          pthread_mutex_init((m), NULL)
+#define qemu_mutex_destroy(m)       pthread_mutex_destroy(m)
+#define qemu_mutex_lock(m)          pthread_mutex_lock(m)
+#define qemu_mutex_unlock(m)        pthread_mutex_unlock(m)
+#define qemu_cond_init(c)           pthread_cond_init((c), NULL)
+#define qemu_cond_destroy(c)        pthread_cond_destroy(c)
+#define qemu_cond_wait(c, m)        pthread_cond_wait((c), (m))
+#define qemu_cond_signal(c)         pthread_cond_signal(c)
+#define qemu_cond_broadcast(c)      pthread_cond_broadcast(c)
+#define qemu_thread_create(t, name, fn, arg, mode) \
+    pthread_create((t), NULL, (fn), (arg))
+#define qemu_thread_join(t)         pthread_join(*(t), NULL)
+
+#endif /* PRISM_BENCH_THREAD_H */
@@ -0,0 +1,327 @@
+#include "qemu/osdep.h"
+#include "prism_compose.h"
+
+#ifdef CONFIG_AVX2_OPT
+#include <immintrin.h>
+#include "host/cpuinfo.h"
+#endif
+
+/* x / 255 rounded, exact for x <= 255 * 255 */
+static inline uint32_t prism_compose_div255(uint32_t x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+static inline uint32_t prism_compose_clamp8(int v)
+{
+    return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+/* BT.601 limited range, 8 bit fixed point; the AVX2 path does the same */
+static inline uint32_t prism_compose_yuv(int y, int u, int v)
+{
+    int c = 298 * (y - 16), d = u - 128, e = v - 128;
+
+    return 0xff000000 |
+           prism_compose_clamp8((c + 409 * e + 128) >> 8) << 16 |
+           prism_compose_clamp8((c - 100 * d - 208 * e + 128) >> 8) << 8 |
+           prism_compose_clamp8((c + 516 * d + 128) >> 8);
+}
+
+#ifdef CONFIG_AVX2_OPT
+static inline __m256i __attribute__((target("avx2")))
+prism_compose_div255_avx2(__m256i x)
+{
+    x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+/*
+ * blend avx2
+ *
+ * eight pixels per iteration: the pixels are widened to 16 bit channels,
+ * each pixel's alpha is replicated over its four channels with a byte
+ * shuffle, so both halves are blended with plain 16 bit multiplies;
+ * returns the number of pixels done, the rest is left to the C loop
+ */
+static int __attribute__((target("avx2")))
+prism_compose_blend_avx2(uint32_t *dst, const uint32_t *src, int n,
+                         uint32_t alpha, bool src_alpha)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i galpha = _mm256_set1_epi16(alpha);
+    const __m256i c255 = _mm256_set1_epi16(255);
+    const __m256i opaque = _mm256_set1_epi32(0xff000000);
+    const __m256i force = src_alpha ? zero : opaque;
+    const __m256i rep = _mm256_setr_epi8(6, 7, 6, 7, 6, 7, 6, 7,
+                                         14, 15, 14, 15, 14, 15, 14, 15,
+                                         6, 7, 6, 7, 6, 7, 6, 7,
+                                         14, 15, 14, 15, 14, 15, 14, 15);
+    int i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m256i s = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(src + i)),
+                                    force);
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i slo = _mm256_unpacklo_epi8(s, zero);
+        __m256i shi = _mm256_unpackhi_epi8(s, zero);
+        __m256i dlo = _mm256_unpacklo_epi8(d, zero);
+        __m256i dhi = _mm256_unpackhi_epi8(d, zero);
+        __m256i alo = prism_compose_div255_avx2(
+                          _mm256_mullo_epi16(_mm256_shuffle_epi8(slo, rep), galpha));
+        __m256i ahi = prism_compose_div255_avx2(
+                          _mm256_mullo_epi16(_mm256_shuffle_epi8(shi, rep), galpha));
+        __m256i rlo = _mm256_add_epi16(_mm256_mullo_epi16(slo, alo),
+                          _mm256_mullo_epi16(dlo, _mm256_sub_epi16(c255, alo)));
+        __m256i rhi = _mm256_add_epi16(_mm256_mullo_epi16(shi, ahi),
+                          _mm256_mullo_epi16(dhi, _mm256_sub_epi16(c255, ahi)));
+        __m256i r = _mm256_packus_epi16(prism_compose_div255_avx2(rlo),
+                                        prism_compose_div255_avx2(rhi));
+
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_or_si256(r, opaque));
+    }
+    return i;
+}
+
+/* eight pixels of y / u / v in 32 bit lanes to XRGB8888 */
+static inline __m256i __attribute__((target("avx2")))
+prism_compose_yuv_avx2(__m256i y, __m256i u, __m256i v)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i c255 = _mm256_set1_epi32(255);
+    const __m256i half = _mm256_set1_epi32(128);
+    __m256i c = _mm256_mullo_epi32(_mm256_sub_epi32(y, _mm256_set1_epi32(16)),
+                                   _mm256_set1_epi32(298));
+    __m256i d = _mm256_sub_epi32(u, half);
+    __m256i e = _mm256_sub_epi32(v, half);
+    __m256i r = _mm256_add_epi32(c, _mm256_mullo_epi32(e, _mm256_set1_epi32(409)));
+    __m256i g = _mm256_sub_epi32(c, _mm256_add_epi32(
+                    _mm256_mullo_epi32(d, _mm256_set1_epi32(100)),
+                    _mm256_mullo_epi32(e, _mm256_set1_epi32(208))));
+    __m256i b = _mm256_add_epi32(c, _mm256_mullo_epi32(d, _mm256_set1_epi32(516)));
+
+    r = _mm256_srai_epi32(_mm256_add_epi32(r, half), 8);
+    g = _mm256_srai_epi32(_mm256_add_epi32(g, half), 8);
+    b = _mm256_srai_epi32(_mm256_add_epi32(b, half), 8);
+    r = _mm256_min_epi32(_mm256_max_epi32(r, zero), c255);
+    g = _mm256_min_epi32(_mm256_max_epi32(g, zero), c255);
+    b = _mm256_min_epi32(_mm256_max_epi32(b, zero), c255);
+    return _mm256_or_si256(_mm256_set1_epi32(0xff000000),
+                           _mm256_or_si256(_mm256_slli_epi32(r, 16),
+                                           _mm256_or_si256(_mm256_slli_epi32(g, 8), b)));
+}
+
+/*
+ * convert avx2
+ *
+ * pixels [x, xe) of a row, x even for the YUV formats so every vector
+ * starts on a chroma pair; returns where it stopped, the C loop does
+ * the tail
+ */
+static int __attribute__((target("avx2")))
+prism_compose_convert_avx2(uint32_t *dst, const uint8_t *src, const uint8_t *uv,
+                           uint32_t format, int x, int xe)
+{
+    const __m256i m5 = _mm256_set1_epi16(0x1f);
+    const __m256i m6 = _mm256_set1_epi16(0x3f);
+    const __m256i m8 = _mm256_set1_epi32(0xff);
+    const __m128i even = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14,
+                                       -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i yuyv_u = _mm_setr_epi8(1, 1, 5, 5, 9, 9, 13, 13,
+                                         -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i yuyv_v = _mm_setr_epi8(3, 3, 7, 7, 11, 11, 15, 15,
+                                         -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i nv12_u = _mm_setr_epi8(0, 0, 2, 2, 4, 4, 6, 6,
+                                         -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i nv12_v = _mm_setr_epi8(1, 1, 3, 3, 5, 5, 7, 7,
+                                         -1, -1, -1, -1, -1, -1, -1, -1);
+    __m256i p, r, g, b, lo, hi;
+    __m128i q;
+
+    switch (format) {
+    case PRISM_COMPOSE_FMT_RGB565:
+        /* 16 pixels: widen each channel to 8 bit in 16 bit lanes, interleave */
+        for (; x + 16 <= xe; x += 16) {
+            p = _mm256_loadu_si256((const __m256i *)(src + x * 2));
+            r = _mm256_srli_epi16(p, 11);
+            g = _mm256_and_si256(_mm256_srli_epi16(p, 5), m6);
+            b = _mm256_and_si256(p, m5);
+            r = _mm256_or_si256(_mm256_slli_epi16(r, 3), _mm256_srli_epi16(r, 2));
+            g = _mm256_or_si256(_mm256_slli_epi16(g, 2), _mm256_srli_epi16(g, 4));
+            b = _mm256_or_si256(_mm256_slli_epi16(b, 3), _mm256_srli_epi16(b, 2));
+            b = _mm256_or_si256(b, _mm256_slli_epi16(g, 8));
+            r = _mm256_or_si256(r, _mm256_set1_epi16((short)0xff00));
+            lo = _mm256_unpacklo_epi16(b, r);
+            hi = _mm256_unpackhi_epi16(b, r);
+            _mm256_storeu_si256((__m256i *)(dst + x),
+                                _mm256_permute2x128_si256(lo, hi, 0x20));
+            _mm256_storeu_si256((__m256i *)(dst + x + 8),
+                                _mm256_permute2x128_si256(lo, hi, 0x31));
+        }
+        break;
+    case PRISM_COMPOSE_FMT_XRGB2101010:
+        /* keep the top 8 of each 10 bits */
+        for (; x + 8 <= xe; x += 8) {
+            p = _mm256_loadu_si256((const __m256i *)(src + x * 4));
+            r = _mm256_and_si256(_mm256_srli_epi32(p, 22), m8);
+            g = _mm256_and_si256(_mm256_srli_epi32(p, 12), m8);
+            b = _mm256_and_si256(_mm256_srli_epi32(p, 2), m8);
+            _mm256_storeu_si256((__m256i *)(dst + x),
+                _mm256_or_si256(_mm256_set1_epi32(0xff000000),
+                                _mm256_or_si256(_mm256_slli_epi32(r, 16),
+                                                _mm256_or_si256(_mm256_slli_epi32(g, 8), b))));
+        }
+        break;
+    case PRISM_COMPOSE_FMT_YUYV:
+        for (; x + 8 <= xe; x += 8) {
+            q = _mm_loadu_si128((const __m128i *)(src + x * 2));
+            _mm256_storeu_si256((__m256i *)(dst + x), prism_compose_yuv_avx2(
+                _mm256_cvtepu8_epi32(_mm_shuffle_epi8(q, even)),
+                _mm256_cvtepu8_epi32(_mm_shuffle_epi8(q, yuyv_u)),
+                _mm256_cvtepu8_epi32(_mm_shuffle_epi8(q, yuyv_v))));
+        }
+        break;
+    case PRISM_COMPOSE_FMT_NV12:
+        for (; x + 8 <= xe; x += 8) {
+            q = _mm_loadl_epi64((const __m128i *)(uv + x));
+            _mm256_storeu_si256((__m256i *)(dst + x), prism_compose_yuv_avx2(
+                _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + x))),
+                _mm256_cvtepu8_epi32(_mm_shuffle_epi8(q, nv12_u)),
+                _mm256_cvtepu8_epi32(_mm_shuffle_epi8(q, nv12_v))));
+        }
+        break;
+    }
+    return x;
+}
+#endif
+
+/* one pixel of a converted format, the reference for the AVX2 kernels */
+static uint32_t prism_compose_pixel(const uint8_t *src, const uint8_t *uv,
+                                    uint32_t format, int x)
+{
+    uint32_t p, r, g, b;
+    const uint8_t *q;
+
+    switch (format) {
+    case PRISM_COMPOSE_FMT_RGB565:
+        p = lduw_le_p(src + x * 2);
+        r = p >> 11;
+        g = (p >> 5) & 0x3f;
+        b = p & 0x1f;
+        return 0xff000000 | (r << 3 | r >> 2) << 16 | (g << 2 | g >> 4) << 8 |
+               (b << 3 | b >> 2);
+    case PRISM_COMPOSE_FMT_XRGB2101010:
+        p = ldl_le_p(src + x * 4);
+        return 0xff000000 | ((p >> 22) & 0xff) << 16 | ((p >> 12) & 0xff) << 8 |
+               ((p >> 2) & 0xff);
+    case PRISM_COMPOSE_FMT_YUYV:
+        q = src + (x & ~1) * 2;
+        return prism_compose_yuv(q[(x & 1) * 2], q[1], q[3]);
+    default:    /* NV12 */
+        return prism_compose_yuv(src[x], uv[x & ~1], uv[(x & ~1) + 1]);
+    }
+}
+
+/* formats the UI can not scan out as they are and that need converting */
+bool prism_compose_needs_convert(uint32_t format)
+{
+    switch (format) {
+    case PRISM_COMPOSE_FMT_RGB565:
+    case PRISM_COMPOSE_FMT_XRGB2101010:
+    case PRISM_COMPOSE_FMT_YUYV:
+    case PRISM_COMPOSE_FMT_NV12:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*
+ * row bytes
+ *
+ * bytes read from one row of the first plane for width pixels, 0 for a
+ * format this file does not know
+ */
+uint32_t prism_compose_row_bytes(uint32_t format, uint32_t width)
+{
+    switch (format) {
+    case PRISM_COMPOSE_FMT_ARGB8888:
+    case PRISM_COMPOSE_FMT_XRGB8888:
+    case PRISM_COMPOSE_FMT_XRGB2101010:
+        return width * 4;
+    case PRISM_COMPOSE_FMT_RGB565:
+    case PRISM_COMPOSE_FMT_YUYV:
+        return width * 2;
+    case PRISM_COMPOSE_FMT_NV12:
+        return width;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * prism compose convert
+ *
+ * dst[xs, xe) = pixels [xs, xe) of a primary row as XRGB8888. src is the
+ * row (the luma row for NV12), uv the NV12 chroma row covering it;
+ * XRGB8888 / ARGB8888 primaries are copied as they are, format is one
+ * of those or a converted format
+ */
+void prism_compose_convert(uint32_t *dst, const uint8_t *src, const uint8_t *uv,
+                           uint32_t format, int xs, int xe)
+{
+    int x = xs;
+
+    if (format == PRISM_COMPOSE_FMT_XRGB8888 ||
+        format == PRISM_COMPOSE_FMT_ARGB8888) {
+        memcpy(dst + xs, src + xs * 4, (xe - xs) * 4);
+        return;
+    }
+    assert(prism_compose_needs_convert(format));
+    /* a span starting inside a chroma pair */
+    if ((format == PRISM_COMPOSE_FMT_YUYV || format == PRISM_COMPOSE_FMT_NV12) &&
+        (x & 1) && x < xe) {
+        dst[x] = prism_compose_pixel(src, uv, format, x);
+        x++;
+    }
+#ifdef CONFIG_AVX2_OPT
+    if (cpuinfo & CPUINFO_AVX2) {
+        x = prism_compose_convert_avx2(dst, src, uv, format, x, xe);
+    }
+#endif
+    for (; x < xe; x++) {
+        dst[x] = prism_compose_pixel(src, uv, format, x);
+    }
+}
+
+/*
+ * prism compose blend
+ *
+ * dst = src over dst for n pixels, src alpha (if src_alpha) scaled by
+ * the global alpha; same rounding on the AVX2 and the C path
+ */
+void prism_compose_blend(uint32_t *dst, const uint32_t *src, int n,
+                         uint32_t alpha, bool src_alpha)
+{
+    uint32_t s, d, a, out;
+    int i = 0, shift;
+
+    alpha = MIN(alpha, 255);
+#ifdef CONFIG_AVX2_OPT
+    if (cpuinfo & CPUINFO_AVX2) {
+        i = prism_compose_blend_avx2(dst, src, n, alpha, src_alpha);
+    }
+#endif
+    for (; i < n; i++) {
+        s = src[i];
+        d = dst[i];
+        a = prism_compose_div255((src_alpha ? s >> 24 : 255) * alpha);
+        out = 0xff000000;
+        for (shift = 0; shift < 24; shift += 8) {
+            out |= prism_compose_div255(((s >> shift) & 0xff) * a +
+                                        ((d >> shift) & 0xff) * (255 - a)) << shift;
+        }
+        dst[i] = out;
+    }
+}
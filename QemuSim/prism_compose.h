@@ -0,0 +1,45 @@
+#ifndef PRISM_COMPOSE_H
+#define PRISM_COMPOSE_H
+
+/*
+ * scanout compositor
+ *
+ * Overlay planes are ARGB8888 (straight alpha) or XRGB8888 (opaque)
+ * rectangles blended in plane order over the primary, scaled by a global
+ * plane alpha of 0-255. The result is always opaque XRGB8888.
+ *
+ * Primaries the UI can not take as they are (16 bpp, 10 bpc, YUV) are
+ * converted into the same XRGB8888 composition, span by span, so only
+ * damaged pixels are ever converted. YUV is BT.601 limited range; NV12's
+ * interleaved CbCr plane follows the luma plane at offset + stride *
+ * height with the same stride.
+ */
+
+#define PRISM_COMPOSE_FMT_ARGB8888  0x20028888  /* pixman a8r8g8b8 */
+#define PRISM_COMPOSE_FMT_XRGB8888  0x20020888  /* pixman x8r8g8b8 */
+#define PRISM_COMPOSE_FMT_RGB565    0x10020565  /* pixman r5g6b5 */
+#define PRISM_COMPOSE_FMT_XRGB2101010 0x20020aaa  /* pixman x2r10g10b10 */
+#define PRISM_COMPOSE_FMT_YUYV      0x10060000  /* pixman yuy2 */
+#define PRISM_COMPOSE_FMT_NV12      0x0c3f0000  /* 12 bpp, a type pixman does not use */
+
+struct PrismPlane {
+    bool enable;
+    uint32_t base;          //VRAM offset of the top left pixel
+    uint32_t pitch;         //bytes between rows
+    uint32_t format;
+    int32_t x, y;           //position on the primary, may be off screen
+    uint32_t width, height;
+    uint32_t alpha;         //global plane alpha, 0-255
+};
+
+typedef struct PrismPlane PrismPlane;
+
+void prism_compose_blend(uint32_t *dst, const uint32_t *src, int n,
+                         uint32_t alpha, bool src_alpha);
+
+bool prism_compose_needs_convert(uint32_t format);
+uint32_t prism_compose_row_bytes(uint32_t format, uint32_t width);
+void prism_compose_convert(uint32_t *dst, const uint8_t *src, const uint8_t *uv,
+                           uint32_t format, int xs, int xe);
+
+#endif /* PRISM_COMPOSE_H */
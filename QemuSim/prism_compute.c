@@ -0,0 +1,404 @@
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include "qemu/log.h"
+#include "prism_compute.h"
+
+
+static inline uint32_t prism_compute_u32(float f)
+{
+    uint32_t v;
+    memcpy(&v, &f, sizeof(v));
+    return v;
+}
+
+/*
+ * vram range check
+ *
+ * true when [base, base + size) lies inside VRAM
+ */
+static bool prism_compute_range_ok(PrismCompute *c, uint64_t base, uint64_t size)
+{
+    return base <= c->vram_size && size <= c->vram_size - base;
+}
+
+/*
+ * run workgroup
+ *
+ * shade the invocations of one workgroup a wave at a time and store
+ * their outputs
+ */
+static int prism_compute_run_group(PrismComputeWorker *w, uint32_t wg)
+{
+    PrismCompute *c = w->compute;
+    const PrismComputeDispatch *d = &c->cur;
+    PrismShaderCore *core = &w->core;
+    uint32_t gid[3], id[3], first, li, k;
+    uint64_t linear;
+    int lane, n;
+
+    gid[0] = wg % d->grid[0];
+    gid[1] = wg / d->grid[0] % d->grid[1];
+    gid[2] = wg / d->grid[0] / d->grid[1];
+
+    for (first = 0; first < d->group_size; first += PRISM_SHADER_LANES) {
+        n = MIN(d->group_size - first, PRISM_SHADER_LANES);
+
+        prism_shader_reset(core, d->cb, d->cb_size, &w->tex);
+        for (lane = 0; lane < n; lane++) {
+            li = first + lane;
+            id[0] = gid[0] * d->group[0] + li % d->group[0];
+            id[1] = gid[1] * d->group[1] + li / d->group[0] % d->group[1];
+            id[2] = gid[2] * d->group[2] + li / d->group[0] / d->group[1];
+            for (k = 0; k < 3; k++) {
+                core->vgpr[k][lane] = prism_compute_u32(id[k]);
+            }
+            core->vgpr[3][lane] = prism_compute_u32(li);
+        }
+        if (prism_shader_exec(core, d->code, d->code_size) < 0) {
+            return -1;
+        }
+        for (lane = 0; lane < n; lane++) {
+            li = first + lane;
+            id[0] = gid[0] * d->group[0] + li % d->group[0];
+            id[1] = gid[1] * d->group[1] + li / d->group[0] % d->group[1];
+            id[2] = gid[2] * d->group[2] + li / d->group[0] / d->group[1];
+            linear = ((uint64_t)id[2] * d->grid[1] * d->group[1] + id[1]) *
+                     d->grid[0] * d->group[0] + id[0];
+            for (k = 0; k < d->nout; k++) {
+                stl_le_p(d->out + (linear * d->nout + k) * 4,
+                         prism_shader_reg(core, d->out_reg[k], lane));
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * deque pop
+ *
+ * take the workgroup at the back of the own deque
+ */
+static bool prism_compute_pop(PrismComputeWorker *w, uint32_t *wg)
+{
+    PrismComputeDeque *dq = &w->deque;
+    bool ok = false;
+
+    qemu_mutex_lock(&dq->lock);
+    if (dq->head < dq->tail) {
+        *wg = --dq->tail;
+        ok = true;
+    }
+    qemu_mutex_unlock(&dq->lock);
+    return ok;
+}
+
+/*
+ * deque steal
+ *
+ * move the front half of the first non-empty deque found, starting at
+ * the next thread, into the own (empty) deque
+ */
+static bool prism_compute_steal(PrismComputeWorker *w)
+{
+    PrismCompute *c = w->compute;
+    uint32_t start, n;
+    unsigned i;
+
+    for (i = 1; i < c->nthreads; i++) {
+        PrismComputeDeque *victim = &c->workers[(w->index + i) % c->nthreads].deque;
+
+        qemu_mutex_lock(&victim->lock);
+        n = victim->tail - victim->head;
+        if (n == 0) {
+            qemu_mutex_unlock(&victim->lock);
+            continue;
+        }
+        n = DIV_ROUND_UP(n, 2);
+        start = victim->head;
+        victim->head += n;
+        qemu_mutex_unlock(&victim->lock);
+
+        qemu_mutex_lock(&w->deque.lock);
+        w->deque.head = start;
+        w->deque.tail = start + n;
+        qemu_mutex_unlock(&w->deque.lock);
+        w->steals++;
+        return true;
+    }
+    return false;
+}
+
+static void prism_compute_run(PrismComputeWorker *w)
+{
+    PrismCompute *c = w->compute;
+    uint32_t wg;
+
+    while (!qatomic_read(&c->fault)) {
+        if (!prism_compute_pop(w, &wg)) {
+            if (!prism_compute_steal(w)) {
+                break;
+            }
+            continue;
+        }
+        if (prism_compute_run_group(w, wg) < 0) {
+            qatomic_set(&c->fault, true);
+            break;
+        }
+        w->workgroups++;
+    }
+}
+
+/*
+ * dispatch complete
+ *
+ * called with the lock held by the last thread to finish: publish the
+ * statistics, then write the fence after every shader store
+ */
+static void prism_compute_complete(PrismCompute *c)
+{
+    const PrismComputeDispatch *d = &c->cur;
+    uint32_t workgroups = 0, steals = 0;
+    unsigned i;
+
+    for (i = 0; i < c->nthreads; i++) {
+        workgroups += c->workers[i].workgroups;
+        steals += c->workers[i].steals;
+    }
+    qatomic_set(&c->reg[PRISM_COMPUTE_REG_WORKGROUPS], workgroups);
+    qatomic_set(&c->reg[PRISM_COMPUTE_REG_STEALS], steals);
+    if (c->fault) {
+        qemu_log_mask(LOG_GUEST_ERROR, "prism-sim: compute shader fault\n");
+    }
+
+    if (c->done && d->nout) {
+        c->done(c->opaque, d->out - c->vram,
+                (uint64_t)d->workgroups * d->group_size * d->nout * 4);
+    }
+    smp_wmb();
+    stl_le_p(c->vram + d->fence_addr, d->fence_value);
+    if (c->done) {
+        c->done(c->opaque, d->fence_addr, 4);
+    }
+    qatomic_set(&c->reg[PRISM_COMPUTE_REG_FENCE], d->fence_value);
+    qatomic_set(&c->reg[PRISM_COMPUTE_REG_STATUS],
+                c->fault ? PRISM_COMPUTE_STATUS_ERROR : 0);
+
+    c->busy = false;
+    qemu_cond_broadcast(&c->idle_cond);
+}
+
+/*
+ * compute thread
+ *
+ * pool thread: wait for a new dispatch generation, run workgroups
+ * until no deque has any left, report back
+ */
+static void *prism_compute_thread(void *opaque)
+{
+    PrismComputeWorker *w = opaque;
+    PrismCompute *c = w->compute;
+    uint32_t seen = 0;
+
+    qemu_mutex_lock(&c->lock);
+    for (;;) {
+        while (!c->quit && c->generation == seen) {
+            qemu_cond_wait(&c->work_cond, &c->lock);
+        }
+        if (c->quit) {
+            break;
+        }
+        seen = c->generation;
+        qemu_mutex_unlock(&c->lock);
+
+        prism_compute_run(w);
+
+        qemu_mutex_lock(&c->lock);
+        if (--c->pending == 0) {
+            prism_compute_complete(c);
+        }
+    }
+    qemu_mutex_unlock(&c->lock);
+    return NULL;
+}
+
+/*
+ * prism compute init
+ *
+ * start the pool; done (may be NULL) is told about every VRAM range a
+ * dispatch wrote, from the pool thread finishing it
+ */
+void prism_compute_init(PrismCompute *c, uint8_t *vram, uint64_t vram_size,
+                        PrismTextureUnit *tex, unsigned nthreads,
+                        void (*done)(void *, uint64_t, uint64_t), void *opaque)
+{
+    unsigned i;
+
+    memset(c, 0, sizeof(*c));
+    c->vram = vram;
+    c->vram_size = vram_size;
+    c->tex = tex;
+    c->done = done;
+    c->opaque = opaque;
+    c->nthreads = MAX(nthreads, 1);
+    c->workers = g_new0(PrismComputeWorker, c->nthreads);
+    qemu_mutex_init(&c->lock);
+    qemu_cond_init(&c->work_cond);
+    qemu_cond_init(&c->idle_cond);
+
+    for (i = 0; i < c->nthreads; i++) {
+        PrismComputeWorker *w = &c->workers[i];
+
+        w->compute = c;
+        w->index = i;
+        qemu_mutex_init(&w->deque.lock);
+        prism_tex_init(&w->tex, vram, vram_size);
+        qemu_thread_create(&w->thread, "prism-compute",
+                           prism_compute_thread, w, QEMU_THREAD_JOINABLE);
+    }
+}
+
+/*
+ * prism compute wait
+ *
+ * block until the running dispatch, if any, has written its fence
+ */
+void prism_compute_wait(PrismCompute *c)
+{
+    qemu_mutex_lock(&c->lock);
+    while (c->busy) {
+        qemu_cond_wait(&c->idle_cond, &c->lock);
+    }
+    qemu_mutex_unlock(&c->lock);
+}
+
+/*
+ * prism compute exit
+ *
+ * let the running dispatch finish, stop and join the pool
+ */
+void prism_compute_exit(PrismCompute *c)
+{
+    unsigned i;
+
+    if (!c->workers) {
+        return;
+    }
+    prism_compute_wait(c);
+    qemu_mutex_lock(&c->lock);
+    c->quit = true;
+    qemu_cond_broadcast(&c->work_cond);
+    qemu_mutex_unlock(&c->lock);
+
+    for (i = 0; i < c->nthreads; i++) {
+        qemu_thread_join(&c->workers[i].thread);
+        qemu_mutex_destroy(&c->workers[i].deque.lock);
+    }
+    qemu_cond_destroy(&c->idle_cond);
+    qemu_cond_destroy(&c->work_cond);
+    qemu_mutex_destroy(&c->lock);
+    g_free(c->workers);
+    c->workers = NULL;
+}
+
+/*
+ * dispatch latch
+ *
+ * copy the registers into the dispatch parameters, false when anything
+ * the dispatch would touch lies outside VRAM or a size is out of range
+ */
+static bool prism_compute_latch(PrismCompute *c, PrismComputeDispatch *d)
+{
+    uint32_t *reg = c->reg;
+    uint64_t workgroups = 1, group_size = 1, out_size;
+    int k;
+
+    for (k = 0; k < 3; k++) {
+        d->group[k] = reg[PRISM_COMPUTE_REG_GROUP_X + k];
+        d->grid[k] = reg[PRISM_COMPUTE_REG_GRID_X + k];
+        if (!d->group[k] || !d->grid[k]) {
+            return false;
+        }
+        group_size *= d->group[k];
+        workgroups *= d->grid[k];
+        if (group_size > PRISM_COMPUTE_MAX_GROUP || workgroups > UINT32_MAX) {
+            return false;
+        }
+    }
+    d->group_size = group_size;
+    d->workgroups = workgroups;
+
+    for (d->nout = 0; d->nout < PRISM_COMPUTE_MAX_OUTPUTS; d->nout++) {
+        d->out_reg[d->nout] = reg[PRISM_COMPUTE_REG_OUT_REGS] >> (d->nout * 8);
+        if (d->out_reg[d->nout] == 0xff) {
+            break;
+        }
+    }
+    out_size = workgroups * group_size * d->nout * 4;
+
+    d->code_size = reg[PRISM_COMPUTE_REG_CS_SIZE];
+    d->cb_size = reg[PRISM_COMPUTE_REG_CB_SIZE];
+    d->fence_addr = reg[PRISM_COMPUTE_REG_FENCE_ADDR];
+    d->fence_value = reg[PRISM_COMPUTE_REG_FENCE_VALUE];
+    if (reg[PRISM_COMPUTE_REG_CS_BASE] % 4 || !d->code_size ||
+        !prism_compute_range_ok(c, reg[PRISM_COMPUTE_REG_CS_BASE],
+                                (uint64_t)d->code_size * 4) ||
+        !prism_compute_range_ok(c, reg[PRISM_COMPUTE_REG_CB_BASE], d->cb_size) ||
+        !prism_compute_range_ok(c, reg[PRISM_COMPUTE_REG_OUT_BASE], out_size) ||
+        d->fence_addr % 4 || !prism_compute_range_ok(c, d->fence_addr, 4)) {
+        return false;
+    }
+    d->code = (const uint32_t *)(c->vram + reg[PRISM_COMPUTE_REG_CS_BASE]);
+    d->cb = d->cb_size ? c->vram + reg[PRISM_COMPUTE_REG_CB_BASE] : NULL;
+    d->out = c->vram + reg[PRISM_COMPUTE_REG_OUT_BASE];
+    return true;
+}
+
+/*
+ * prism compute dispatch
+ *
+ * hand the grid described by the registers to the pool and return,
+ * -1 (STATUS_ERROR set, no fence written) on bad state or while busy
+ */
+int prism_compute_dispatch(PrismCompute *c)
+{
+    PrismComputeDispatch *d = &c->cur;
+    uint32_t share, extra, start = 0;
+    unsigned i;
+
+    qemu_mutex_lock(&c->lock);
+    if (c->busy) {
+        qemu_mutex_unlock(&c->lock);
+        qemu_log_mask(LOG_GUEST_ERROR, "prism-sim: dispatch while busy\n");
+        return -1;
+    }
+    if (!prism_compute_latch(c, d)) {
+        qatomic_set(&c->reg[PRISM_COMPUTE_REG_STATUS], PRISM_COMPUTE_STATUS_ERROR);
+        qemu_mutex_unlock(&c->lock);
+        qemu_log_mask(LOG_GUEST_ERROR, "prism-sim: invalid dispatch state\n");
+        return -1;
+    }
+
+    /* contiguous shares, the first (workgroups % nthreads) get one more */
+    share = d->workgroups / c->nthreads;
+    extra = d->workgroups % c->nthreads;
+    for (i = 0; i < c->nthreads; i++) {
+        PrismComputeWorker *w = &c->workers[i];
+
+        w->deque.head = start;
+        start += share + (i < extra);
+        w->deque.tail = start;
+        w->workgroups = 0;
+        w->steals = 0;
+        memcpy(w->tex.desc, c->tex->desc, sizeof(w->tex.desc));
+        prism_tex_invalidate(&w->tex);
+    }
+
+    c->busy = true;
+    c->fault = false;
+    qatomic_set(&c->reg[PRISM_COMPUTE_REG_STATUS], PRISM_COMPUTE_STATUS_BUSY);
+    c->pending = c->nthreads;
+    c->generation++;
+    qemu_cond_broadcast(&c->work_cond);
+    qemu_mutex_unlock(&c->lock);
+    return 0;
+}
@@ -0,0 +1,131 @@
+#ifndef PRISM_COMPUTE_H
+#define PRISM_COMPUTE_H
+
+#include "qemu/thread.h"
+#include "prism_shader.h"
+
+/*
+ * compute dispatch
+ *
+ * A dispatch is a grid of GRID_X * GRID_Y * GRID_Z workgroups, each of
+ * GROUP_X * GROUP_Y * GROUP_Z invocations run as waves of 16 lanes.
+ * Writing DISPATCH hands the grid to a pool of host threads and returns
+ * at once. Every thread starts with a contiguous share of the workgroups in
+ * its own deque, pops from the back of it and, once empty, steals the front
+ * half of another thread's deque. When the last workgroup is done the fence
+ * value is written to VRAM at FENCE_ADDR (after all shader output) and
+ * mirrored in the FENCE register.
+ *
+ * Shader ABI:
+ *   in : v0 / v1 / v2 global invocation id x / y / z, v3 index of the
+ *        invocation inside its workgroup (all as float)
+ *   out: up to 4 dwords per invocation, register numbers given by OUT_REGS
+ *        (one per byte, 0xff ends the list), stored at
+ *        OUT_BASE + global linear id * 4 * outputs
+ */
+
+#define PRISM_COMPUTE_MAX_THREADS   64
+#define PRISM_COMPUTE_MAX_GROUP     1024    /* invocations per workgroup */
+#define PRISM_COMPUTE_MAX_OUTPUTS   4
+
+/* registers, all offsets are in VRAM and code sizes in dwords */
+#define PRISM_COMPUTE_REG_CS_BASE    0
+#define PRISM_COMPUTE_REG_CS_SIZE    1
+#define PRISM_COMPUTE_REG_CB_BASE    2
+#define PRISM_COMPUTE_REG_CB_SIZE    3
+#define PRISM_COMPUTE_REG_GROUP_X    4      /* workgroup size */
+#define PRISM_COMPUTE_REG_GROUP_Y    5
+#define PRISM_COMPUTE_REG_GROUP_Z    6
+#define PRISM_COMPUTE_REG_GRID_X     7      /* workgroup count */
+#define PRISM_COMPUTE_REG_GRID_Y     8
+#define PRISM_COMPUTE_REG_GRID_Z     9
+#define PRISM_COMPUTE_REG_OUT_BASE   10
+#define PRISM_COMPUTE_REG_OUT_REGS   11
+#define PRISM_COMPUTE_REG_FENCE_ADDR 12
+#define PRISM_COMPUTE_REG_FENCE_VALUE 13
+#define PRISM_COMPUTE_REG_DISPATCH   14     /* write: start the dispatch */
+#define PRISM_COMPUTE_REG_STATUS     15     /* read only */
+#define PRISM_COMPUTE_REG_FENCE      16     /* read only: last fence written */
+#define PRISM_COMPUTE_REG_WORKGROUPS 17     /* read only: workgroups run */
+#define PRISM_COMPUTE_REG_STEALS     18     /* read only: successful steals */
+#define PRISM_COMPUTE_REG_NUMBER     19
+
+#define PRISM_COMPUTE_STATUS_BUSY    (1 << 0)
+#define PRISM_COMPUTE_STATUS_ERROR   (1 << 1)   /* bad state or shader fault */
+
+typedef struct PrismCompute PrismCompute;
+
+/* workgroups [head, tail) still to run, the owner pops at tail */
+struct PrismComputeDeque {
+    QemuMutex lock;
+    uint32_t head;
+    uint32_t tail;
+};
+
+typedef struct PrismComputeDeque PrismComputeDeque;
+
+struct PrismComputeWorker {
+    PrismCompute *compute;
+    unsigned index;
+    QemuThread thread;
+    PrismComputeDeque deque;
+    PrismShaderCore core;
+    PrismTextureUnit tex;       //own texel cache, descriptors copied per dispatch
+    uint32_t workgroups;
+    uint32_t steals;
+};
+
+typedef struct PrismComputeWorker PrismComputeWorker;
+
+/* dispatch parameters, latched from the registers on DISPATCH */
+struct PrismComputeDispatch {
+    const uint32_t *code;
+    uint32_t code_size;
+    const uint8_t *cb;
+    uint32_t cb_size;
+    uint32_t group[3];
+    uint32_t grid[3];
+    uint32_t group_size;
+    uint32_t workgroups;
+    uint8_t *out;
+    uint8_t out_reg[PRISM_COMPUTE_MAX_OUTPUTS];
+    unsigned nout;
+    uint32_t fence_addr;
+    uint32_t fence_value;
+};
+
+typedef struct PrismComputeDispatch PrismComputeDispatch;
+
+struct PrismCompute {
+    uint32_t reg[PRISM_COMPUTE_REG_NUMBER];
+
+    uint8_t *vram;
+    uint64_t vram_size;
+    PrismTextureUnit *tex;      //device texture unit, descriptors only
+
+    /* called from a pool thread once the fence is written */
+    void (*done)(void *opaque, uint64_t out_base, uint64_t out_size);
+    void *opaque;
+
+    unsigned nthreads;
+    PrismComputeWorker *workers;
+    QemuMutex lock;
+    QemuCond work_cond;
+    QemuCond idle_cond;
+    uint32_t generation;        //bumped for every dispatch
+    unsigned pending;           //threads still working on the dispatch
+    bool busy;
+    bool fault;
+    bool quit;
+
+    PrismComputeDispatch cur;
+};
+
+void prism_compute_init(PrismCompute *c, uint8_t *vram, uint64_t vram_size,
+                        PrismTextureUnit *tex, unsigned nthreads,
+                        void (*done)(void *, uint64_t, uint64_t), void *opaque);
+void prism_compute_exit(PrismCompute *c);
+int prism_compute_dispatch(PrismCompute *c);
+void prism_compute_wait(PrismCompute *c);
+
+#endif /* PRISM_COMPUTE_H */
@@ -0,0 +1,268 @@
+#include "qemu/osdep.h"
+#include "qemu/host-utils.h"
+#include "qemu/log.h"
+#include "prism_fbc.h"
+
+#define PRISM_FBC_PIXELS    (PRISM_FBC_TILE * PRISM_FBC_TILE)
+
+/*
+ * vram range check
+ *
+ * true when [base, base + size) lies inside VRAM
+ */
+static bool prism_fbc_range_ok(uint64_t vram_size, uint64_t base, uint64_t size)
+{
+    return base <= vram_size && size <= vram_size - base;
+}
+
+/* bytes of a slot used by a tile of the given metadata */
+static inline uint32_t prism_fbc_used(uint8_t bits)
+{
+    return bits ? 4 + (PRISM_FBC_PIXELS * 3 * bits + 7) / 8 : 4;
+}
+
+/*
+ * encode tile
+ *
+ * fill slot from the 64 pixels of px, return the metadata byte
+ */
+static uint8_t prism_fbc_encode_tile(const uint32_t *px, uint8_t *slot)
+{
+    uint32_t lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+    uint32_t range = 0, c;
+    uint64_t acc = 0;
+    uint8_t *out = slot + 4;
+    int bits, nacc = 0, i, k;
+
+    for (i = 0; i < PRISM_FBC_PIXELS; i++) {
+        for (k = 0; k < 3; k++) {
+            c = (px[i] >> (k * 8)) & 0xff;
+            lo[k] = MIN(lo[k], c);
+            hi[k] = MAX(hi[k], c);
+        }
+    }
+    for (k = 0; k < 3; k++) {
+        range |= hi[k] - lo[k];
+    }
+    if (!range) {
+        stl_le_p(slot, px[0] & 0xffffff);
+        return 0;
+    }
+
+    stl_le_p(slot, lo[0] | lo[1] << 8 | lo[2] << 16);
+    bits = 32 - clz32(range);
+    for (i = 0; i < PRISM_FBC_PIXELS; i++) {
+        for (k = 0; k < 3; k++) {
+            acc |= (uint64_t)(((px[i] >> (k * 8)) & 0xff) - lo[k]) << nacc;
+            nacc += bits;
+            while (nacc >= 8) {
+                *out++ = acc;
+                acc >>= 8;
+                nacc -= 8;
+            }
+        }
+    }
+    if (nacc) {
+        *out = acc;
+    }
+    return bits;
+}
+
+/* pixel i of a delta tile; bad metadata decodes to something, never out of the slot */
+static inline uint32_t prism_fbc_pixel(const uint8_t *slot, uint8_t bits, int i)
+{
+    uint32_t base = ldl_le_p(slot), out = 0xff000000, mask, pos, v;
+    int k;
+
+    bits = MIN(bits, 8);
+    mask = (1u << bits) - 1;
+    pos = i * 3 * bits;
+    for (k = 0; k < 3; k++, pos += bits) {
+        v = (lduw_le_p(slot + 4 + pos / 8) >> (pos % 8)) & mask;
+        out |= (((base >> (k * 8)) + v) & 0xff) << (k * 8);
+    }
+    return out;
+}
+
+/*
+ * prism fbc check
+ *
+ * both planes of a width x height surface lie inside VRAM
+ */
+bool prism_fbc_check(uint64_t vram_size, uint64_t data, uint64_t meta,
+                     uint32_t width, uint32_t height)
+{
+    uint64_t tiles = (uint64_t)prism_fbc_tiles(width) * prism_fbc_tiles(height);
+
+    return width && height && width <= PRISM_FBC_MAX_SIZE &&
+           height <= PRISM_FBC_MAX_SIZE &&
+           prism_fbc_range_ok(vram_size, data, tiles * PRISM_FBC_SLOT) &&
+           prism_fbc_range_ok(vram_size, meta, tiles);
+}
+
+/*
+ * prism fbc decode span
+ *
+ * dst[xs, xe) = pixels [xs, xe) of row y, a constant tile is a fill
+ */
+void prism_fbc_decode_span(uint32_t *dst, const uint8_t *data, const uint8_t *meta,
+                           uint32_t width, int y, int xs, int xe)
+{
+    uint32_t row = (y / PRISM_FBC_TILE) * prism_fbc_tiles(width);
+    int ry = (y % PRISM_FBC_TILE) * PRISM_FBC_TILE;
+    const uint8_t *slot;
+    uint32_t tile, p;
+    int x, xn;
+
+    for (x = xs; x < xe; x = xn) {
+        tile = row + x / PRISM_FBC_TILE;
+        xn = MIN(xe, (x / PRISM_FBC_TILE + 1) * PRISM_FBC_TILE);
+        slot = data + (uint64_t)tile * PRISM_FBC_SLOT;
+        if (!meta[tile]) {
+            p = 0xff000000 | (ldl_le_p(slot) & 0xffffff);
+            for (; x < xn; x++) {
+                dst[x] = p;
+            }
+            continue;
+        }
+        for (; x < xn; x++) {
+            dst[x] = prism_fbc_pixel(slot, meta[tile], ry + x % PRISM_FBC_TILE);
+        }
+    }
+}
+
+/*
+ * encode
+ *
+ * compress the linear surface tile by tile, edge tiles repeat the last
+ * column / row. A tile whose encoding is already in VRAM is not written,
+ * the rest is reported dirty one tile row at a time
+ */
+static int prism_fbc_encode(PrismFbc *f)
+{
+    uint32_t *reg = f->reg;
+    uint64_t linear = reg[PRISM_FBC_REG_LINEAR], data = reg[PRISM_FBC_REG_DATA];
+    uint64_t meta = reg[PRISM_FBC_REG_META];
+    uint32_t stride = reg[PRISM_FBC_REG_LINEAR_STRIDE];
+    uint32_t width = reg[PRISM_FBC_REG_WIDTH], height = reg[PRISM_FBC_REG_HEIGHT];
+    uint32_t tiles_x = prism_fbc_tiles(width), tiles_y = prism_fbc_tiles(height);
+    uint32_t px[PRISM_FBC_PIXELS], tx, ty, i, j, idx, used, written = 0;
+    uint8_t tmp[PRISM_FBC_SLOT], bits, *slot;
+    uint64_t lo, hi;
+
+    if (stride < (uint64_t)width * 4 ||
+        !prism_fbc_range_ok(f->vram_size, linear,
+                            (uint64_t)stride * (height - 1) + width * 4)) {
+        return -1;
+    }
+
+    for (ty = 0; ty < tiles_y; ty++) {
+        lo = UINT64_MAX;
+        hi = 0;
+        for (tx = 0; tx < tiles_x; tx++) {
+            for (j = 0; j < PRISM_FBC_TILE; j++) {
+                uint64_t row = linear + (uint64_t)stride *
+                               MIN(ty * PRISM_FBC_TILE + j, height - 1);
+
+                for (i = 0; i < PRISM_FBC_TILE; i++) {
+                    px[j * PRISM_FBC_TILE + i] = ldl_le_p(f->vram + row +
+                        MIN(tx * PRISM_FBC_TILE + i, width - 1) * 4);
+                }
+            }
+            bits = prism_fbc_encode_tile(px, tmp);
+            used = prism_fbc_used(bits);
+            f->raw_bytes += MIN(PRISM_FBC_TILE, width - tx * PRISM_FBC_TILE) *
+                            MIN(PRISM_FBC_TILE, height - ty * PRISM_FBC_TILE) * 4;
+            f->packed_bytes += used + 1;
+
+            idx = ty * tiles_x + tx;
+            slot = f->vram + data + (uint64_t)idx * PRISM_FBC_SLOT;
+            if (f->vram[meta + idx] == bits && memcmp(slot, tmp, used) == 0) {
+                continue;
+            }
+            memcpy(slot, tmp, used);
+            f->vram[meta + idx] = bits;
+            lo = MIN(lo, tx);
+            hi = MAX(hi, tx + 1);
+            written++;
+        }
+        if (f->dirty && lo < hi) {
+            idx = ty * tiles_x;
+            f->dirty(f->opaque, data + (idx + lo) * PRISM_FBC_SLOT,
+                     (hi - lo) * PRISM_FBC_SLOT);
+            f->dirty(f->opaque, meta + idx + lo, hi - lo);
+        }
+    }
+    reg[PRISM_FBC_REG_TILES_WRITTEN] = written;
+    return 0;
+}
+
+/*
+ * decode
+ *
+ * expand the FBC surface into the linear one (the blit direction)
+ */
+static int prism_fbc_decode(PrismFbc *f)
+{
+    uint32_t *reg = f->reg;
+    uint64_t linear = reg[PRISM_FBC_REG_LINEAR];
+    uint32_t stride = reg[PRISM_FBC_REG_LINEAR_STRIDE];
+    uint32_t width = reg[PRISM_FBC_REG_WIDTH], height = reg[PRISM_FBC_REG_HEIGHT];
+    uint64_t size = (uint64_t)stride * (height - 1) + width * 4;
+    uint32_t y;
+
+    if (linear % 4 || stride % 4 || stride < (uint64_t)width * 4 ||
+        !prism_fbc_range_ok(f->vram_size, linear, size)) {
+        return -1;
+    }
+
+    for (y = 0; y < height; y++) {
+        prism_fbc_decode_span((uint32_t *)(f->vram + linear + (uint64_t)stride * y),
+                              f->vram + reg[PRISM_FBC_REG_DATA],
+                              f->vram + reg[PRISM_FBC_REG_META], width, y, 0, width);
+    }
+    if (f->dirty) {
+        f->dirty(f->opaque, linear, size);
+    }
+    return 0;
+}
+
+void prism_fbc_init(PrismFbc *f, uint8_t *vram, uint64_t vram_size,
+                    PrismFbcDirtyFn *dirty, void *opaque)
+{
+    memset(f, 0, sizeof(*f));
+    f->vram = vram;
+    f->vram_size = vram_size;
+    f->dirty = dirty;
+    f->opaque = opaque;
+}
+
+/*
+ * prism fbc run
+ *
+ * run cmd to completion, return 0 or -1 (STATUS_ERROR set) on bad state
+ */
+int prism_fbc_run(PrismFbc *f, uint32_t cmd)
+{
+    uint32_t *reg = f->reg;
+    int ret = -1;
+
+    reg[PRISM_FBC_REG_STATUS] = 0;
+    if (prism_fbc_check(f->vram_size, reg[PRISM_FBC_REG_DATA],
+                        reg[PRISM_FBC_REG_META], reg[PRISM_FBC_REG_WIDTH],
+                        reg[PRISM_FBC_REG_HEIGHT])) {
+        switch (cmd) {
+        case PRISM_FBC_CMD_ENCODE:
+            ret = prism_fbc_encode(f);
+            break;
+        case PRISM_FBC_CMD_DECODE:
+            ret = prism_fbc_decode(f);
+            break;
+        }
+    }
+    if (ret < 0) {
+        qemu_log_mask(LOG_GUEST_ERROR, "prism-sim: invalid fbc state\n");
+        reg[PRISM_FBC_REG_STATUS] = PRISM_FBC_STATUS_ERROR;
+    }
+    return ret;
+}
@@ -0,0 +1,87 @@
+#ifndef PRISM_FBC_H
+#define PRISM_FBC_H
+
+/*
+ * lossless framebuffer compression
+ *
+ * An FBC surface is XRGB8888 cut into 8x8 tiles kept in two planes. The
+ * data plane gives every tile a fixed PRISM_FBC_SLOT byte slot, tile rows
+ * one after another, so any pixel is found without walking the surface;
+ * the metadata plane has one byte per tile, the delta width in bits:
+ *   0      constant tile, the slot holds the one pixel (4 bytes)
+ *   1 - 8  the per channel minimum (4 bytes), then for each of the 64
+ *          pixels a blue, green and red delta of that many bits, packed
+ *          LSB first
+ * Only the metadata byte and the used part of a slot are read or written,
+ * so flat and gradient content costs a fraction of the linear surface.
+ * The X byte is not kept, decoded pixels are opaque.
+ *
+ * The copy engine encodes a linear XRGB8888 surface into FBC (tiles whose
+ * encoding did not change are not written) and decodes FBC back to linear;
+ * scanout decodes FBC primaries itself. The statistics count the linear
+ * bytes encoded and the compressed bytes they took.
+ */
+
+#define PRISM_FBC_TILE          8
+#define PRISM_FBC_SLOT          256
+#define PRISM_FBC_MAX_SIZE      16384   /* surface width / height */
+#define PRISM_FBC_FORMAT        0x203e0888  /* scanout format, a pixman type nobody uses */
+
+/* registers, all offsets are in VRAM */
+#define PRISM_FBC_REG_LINEAR        0   /* linear XRGB8888 surface */
+#define PRISM_FBC_REG_LINEAR_STRIDE 1
+#define PRISM_FBC_REG_DATA          2   /* FBC data plane */
+#define PRISM_FBC_REG_META          3   /* FBC metadata plane */
+#define PRISM_FBC_REG_WIDTH         4
+#define PRISM_FBC_REG_HEIGHT        5
+#define PRISM_FBC_REG_CMD           6   /* write: PRISM_FBC_CMD_* */
+#define PRISM_FBC_REG_STATUS        7   /* read only */
+#define PRISM_FBC_REG_RAW_KB        8   /* read only, linear KiB encoded */
+#define PRISM_FBC_REG_PACKED_KB     9   /* read only, compressed KiB produced */
+#define PRISM_FBC_REG_RATIO         10  /* read only, raw / packed * 100 */
+#define PRISM_FBC_REG_TILES_WRITTEN 11  /* read only, tiles the last encode changed */
+#define PRISM_FBC_REG_CTRL          12
+#define PRISM_FBC_REG_NUMBER        13
+
+#define PRISM_FBC_CMD_ENCODE        1
+#define PRISM_FBC_CMD_DECODE        2
+
+#define PRISM_FBC_STATUS_ERROR      (1 << 0)
+
+#define PRISM_FBC_CTRL_CLEAR_STATS  (1 << 0)
+
+/* VRAM written by the engine */
+typedef void PrismFbcDirtyFn(void *opaque, uint64_t addr, uint64_t size);
+
+struct PrismFbc {
+    uint8_t *vram;
+    uint64_t vram_size;
+    uint32_t reg[PRISM_FBC_REG_NUMBER];
+    uint64_t raw_bytes;
+    uint64_t packed_bytes;
+    PrismFbcDirtyFn *dirty;
+    void *opaque;
+};
+
+typedef struct PrismFbc PrismFbc;
+
+static inline uint32_t prism_fbc_tiles(uint32_t pixels)
+{
+    return (pixels + PRISM_FBC_TILE - 1) / PRISM_FBC_TILE;
+}
+
+/* bytes of the data plane of a tile row */
+static inline uint64_t prism_fbc_band(uint32_t width)
+{
+    return (uint64_t)prism_fbc_tiles(width) * PRISM_FBC_SLOT;
+}
+
+void prism_fbc_init(PrismFbc *f, uint8_t *vram, uint64_t vram_size,
+                    PrismFbcDirtyFn *dirty, void *opaque);
+int prism_fbc_run(PrismFbc *f, uint32_t cmd);
+bool prism_fbc_check(uint64_t vram_size, uint64_t data, uint64_t meta,
+                     uint32_t width, uint32_t height);
+void prism_fbc_decode_span(uint32_t *dst, const uint8_t *data, const uint8_t *meta,
+                           uint32_t width, int y, int xs, int xe);
+
+#endif /* PRISM_FBC_H */
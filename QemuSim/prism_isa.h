@@ -0,0 +1,71 @@
+#ifndef PRISM_ISA_H
+#define PRISM_ISA_H
+
+/*
+ * PISA (Prism ISA) definitions shared by the shader engine.
+ *
+ * Must stay in sync with Compiler/pisa_defs.h.
+ * Type-R: [OP:8] [DEST:8] [SRC_A:8] [SRC_B:8]
+ * MAD takes a second word carrying the third source: [0:24] [SRC_C:8]
+ * V_SAMPLE takes a second word selecting the texture: [0:14] [COMP:2] [SLOT:8]
+ * An instruction with a PRISM_ISA_LITERAL source is followed by one
+ * more word holding the literal value (at most one literal per instruction).
+ */
+
+#define PRISM_ISA_OP(w)     (((w) >> 24) & 0xff)
+#define PRISM_ISA_DST(w)    (((w) >> 16) & 0xff)
+#define PRISM_ISA_SRC_A(w)  (((w) >> 8) & 0xff)
+#define PRISM_ISA_SRC_B(w)  ((w) & 0xff)
+#define PRISM_ISA_SRC_C(w)  ((w) & 0xff)
+#define PRISM_ISA_TEX_SLOT(w) ((w) & 0xff)
+#define PRISM_ISA_TEX_COMP(w) (((w) >> 8) & 3)
+
+/* opcodes */
+#define PRISM_OP_S_MOV      0x40
+#define PRISM_OP_S_LOAD     0x42
+#define PRISM_OP_S_LOAD_X4  0x43
+#define PRISM_OP_S_LOAD_X8  0x44
+#define PRISM_OP_S_ADD      0x52    /* scalar ALU: vector opcode - 0x30 */
+#define PRISM_OP_S_SUB      0x53
+#define PRISM_OP_S_MUL      0x5A
+#define PRISM_OP_S_MAD      0x5B    /* 2 words: sD = sA * sB + sC */
+#define PRISM_OP_S_CMP_LT   0x60    /* writes SCC */
+#define PRISM_OP_S_CMP_GE   0x61
+#define PRISM_OP_S_CMP_EQ   0x62
+#define PRISM_OP_S_CMP_NE   0x63
+#define PRISM_OP_S_CSELECT  0x64    /* sD = SCC ? sA : sB */
+#define PRISM_OP_S_SIN      0x70    /* special function unit, one source */
+#define PRISM_OP_S_COS      0x71
+#define PRISM_OP_S_RCP      0x72    /* sD = 1 / sA */
+#define PRISM_OP_V_ADD      0x82
+#define PRISM_OP_V_SUB      0x83
+#define PRISM_OP_V_MUL      0x8A
+#define PRISM_OP_V_MAD      0x8B    /* 2 words: vD = A * B + C */
+#define PRISM_OP_V_CMP_LT   0x90    /* writes the per-lane VCC mask */
+#define PRISM_OP_V_CMP_GE   0x91
+#define PRISM_OP_V_CMP_EQ   0x92
+#define PRISM_OP_V_CMP_NE   0x93
+#define PRISM_OP_V_CNDMASK  0x94    /* vD = VCC[lane] ? A : B */
+#define PRISM_OP_V_SIN      0xA0
+#define PRISM_OP_V_COS      0xA1
+#define PRISM_OP_V_RCP      0xA2
+#define PRISM_OP_V_SAMPLE   0xB0    /* 2 words: vD = bilinear(tex, A, B).comp */
+#define PRISM_OP_V_MOV      0xC0
+
+/*
+ * register operands (8 bit)
+ * 0  - 7   : vector registers v0-v7
+ * 10 - 127 : scalar registers, broadcast to all lanes when read by
+ *            a vector instruction; s64 and above hold the constant block
+ * 128 - 136: inline float constants (source operands only)
+ * 255      : literal, value in the word following the instruction
+ */
+#define PRISM_ISA_NUM_VGPRS     8
+#define PRISM_ISA_SGPR_BASE     10
+#define PRISM_ISA_SGPR_UNIFORM  64
+#define PRISM_ISA_NUM_SGPRS     128
+#define PRISM_ISA_INLINE_CONST  128
+#define PRISM_ISA_NUM_INLINE    9
+#define PRISM_ISA_LITERAL       255
+
+#endif /* PRISM_ISA_H */
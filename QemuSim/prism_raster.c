@@ -0,0 +1,550 @@
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include "qemu/log.h"
+#include "prism_raster.h"
+
+
+static inline float prism_raster_f32(uint32_t v)
+{
+    float f;
+    memcpy(&f, &v, sizeof(f));
+    return f;
+}
+
+static inline uint32_t prism_raster_u32(float f)
+{
+    uint32_t v;
+    memcpy(&v, &f, sizeof(v));
+    return v;
+}
+
+/*
+ * vram range check
+ *
+ * true when [base, base + size) lies inside VRAM
+ */
+static bool prism_raster_range_ok(PrismRaster *r, uint64_t base, uint64_t size)
+{
+    return base <= r->vram_size && size <= r->vram_size - base;
+}
+
+/* fragments of one triangle collected for a fragment shader wave */
+struct PrismRasterWave {
+    int n;
+    uint16_t x[PRISM_SHADER_LANES];
+    uint16_t y[PRISM_SHADER_LANES];
+    float l0[PRISM_SHADER_LANES];   //barycentric weights of vertex 0 / 1
+    float l1[PRISM_SHADER_LANES];
+};
+
+typedef struct PrismRasterWave PrismRasterWave;
+
+static inline uint32_t prism_raster_unorm8(float c)
+{
+    c = c > 0.0f ? (c < 1.0f ? c : 1.0f) : 0.0f;    /* NaN reads as 0 */
+    return (uint32_t)(c * 255.0f + 0.5f);
+}
+
+/*
+ * shade wave
+ *
+ * interpolate the varyings into v0.., run the fragment shader and
+ * write the covered pixels of the render target
+ */
+static void prism_raster_shade_wave(PrismRasterWorker *w,
+                                    const PrismRasterTri *t,
+                                    const PrismRasterWave *wave)
+{
+    PrismRaster *r = w->raster;
+    PrismShaderCore *core = &w->core;
+    unsigned k;
+    int lane;
+
+    prism_shader_reset(core, r->fs_cb, r->fs_cb_size, &w->tex);
+    for (k = 0; k < r->nvary; k++) {
+        for (lane = 0; lane < wave->n; lane++) {
+            float l0 = wave->l0[lane], l1 = wave->l1[lane];
+            float l2 = 1.0f - l0 - l1;
+
+            core->vgpr[k][lane] = prism_raster_u32(l0 * t->vary[0][k] +
+                                                   l1 * t->vary[1][k] +
+                                                   l2 * t->vary[2][k]);
+        }
+    }
+    if (prism_shader_exec(core, r->fs_code, r->fs_size) < 0) {
+        w->fault = true;
+        return;
+    }
+
+    for (lane = 0; lane < wave->n; lane++) {
+        uint32_t red = prism_raster_unorm8(prism_raster_f32(
+                           prism_shader_reg(core, r->fs_out[0], lane)));
+        uint32_t green = prism_raster_unorm8(prism_raster_f32(
+                             prism_shader_reg(core, r->fs_out[1], lane)));
+        uint32_t blue = prism_raster_unorm8(prism_raster_f32(
+                            prism_shader_reg(core, r->fs_out[2], lane)));
+
+        stl_le_p(r->rt + (uint64_t)wave->y[lane] * r->rt_stride +
+                 wave->x[lane] * 4,
+                 0xff000000 | red << 16 | green << 8 | blue);
+    }
+    w->fragments += wave->n;
+}
+
+/*
+ * shade tile
+ *
+ * walk the tile's triangles in submission order, gather covered pixel
+ * centers into waves of PRISM_SHADER_LANES fragments
+ */
+static void prism_raster_shade_tile(PrismRasterWorker *w, uint32_t tile)
+{
+    PrismRaster *r = w->raster;
+    PrismRasterBin *bin = &r->bins[tile];
+    int tx0 = (tile % r->tiles_x) * PRISM_RASTER_TILE;
+    int ty0 = (tile / r->tiles_x) * PRISM_RASTER_TILE;
+    int tx1 = MIN(tx0 + PRISM_RASTER_TILE, (int)r->rt_width) - 1;
+    int ty1 = MIN(ty0 + PRISM_RASTER_TILE, (int)r->rt_height) - 1;
+    PrismRasterWave wave;
+    uint32_t i;
+    int x, y, k;
+
+    for (i = 0; i < bin->count && !w->fault; i++) {
+        const PrismRasterTri *t = &r->tris[bin->tri[i]];
+        int x0 = MAX(tx0, t->minx), x1 = MIN(tx1, t->maxx);
+        int y0 = MAX(ty0, t->miny), y1 = MIN(ty1, t->maxy);
+
+        wave.n = 0;
+        for (y = y0; y <= y1; y++) {
+            for (x = x0; x <= x1; x++) {
+                float px = x + 0.5f, py = y + 0.5f, e[3];
+                bool covered = true;
+
+                for (k = 0; k < 3; k++) {
+                    e[k] = t->a[k] * px + t->b[k] * py + t->c[k];
+                    if (e[k] < 0.0f || (e[k] == 0.0f && !t->top_left[k])) {
+                        covered = false;
+                    }
+                }
+                if (!covered) {
+                    continue;
+                }
+                wave.x[wave.n] = x;
+                wave.y[wave.n] = y;
+                wave.l0[wave.n] = e[0] * t->inv_area;
+                wave.l1[wave.n] = e[1] * t->inv_area;
+                if (++wave.n == PRISM_SHADER_LANES) {
+                    prism_raster_shade_wave(w, t, &wave);
+                    wave.n = 0;
+                }
+            }
+        }
+        if (wave.n) {
+            prism_raster_shade_wave(w, t, &wave);
+        }
+    }
+}
+
+/*
+ * shade tiles
+ *
+ * claim tiles until none are left, shared by every thread of the pool
+ */
+static void prism_raster_shade_tiles(PrismRasterWorker *w)
+{
+    PrismRaster *r = w->raster;
+    uint32_t ntiles = r->tiles_x * r->tiles_y;
+    uint32_t tile;
+
+    while ((tile = qatomic_fetch_inc(&r->next_tile)) < ntiles) {
+        prism_raster_shade_tile(w, tile);
+    }
+}
+
+/*
+ * raster thread
+ *
+ * pool thread: wait for a new draw generation, shade tiles, report back
+ */
+static void *prism_raster_thread(void *opaque)
+{
+    PrismRasterWorker *w = opaque;
+    PrismRaster *r = w->raster;
+    uint32_t seen = 0;
+
+    qemu_mutex_lock(&r->lock);
+    for (;;) {
+        while (!r->quit && r->generation == seen) {
+            qemu_cond_wait(&r->work_cond, &r->lock);
+        }
+        if (r->quit) {
+            break;
+        }
+        seen = r->generation;
+        qemu_mutex_unlock(&r->lock);
+
+        prism_raster_shade_tiles(w);
+
+        qemu_mutex_lock(&r->lock);
+        if (--r->pending == 0) {
+            qemu_cond_signal(&r->done_cond);
+        }
+    }
+    qemu_mutex_unlock(&r->lock);
+    return NULL;
+}
+
+/*
+ * prism raster init
+ *
+ * start nthreads - 1 pool threads, the thread kicking a draw is worker 0
+ */
+void prism_raster_init(PrismRaster *r, uint8_t *vram, uint64_t vram_size,
+                       PrismTextureUnit *tex, unsigned nthreads)
+{
+    unsigned i;
+
+    memset(r, 0, sizeof(*r));
+    r->vram = vram;
+    r->vram_size = vram_size;
+    r->tex = tex;
+    r->nthreads = MAX(nthreads, 1);
+    r->workers = g_new0(PrismRasterWorker, r->nthreads);
+    qemu_mutex_init(&r->lock);
+    qemu_cond_init(&r->work_cond);
+    qemu_cond_init(&r->done_cond);
+
+    for (i = 0; i < r->nthreads; i++) {
+        PrismRasterWorker *w = &r->workers[i];
+
+        w->raster = r;
+        prism_tex_init(&w->tex, vram, vram_size);
+        if (i > 0) {
+            qemu_thread_create(&w->thread, "prism-raster",
+                               prism_raster_thread, w, QEMU_THREAD_JOINABLE);
+        }
+    }
+}
+
+/*
+ * prism raster exit
+ *
+ * stop and join the pool
+ */
+void prism_raster_exit(PrismRaster *r)
+{
+    unsigned i;
+
+    if (!r->workers) {
+        return;
+    }
+    qemu_mutex_lock(&r->lock);
+    r->quit = true;
+    qemu_cond_broadcast(&r->work_cond);
+    qemu_mutex_unlock(&r->lock);
+
+    for (i = 1; i < r->nthreads; i++) {
+        qemu_thread_join(&r->workers[i].thread);
+    }
+    qemu_cond_destroy(&r->done_cond);
+    qemu_cond_destroy(&r->work_cond);
+    qemu_mutex_destroy(&r->lock);
+    g_free(r->workers);
+    r->workers = NULL;
+}
+
+/*
+ * shade vertices
+ *
+ * run the vertex shader PRISM_SHADER_LANES vertices at a time and keep
+ * the NDC position and varyings of every vertex
+ */
+static int prism_raster_shade_vertices(PrismRaster *r, PrismShaderCore *core,
+                                       PrismTextureUnit *tex,
+                                       float *pos, float *vary)
+{
+    uint32_t *reg = r->reg;
+    uint32_t count = reg[PRISM_RASTER_REG_VB_COUNT];
+    uint32_t attrs = reg[PRISM_RASTER_REG_VB_ATTRS];
+    uint32_t stride = reg[PRISM_RASTER_REG_VB_STRIDE];
+    const uint8_t *vb = r->vram + reg[PRISM_RASTER_REG_VB_BASE];
+    const uint32_t *code = (const uint32_t *)(r->vram +
+                                              reg[PRISM_RASTER_REG_VS_BASE]);
+    const uint8_t *cb = reg[PRISM_RASTER_REG_VS_CB_SIZE] ?
+                        r->vram + reg[PRISM_RASTER_REG_VS_CB_BASE] : NULL;
+    uint8_t xr = reg[PRISM_RASTER_REG_VS_OUT_POS] & 0xff;
+    uint8_t yr = (reg[PRISM_RASTER_REG_VS_OUT_POS] >> 8) & 0xff;
+    uint32_t first, v, a, k;
+    int lane;
+
+    for (first = 0; first < count; first += PRISM_SHADER_LANES) {
+        int n = MIN(count - first, PRISM_SHADER_LANES);
+
+        prism_shader_reset(core, cb, reg[PRISM_RASTER_REG_VS_CB_SIZE], tex);
+        for (lane = 0; lane < n; lane++) {
+            for (a = 0; a < attrs; a++) {
+                core->vgpr[a][lane] = ldl_le_p(vb + (uint64_t)(first + lane) *
+                                               stride + a * 4);
+            }
+        }
+        if (prism_shader_exec(core, code, reg[PRISM_RASTER_REG_VS_SIZE]) < 0) {
+            return -1;
+        }
+        for (lane = 0; lane < n; lane++) {
+            v = first + lane;
+            pos[v * 2] = prism_raster_f32(prism_shader_reg(core, xr, lane));
+            pos[v * 2 + 1] = prism_raster_f32(prism_shader_reg(core, yr, lane));
+            for (k = 0; k < r->nvary; k++) {
+                uint8_t vr = reg[PRISM_RASTER_REG_VS_OUT_VARY] >> (k * 8);
+
+                vary[v * PRISM_RASTER_MAX_VARYINGS + k] =
+                    prism_raster_f32(prism_shader_reg(core, vr, lane));
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * triangle setup
+ *
+ * NDC to pixels, edge equations oriented so the inside is positive,
+ * bounding box; false for degenerate or off-screen triangles
+ */
+static bool prism_raster_setup(PrismRaster *r, PrismRasterTri *t,
+                               const float *pos, const float *vary,
+                               uint32_t first)
+{
+    float x[3], y[3], area, x0, y0, x1, y1;
+    int k, i, j;
+
+    for (k = 0; k < 3; k++) {
+        x[k] = (pos[(first + k) * 2] * 0.5f + 0.5f) * r->rt_width;
+        y[k] = (0.5f - pos[(first + k) * 2 + 1] * 0.5f) * r->rt_height;
+        if (!isfinite(x[k]) || !isfinite(y[k])) {
+            return false;
+        }
+        memcpy(t->vary[k], &vary[(first + k) * PRISM_RASTER_MAX_VARYINGS],
+               sizeof(t->vary[k]));
+    }
+
+    for (k = 0; k < 3; k++) {
+        i = (k + 1) % 3;
+        j = (k + 2) % 3;
+        t->a[k] = y[i] - y[j];
+        t->b[k] = x[j] - x[i];
+        t->c[k] = x[i] * y[j] - x[j] * y[i];
+    }
+    area = t->a[0] * x[0] + t->b[0] * y[0] + t->c[0];
+    if (area == 0.0f) {
+        return false;
+    }
+    /* accept both windings */
+    if (area < 0.0f) {
+        for (k = 0; k < 3; k++) {
+            t->a[k] = -t->a[k];
+            t->b[k] = -t->b[k];
+            t->c[k] = -t->c[k];
+        }
+        area = -area;
+    }
+    t->inv_area = 1.0f / area;
+    for (k = 0; k < 3; k++) {
+        /* left edge: inside grows to the right; top edge: inside below */
+        t->top_left[k] = t->a[k] > 0.0f || (t->a[k] == 0.0f && t->b[k] > 0.0f);
+    }
+
+    /* clip in float, the box may be far outside the int range */
+    x0 = MAX(0.0f, floorf(MIN(x[0], MIN(x[1], x[2]))));
+    y0 = MAX(0.0f, floorf(MIN(y[0], MIN(y[1], y[2]))));
+    x1 = MIN((float)r->rt_width - 1, ceilf(MAX(x[0], MAX(x[1], x[2]))));
+    y1 = MIN((float)r->rt_height - 1, ceilf(MAX(y[0], MAX(y[1], y[2]))));
+    if (x0 > x1 || y0 > y1) {
+        return false;
+    }
+    t->minx = x0;
+    t->miny = y0;
+    t->maxx = x1;
+    t->maxy = y1;
+    return true;
+}
+
+static void prism_raster_bin_push(PrismRasterBin *bin, uint32_t tri)
+{
+    if (bin->count == bin->cap) {
+        bin->cap = bin->cap ? bin->cap * 2 : 16;
+        bin->tri = g_renew(uint32_t, bin->tri, bin->cap);
+    }
+    bin->tri[bin->count++] = tri;
+}
+
+/*
+ * draw state check
+ *
+ * everything the draw will touch must lie inside VRAM
+ */
+static bool prism_raster_check(PrismRaster *r)
+{
+    uint32_t *reg = r->reg;
+    uint32_t count = reg[PRISM_RASTER_REG_VB_COUNT];
+    uint32_t attrs = reg[PRISM_RASTER_REG_VB_ATTRS];
+    uint32_t width = reg[PRISM_RASTER_REG_RT_WIDTH];
+    uint32_t height = reg[PRISM_RASTER_REG_RT_HEIGHT];
+    uint32_t stride = reg[PRISM_RASTER_REG_RT_STRIDE];
+    int k;
+
+    if (!width || !height || width > PRISM_RASTER_MAX_SIZE ||
+        height > PRISM_RASTER_MAX_SIZE || stride < width * 4 ||
+        !prism_raster_range_ok(r, reg[PRISM_RASTER_REG_RT_BASE],
+                               (uint64_t)stride * (height - 1) + width * 4)) {
+        return false;
+    }
+    if (count > PRISM_RASTER_MAX_VERTICES || attrs > PRISM_RASTER_MAX_ATTRS ||
+        (count && !prism_raster_range_ok(r, reg[PRISM_RASTER_REG_VB_BASE],
+                        (uint64_t)reg[PRISM_RASTER_REG_VB_STRIDE] * (count - 1) +
+                        attrs * 4))) {
+        return false;
+    }
+    for (k = 0; k < 2; k++) {
+        uint32_t base = reg[k ? PRISM_RASTER_REG_FS_BASE : PRISM_RASTER_REG_VS_BASE];
+        uint32_t size = reg[k ? PRISM_RASTER_REG_FS_SIZE : PRISM_RASTER_REG_VS_SIZE];
+        uint32_t cb = reg[k ? PRISM_RASTER_REG_FS_CB_BASE : PRISM_RASTER_REG_VS_CB_BASE];
+        uint32_t cb_size = reg[k ? PRISM_RASTER_REG_FS_CB_SIZE :
+                                   PRISM_RASTER_REG_VS_CB_SIZE];
+
+        if (base % 4 || !size || !prism_raster_range_ok(r, base, (uint64_t)size * 4) ||
+            !prism_raster_range_ok(r, cb, cb_size)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * prism raster draw
+ *
+ * run the draw described by the registers to completion, return 0,
+ * -EINVAL on bad state (rejected before anything is written) or -EFAULT
+ * on a shader fault (the render target may be partly written);
+ * STATUS_ERROR is set on both errors
+ */
+int prism_raster_draw(PrismRaster *r)
+{
+    uint32_t *reg = r->reg;
+    uint32_t count, ntiles, i, tx, ty;
+    uint64_t fragments = 0;
+    float *pos, *vary;
+    bool fault = false;
+
+    reg[PRISM_RASTER_REG_TRIANGLES] = 0;
+    reg[PRISM_RASTER_REG_FRAGMENTS] = 0;
+    r->ntris = 0;
+    if (!prism_raster_check(r)) {
+        qemu_log_mask(LOG_GUEST_ERROR, "prism-sim: invalid draw state\n");
+        reg[PRISM_RASTER_REG_STATUS] = PRISM_RASTER_STATUS_ERROR;
+        return -EINVAL;
+    }
+
+    count = reg[PRISM_RASTER_REG_VB_COUNT] / 3 * 3;
+    for (r->nvary = 0; r->nvary < PRISM_RASTER_MAX_VARYINGS; r->nvary++) {
+        if (((reg[PRISM_RASTER_REG_VS_OUT_VARY] >> (r->nvary * 8)) & 0xff) == 0xff) {
+            break;
+        }
+    }
+    r->fs_code = (const uint32_t *)(r->vram + reg[PRISM_RASTER_REG_FS_BASE]);
+    r->fs_size = reg[PRISM_RASTER_REG_FS_SIZE];
+    r->fs_cb_size = reg[PRISM_RASTER_REG_FS_CB_SIZE];
+    r->fs_cb = r->fs_cb_size ? r->vram + reg[PRISM_RASTER_REG_FS_CB_BASE] : NULL;
+    for (i = 0; i < 3; i++) {
+        r->fs_out[i] = reg[PRISM_RASTER_REG_FS_OUT] >> (i * 8);
+    }
+    r->rt = r->vram + reg[PRISM_RASTER_REG_RT_BASE];
+    r->rt_width = reg[PRISM_RASTER_REG_RT_WIDTH];
+    r->rt_height = reg[PRISM_RASTER_REG_RT_HEIGHT];
+    r->rt_stride = reg[PRISM_RASTER_REG_RT_STRIDE];
+
+    /* every unit starts the draw with the current descriptors and a cold cache */
+    for (i = 0; i < r->nthreads; i++) {
+        PrismRasterWorker *w = &r->workers[i];
+
+        memcpy(w->tex.desc, r->tex->desc, sizeof(w->tex.desc));
+        prism_tex_invalidate(&w->tex);
+        w->tex.hits = 0;
+        w->tex.misses = 0;
+        w->fragments = 0;
+        w->fault = false;
+    }
+
+    pos = g_new(float, count * 2 + 1);
+    vary = g_new0(float, count * PRISM_RASTER_MAX_VARYINGS + 1);
+    if (prism_raster_shade_vertices(r, &r->workers[0].core, &r->workers[0].tex,
+                                    pos, vary) < 0) {
+        fault = true;
+        goto out;
+    }
+
+    r->tiles_x = DIV_ROUND_UP(r->rt_width, PRISM_RASTER_TILE);
+    r->tiles_y = DIV_ROUND_UP(r->rt_height, PRISM_RASTER_TILE);
+    ntiles = r->tiles_x * r->tiles_y;
+    r->bins = g_new0(PrismRasterBin, ntiles);
+    r->tris = g_new(PrismRasterTri, count / 3 + 1);
+    for (i = 0; i < count; i += 3) {
+        PrismRasterTri *t = &r->tris[r->ntris];
+
+        if (!prism_raster_setup(r, t, pos, vary, i)) {
+            continue;
+        }
+        for (ty = t->miny / PRISM_RASTER_TILE; ty <= t->maxy / PRISM_RASTER_TILE; ty++) {
+            for (tx = t->minx / PRISM_RASTER_TILE; tx <= t->maxx / PRISM_RASTER_TILE; tx++) {
+                prism_raster_bin_push(&r->bins[ty * r->tiles_x + tx], r->ntris);
+            }
+        }
+        r->ntris++;
+    }
+
+    qatomic_set(&r->next_tile, 0);
+    if (r->nthreads > 1) {
+        qemu_mutex_lock(&r->lock);
+        r->pending = r->nthreads - 1;
+        r->generation++;
+        qemu_cond_broadcast(&r->work_cond);
+        qemu_mutex_unlock(&r->lock);
+    }
+    prism_raster_shade_tiles(&r->workers[0]);
+    if (r->nthreads > 1) {
+        qemu_mutex_lock(&r->lock);
+        while (r->pending) {
+            qemu_cond_wait(&r->done_cond, &r->lock);
+        }
+        qemu_mutex_unlock(&r->lock);
+    }
+
+    for (i = 0; i < ntiles; i++) {
+        g_free(r->bins[i].tri);
+    }
+    g_free(r->bins);
+    g_free(r->tris);
+    r->bins = NULL;
+    r->tris = NULL;
+
+out:
+    for (i = 0; i < r->nthreads; i++) {
+        PrismRasterWorker *w = &r->workers[i];
+
+        fragments += w->fragments;
+        fault |= w->fault;
+        r->tex->hits += w->tex.hits;
+        r->tex->misses += w->tex.misses;
+    }
+    g_free(pos);
+    g_free(vary);
+
+    reg[PRISM_RASTER_REG_TRIANGLES] = r->ntris;
+    reg[PRISM_RASTER_REG_FRAGMENTS] = fragments;
+    reg[PRISM_RASTER_REG_STATUS] = fault ? PRISM_RASTER_STATUS_ERROR : 0;
+    if (fault) {
+        qemu_log_mask(LOG_GUEST_ERROR, "prism-sim: shader fault during draw\n");
+        return -EFAULT;
+    }
+    return 0;
+}
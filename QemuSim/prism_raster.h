@@ -0,0 +1,130 @@
+#ifndef PRISM_RASTER_H
+#define PRISM_RASTER_H
+
+#include "qemu/thread.h"
+#include "prism_shader.h"
+
+/*
+ * tile-binned triangle rasterizer
+ *
+ * A draw is a triangle list in VRAM plus a PISA vertex and fragment shader.
+ * Vertex shading, triangle setup and binning into 32x32 screen tiles run on
+ * the thread that kicks the draw; the tiles are then shaded in parallel by
+ * a pool of host threads (the kicking thread included). A tile is owned by
+ * one thread at a time and walks its triangles in submission order, so the
+ * result does not depend on the thread count.
+ *
+ * Shader ABI:
+ *   vertex shader   in : dword k of the vertex in vk (k < VB_ATTRS)
+ *                   out: NDC x / y and up to 4 varyings, register numbers
+ *                        given by VS_OUT_POS / VS_OUT_VARY (one per byte)
+ *   fragment shader in : interpolated varying k in vk
+ *                   out: red / green / blue (0.0 - 1.0), register numbers
+ *                        given by FS_OUT (one per byte)
+ * The render target is XRGB8888. There is no depth buffer.
+ */
+
+#define PRISM_RASTER_TILE           32
+#define PRISM_RASTER_MAX_THREADS    64
+#define PRISM_RASTER_MAX_ATTRS      PRISM_ISA_NUM_VGPRS
+#define PRISM_RASTER_MAX_VARYINGS   4
+#define PRISM_RASTER_MAX_VERTICES   65536
+#define PRISM_RASTER_MAX_SIZE       8192    /* render target width / height */
+
+/* registers, all offsets are in VRAM and code sizes in dwords */
+#define PRISM_RASTER_REG_VB_BASE     0
+#define PRISM_RASTER_REG_VB_STRIDE   1      /* bytes between vertices */
+#define PRISM_RASTER_REG_VB_COUNT    2      /* vertices, 3 per triangle */
+#define PRISM_RASTER_REG_VB_ATTRS    3      /* dwords loaded per vertex */
+#define PRISM_RASTER_REG_VS_BASE     4
+#define PRISM_RASTER_REG_VS_SIZE     5
+#define PRISM_RASTER_REG_VS_CB_BASE  6
+#define PRISM_RASTER_REG_VS_CB_SIZE  7
+#define PRISM_RASTER_REG_FS_BASE     8
+#define PRISM_RASTER_REG_FS_SIZE     9
+#define PRISM_RASTER_REG_FS_CB_BASE  10
+#define PRISM_RASTER_REG_FS_CB_SIZE  11
+#define PRISM_RASTER_REG_VS_OUT_POS  12     /* byte 0: x, byte 1: y */
+#define PRISM_RASTER_REG_VS_OUT_VARY 13     /* 0xff ends the list */
+#define PRISM_RASTER_REG_FS_OUT      14     /* byte 0-2: r, g, b */
+#define PRISM_RASTER_REG_RT_BASE     15
+#define PRISM_RASTER_REG_RT_WIDTH    16
+#define PRISM_RASTER_REG_RT_HEIGHT   17
+#define PRISM_RASTER_REG_RT_STRIDE   18
+#define PRISM_RASTER_REG_DRAW        19     /* write: run the draw */
+#define PRISM_RASTER_REG_STATUS      20     /* read only */
+#define PRISM_RASTER_REG_TRIANGLES   21     /* read only: triangles binned */
+#define PRISM_RASTER_REG_FRAGMENTS   22     /* read only: fragments shaded */
+#define PRISM_RASTER_REG_NUMBER      23
+
+#define PRISM_RASTER_STATUS_ERROR    (1 << 0)   /* bad state or shader fault */
+
+typedef struct PrismRaster PrismRaster;
+
+struct PrismRasterTri {
+    float a[3], b[3], c[3];     //edge k: a*x + b*y + c >= 0 inside
+    bool top_left[3];           //pixels exactly on edge k are covered
+    float inv_area;             //1 / edge value at the opposite vertex
+    float vary[3][PRISM_RASTER_MAX_VARYINGS];
+    int minx, miny, maxx, maxy; //bounding box clipped to the target
+};
+
+typedef struct PrismRasterTri PrismRasterTri;
+
+struct PrismRasterBin {
+    uint32_t *tri;
+    uint32_t count;
+    uint32_t cap;
+};
+
+typedef struct PrismRasterBin PrismRasterBin;
+
+struct PrismRasterWorker {
+    PrismRaster *raster;
+    QemuThread thread;
+    PrismShaderCore core;
+    PrismTextureUnit tex;       //own texel cache, descriptors copied per draw
+    uint64_t fragments;
+    bool fault;
+};
+
+typedef struct PrismRasterWorker PrismRasterWorker;
+
+struct PrismRaster {
+    uint32_t reg[PRISM_RASTER_REG_NUMBER];
+
+    uint8_t *vram;
+    uint64_t vram_size;
+    PrismTextureUnit *tex;      //device texture unit: descriptors, counters
+
+    unsigned nthreads;
+    PrismRasterWorker *workers; //workers[0] is the thread kicking the draw
+    QemuMutex lock;
+    QemuCond work_cond;
+    QemuCond done_cond;
+    uint32_t generation;        //bumped for every draw handed to the pool
+    unsigned pending;           //pool threads still shading the draw
+    bool quit;
+
+    /* current draw */
+    const uint32_t *fs_code;
+    uint32_t fs_size;
+    const uint8_t *fs_cb;
+    uint32_t fs_cb_size;
+    unsigned nvary;
+    uint8_t fs_out[3];
+    uint8_t *rt;
+    uint32_t rt_width, rt_height, rt_stride;
+    PrismRasterTri *tris;
+    uint32_t ntris;
+    PrismRasterBin *bins;
+    uint32_t tiles_x, tiles_y;
+    uint32_t next_tile;         //next tile to claim, atomic
+};
+
+void prism_raster_init(PrismRaster *r, uint8_t *vram, uint64_t vram_size,
+                       PrismTextureUnit *tex, unsigned nthreads);
+void prism_raster_exit(PrismRaster *r);
+int prism_raster_draw(PrismRaster *r);
+
+#endif /* PRISM_RASTER_H */
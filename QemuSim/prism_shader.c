@@ -0,0 +1,368 @@
+#include "qemu/osdep.h"
+#include "qemu/log.h"
+#include "prism_shader.h"
+
+
+/*
+ * prism shader reset
+ *
+ * clear the register file, bind a constant block and a texture unit
+ */
+void prism_shader_reset(PrismShaderCore *core,
+                        const uint8_t *cbuf, uint32_t cbuf_size,
+                        PrismTextureUnit *tex)
+{
+    memset(core, 0, sizeof(*core));
+    core->cbuf = cbuf;
+    core->cbuf_size = cbuf_size;
+    core->tex = tex;
+}
+
+static inline float prism_f32(uint32_t v)
+{
+    float f;
+    memcpy(&f, &v, sizeof(f));
+    return f;
+}
+
+static inline uint32_t prism_u32(float f)
+{
+    uint32_t v;
+    memcpy(&v, &f, sizeof(v));
+    return v;
+}
+
+/* must stay in sync with the table in Compiler/pisa_defs.c */
+static const float prism_inline_consts[PRISM_ISA_NUM_INLINE] = {
+    0.0f, 0.5f, -0.5f, 1.0f, -1.0f, 2.0f, -2.0f, 4.0f, -4.0f
+};
+
+/*
+ * scalar source operand read
+ *
+ * scalar register, inline constant or the instruction's literal
+ */
+static inline uint32_t prism_shader_ssrc(PrismShaderCore *core, uint8_t r)
+{
+    if (r == PRISM_ISA_LITERAL) {
+        return core->literal;
+    }
+    if (r >= PRISM_ISA_INLINE_CONST) {
+        return r < PRISM_ISA_INLINE_CONST + PRISM_ISA_NUM_INLINE ?
+               prism_u32(prism_inline_consts[r - PRISM_ISA_INLINE_CONST]) : 0;
+    }
+    return core->sgpr[r % PRISM_ISA_NUM_SGPRS];
+}
+
+/*
+ * source operand read
+ *
+ * vector register or broadcast scalar operand for one lane
+ */
+static inline uint32_t prism_shader_src(PrismShaderCore *core,
+                                        uint8_t r, int lane)
+{
+    if (r < PRISM_ISA_NUM_VGPRS) {
+        return core->vgpr[r][lane];
+    }
+    return prism_shader_ssrc(core, r);
+}
+
+/*
+ * prism shader reg
+ *
+ * read a result register of one lane after the program ran
+ */
+uint32_t prism_shader_reg(PrismShaderCore *core, uint8_t r, int lane)
+{
+    return prism_shader_src(core, r, lane % PRISM_SHADER_LANES);
+}
+
+/*
+ * scalar register read/write
+ */
+static inline float prism_sgpr_f32(PrismShaderCore *core, uint8_t r)
+{
+    return prism_f32(prism_shader_ssrc(core, r));
+}
+
+static inline void prism_sgpr_set_f32(PrismShaderCore *core, uint8_t r,
+                                      float f)
+{
+    core->sgpr[r % PRISM_ISA_NUM_SGPRS] = prism_u32(f);
+}
+
+/*
+ * float compare
+ *
+ * shared by V_CMP_* and S_CMP_*, the low two opcode bits select the
+ * relation (LT, GE, EQ, NE)
+ */
+static inline bool prism_shader_cmp(uint8_t op, float a, float b)
+{
+    switch (op & 3) {
+    case 0:
+        return a < b;
+    case 1:
+        return a >= b;
+    case 2:
+        return a == b;
+    default:
+        return a != b;
+    }
+}
+
+/*
+ * scalar load
+ *
+ * load n dwords from the constant block into sD..sD+n-1,
+ * reads past the end of the block return zero
+ */
+static void prism_shader_s_load(PrismShaderCore *core, uint8_t d,
+                                uint32_t off, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++, off += 4) {
+        uint32_t v = 0;
+
+        if (core->cbuf && off + 4 <= core->cbuf_size) {
+            v = ldl_le_p(core->cbuf + off);
+        }
+        core->sgpr[(d + i) % PRISM_ISA_NUM_SGPRS] = v;
+    }
+}
+
+/*
+ * special function unit
+ *
+ * gather the lanes into a contiguous array so the host compiler can
+ * vectorize the libm calls, then scatter the results back
+ */
+static void prism_shader_sfu(PrismShaderCore *core, uint8_t op,
+                             uint8_t d, uint8_t a)
+{
+    float in[PRISM_SHADER_LANES], out[PRISM_SHADER_LANES];
+    int lane;
+
+    for (lane = 0; lane < PRISM_SHADER_LANES; lane++) {
+        in[lane] = prism_f32(prism_shader_src(core, a, lane));
+    }
+    if (op == PRISM_OP_V_SIN) {
+        for (lane = 0; lane < PRISM_SHADER_LANES; lane++) {
+            out[lane] = sinf(in[lane]);
+        }
+    } else if (op == PRISM_OP_V_COS) {
+        for (lane = 0; lane < PRISM_SHADER_LANES; lane++) {
+            out[lane] = cosf(in[lane]);
+        }
+    } else {
+        for (lane = 0; lane < PRISM_SHADER_LANES; lane++) {
+            out[lane] = 1.0f / in[lane];
+        }
+    }
+    for (lane = 0; lane < PRISM_SHADER_LANES; lane++) {
+        core->vgpr[d % PRISM_ISA_NUM_VGPRS][lane] = prism_u32(out[lane]);
+    }
+}
+
+/*
+ * texture sample
+ *
+ * gather the coordinates of all lanes and let the texture unit filter
+ * the whole wave at once; without a texture unit the result is zero
+ */
+static void prism_shader_sample(PrismShaderCore *core, uint8_t d,
+                                uint8_t a, uint8_t b, uint32_t w1)
+{
+    float u[PRISM_SHADER_LANES], v[PRISM_SHADER_LANES];
+    float out[PRISM_SHADER_LANES] = { 0 };
+    int lane;
+
+    if (core->tex) {
+        for (lane = 0; lane < PRISM_SHADER_LANES; lane++) {
+            u[lane] = prism_f32(prism_shader_src(core, a, lane));
+            v[lane] = prism_f32(prism_shader_src(core, b, lane));
+        }
+        prism_tex_sample(core->tex, PRISM_ISA_TEX_SLOT(w1),
+                         PRISM_ISA_TEX_COMP(w1), u, v, out,
+                         PRISM_SHADER_LANES);
+    }
+    for (lane = 0; lane < PRISM_SHADER_LANES; lane++) {
+        core->vgpr[d % PRISM_ISA_NUM_VGPRS][lane] = prism_u32(out[lane]);
+    }
+}
+
+/*
+ * prism shader exec
+ *
+ * run a straight-line PISA program on one wave,
+ * return 0 on success or -1 on an illegal instruction
+ */
+int prism_shader_exec(PrismShaderCore *core,
+                      const uint32_t *code, uint32_t nwords)
+{
+    uint32_t pc;
+    int lane;
+
+    for (pc = 0; pc < nwords; pc++) {
+        uint32_t w = code[pc];
+        uint8_t op = PRISM_ISA_OP(w);
+        uint8_t d  = PRISM_ISA_DST(w);
+        uint8_t a  = PRISM_ISA_SRC_A(w);
+        uint8_t b  = PRISM_ISA_SRC_B(w);
+        uint8_t c  = 0;
+        uint32_t w1 = 0;
+
+        /* two-word instructions: SRC_C (MAD) or the texture (V_SAMPLE) */
+        if (op == PRISM_OP_V_MAD || op == PRISM_OP_S_MAD ||
+            op == PRISM_OP_V_SAMPLE) {
+            if (pc + 1 >= nwords) {
+                qemu_log_mask(LOG_GUEST_ERROR,
+                              "prism-sim: truncated shader op 0x%02x at pc %u\n",
+                              op, pc);
+                return -1;
+            }
+            w1 = code[++pc];
+            if (op != PRISM_OP_V_SAMPLE) {
+                c = PRISM_ISA_SRC_C(w1);
+            }
+        }
+
+        /* S_LOAD* use SRC_B as a byte offset, not as an operand */
+        if (op != PRISM_OP_S_LOAD && op != PRISM_OP_S_LOAD_X4 &&
+            op != PRISM_OP_S_LOAD_X8 &&
+            (a == PRISM_ISA_LITERAL || b == PRISM_ISA_LITERAL ||
+             c == PRISM_ISA_LITERAL)) {
+            if (pc + 1 >= nwords) {
+                qemu_log_mask(LOG_GUEST_ERROR,
+                              "prism-sim: missing literal for op 0x%02x at pc %u\n",
+                              op, pc);
+                return -1;
+            }
+            core->literal = code[++pc];
+        }
+
+        switch (op) {
+        case PRISM_OP_S_MOV:
+            core->sgpr[d % PRISM_ISA_NUM_SGPRS] = prism_shader_ssrc(core, a);
+            break;
+        case PRISM_OP_S_LOAD:
+            prism_shader_s_load(core, d, b, 1);
+            break;
+        case PRISM_OP_S_LOAD_X4:
+            prism_shader_s_load(core, d, b, 4);
+            break;
+        case PRISM_OP_S_LOAD_X8:
+            prism_shader_s_load(core, d, b, 8);
+            break;
+        case PRISM_OP_S_ADD:
+            prism_sgpr_set_f32(core, d, prism_sgpr_f32(core, a) +
+                                        prism_sgpr_f32(core, b));
+            break;
+        case PRISM_OP_S_SUB:
+            prism_sgpr_set_f32(core, d, prism_sgpr_f32(core, a) -
+                                        prism_sgpr_f32(core, b));
+            break;
+        case PRISM_OP_S_MUL:
+            prism_sgpr_set_f32(core, d, prism_sgpr_f32(core, a) *
+                                        prism_sgpr_f32(core, b));
+            break;
+        case PRISM_OP_S_MAD:
+            prism_sgpr_set_f32(core, d, prism_sgpr_f32(core, a) *
+                                        prism_sgpr_f32(core, b) +
+                                        prism_sgpr_f32(core, c));
+            break;
+        case PRISM_OP_S_CMP_LT:
+        case PRISM_OP_S_CMP_GE:
+        case PRISM_OP_S_CMP_EQ:
+        case PRISM_OP_S_CMP_NE:
+            core->scc = prism_shader_cmp(op, prism_sgpr_f32(core, a),
+                                         prism_sgpr_f32(core, b));
+            break;
+        case PRISM_OP_S_CSELECT:
+            core->sgpr[d % PRISM_ISA_NUM_SGPRS] =
+                prism_shader_ssrc(core, core->scc ? a : b);
+            break;
+        case PRISM_OP_S_SIN:
+            prism_sgpr_set_f32(core, d, sinf(prism_sgpr_f32(core, a)));
+            break;
+        case PRISM_OP_S_COS:
+            prism_sgpr_set_f32(core, d, cosf(prism_sgpr_f32(core, a)));
+            break;
+        case PRISM_OP_S_RCP:
+            prism_sgpr_set_f32(core, d, 1.0f / prism_sgpr_f32(core, a));
+            break;
+        case PRISM_OP_V_SIN:
+        case PRISM_OP_V_COS:
+        case PRISM_OP_V_RCP:
+            prism_shader_sfu(core, op, d, a);
+            break;
+        case PRISM_OP_V_SAMPLE:
+            prism_shader_sample(core, d, a, b, w1);
+            break;
+        case PRISM_OP_V_MAD:
+            for (lane = 0; lane < PRISM_SHADER_LANES; lane++) {
+                core->vgpr[d % PRISM_ISA_NUM_VGPRS][lane] = prism_u32(
+                    prism_f32(prism_shader_src(core, a, lane)) *
+                    prism_f32(prism_shader_src(core, b, lane)) +
+                    prism_f32(prism_shader_src(core, c, lane)));
+            }
+            break;
+        case PRISM_OP_V_CMP_LT:
+        case PRISM_OP_V_CMP_GE:
+        case PRISM_OP_V_CMP_EQ:
+        case PRISM_OP_V_CMP_NE:
+            core->vcc = 0;
+            for (lane = 0; lane < PRISM_SHADER_LANES; lane++) {
+                if (prism_shader_cmp(op,
+                                     prism_f32(prism_shader_src(core, a, lane)),
+                                     prism_f32(prism_shader_src(core, b, lane)))) {
+                    core->vcc |= 1u << lane;
+                }
+            }
+            break;
+        case PRISM_OP_V_CNDMASK:
+            for (lane = 0; lane < PRISM_SHADER_LANES; lane++) {
+                core->vgpr[d % PRISM_ISA_NUM_VGPRS][lane] =
+                    prism_shader_src(core, (core->vcc >> lane) & 1 ? a : b,
+                                     lane);
+            }
+            break;
+        case PRISM_OP_V_MOV:
+            for (lane = 0; lane < PRISM_SHADER_LANES; lane++) {
+                core->vgpr[d % PRISM_ISA_NUM_VGPRS][lane] =
+                    prism_shader_src(core, a, lane);
+            }
+            break;
+        case PRISM_OP_V_ADD:
+            for (lane = 0; lane < PRISM_SHADER_LANES; lane++) {
+                core->vgpr[d % PRISM_ISA_NUM_VGPRS][lane] = prism_u32(
+                    prism_f32(prism_shader_src(core, a, lane)) +
+                    prism_f32(prism_shader_src(core, b, lane)));
+            }
+            break;
+        case PRISM_OP_V_SUB:
+            for (lane = 0; lane < PRISM_SHADER_LANES; lane++) {
+                core->vgpr[d % PRISM_ISA_NUM_VGPRS][lane] = prism_u32(
+                    prism_f32(prism_shader_src(core, a, lane)) -
+                    prism_f32(prism_shader_src(core, b, lane)));
+            }
+            break;
+        case PRISM_OP_V_MUL:
+            for (lane = 0; lane < PRISM_SHADER_LANES; lane++) {
+                core->vgpr[d % PRISM_ISA_NUM_VGPRS][lane] = prism_u32(
+                    prism_f32(prism_shader_src(core, a, lane)) *
+                    prism_f32(prism_shader_src(core, b, lane)));
+            }
+            break;
+        default:
+            qemu_log_mask(LOG_GUEST_ERROR,
+                          "prism-sim: illegal shader op 0x%02x at pc %u\n",
+                          op, pc);
+            return -1;
+        }
+        core->inst_count++;
+    }
+    return 0;
+}
@@ -0,0 +1,35 @@
+#ifndef PRISM_SHADER_H
+#define PRISM_SHADER_H
+
+#include "prism_isa.h"
+#include "prism_texture.h"
+
+#define PRISM_SHADER_LANES 16
+
+/*
+ * one shader core: scalar + vector register file of a single wave
+ */
+struct PrismShaderCore {
+    uint32_t sgpr[PRISM_ISA_NUM_SGPRS];
+    uint32_t vgpr[PRISM_ISA_NUM_VGPRS][PRISM_SHADER_LANES];
+    uint32_t vcc;           //per-lane condition mask, written by V_CMP_*
+    bool scc;               //scalar condition bit, written by S_CMP_*
+    uint32_t literal;       //trailing literal of the current instruction
+
+    const uint8_t *cbuf;    //constant block (uniforms), read by S_LOAD*
+    uint32_t cbuf_size;
+    PrismTextureUnit *tex;  //texture unit serving V_SAMPLE, may be NULL
+
+    uint64_t inst_count;    //executed instructions, for statistics
+};
+
+typedef struct PrismShaderCore PrismShaderCore;
+
+void prism_shader_reset(PrismShaderCore *core,
+                        const uint8_t *cbuf, uint32_t cbuf_size,
+                        PrismTextureUnit *tex);
+uint32_t prism_shader_reg(PrismShaderCore *core, uint8_t r, int lane);
+int prism_shader_exec(PrismShaderCore *core,
+                      const uint32_t *code, uint32_t nwords);
+
+#endif /* PRISM_SHADER_H */
@@ -3,141 +3,1402 @@
 
 OBJECT_DECLARE_TYPE(PrismSimState, PrismSimClass, PRISM_SIM)
 
+/*
+ * prism display bytepp
+ *
+ * bytes per pixel of the first plane of a scanout format, 0 for a format
+ * scanout can not read. The only 32 bpp formats are XRGB8888 / ARGB8888,
+ * which go to the UI as they are, and the converted XRGB2101010
+ */
+static uint32_t prism_display_bytepp(uint32_t format)
+{
+    if (format == PRISM_FBC_FORMAT) {
+        return 4;
+    }
+    if (format == PRISM_COMPOSE_FMT_NV12) {
+        return 1;
+    }
+    if (!pixman_format_supported_source(format) || PIXMAN_FORMAT_BPP(format) % 8) {
+        return 0;
+    }
+    if (PIXMAN_FORMAT_BPP(format) == 32 &&
+        format != PRISM_COMPOSE_FMT_XRGB8888 &&
+        format != PRISM_COMPOSE_FMT_ARGB8888 &&
+        !prism_compose_needs_convert(format)) {
+        return 0;
+    }
+    return PIXMAN_FORMAT_BPP(format) / 8;
+}
+
 /*
  * prism display mode get
  *
- * get the current display mode from registers
+ * get the current display mode from registers. Every row scanout reads
+ * (width * bytepp bytes, stride apart) must lie inside VRAM, the guest
+ * controls all of it
+ */
+static int prism_display_get_mode(PrismSimHead *h, PrismDisplayMode *mode){
+    uint32_t *reg = h->prism_reg_active;
+    uint32_t bytepp;
+
+    mode->format = reg[PRISM_SIM_MODE_REG_FORMATE]; //暂时先这样简单来
+    mode->bytepp = reg[PRISM_SIM_MODE_REG_BYREPP];
+    mode->width  = reg[PRISM_SIM_MODE_REG_WIDTH];
+    mode->height = reg[PRISM_SIM_MODE_REG_HEIGHT];
+    mode->stride = reg[PRISM_SIM_MODE_REG_STRIDE];
+    mode->offset = reg[PRISM_SIM_MODE_REG_OFFSET];
+    mode->size   = reg[PRISM_SIM_MODE_REG_SIZE];
+    mode->meta   = 0;
+
+    bytepp = prism_display_bytepp(mode->format);
+    if (!bytepp || mode->bytepp != bytepp) {
+        return -1;
+    }
+
+    /* FBC: the data plane is at offset, a row "owns" 1/8 of its tile row */
+    if (mode->format == PRISM_FBC_FORMAT) {
+        mode->meta = reg[PRISM_SIM_MODE_REG_META];
+        mode->stride = prism_fbc_band(mode->width) / PRISM_FBC_TILE;
+        if (!prism_fbc_check(h->s->vgamem, mode->offset, mode->meta,
+                             mode->width, mode->height) ||
+            prism_fbc_band(mode->width) * prism_fbc_tiles(mode->height) > mode->size) {
+            return -1;
+        }
+    }
+
+    if (mode->size > h->s->vgamem || mode->offset > h->s->vgamem - mode->size ||
+        (uint64_t)mode->stride * mode->height > mode->size) {
+        return -1;
+    }
+    if ((uint64_t)mode->stride < (uint64_t)mode->width * bytepp) {
+        return -1;
+    }
+    /* YUV: whole chroma pairs, NV12 also needs room for its chroma plane */
+    if ((mode->format == PRISM_COMPOSE_FMT_YUYV ||
+         mode->format == PRISM_COMPOSE_FMT_NV12) && mode->width % 2) {
+        return -1;
+    }
+    if (mode->format == PRISM_COMPOSE_FMT_NV12 &&
+        (mode->height % 2 ||
+         (uint64_t)mode->stride * mode->height / 2 * 3 > mode->size)) {
+        return -1;
+    }
+    return 0;
+}
+
+/* start of the NV12 chroma row used by row y */
+static uint64_t prism_display_uv_row(const PrismDisplayMode *mode,
+                                     uint64_t offset, int y)
+{
+    return offset + (uint64_t)mode->stride * (mode->height + y / 2);
+}
+
+/*
+ * prism display geometry equal
+ *
+ * everything but the scanout offset, a change here needs new surfaces
+ */
+static bool prism_display_geometry_equal(const PrismDisplayMode *a,
+                                         const PrismDisplayMode *b)
+{
+    return a->format == b->format && a->bytepp == b->bytepp &&
+           a->width == b->width && a->height == b->height &&
+           a->stride == b->stride && a->size == b->size;
+}
+
+/* drop an exported buffer, the UI lets go of its import first */
+static void prism_sim_dmabuf_free(PrismSimHead *h, PrismScanoutDmabuf *slot)
+{
+    if (slot->buf) {
+        dpy_gl_release_dmabuf(h->con, slot->buf);
+        qemu_dmabuf_close(slot->buf);
+        qemu_dmabuf_free(slot->buf);
+        slot->buf = NULL;
+    }
+}
+
+/*
+ * prism dmabuf release
+ *
+ * leave dmabuf scanout and drop the export pool
+ */
+static void prism_sim_dmabuf_release(PrismSimHead *h)
+{
+    int i;
+
+    if (h->dmabuf_on) {
+        dpy_gl_scanout_disable(h->con);
+        h->dmabuf_on = false;
+    }
+    for (i = 0; i < PRISM_SIM_DMABUF_POOL; i++) {
+        prism_sim_dmabuf_free(h, &h->dmabuf[i]);
+    }
+}
+
+/*
+ * prism surface release
+ *
+ * drop the shadow, the composition, the exported dmabufs and the pending
+ * rows, the console keeps its own reference to the surface it is showing
+ */
+static void prism_sim_surface_release(PrismSimHead *h)
+{
+    g_free(h->pending_rows);
+    h->pending_rows = NULL;
+    if (h->shadow) {
+        pixman_image_unref(h->shadow);
+        h->shadow = NULL;
+    }
+    if (h->compose) {
+        pixman_image_unref(h->compose);
+        h->compose = NULL;
+    }
+    prism_sim_dmabuf_release(h);
+}
+
+/*
+ * prism shadow copy
+ *
+ * copy the rows of the primary at mode->offset flagged in rows (all of
+ * them when rows is NULL) into the shadow. The shadow is the one surface
+ * the console shows for a directly scanned out primary, so a page flip
+ * is a copy of the rows that differ, not a new surface
+ */
+static void prism_sim_shadow_copy(PrismSimHead *h, const PrismDisplayMode *mode,
+                                  const bool *rows)
+{
+    uint8_t *src = (uint8_t *)memory_region_get_ram_ptr(&h->s->vram) + mode->offset;
+    uint8_t *dst = (uint8_t *)pixman_image_get_data(h->shadow);
+    int stride = pixman_image_get_stride(h->shadow);
+    uint32_t row = mode->width * mode->bytepp;
+    int y;
+
+    for (y = 0; y < mode->height; y++) {
+        if (!rows || rows[y]) {
+            memcpy(dst + (uint64_t)stride * y, src + (uint64_t)mode->stride * y, row);
+        }
+    }
+}
+
+/*
+ * prism dmabuf wanted
+ *
+ * the primary can go to the console as a dmabuf: export on, a GL console,
+ * no composition, a format the UI takes as it is and a page aligned
+ * scanout (udmabuf works on whole pages of the VRAM memfd)
+ */
+static bool prism_sim_dmabuf_wanted(PrismSimHead *h, const PrismDisplayMode *mode,
+                                    bool compose)
+{
+    PrismSimState *s = h->s;
+
+    return s->scanout_dmabuf && !s->dmabuf_failed && !compose &&
+           console_has_gl(h->con) &&
+           (mode->format == PRISM_COMPOSE_FMT_XRGB8888 ||
+            mode->format == PRISM_COMPOSE_FMT_ARGB8888) &&
+           mode->stride % 4 == 0 && mode->stride >= mode->width * 4 &&
+           QEMU_IS_ALIGNED(mode->offset, qemu_real_host_page_size());
+}
+
+/*
+ * prism udmabuf
+ *
+ * dmabuf fd of the VRAM pages holding [offset, offset + size), -1 when the
+ * host can not make one (no /dev/udmabuf, VRAM not a memfd)
+ */
+static int prism_sim_udmabuf(PrismSimState *s, uint64_t offset, uint64_t size)
+{
+#ifdef CONFIG_LINUX
+    struct udmabuf_create create = {
+        .flags = UDMABUF_FLAGS_CLOEXEC,
+        .offset = offset,
+        .size = ROUND_UP(size, qemu_real_host_page_size()),
+    };
+    int memfd = memory_region_get_fd(&s->vram);
+
+    if (memfd < 0 || udmabuf_fd() < 0) {
+        return -1;
+    }
+    create.memfd = memfd;
+    return ioctl(udmabuf_fd(), UDMABUF_CREATE, &create);
+#else
+    return -1;
+#endif
+}
+
+/*
+ * prism dmabuf get
+ *
+ * exported buffer scanning out mode->offset, from the pool (a free or the
+ * least recently used slot is refilled on a miss). A failed export turns
+ * the export off for the device, scanout goes on through the shadow
+ */
+static QemuDmaBuf *prism_sim_dmabuf_get(PrismSimHead *h,
+                                        const PrismDisplayMode *mode)
+{
+    PrismScanoutDmabuf *slot, *victim = NULL;
+    uint32_t offset = 0, stride = mode->stride;
+    int32_t fd;
+    int i;
+
+    for (i = 0; i < PRISM_SIM_DMABUF_POOL; i++) {
+        slot = &h->dmabuf[i];
+        if (slot->buf && slot->offset == mode->offset) {
+            goto found;
+        }
+        if (!victim || (victim->buf && (!slot->buf ||
+                        slot->last_used < victim->last_used))) {
+            victim = slot;
+        }
+    }
+
+    slot = victim;
+    prism_sim_dmabuf_free(h, slot);
+    fd = prism_sim_udmabuf(h->s, mode->offset, (uint64_t)mode->stride * mode->height);
+    if (fd < 0) {
+        warn_report("prism-sim: scanout dmabuf export failed, falling back to surfaces");
+        h->s->dmabuf_failed = true;
+        return NULL;
+    }
+    /* the primary is opaque whatever its alpha byte holds */
+    slot->buf = qemu_dmabuf_new(mode->width, mode->height, &offset, &stride,
+                                0, 0, mode->width, mode->height,
+                                DRM_FORMAT_XRGB8888, DRM_FORMAT_MOD_LINEAR,
+                                &fd, 1, false, false);
+    slot->offset = mode->offset;
+
+found:
+    slot->last_used = ++h->dmabuf_clock;
+    return slot->buf;
+}
+
+/*
+ * prism dmabuf show
+ *
+ * scan out mode->offset as a dmabuf, all of it is damage. false when the
+ * export failed and the caller has to use a surface
+ */
+static bool prism_sim_dmabuf_show(PrismSimHead *h, const PrismDisplayMode *mode)
+{
+    QemuDmaBuf *buf = prism_sim_dmabuf_get(h, mode);
+
+    if (!buf) {
+        return false;
+    }
+    if (!h->dmabuf_on) {
+        qemu_console_resize(h->con, mode->width, mode->height);
+        h->dmabuf_on = true;
+    }
+    dpy_gl_scanout_dmabuf(h->con, buf);
+    return true;
+}
+
+/* true when [start, start + size) and [base, base + len) share a dirty page */
+static bool prism_sim_range_dirty(MemoryRegion *vram, DirtyBitmapSnapshot *snap,
+                                  uint64_t start, uint64_t size,
+                                  uint64_t base, uint64_t len)
+{
+    uint64_t lo = MAX(start, base), hi = MIN(start + size, base + len);
+
+    return lo < hi && memory_region_snapshot_get_dirty(vram, snap, lo, hi - lo);
+}
+
+/*
+ * prism pending rows
+ *
+ * flag the rows of head o showing anything written in [start, start + size)
+ * according to snap: primary rows (with their FBC tile row or NV12 chroma
+ * row) and the screen rows its overlays cover
+ */
+static void prism_sim_pending_rows(PrismSimHead *o, DirtyBitmapSnapshot *snap,
+                                   uint64_t start, uint64_t size)
+{
+    MemoryRegion *vram = &o->s->vram;
+    const PrismDisplayMode *m = &o->mode;
+    const PrismPlane *p;
+    uint64_t band = prism_fbc_band(m->width);
+    uint32_t tiles_x = prism_fbc_tiles(m->width);
+    uint32_t tiles_y = prism_fbc_tiles(m->height);
+    int j, r, y;
+
+    if (m->format == PRISM_FBC_FORMAT) {
+        for (y = 0; y < tiles_y; y++) {
+            if (prism_sim_range_dirty(vram, snap, start, size,
+                                      m->offset + band * y, band) ||
+                prism_sim_range_dirty(vram, snap, start, size,
+                                      m->meta + (uint64_t)tiles_x * y, tiles_x)) {
+                bitmap_set(o->pending_rows, y * PRISM_FBC_TILE,
+                           MIN(PRISM_FBC_TILE, m->height - y * PRISM_FBC_TILE));
+            }
+        }
+    } else if (prism_sim_range_dirty(vram, snap, start, size, m->offset, m->size)) {
+        for (y = 0; y < m->height; y++) {
+            if (prism_sim_range_dirty(vram, snap, start, size,
+                                      m->offset + (uint64_t)m->stride * y,
+                                      m->stride) ||
+                (m->format == PRISM_COMPOSE_FMT_NV12 &&
+                 prism_sim_range_dirty(vram, snap, start, size,
+                                       prism_display_uv_row(m, m->offset, y),
+                                       m->stride))) {
+                set_bit(y, o->pending_rows);
+            }
+        }
+    }
+
+    for (j = 0; j < PRISM_SIM_OVERLAYS; j++) {
+        p = &o->plane_shown[j];
+        if (!p->enable ||
+            !prism_sim_range_dirty(vram, snap, start, size, p->base,
+                                   (uint64_t)p->pitch * (p->height - 1) +
+                                   p->width * 4)) {
+            continue;
+        }
+        for (r = 0; r < p->height; r++) {
+            y = p->y + r;
+            if (y >= 0 && y < m->height &&
+                prism_sim_range_dirty(vram, snap, start, size,
+                                      p->base + (uint64_t)p->pitch * r,
+                                      p->width * 4)) {
+                set_bit(y, o->pending_rows);
+            }
+        }
+    }
+}
+
+/*
+ * prism snapshot
+ *
+ * fetch and clear the VGA dirty bits of [start, start + size). The bits
+ * are shared by all heads, so when the range holds writes another head
+ * scans out (clone mode, an overlay shown on two heads) the rows of that
+ * head showing them are left pending for its next update instead of
+ * missing the damage
+ */
+static DirtyBitmapSnapshot *prism_sim_snapshot(PrismSimHead *h,
+                                               uint64_t start, uint64_t size)
+{
+    PrismSimState *s = h->s;
+    DirtyBitmapSnapshot *snap;
+    PrismSimHead *o;
+    unsigned int i;
+
+    snap = memory_region_snapshot_and_clear_dirty(&s->vram, start, size,
+                                                  DIRTY_MEMORY_VGA);
+    for (i = 0; i < s->heads; i++) {
+        o = &s->head[i];
+        if (o != h && o->pending_rows) {
+            prism_sim_pending_rows(o, snap, start, size);
+        }
+    }
+    return snap;
+}
+
+/*
+ * fbc rows
+ *
+ * an FBC primary changes a tile row at a time: its rows are damaged when
+ * the data or the metadata of the tile row was written. A flip or a new
+ * metadata plane is a full redraw, see display update
+ */
+static void prism_sim_fbc_rows(PrismSimHead *h, const PrismDisplayMode *mode,
+                               bool *rows)
+{
+    MemoryRegion *vram = &h->s->vram;
+    uint32_t tiles_x = prism_fbc_tiles(mode->width);
+    uint32_t tiles_y = prism_fbc_tiles(mode->height);
+    uint64_t band = prism_fbc_band(mode->width);
+    DirtyBitmapSnapshot *snap, *meta_snap;
+    uint32_t ty, y;
+    bool dirty;
+
+    snap = prism_sim_snapshot(h, mode->offset, band * tiles_y);
+    meta_snap = prism_sim_snapshot(h, mode->meta, (uint64_t)tiles_x * tiles_y);
+    for (ty = 0; ty < tiles_y; ty++) {
+        dirty = memory_region_snapshot_get_dirty(vram, snap,
+                                                 mode->offset + band * ty, band) ||
+                memory_region_snapshot_get_dirty(vram, meta_snap,
+                                                 mode->meta + (uint64_t)tiles_x * ty,
+                                                 tiles_x);
+        for (y = ty * PRISM_FBC_TILE;
+             y < MIN((ty + 1) * PRISM_FBC_TILE, mode->height); y++) {
+            rows[y] = dirty;
+        }
+    }
+
+    g_free(meta_snap);
+    g_free(snap);
+}
+
+/* add the rows other heads left pending for h, then clear them */
+static void prism_sim_take_pending(PrismSimHead *h, const PrismDisplayMode *mode,
+                                   bool *rows)
+{
+    int y;
+
+    if (!h->pending_rows) {
+        return;
+    }
+    for (y = 0; y < mode->height; y++) {
+        rows[y] |= test_bit(y, h->pending_rows);
+    }
+    bitmap_zero(h->pending_rows, mode->height);
+}
+
+/*
+ * prism primary rows
+ *
+ * mark the rows of the primary that changed since the last update. After
+ * a flip from old_offset a row changed when it differs from the buffer
+ * shown before or either buffer was written since the last update; an
+ * NV12 row also changes with its chroma row. Rows other heads left
+ * pending are added
+ */
+static void prism_sim_primary_rows(PrismSimHead *h,
+                                   const PrismDisplayMode *mode,
+                                   uint64_t old_offset, bool *rows)
+{
+    DirtyBitmapSnapshot *snap, *old_snap = NULL;
+    bool flip = old_offset != mode->offset;
+    bool nv12 = mode->format == PRISM_COMPOSE_FMT_NV12;
+    uint32_t row = prism_compose_row_bytes(mode->format, mode->width);
+    uint8_t *ptr = memory_region_get_ram_ptr(&h->s->vram);
+    uint64_t pos, uv, old_uv;
+    int y;
+
+    if (mode->format == PRISM_FBC_FORMAT) {
+        prism_sim_fbc_rows(h, mode, rows);
+        prism_sim_take_pending(h, mode, rows);
+        return;
+    }
+
+    row = MIN(row ? row : mode->width * mode->bytepp, mode->stride);
+
+    snap = prism_sim_snapshot(h, mode->offset, mode->size);
+    if (flip) {
+        old_snap = prism_sim_snapshot(h, old_offset, mode->size);
+    }
+
+    for (y = 0; y < mode->height; y++) {
+        pos = (uint64_t)mode->stride * y;
+        rows[y] = memory_region_snapshot_get_dirty(&h->s->vram, snap,
+                                                   mode->offset + pos,
+                                                   mode->stride);
+        if (flip && !rows[y]) {
+            rows[y] = memory_region_snapshot_get_dirty(&h->s->vram, old_snap,
+                                                       old_offset + pos,
+                                                       mode->stride) ||
+                      memcmp(ptr + mode->offset + pos,
+                             ptr + old_offset + pos, row) != 0;
+        }
+        if (!nv12 || rows[y]) {
+            continue;
+        }
+        uv = prism_display_uv_row(mode, mode->offset, y);
+        old_uv = prism_display_uv_row(mode, old_offset, y);
+        rows[y] = memory_region_snapshot_get_dirty(&h->s->vram, snap, uv,
+                                                   mode->stride);
+        if (flip && !rows[y]) {
+            rows[y] = memory_region_snapshot_get_dirty(&h->s->vram, old_snap,
+                                                       old_uv, mode->stride) ||
+                      memcmp(ptr + uv, ptr + old_uv, row) != 0;
+        }
+    }
+
+    g_free(old_snap);
+    g_free(snap);
+    prism_sim_take_pending(h, mode, rows);
+}
+
+/* damage to the console, a dmabuf scanout is read by the UI straight from VRAM */
+static void prism_sim_update_rect(PrismSimHead *h, int x, int y, int w, int ht)
+{
+    if (h->dmabuf_on) {
+        dpy_gl_update(h->con, x, y, w, ht);
+    } else {
+        dpy_gfx_update(h->con, x, y, w, ht);
+    }
+}
+
+/*
+ * prism display damage
+ *
+ * push the changed rows of the directly scanned out primary to the console,
+ * or all of them when full; without a dmabuf they are copied into the
+ * shadow first
+ */
+static void prism_sim_display_damage(PrismSimHead *h,
+                                     const PrismDisplayMode *mode,
+                                     uint64_t old_offset, bool full)
+{
+    bool *rows = g_new(bool, mode->height + 1);
+    int y, ys;
+
+    prism_sim_primary_rows(h, mode, old_offset, rows);
+    if (full) {
+        memset(rows, true, mode->height);
+    }
+    if (!h->dmabuf_on) {
+        prism_sim_shadow_copy(h, mode, rows);
+    }
+
+    ys = -1;
+    for (y = 0; y < mode->height; y++) {
+        if (rows[y] && ys < 0) {
+            ys = y;
+        }
+        if (!rows[y] && ys >= 0) {
+            prism_sim_update_rect(h, 0, ys, mode->width, y - ys);
+            ys = -1;
+        }
+    }
+    if (ys >= 0) {
+        prism_sim_update_rect(h, 0, ys, mode->width, y - ys);
+    }
+
+    g_free(rows);
+}
+
+/*
+ * prism plane get
+ *
+ * decode the latched bank of overlay i; planes that are off, of an
+ * unknown format or not inside VRAM come back disabled
+ */
+static void prism_sim_plane_get(PrismSimHead *h, int i, PrismPlane *p)
+{
+    uint32_t *reg = h->plane_reg_active[i];
+
+    memset(p, 0, sizeof(*p));
+    p->base = reg[PRISM_SIM_PLANE_REG_BASE];
+    p->pitch = reg[PRISM_SIM_PLANE_REG_PITCH];
+    p->format = reg[PRISM_SIM_PLANE_REG_FORMAT];
+    p->x = (int16_t)(reg[PRISM_SIM_PLANE_REG_POS] & 0xffff);
+    p->y = (int16_t)(reg[PRISM_SIM_PLANE_REG_POS] >> 16);
+    p->width = reg[PRISM_SIM_PLANE_REG_SIZE_WH] & 0xffff;
+    p->height = reg[PRISM_SIM_PLANE_REG_SIZE_WH] >> 16;
+    p->alpha = MIN(reg[PRISM_SIM_PLANE_REG_ALPHA], 255);
+    p->enable = (reg[PRISM_SIM_PLANE_REG_CTRL] & PRISM_SIM_PLANE_CTRL_ENABLE) &&
+                p->width && p->height && p->alpha &&
+                (p->format == PRISM_COMPOSE_FMT_ARGB8888 ||
+                 p->format == PRISM_COMPOSE_FMT_XRGB8888) &&
+                p->base % 4 == 0 && p->pitch % 4 == 0 &&
+                p->pitch >= p->width * 4 &&
+                (uint64_t)p->pitch * (p->height - 1) + p->width * 4 <=
+                h->s->vgamem - MIN(p->base, h->s->vgamem);
+    if (!p->enable) {
+        memset(p, 0, sizeof(*p));
+    }
+}
+
+/*
+ * compose wanted
+ *
+ * composition is needed for a primary that has to be converted, and
+ * over an XRGB8888 / ARGB8888 primary while an overlay is on; otherwise
+ * the primary is scanned out directly
+ */
+static bool prism_sim_compose_wanted(const PrismDisplayMode *mode,
+                                     const PrismPlane *planes)
+{
+    int i;
+
+    if (!mode->width || !mode->height) {
+        return false;
+    }
+    if (prism_compose_needs_convert(mode->format) ||
+        mode->format == PRISM_FBC_FORMAT) {
+        return true;
+    }
+    if (mode->format != PRISM_COMPOSE_FMT_XRGB8888 &&
+        mode->format != PRISM_COMPOSE_FMT_ARGB8888) {
+        return false;
+    }
+    for (i = 0; i < PRISM_SIM_OVERLAYS; i++) {
+        if (planes[i].enable) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* grow the damaged span of every row of a rectangle, clipped to the screen */
+static void prism_sim_damage_rect(const PrismDisplayMode *mode,
+                                  int *x0, int *x1,
+                                  int x, int y, int w, int h)
+{
+    int cx0 = MAX(x, 0), cx1 = MIN(x + w, (int)mode->width);
+    int cy0 = MAX(y, 0), cy1 = MIN(y + h, (int)mode->height);
+
+    for (; cy0 < cy1 && cx0 < cx1; cy0++) {
+        x0[cy0] = MIN(x0[cy0], cx0);
+        x1[cy0] = MAX(x1[cy0], cx1);
+    }
+}
+
+/*
+ * compose span
+ *
+ * convert (or copy) [xs, xe) of row y of the primary into the composition
+ * and blend the overlays covering it, in plane order
+ */
+static void prism_sim_compose_span(PrismSimHead *h,
+                                   const PrismDisplayMode *mode,
+                                   const PrismPlane *planes,
+                                   int y, int xs, int xe)
+{
+    uint8_t *ptr = memory_region_get_ram_ptr(&h->s->vram);
+    uint32_t *dst = (uint32_t *)((uint8_t *)pixman_image_get_data(h->compose) +
+                                 pixman_image_get_stride(h->compose) * y);
+    const PrismPlane *p;
+    const uint32_t *src;
+    int i, px0, px1;
+
+    if (mode->format == PRISM_FBC_FORMAT) {
+        prism_fbc_decode_span(dst, ptr + mode->offset, ptr + mode->meta,
+                              mode->width, y, xs, xe);
+    } else {
+        prism_compose_convert(dst, ptr + mode->offset + (uint64_t)mode->stride * y,
+                              mode->format == PRISM_COMPOSE_FMT_NV12 ?
+                              ptr + prism_display_uv_row(mode, mode->offset, y) : NULL,
+                              mode->format, xs, xe);
+    }
+
+    for (i = 0; i < PRISM_SIM_OVERLAYS; i++) {
+        p = &planes[i];
+        if (!p->enable || y < p->y || y >= p->y + (int)p->height) {
+            continue;
+        }
+        px0 = MAX(xs, p->x);
+        px1 = MIN(xe, p->x + (int)p->width);
+        if (px0 >= px1) {
+            continue;
+        }
+        src = (const uint32_t *)(ptr + p->base +
+                                 (uint64_t)p->pitch * (y - p->y) +
+                                 (px0 - p->x) * 4);
+        prism_compose_blend(dst + px0, src, px1 - px0, p->alpha,
+                            p->format == PRISM_COMPOSE_FMT_ARGB8888);
+    }
+}
+
+/*
+ * compose update
+ *
+ * collect the damage (changed primary rows, overlay buffer writes,
+ * overlays that moved, resized or changed alpha) as one span per row,
+ * recompose only those spans and send them as rectangles
+ */
+static void prism_sim_compose_update(PrismSimHead *h,
+                                     const PrismDisplayMode *mode,
+                                     uint64_t old_offset,
+                                     const PrismPlane *planes, bool full)
+{
+    int height = mode->height, width = mode->width;
+    bool *rows = g_new(bool, height + 1);
+    int *x0 = g_new(int, height + 1), *x1 = g_new(int, height + 1);
+    DirtyBitmapSnapshot *snap;
+    const PrismPlane *p, *shown;
+    int i, r, y, ys, rx0, rx1;
+
+    prism_sim_primary_rows(h, mode, old_offset, rows);
+    for (y = 0; y < height; y++) {
+        x0[y] = full || rows[y] ? 0 : width;
+        x1[y] = full || rows[y] ? width : 0;
+    }
+
+    for (i = 0; i < PRISM_SIM_OVERLAYS; i++) {
+        p = &planes[i];
+        shown = &h->plane_shown[i];
+        if (memcmp(p, shown, sizeof(*p)) != 0) {
+            prism_sim_damage_rect(mode, x0, x1, shown->x, shown->y,
+                                  shown->width, shown->height);
+            prism_sim_damage_rect(mode, x0, x1, p->x, p->y,
+                                  p->width, p->height);
+            continue;
+        }
+        if (!p->enable) {
+            continue;
+        }
+        snap = prism_sim_snapshot(h, p->base,
+                    (uint64_t)p->pitch * (p->height - 1) + p->width * 4);
+        for (r = 0; r < p->height; r++) {
+            if (memory_region_snapshot_get_dirty(&h->s->vram, snap,
+                                                 p->base + (uint64_t)p->pitch * r,
+                                                 p->width * 4)) {
+                prism_sim_damage_rect(mode, x0, x1, p->x, p->y + r, p->width, 1);
+            }
+        }
+        g_free(snap);
+    }
+
+    /* consecutive damaged rows go out as one rectangle */
+    ys = -1;
+    rx0 = width;
+    rx1 = 0;
+    for (y = 0; y <= height; y++) {
+        if (y < height && x0[y] < x1[y]) {
+            prism_sim_compose_span(h, mode, planes, y, x0[y], x1[y]);
+            if (ys < 0) {
+                ys = y;
+            }
+            rx0 = MIN(rx0, x0[y]);
+            rx1 = MAX(rx1, x1[y]);
+        } else if (ys >= 0) {
+            dpy_gfx_update(h->con, rx0, ys, rx1 - rx0, y - ys);
+            ys = -1;
+            rx0 = width;
+            rx1 = 0;
+        }
+    }
+
+    memcpy(h->plane_shown, planes, sizeof(h->plane_shown));
+    g_free(x1);
+    g_free(x0);
+    g_free(rows);
+}
+
+
+/*
+ * qemu com update 
+ *
+ * update function 
+ */
+static void prism_sim_display_update(void *opaque)
+{
+    PrismSimHead *h = opaque ;
+    PrismPlane planes[PRISM_SIM_OVERLAYS];
+    PrismDisplayMode mode;
+    DisplaySurface *ds ;
+    uint64_t old_offset ;
+    bool compose, dmabuf, redraw = false;
+    int i, ret ;
+
+    ret = prism_display_get_mode(h, &mode);
+
+    if(ret < 0){
+        return;
+    }
+
+    for (i = 0; i < PRISM_SIM_OVERLAYS; i++) {
+        prism_sim_plane_get(h, i, &planes[i]);
+    }
+    compose = prism_sim_compose_wanted(&mode, planes);
+    dmabuf = prism_sim_dmabuf_wanted(h, &mode, compose);
+
+    /*
+     * format / geometry change, overlays or dmabuf scanout switched on /
+     * off: the shadow, the exports or the composition no longer fit
+     */
+    if(!prism_display_geometry_equal(&h->mode, &mode) ||
+       compose != (h->compose != NULL) || dmabuf != h->dmabuf_on){
+        prism_sim_surface_release(h);
+        h->mode = mode;
+        h->pending_rows = bitmap_new(mode.height);
+        if (dmabuf && prism_sim_dmabuf_show(h, &mode)) {
+            dpy_gl_update(h->con, 0, 0, mode.width, mode.height);
+            return;
+        }
+        if (compose) {
+            h->compose = pixman_image_create_bits(PIXMAN_x8r8g8b8,
+                                                  mode.width, mode.height,
+                                                  NULL, 0);
+            ds = h->compose ? qemu_create_displaysurface_pixman(h->compose) : NULL;
+        } else {
+            h->shadow = pixman_image_create_bits(mode.format, mode.width,
+                                                 mode.height, NULL, 0);
+            if (h->shadow) {
+                prism_sim_shadow_copy(h, &mode, NULL);
+            }
+            ds = h->shadow ? qemu_create_displaysurface_pixman(h->shadow) : NULL;
+        }
+        if (!ds) {
+            return;
+        }
+        dpy_gfx_replace_surface(h->con, ds);
+        if (compose) {
+            prism_sim_compose_update(h, &mode, mode.offset, planes, true);
+        } else {
+            dpy_gfx_update_full(h->con);
+        }
+        return;
+    }
+
+    old_offset = h->mode.offset;
+    /* FBC tiles are not compared across a flip, redraw all of it */
+    if (mode.format == PRISM_FBC_FORMAT &&
+        (old_offset != mode.offset || h->mode.meta != mode.meta)) {
+        redraw = true;
+    }
+    h->mode = mode;
+
+    /* overlays on: the composition stays the surface, a flip is just damage */
+    if (compose) {
+        prism_sim_compose_update(h, &mode, old_offset, planes, redraw);
+        return;
+    }
+
+    /*
+     * page flip: a dmabuf scanout swaps to the pooled export, the shadow
+     * stays the surface and gets the rows that differ; either way only the
+     * real damage is sent
+     */
+    if(old_offset != mode.offset && h->dmabuf_on){
+        if (!prism_sim_dmabuf_show(h, &mode)) {
+            /* rebuilt on the shadow by the next update */
+            prism_sim_surface_release(h);
+            memset(&h->mode, 0, sizeof(h->mode));
+            return;
+        }
+    }
+
+    prism_sim_display_damage(h, &mode, old_offset, redraw);
+}
+
+
+/*
+ * vblank
+ *
+ * latch the pending commit into the scanout state, then rearm
+ */
+static void prism_sim_vblank(void *opaque)
+{
+    PrismSimHead *h = opaque;
+
+    if (h->commit_pending) {
+        memcpy(h->prism_reg_active, h->prism_reg_pending,
+               sizeof(h->prism_reg_active));
+        memcpy(h->plane_reg_active, h->plane_reg_pending,
+               sizeof(h->plane_reg_active));
+        h->commit_pending = false;
+    }
+    h->vblank_count++;
+    timer_mod(h->vblank_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+              NANOSECONDS_PER_SECOND / PRISM_SIM_VBLANK_HZ);
+}
+
+
+/*
+ * graphic ops 
+ *
+ * only realize update function now
+ */
+static GraphicHwOps prism_sim_gfx_ops = {
+    .gfx_update = prism_sim_display_update,
+};
+
+
+/*
+ * mode reg  read 
+ *
+ * read function for prism sim mode reg
+ */
+static uint64_t prism_sim_mode_reg_read(void *opaque,
+                                     hwaddr addr,
+                                     unsigned size)
+{
+    PrismSimHead *h = opaque;
+
+    unsigned int index = addr >> 2;
+
+    switch (index) {
+    case PRISM_SIM_MODE_REG_START:
+        return h->commit_pending;
+    case PRISM_SIM_MODE_REG_VBLANK:
+        return h->vblank_count;
+    case PRISM_SIM_MODE_REG_HEADS:
+        return h->s->heads;
+    default:
+        return index < PRISM_SIM_REG_NUMBER ? h->prism_reg[index] : 0;
+    }
+}
+
+/*
+ * mode reg write
+ *
+ * write function for prism sim mode reg
+ */
+static void prism_sim_mode_reg_write(void *opaque,
+                                      hwaddr addr,
+                                      uint64_t val,
+                                      unsigned size)
+{
+    PrismSimHead *h = opaque;
+
+    unsigned int index = addr >> 2;
+
+    switch (index) {
+    case PRISM_SIM_MODE_REG_START:
+        /* 一次提交: 之后的写入只影响下一次提交 */
+        memcpy(h->prism_reg_pending, h->prism_reg, sizeof(h->prism_reg_pending));
+        memcpy(h->plane_reg_pending, h->plane_reg, sizeof(h->plane_reg_pending));
+        h->commit_pending = true;
+        return;
+    case PRISM_SIM_MODE_REG_VBLANK:
+    case PRISM_SIM_MODE_REG_HEADS:
+        return;
+    default:
+        if (index < PRISM_SIM_REG_NUMBER) {
+            h->prism_reg[index] = val;
+        }
+        return;
+    }
+}
+
+
+/*
+ * prism display mode ctrl reg 
+ *
+ * realize the operation of prism sim mode reg
+ */
+static const MemoryRegionOps prism_sim_mode_reg_ops = {
+    .read = prism_sim_mode_reg_read,
+    .write = prism_sim_mode_reg_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .impl = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+};
+
+
+/*
+ * plane reg read / write
+ *
+ * the guest sees the shadow banks, START commits them with the mode
+ */
+static uint64_t prism_sim_plane_reg_read(void *opaque,
+                                         hwaddr addr,
+                                         unsigned size)
+{
+    PrismSimHead *h = opaque;
+    unsigned int index = addr >> 2;
+
+    return h->plane_reg[index / PRISM_SIM_PLANE_REG_NUMBER]
+                       [index % PRISM_SIM_PLANE_REG_NUMBER];
+}
+
+static void prism_sim_plane_reg_write(void *opaque,
+                                      hwaddr addr,
+                                      uint64_t val,
+                                      unsigned size)
+{
+    PrismSimHead *h = opaque;
+    unsigned int index = addr >> 2;
+
+    h->plane_reg[index / PRISM_SIM_PLANE_REG_NUMBER]
+                [index % PRISM_SIM_PLANE_REG_NUMBER] = val;
+}
+
+static const MemoryRegionOps prism_sim_plane_reg_ops = {
+    .read = prism_sim_plane_reg_read,
+    .write = prism_sim_plane_reg_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .impl = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+};
+
+
+/*
+ * cursor define
+ *
+ * copy the cursor image out of VRAM and hand it to the UI
+ */
+static void prism_sim_cursor_define(PrismSimHead *h)
+{
+    uint32_t *reg = h->cursor_reg;
+    uint32_t width = reg[PRISM_SIM_CURSOR_REG_SIZE_WH] & 0xffff;
+    uint32_t height = reg[PRISM_SIM_CURSOR_REG_SIZE_WH] >> 16;
+    uint32_t base = reg[PRISM_SIM_CURSOR_REG_BASE];
+    uint8_t *ptr = memory_region_get_ram_ptr(&h->s->vram);
+    QEMUCursor *c;
+    uint32_t i;
+
+    if (!width || !height || width > PRISM_SIM_CURSOR_MAX ||
+        height > PRISM_SIM_CURSOR_MAX || base % 4 ||
+        (uint64_t)width * height * 4 > h->s->vgamem - MIN(base, h->s->vgamem)) {
+        qemu_log_mask(LOG_GUEST_ERROR, "prism-sim: invalid cursor image\n");
+        return;
+    }
+
+    c = cursor_alloc(width, height);
+    c->hot_x = MIN(reg[PRISM_SIM_CURSOR_REG_HOT] & 0xffff, width - 1);
+    c->hot_y = MIN(reg[PRISM_SIM_CURSOR_REG_HOT] >> 16, height - 1);
+    for (i = 0; i < width * height; i++) {
+        c->data[i] = ldl_le_p(ptr + base + i * 4);
+    }
+    dpy_cursor_define(h->con, c);
+    cursor_unref(c);
+    h->cursor_defined = true;
+}
+
+/*
+ * cursor move
+ *
+ * the UI wants the pointer (hotspot) position, POS is the image corner
  */
-static int prism_display_get_mode(PrismSimState *s, PrismDisplayMode *mode){
-    uint32_t *reg = s->prism_reg;
+static void prism_sim_cursor_move(PrismSimHead *h)
+{
+    uint32_t *reg = h->cursor_reg;
+    int16_t x = reg[PRISM_SIM_CURSOR_REG_POS] & 0xffff;
+    int16_t y = reg[PRISM_SIM_CURSOR_REG_POS] >> 16;
+    bool on = h->cursor_defined &&
+              (reg[PRISM_SIM_CURSOR_REG_CTRL] & PRISM_SIM_CURSOR_CTRL_ENABLE);
 
-    mode->format = reg[PRISM_SIM_MODE_REG_FORMATE]; //暂时先这样简单来
-    mode->bytepp = reg[PRISM_SIM_MODE_REG_BYREPP];
-    mode->width  = reg[PRISM_SIM_MODE_REG_WIDTH];
-    mode->height = reg[PRISM_SIM_MODE_REG_HEIGHT];
-    mode->stride = reg[PRISM_SIM_MODE_REG_STRIDE];
-    mode->offset = reg[PRISM_SIM_MODE_REG_OFFSET];
-    mode->size   = reg[PRISM_SIM_MODE_REG_SIZE];
+    dpy_mouse_set(h->con, x + (int)(reg[PRISM_SIM_CURSOR_REG_HOT] & 0xffff),
+                  y + (int)(reg[PRISM_SIM_CURSOR_REG_HOT] >> 16), on);
+}
 
-    return 0;
+/*
+ * cursor reg read
+ */
+static uint64_t prism_sim_cursor_reg_read(void *opaque,
+                                          hwaddr addr,
+                                          unsigned size)
+{
+    PrismSimHead *h = opaque;
+    unsigned int index = addr >> 2;
+
+    return index == PRISM_SIM_CURSOR_REG_UPDATE ? 0 : h->cursor_reg[index];
+}
+
+/*
+ * cursor reg write
+ *
+ * POS and CTRL move / show the pointer right away, no vblank latch and
+ * no framebuffer damage; UPDATE reloads the image
+ */
+static void prism_sim_cursor_reg_write(void *opaque,
+                                       hwaddr addr,
+                                       uint64_t val,
+                                       unsigned size)
+{
+    PrismSimHead *h = opaque;
+    unsigned int index = addr >> 2;
+
+    switch (index) {
+    case PRISM_SIM_CURSOR_REG_UPDATE:
+        prism_sim_cursor_define(h);
+        prism_sim_cursor_move(h);
+        return;
+    case PRISM_SIM_CURSOR_REG_POS:
+    case PRISM_SIM_CURSOR_REG_CTRL:
+        h->cursor_reg[index] = val;
+        prism_sim_cursor_move(h);
+        return;
+    default:
+        h->cursor_reg[index] = val;
+        return;
+    }
 }
 
+static const MemoryRegionOps prism_sim_cursor_reg_ops = {
+    .read = prism_sim_cursor_reg_read,
+    .write = prism_sim_cursor_reg_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .impl = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+};
+
 
 /*
- * qemu com update 
+ * texture reg read
  *
- * update function 
+ * descriptor slots and the texture cache counters
  */
-static void prism_sim_display_update(void *opaque)
+static uint64_t prism_sim_tex_reg_read(void *opaque,
+                                       hwaddr addr,
+                                       unsigned size)
 {
-    PrismSimState *s = opaque ;
-    DirtyBitmapSnapshot *snap = NULL;
-    bool full_update = false ;
-    PrismDisplayMode mode;
-    DisplaySurface *ds ;
-    uint8_t *ptr ;
-    bool dirty ;
-    int y, ys, ret ;
+    PrismSimState *s = opaque;
+    PrismTextureUnit *tu = &s->tex;
+    unsigned int index = addr >> 2;
+    uint64_t total;
 
-    ret = prism_display_get_mode(s, &mode);
+    if (index < PRISM_TEX_SLOTS * 4) {
+        PrismTexDesc *d = &tu->desc[index / 4];
 
-    if(ret < 0){
+        switch (index % 4) {
+        case PRISM_SIM_TEX_REG_BASE:
+            return d->base;
+        case PRISM_SIM_TEX_REG_WIDTH:
+            return d->width;
+        case PRISM_SIM_TEX_REG_HEIGHT:
+            return d->height;
+        default:
+            return d->format;
+        }
+    }
+
+    switch (index) {
+    case PRISM_SIM_TEX_REG_HITS:
+        return (uint32_t)tu->hits;
+    case PRISM_SIM_TEX_REG_MISSES:
+        return (uint32_t)tu->misses;
+    case PRISM_SIM_TEX_REG_HIT_RATE:
+        total = tu->hits + tu->misses;
+        return total ? tu->hits * 10000 / total : 0;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * texture reg write
+ *
+ * a new descriptor invalidates the cache, the counters are read only
+ */
+static void prism_sim_tex_reg_write(void *opaque,
+                                    hwaddr addr,
+                                    uint64_t val,
+                                    unsigned size)
+{
+    PrismSimState *s = opaque;
+    PrismTextureUnit *tu = &s->tex;
+    unsigned int index = addr >> 2;
+
+    if (index < PRISM_TEX_SLOTS * 4) {
+        PrismTexDesc *d = &tu->desc[index / 4];
+
+        switch (index % 4) {
+        case PRISM_SIM_TEX_REG_BASE:
+            d->base = val;
+            break;
+        case PRISM_SIM_TEX_REG_WIDTH:
+            d->width = val;
+            break;
+        case PRISM_SIM_TEX_REG_HEIGHT:
+            d->height = val;
+            break;
+        default:
+            d->format = val;
+            break;
+        }
+        prism_tex_invalidate(tu);
         return;
     }
 
-    if(memcmp(&s->mode, &mode, sizeof(mode)) != 0){
-        s->mode = mode;
-        ptr = memory_region_get_ram_ptr(&s->vram);
-        ds = qemu_create_displaysurface_from(mode.width,
-                                             mode.height,
-                                             mode.format,
-                                             mode.stride,
-                                             ptr + mode.offset);
-        dpy_gfx_replace_surface(s->con, ds);
-        full_update = true;
-    }
-
-    if(full_update){
-        dpy_gfx_update_full(s->con);
-    }
-    else {
-        snap = memory_region_snapshot_and_clear_dirty(&s->vram,
-                                                      mode.offset, mode.size,
-                                                      DIRTY_MEMORY_VGA);
-        ys = -1;
-        for (y = 0; y < mode.height; y++) {
-            dirty = memory_region_snapshot_get_dirty(&s->vram, snap,
-                                                     mode.offset + mode.stride * y,
-                                                     mode.stride);
-            if (dirty && ys < 0) {
-                ys = y;
-            }
-            if (!dirty && ys >= 0) {
-                dpy_gfx_update(s->con, 0, ys,
-                               mode.width, y - ys);
-                ys = -1;
-            }
+    if (index == PRISM_SIM_TEX_REG_CTRL) {
+        if (val & PRISM_SIM_TEX_CTRL_INVALIDATE) {
+            prism_tex_invalidate(tu);
         }
-        if (ys >= 0) {
-            dpy_gfx_update(s->con, 0, ys,
-                           mode.width, y - ys);
+        if (val & PRISM_SIM_TEX_CTRL_CLEAR_STATS) {
+            tu->hits = 0;
+            tu->misses = 0;
         }
     }
-
-    g_free(snap);
 }
 
+static const MemoryRegionOps prism_sim_tex_reg_ops = {
+    .read = prism_sim_tex_reg_read,
+    .write = prism_sim_tex_reg_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .impl = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+};
+
 
 /*
- * graphic ops 
+ * raster reg read
  *
- * only realize update function now
+ * draw state and the statistics of the last draw
  */
-static GraphicHwOps prism_sim_gfx_ops = {
-    .gfx_update = prism_sim_display_update,
+static uint64_t prism_sim_raster_reg_read(void *opaque,
+                                          hwaddr addr,
+                                          unsigned size)
+{
+    PrismSimState *s = opaque;
+
+    return s->raster.reg[addr >> 2];
+}
+
+/*
+ * raster reg write
+ *
+ * a write to DRAW runs the draw to completion on the pool before the
+ * access returns, then marks the render target dirty for the display
+ */
+static void prism_sim_raster_reg_write(void *opaque,
+                                       hwaddr addr,
+                                       uint64_t val,
+                                       unsigned size)
+{
+    PrismSimState *s = opaque;
+    PrismRaster *r = &s->raster;
+    unsigned int index = addr >> 2;
+
+    switch (index) {
+    case PRISM_RASTER_REG_STATUS:
+    case PRISM_RASTER_REG_TRIANGLES:
+    case PRISM_RASTER_REG_FRAGMENTS:
+        return;
+    case PRISM_RASTER_REG_DRAW:
+        /*
+         * once the state passed the check the draw may have written the
+         * render target even if a shader faulted later, so mark the
+         * validated extent dirty, the last row is only width pixels
+         */
+        if (prism_raster_draw(r) != -EINVAL) {
+            memory_region_set_dirty(&s->vram, r->reg[PRISM_RASTER_REG_RT_BASE],
+                                    (uint64_t)r->rt_stride * (r->rt_height - 1) +
+                                    r->rt_width * 4);
+        }
+        return;
+    default:
+        r->reg[index] = val;
+        return;
+    }
+}
+
+static const MemoryRegionOps prism_sim_raster_reg_ops = {
+    .read = prism_sim_raster_reg_read,
+    .write = prism_sim_raster_reg_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .impl = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
 };
 
 
 /*
- * mode reg  read 
+ * compute reg read
  *
- * read function for prism sim mode reg
+ * dispatch state, STATUS / FENCE and the statistics are updated by the
+ * pool thread finishing a dispatch
  */
-static uint64_t prism_sim_mode_reg_read(void *opaque,
-                                     hwaddr addr,
-                                     unsigned size)
+static uint64_t prism_sim_compute_reg_read(void *opaque,
+                                           hwaddr addr,
+                                           unsigned size)
 {
     PrismSimState *s = opaque;
 
+    return qatomic_read(&s->compute.reg[addr >> 2]);
+}
+
+/*
+ * compute reg write
+ *
+ * a write to DISPATCH starts the dispatch and returns at once,
+ * the guest waits for the fence
+ */
+static void prism_sim_compute_reg_write(void *opaque,
+                                        hwaddr addr,
+                                        uint64_t val,
+                                        unsigned size)
+{
+    PrismSimState *s = opaque;
     unsigned int index = addr >> 2;
-    return s->prism_reg[index];
+
+    switch (index) {
+    case PRISM_COMPUTE_REG_STATUS:
+    case PRISM_COMPUTE_REG_FENCE:
+    case PRISM_COMPUTE_REG_WORKGROUPS:
+    case PRISM_COMPUTE_REG_STEALS:
+        return;
+    case PRISM_COMPUTE_REG_DISPATCH:
+        prism_compute_dispatch(&s->compute);
+        return;
+    default:
+        s->compute.reg[index] = val;
+        return;
+    }
 }
 
+static const MemoryRegionOps prism_sim_compute_reg_ops = {
+    .read = prism_sim_compute_reg_read,
+    .write = prism_sim_compute_reg_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .impl = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+};
+
 /*
- * mode reg write
+ * vram written
  *
- * write function for prism sim mode reg
+ * VRAM written by an engine behind the display's back: a finished
+ * dispatch (called from a pool thread) or the fbc copy engine
  */
-static void prism_sim_mode_reg_write(void *opaque,
-                                      hwaddr addr,
-                                      uint64_t val,
-                                      unsigned size)
+static void prism_sim_vram_written(void *opaque, uint64_t addr, uint64_t size)
 {
     PrismSimState *s = opaque;
 
-    unsigned int index = addr >> 2;
-    s->prism_reg[index] = val;
+    memory_region_set_dirty(&s->vram, addr, size);
 }
 
 
 /*
- * prism display mode ctrl reg 
+ * fbc reg read
  *
- * realize the operation of prism sim mode reg
+ * copy engine state and the compression statistics
  */
-static const MemoryRegionOps prism_sim_mode_reg_ops = {
-    .read = prism_sim_mode_reg_read,
-    .write = prism_sim_mode_reg_write,
+static uint64_t prism_sim_fbc_reg_read(void *opaque,
+                                       hwaddr addr,
+                                       unsigned size)
+{
+    PrismSimState *s = opaque;
+    PrismFbc *f = &s->fbc;
+    unsigned int index = addr >> 2;
+
+    switch (index) {
+    case PRISM_FBC_REG_RAW_KB:
+        return (uint32_t)(f->raw_bytes >> 10);
+    case PRISM_FBC_REG_PACKED_KB:
+        return (uint32_t)(f->packed_bytes >> 10);
+    case PRISM_FBC_REG_RATIO:
+        return f->packed_bytes ? f->raw_bytes * 100 / f->packed_bytes : 0;
+    default:
+        return f->reg[index];
+    }
+}
+
+/*
+ * fbc reg write
+ *
+ * a write to CMD encodes or decodes to completion before the access
+ * returns, like a draw
+ */
+static void prism_sim_fbc_reg_write(void *opaque,
+                                    hwaddr addr,
+                                    uint64_t val,
+                                    unsigned size)
+{
+    PrismSimState *s = opaque;
+    PrismFbc *f = &s->fbc;
+    unsigned int index = addr >> 2;
+
+    switch (index) {
+    case PRISM_FBC_REG_STATUS:
+    case PRISM_FBC_REG_RAW_KB:
+    case PRISM_FBC_REG_PACKED_KB:
+    case PRISM_FBC_REG_RATIO:
+    case PRISM_FBC_REG_TILES_WRITTEN:
+        return;
+    case PRISM_FBC_REG_CMD:
+        prism_fbc_run(f, val);
+        return;
+    case PRISM_FBC_REG_CTRL:
+        if (val & PRISM_FBC_CTRL_CLEAR_STATS) {
+            f->raw_bytes = 0;
+            f->packed_bytes = 0;
+        }
+        return;
+    default:
+        f->reg[index] = val;
+        return;
+    }
+}
+
+static const MemoryRegionOps prism_sim_fbc_reg_ops = {
+    .read = prism_sim_fbc_reg_read,
+    .write = prism_sim_fbc_reg_write,
     .endianness = DEVICE_NATIVE_ENDIAN,
     .impl = {
         .min_access_size = 4,
@@ -146,6 +1407,93 @@ static const MemoryRegionOps prism_sim_mode_reg_ops = {
 };
 
 
+/*
+ * vm state change
+ *
+ * VRAM is a RAM block, migration pre-copies it with its own dirty log
+ * and every engine write is reported through memory_region_set_dirty.
+ * A compute dispatch runs on its own threads though, so it is drained
+ * when the VM stops: the final RAM pass then sees all of its writes
+ */
+static void prism_sim_vm_change(void *opaque, bool running, RunState state)
+{
+    PrismSimState *s = opaque;
+
+    if (!running) {
+        prism_compute_wait(&s->compute);
+    }
+}
+
+
+/*
+ * head init
+ *
+ * console, vblank timer and register bank of head i, head 0 also
+ * answers at the single head offsets
+ */
+static void prism_sim_head_init(PrismSimState *s, unsigned int i)
+{
+    PrismSimHead *h = &s->head[i];
+    Object *obj = OBJECT(s);
+    hwaddr bank = PRISM_SIM_HEAD_REG_OFFSET + i * PRISM_SIM_HEAD_BANK;
+    char name[32];
+
+    h->s = s;
+    h->index = i;
+    h->con = graphic_console_init(DEVICE(s), i, &prism_sim_gfx_ops, h);
+
+    h->vblank_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, prism_sim_vblank, h);
+    timer_mod(h->vblank_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+              NANOSECONDS_PER_SECOND / PRISM_SIM_VBLANK_HZ);
+
+    snprintf(name, sizeof(name), "prism-sim.head%u.mode-reg", i);
+    memory_region_init_io(&h->preg, obj, &prism_sim_mode_reg_ops,
+                          h, name, PRISM_REGISTER_SIZE);
+    memory_region_add_subregion(&s->mmio, bank + PRISM_SIM_HEAD_MODE_OFFSET,
+                                &h->preg);
+
+    snprintf(name, sizeof(name), "prism-sim.head%u.cursor-reg", i);
+    memory_region_init_io(&h->cureg, obj, &prism_sim_cursor_reg_ops,
+                          h, name, PRISM_SIM_CURSOR_REG_SIZE);
+    memory_region_add_subregion(&s->mmio, bank + PRISM_SIM_HEAD_CURSOR_OFFSET,
+                                &h->cureg);
+
+    snprintf(name, sizeof(name), "prism-sim.head%u.plane-reg", i);
+    memory_region_init_io(&h->plreg, obj, &prism_sim_plane_reg_ops,
+                          h, name, PRISM_SIM_PLANE_REG_SIZE);
+    memory_region_add_subregion(&s->mmio, bank + PRISM_SIM_HEAD_PLANE_OFFSET,
+                                &h->plreg);
+
+    if (i != 0) {
+        return;
+    }
+
+    memory_region_init_alias(&h->preg_alias, obj, "prism-sim.mode-reg",
+                             &h->preg, 0, PRISM_REGISTER_SIZE);
+    memory_region_add_subregion(&s->mmio, PRISM_SIM_REG_OFFSET, &h->preg_alias);
+
+    memory_region_init_alias(&h->cureg_alias, obj, "prism-sim.cursor-reg",
+                             &h->cureg, 0, PRISM_SIM_CURSOR_REG_SIZE);
+    memory_region_add_subregion(&s->mmio, PRISM_SIM_CURSOR_REG_OFFSET,
+                                &h->cureg_alias);
+
+    memory_region_init_alias(&h->plreg_alias, obj, "prism-sim.plane-reg",
+                             &h->plreg, 0, PRISM_SIM_PLANE_REG_SIZE);
+    memory_region_add_subregion(&s->mmio, PRISM_SIM_PLANE_REG_OFFSET,
+                                &h->plreg_alias);
+}
+
+/*
+ * head exit
+ */
+static void prism_sim_head_exit(PrismSimHead *h)
+{
+    timer_free(h->vblank_timer);
+    prism_sim_surface_release(h);
+    graphic_console_close(h->con);
+}
+
+
 /*
  * class realize
  *
@@ -155,27 +1503,88 @@ static void prism_sim_realize(PCIDevice *dev, Error **errp)
 {
     PrismSimState *s = PRISM_SIM(dev);
     Object *obj = OBJECT(dev);
+    unsigned int i;
     int ret;
 
-    s->con = graphic_console_init(DEVICE(dev), 0, &prism_sim_gfx_ops, s);
+    if (s->heads < 1 || s->heads > PRISM_SIM_MAX_HEADS) {
+        error_setg(errp, "heads must be between 1 and %d", PRISM_SIM_MAX_HEADS);
+        return;
+    }
+    if (s->raster_threads < 1 || s->raster_threads > PRISM_RASTER_MAX_THREADS) {
+        error_setg(errp, "raster-threads must be between 1 and %d",
+                   PRISM_RASTER_MAX_THREADS);
+        return;
+    }
+    if (s->compute_threads < 1 || s->compute_threads > PRISM_COMPUTE_MAX_THREADS) {
+        error_setg(errp, "compute-threads must be between 1 and %d",
+                   PRISM_COMPUTE_MAX_THREADS);
+        return;
+    }
 
-    /* vram */
-    memory_region_init_ram(&s->vram, obj, "prism-sim.vram",
-                           s->vgamem, errp);
-    if (*errp) {
+    /* vram, a BAR is a power of two and the offset registers are 32 bit */
+    if (s->vgamem < PRISM_SIM_VRAM_MIN || s->vgamem > PRISM_SIM_VRAM_MAX) {
+        error_setg(errp, "vram-size must be between %d MiB and %d GiB",
+                   (int)(PRISM_SIM_VRAM_MIN / MiB), (int)(PRISM_SIM_VRAM_MAX / GiB));
         return;
     }
+    s->vgamem = pow2ceil(s->vgamem);
+    if (s->vram_hugepages || s->scanout_dmabuf) {
+        int fd = qemu_memfd_create("prism-sim.vram", s->vgamem, s->vram_hugepages, 0,
+                                   F_SEAL_GROW | F_SEAL_SHRINK | F_SEAL_SEAL, errp);
+
+        if (fd < 0) {
+            return;
+        }
+        if (!memory_region_init_ram_from_fd(&s->vram, obj, "prism-sim.vram",
+                                            s->vgamem, RAM_SHARED, fd, 0, errp)) {
+            close(fd);
+            return;
+        }
+        vmstate_register_ram(&s->vram, DEVICE(dev));
+    } else {
+        memory_region_init_ram(&s->vram, obj, "prism-sim.vram",
+                               s->vgamem, errp);
+        if (*errp) {
+            return;
+        }
+    }
     pci_register_bar(&s->pci, 0, PCI_BASE_ADDRESS_SPACE_MEMORY 
                                 | PCI_BASE_ADDRESS_MEM_TYPE_64 
                                 | PCI_BASE_ADDRESS_MEM_PREFETCH, &s->vram);
 
+    prism_tex_init(&s->tex, memory_region_get_ram_ptr(&s->vram), s->vgamem);
+    prism_raster_init(&s->raster, memory_region_get_ram_ptr(&s->vram),
+                      s->vgamem, &s->tex, s->raster_threads);
+    prism_compute_init(&s->compute, memory_region_get_ram_ptr(&s->vram),
+                       s->vgamem, &s->tex, s->compute_threads,
+                       prism_sim_vram_written, s);
+    prism_fbc_init(&s->fbc, memory_region_get_ram_ptr(&s->vram), s->vgamem,
+                   prism_sim_vram_written, s);
+    s->vm_change = qemu_add_vm_change_state_handler(prism_sim_vm_change, s);
+
 
     /* mmio */
     memory_region_init(&s->mmio, obj, "prism-sim.mmio", PCI_PRISM_MMIO_SIZE);
 
-    memory_region_init_io(&s->preg, obj, &prism_sim_mode_reg_ops,
-                          s, "prism-sim.mode-reg", PRISM_REGISTER_SIZE);
-    memory_region_add_subregion(&s->mmio, PRISM_SIM_REG_OFFSET, &s->preg);
+    for (i = 0; i < s->heads; i++) {
+        prism_sim_head_init(s, i);
+    }
+
+    memory_region_init_io(&s->treg, obj, &prism_sim_tex_reg_ops,
+                          s, "prism-sim.tex-reg", PRISM_SIM_TEX_REG_SIZE);
+    memory_region_add_subregion(&s->mmio, PRISM_SIM_TEX_REG_OFFSET, &s->treg);
+
+    memory_region_init_io(&s->rreg, obj, &prism_sim_raster_reg_ops,
+                          s, "prism-sim.raster-reg", PRISM_SIM_RASTER_REG_SIZE);
+    memory_region_add_subregion(&s->mmio, PRISM_SIM_RASTER_REG_OFFSET, &s->rreg);
+
+    memory_region_init_io(&s->creg, obj, &prism_sim_compute_reg_ops,
+                          s, "prism-sim.compute-reg", PRISM_SIM_COMPUTE_REG_SIZE);
+    memory_region_add_subregion(&s->mmio, PRISM_SIM_COMPUTE_REG_OFFSET, &s->creg);
+
+    memory_region_init_io(&s->freg, obj, &prism_sim_fbc_reg_ops,
+                          s, "prism-sim.fbc-reg", PRISM_SIM_FBC_REG_SIZE);
+    memory_region_add_subregion(&s->mmio, PRISM_SIM_FBC_REG_OFFSET, &s->freg);
 
     pci_register_bar(&s->pci, 2, PCI_BASE_ADDRESS_SPACE_MEMORY, &s->mmio);
     if (pci_bus_is_express(pci_get_bus(dev))) {
@@ -197,16 +1606,176 @@ static void prism_sim_realize(PCIDevice *dev, Error **errp)
 static void prism_sim_exit(PCIDevice *dev)
 {
     PrismSimState *s = PRISM_SIM(dev);
+    unsigned int i;
+
+    qemu_del_vm_change_state_handler(s->vm_change);
+    prism_compute_exit(&s->compute);
+    prism_raster_exit(&s->raster);
+    for (i = 0; i < s->heads; i++) {
+        prism_sim_head_exit(&s->head[i]);
+    }
+}
+
+/*
+ * properties
+ *
+ * raster-threads: host threads shading tiles, the vCPU kicking a draw
+ * is one of them
+ * compute-threads: host threads running compute workgroups
+ * heads: display pipes, one console each
+ * vram-size: size of BAR 0, rounded up to a power of two, at most 4 GiB
+ * vram-hugepages: back VRAM with a hugetlb memfd, the huge page size is
+ * the host default and must divide vram-size
+ * scanout-dmabuf: back VRAM with a sealed memfd and hand primaries to GL
+ * consoles as udmabufs instead of surfaces
+ */
+static const Property prism_sim_properties[] = {
+    DEFINE_PROP_SIZE("vram-size", PrismSimState, vgamem, PRISM_SIM_VRAM_SIZE),
+    DEFINE_PROP_BOOL("vram-hugepages", PrismSimState, vram_hugepages, false),
+    DEFINE_PROP_BOOL("scanout-dmabuf", PrismSimState, scanout_dmabuf, false),
+    DEFINE_PROP_UINT32("heads", PrismSimState, heads, PRISM_SIM_HEADS),
+    DEFINE_PROP_UINT32("raster-threads", PrismSimState, raster_threads,
+                       PRISM_SIM_RASTER_THREADS),
+    DEFINE_PROP_UINT32("compute-threads", PrismSimState, compute_threads,
+                       PRISM_SIM_COMPUTE_THREADS),
+};
+
+/*
+ * post load
+ *
+ * only guest visible state is migrated: scanout surfaces, the
+ * composition and the UI cursor are rebuilt from the latched registers,
+ * the texture cache starts cold
+ */
+static int prism_sim_post_load(void *opaque, int version_id)
+{
+    PrismSimState *s = opaque;
+    PrismSimHead *h;
+    unsigned int i;
 
-    graphic_console_close(s->con);
+    for (i = 0; i < s->heads; i++) {
+        h = &s->head[i];
+        prism_sim_surface_release(h);
+        memset(&h->mode, 0, sizeof(h->mode));
+        memset(h->plane_shown, 0, sizeof(h->plane_shown));
+        h->cursor_defined = false;
+        if (h->cursor_reg[PRISM_SIM_CURSOR_REG_CTRL] & PRISM_SIM_CURSOR_CTRL_ENABLE) {
+            prism_sim_cursor_define(h);
+            prism_sim_cursor_move(h);
+        }
+    }
+    prism_tex_invalidate(&s->tex);
+    return 0;
 }
 
+static const VMStateDescription vmstate_prism_sim_head = {
+    .name = "prism-sim/head",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (const VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(prism_reg, PrismSimHead, PRISM_SIM_REG_NUMBER),
+        VMSTATE_UINT32_ARRAY(prism_reg_pending, PrismSimHead, PRISM_SIM_REG_NUMBER),
+        VMSTATE_UINT32_ARRAY(prism_reg_active, PrismSimHead, PRISM_SIM_REG_NUMBER),
+        VMSTATE_UINT32_2DARRAY(plane_reg, PrismSimHead,
+                               PRISM_SIM_OVERLAYS, PRISM_SIM_PLANE_REG_NUMBER),
+        VMSTATE_UINT32_2DARRAY(plane_reg_pending, PrismSimHead,
+                               PRISM_SIM_OVERLAYS, PRISM_SIM_PLANE_REG_NUMBER),
+        VMSTATE_UINT32_2DARRAY(plane_reg_active, PrismSimHead,
+                               PRISM_SIM_OVERLAYS, PRISM_SIM_PLANE_REG_NUMBER),
+        VMSTATE_BOOL(commit_pending, PrismSimHead),
+        VMSTATE_UINT32(vblank_count, PrismSimHead),
+        VMSTATE_TIMER_PTR(vblank_timer, PrismSimHead),
+        VMSTATE_UINT32_ARRAY(cursor_reg, PrismSimHead, PRISM_SIM_CURSOR_REG_NUMBER),
+        VMSTATE_END_OF_LIST()
+    },
+};
+
+static const VMStateDescription vmstate_prism_tex_desc = {
+    .name = "prism-sim/tex-desc",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (const VMStateField[]) {
+        VMSTATE_UINT32(base, PrismTexDesc),
+        VMSTATE_UINT32(width, PrismTexDesc),
+        VMSTATE_UINT32(height, PrismTexDesc),
+        VMSTATE_UINT32(format, PrismTexDesc),
+        VMSTATE_END_OF_LIST()
+    },
+};
+
+/*
+ * vmstate
+ *
+ * the register file of every block; VRAM itself goes with the RAM
+ * blocks (iterative pre-copy), the head count has to match
+ */
+static const VMStateDescription vmstate_prism_sim = {
+    .name = TYPE_PRISM_SIM,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = prism_sim_post_load,
+    .fields = (const VMStateField[]) {
+        VMSTATE_PCI_DEVICE(pci, PrismSimState),
+        VMSTATE_UINT64_EQUAL(vgamem, PrismSimState, NULL),
+        VMSTATE_UINT32_EQUAL(heads, PrismSimState, NULL),
+        VMSTATE_STRUCT_VARRAY_UINT32(head, PrismSimState, heads, 1,
+                                     vmstate_prism_sim_head, PrismSimHead),
+        VMSTATE_STRUCT_ARRAY(tex.desc, PrismSimState, PRISM_TEX_SLOTS, 1,
+                             vmstate_prism_tex_desc, PrismTexDesc),
+        VMSTATE_UINT64(tex.hits, PrismSimState),
+        VMSTATE_UINT64(tex.misses, PrismSimState),
+        VMSTATE_UINT32_ARRAY(raster.reg, PrismSimState, PRISM_RASTER_REG_NUMBER),
+        VMSTATE_UINT32_ARRAY(compute.reg, PrismSimState, PRISM_COMPUTE_REG_NUMBER),
+        VMSTATE_UINT32_ARRAY(fbc.reg, PrismSimState, PRISM_FBC_REG_NUMBER),
+        VMSTATE_UINT64(fbc.raw_bytes, PrismSimState),
+        VMSTATE_UINT64(fbc.packed_bytes, PrismSimState),
+        VMSTATE_END_OF_LIST()
+    },
+};
+
 /*
  * PrismSimClass
  *
  * Class for Prism Simulator PCI Device initialization
  */
 
+/*
+ * reset
+ *
+ * let a running dispatch write its fence, then clear every head's
+ * register banks (shadow, committed and latched mode and overlay banks,
+ * cursor) and drop a commit still waiting for vblank; the cursor is
+ * hidden and the scanout state is rebuilt once the guest sets a mode
+ */
+static void prism_sim_reset(DeviceState *dev)
+{
+    PrismSimState *s = PRISM_SIM(dev);
+    PrismSimHead *h;
+    unsigned int i;
+
+    prism_compute_wait(&s->compute);
+
+    for (i = 0; i < s->heads; i++) {
+        h = &s->head[i];
+        memset(h->prism_reg, 0, sizeof(h->prism_reg));
+        memset(h->prism_reg_pending, 0, sizeof(h->prism_reg_pending));
+        memset(h->prism_reg_active, 0, sizeof(h->prism_reg_active));
+        memset(h->plane_reg, 0, sizeof(h->plane_reg));
+        memset(h->plane_reg_pending, 0, sizeof(h->plane_reg_pending));
+        memset(h->plane_reg_active, 0, sizeof(h->plane_reg_active));
+        h->commit_pending = false;
+        h->vblank_count = 0;
+
+        memset(h->cursor_reg, 0, sizeof(h->cursor_reg));
+        prism_sim_cursor_move(h);
+        h->cursor_defined = false;
+
+        prism_sim_surface_release(h);
+        memset(&h->mode, 0, sizeof(h->mode));
+        memset(h->plane_shown, 0, sizeof(h->plane_shown));
+    }
+}
+
 static void prism_sim_class_init(ObjectClass *klass, const void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
@@ -217,7 +1786,10 @@ static void prism_sim_class_init(ObjectClass *klass, const void *data)
     k->pci.device_id = 0x2000; //prism device id
     k->pci.realize = prism_sim_realize;
     k->pci.exit = prism_sim_exit;
+    device_class_set_legacy_reset(dc, prism_sim_reset);
     set_bit(DEVICE_CATEGORY_MISC, dc->categories);
+    device_class_set_props(dc, prism_sim_properties);
+    dc->vmsd = &vmstate_prism_sim;
 }
 
 /*
@@ -251,9 +1823,6 @@ static void prism_set_endian_fb(Object *obj, bool val, Error **errp)
  */
 static void prism_sim_init(Object *obj){
     PCIDevice *dev = PCI_DEVICE(obj);
-    PrismSimState *s = PRISM_SIM(dev);
-
-    s->vgamem = 64 * MiB; //default vram size
 
     dev->cap_present |= QEMU_PCI_CAP_EXPRESS;
 
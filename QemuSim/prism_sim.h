@@ -13,13 +13,31 @@
 
 
 #include "ui/console.h"
+#include "ui/dmabuf.h"
 #include "ui/qemu-pixman.h"
+#include "standard-headers/drm/drm_fourcc.h"
+#ifdef CONFIG_LINUX
+#include <sys/ioctl.h>
+#include "standard-headers/linux/udmabuf.h"
+#endif
+#include "qemu/timer.h"
+#include "qemu/bitmap.h"
+#include "system/runstate.h"
+#include "qemu/log.h"
+#include "qemu/memfd.h"
+#include "qemu/error-report.h"
 #include "qom/object.h"
 
+#include "prism_texture.h"
+#include "prism_raster.h"
+#include "prism_compute.h"
+#include "prism_compose.h"
+#include "prism_fbc.h"
+
 
 #define TYPE_PRISM_SIM "prism-sim"
 
-#define PCI_PRISM_MMIO_SIZE     0x40
+#define PCI_PRISM_MMIO_SIZE     0x800
 
 #define PRISM_REGISTER_SIZE   4*16  //16个寄存器，每个寄存器4字节
 #define PRISM_SIM_REG_NUMBER 15
@@ -32,6 +50,109 @@
 #define PRISM_SIM_MODE_REG_STRIDE  4
 #define PRISM_SIM_MODE_REG_OFFSET  5
 #define PRISM_SIM_MODE_REG_SIZE    6
+#define PRISM_SIM_MODE_REG_START   7    //写: 提交影子寄存器, 读: 是否有待生效的提交
+#define PRISM_SIM_MODE_REG_VBLANK  8    //只读: vblank 计数
+#define PRISM_SIM_MODE_REG_HEADS   9    //只读: 显示头的数量
+#define PRISM_SIM_MODE_REG_META    10   //FBC 元数据平面的偏移, 格式为 PRISM_FBC_FORMAT 时有效
+
+/*
+ * mode registers are double buffered: writes land in the shadow bank,
+ * a START write snapshots it as one commit and the next vblank makes
+ * the commit the scanout state, so the display never sees half a mode
+ */
+#define PRISM_SIM_VBLANK_HZ        60
+
+/*
+ * texture unit registers: four per descriptor slot (BASE, WIDTH, HEIGHT,
+ * FORMAT), then the cache counters and control.
+ * HIT_RATE reads hits per 10000 lookups; writing CTRL_INVALIDATE drops the
+ * cached tiles, CTRL_CLEAR_STATS resets the counters
+ */
+#define PRISM_SIM_TEX_REG_OFFSET   0x40
+#define PRISM_SIM_TEX_REG_SIZE     (4 * 20)
+#define PRISM_SIM_TEX_REG_BASE     0
+#define PRISM_SIM_TEX_REG_WIDTH    1
+#define PRISM_SIM_TEX_REG_HEIGHT   2
+#define PRISM_SIM_TEX_REG_FORMAT   3
+#define PRISM_SIM_TEX_REG_HITS     16
+#define PRISM_SIM_TEX_REG_MISSES   17
+#define PRISM_SIM_TEX_REG_HIT_RATE 18
+#define PRISM_SIM_TEX_REG_CTRL     19
+
+#define PRISM_SIM_TEX_CTRL_INVALIDATE   (1 << 0)
+#define PRISM_SIM_TEX_CTRL_CLEAR_STATS  (1 << 1)
+
+/*
+ * hardware cursor registers: an ARGB8888 image of up to 64x64 in VRAM,
+ * handed to the UI as its pointer so moving it never touches the
+ * framebuffer. POS is the top left corner of the image relative to the
+ * scanout (signed 16 bit x / y), writing UPDATE reloads the image
+ */
+#define PRISM_SIM_CURSOR_REG_OFFSET 0x90
+#define PRISM_SIM_CURSOR_REG_NUMBER 6
+#define PRISM_SIM_CURSOR_REG_SIZE   (4 * PRISM_SIM_CURSOR_REG_NUMBER)
+#define PRISM_SIM_CURSOR_REG_BASE   0
+#define PRISM_SIM_CURSOR_REG_SIZE_WH 1  //width | height << 16
+#define PRISM_SIM_CURSOR_REG_HOT    2   //hot_x | hot_y << 16
+#define PRISM_SIM_CURSOR_REG_POS    3   //x | y << 16
+#define PRISM_SIM_CURSOR_REG_CTRL   4
+#define PRISM_SIM_CURSOR_REG_UPDATE 5   //write only
+
+#define PRISM_SIM_CURSOR_CTRL_ENABLE (1 << 0)
+#define PRISM_SIM_CURSOR_MAX        64
+
+/*
+ * overlay plane banks, PRISM_SIM_PLANE_BANK bytes apart, composited over
+ * the primary in bank order; double buffered like the mode registers
+ * (committed by START, latched at vblank)
+ */
+#define PRISM_SIM_PLANE_REG_OFFSET  0x200
+#define PRISM_SIM_OVERLAYS          2
+#define PRISM_SIM_PLANE_BANK        0x20
+#define PRISM_SIM_PLANE_REG_NUMBER  (PRISM_SIM_PLANE_BANK / 4)
+#define PRISM_SIM_PLANE_REG_SIZE    (PRISM_SIM_OVERLAYS * PRISM_SIM_PLANE_BANK)
+#define PRISM_SIM_PLANE_REG_BASE    0
+#define PRISM_SIM_PLANE_REG_PITCH   1
+#define PRISM_SIM_PLANE_REG_FORMAT  2   //PRISM_COMPOSE_FMT_*
+#define PRISM_SIM_PLANE_REG_POS     3   //x | y << 16, signed 16 bit
+#define PRISM_SIM_PLANE_REG_SIZE_WH 4   //width | height << 16
+#define PRISM_SIM_PLANE_REG_ALPHA   5   //0 - 255
+#define PRISM_SIM_PLANE_REG_CTRL    6
+
+#define PRISM_SIM_PLANE_CTRL_ENABLE (1 << 0)
+
+/*
+ * display heads: each head is a whole pipe (mode registers, cursor and
+ * overlay banks, laid out as below) with its own console, scanout
+ * surfaces and vblank timer. Head n's bank is at
+ * PRISM_SIM_HEAD_REG_OFFSET + n * PRISM_SIM_HEAD_BANK; head 0 also
+ * answers at the single head offsets above
+ */
+#define PRISM_SIM_HEAD_REG_OFFSET   0x400
+#define PRISM_SIM_HEAD_BANK         0x100
+#define PRISM_SIM_HEAD_MODE_OFFSET  0x00
+#define PRISM_SIM_HEAD_CURSOR_OFFSET 0x40
+#define PRISM_SIM_HEAD_PLANE_OFFSET 0x80
+#define PRISM_SIM_MAX_HEADS         4
+#define PRISM_SIM_HEADS             1   //default heads
+
+#define PRISM_SIM_VRAM_SIZE         (64 * MiB)  //default vram size
+#define PRISM_SIM_VRAM_MIN          (16 * MiB)
+#define PRISM_SIM_VRAM_MAX          (4 * GiB)   //offsets in the registers are 32 bit
+
+/* rasterizer registers, layout in prism_raster.h */
+#define PRISM_SIM_RASTER_REG_OFFSET 0x100
+#define PRISM_SIM_RASTER_REG_SIZE   (4 * PRISM_RASTER_REG_NUMBER)
+#define PRISM_SIM_RASTER_THREADS    4   //default raster-threads
+
+/* compute dispatch registers, layout in prism_compute.h */
+#define PRISM_SIM_COMPUTE_REG_OFFSET 0x180
+#define PRISM_SIM_COMPUTE_REG_SIZE   (4 * PRISM_COMPUTE_REG_NUMBER)
+#define PRISM_SIM_COMPUTE_THREADS    4  //default compute-threads
+
+/* framebuffer compression copy engine registers, layout in prism_fbc.h */
+#define PRISM_SIM_FBC_REG_OFFSET    0x300
+#define PRISM_SIM_FBC_REG_SIZE      (4 * PRISM_FBC_REG_NUMBER)
 
 struct PrismDisplayMode
  {
@@ -42,24 +163,93 @@ struct PrismDisplayMode
     uint32_t             stride   ;//步幅，从一行的开头到下一行开头的字节数
     uint64_t             offset   ;//指定了显示缓冲区在显存中的偏移量
     uint64_t             size     ;//显存的大小
+    uint64_t             meta     ;//FBC 元数据平面的偏移
  };
 
 typedef struct PrismDisplayMode PrismDisplayMode;
 
+/*
+ * dmabuf export pool: with scanout-dmabuf on and a GL console, an
+ * XRGB8888 / ARGB8888 primary goes to the UI as a udmabuf of its VRAM
+ * pages, one per VRAM offset seen with the current geometry, so the UI
+ * samples the guest framebuffer with no per frame copy and a page flip
+ * reuses the export of the new offset
+ */
+#define PRISM_SIM_DMABUF_POOL 4
+
+struct PrismScanoutDmabuf {
+    QemuDmaBuf *buf;        //NULL when the slot is free
+    uint64_t offset;
+    uint64_t last_used;
+};
+
+typedef struct PrismScanoutDmabuf PrismScanoutDmabuf;
+
+typedef struct PrismSimState PrismSimState;
+
+/*
+ * one display pipe, everything the scanout of a head touches, so the
+ * refresh of one console never walks the state of another
+ */
+struct PrismSimHead {
+    PrismSimState *s;
+    unsigned int index;
+    QemuConsole *con;
+    MemoryRegion preg;
+    MemoryRegion cureg;
+    MemoryRegion plreg;
+    MemoryRegion preg_alias;    //head 0 only, at the single head offsets
+    MemoryRegion cureg_alias;
+    MemoryRegion plreg_alias;
+
+    uint32_t prism_reg[PRISM_SIM_REG_NUMBER];          //shadow, written by the guest
+    uint32_t prism_reg_pending[PRISM_SIM_REG_NUMBER];  //committed by START
+    uint32_t prism_reg_active[PRISM_SIM_REG_NUMBER];   //latched at vblank, scanned out
+    uint32_t plane_reg[PRISM_SIM_OVERLAYS][PRISM_SIM_PLANE_REG_NUMBER];
+    uint32_t plane_reg_pending[PRISM_SIM_OVERLAYS][PRISM_SIM_PLANE_REG_NUMBER];
+    uint32_t plane_reg_active[PRISM_SIM_OVERLAYS][PRISM_SIM_PLANE_REG_NUMBER];
+    bool commit_pending;
+    uint32_t vblank_count;
+    QEMUTimer *vblank_timer;
+    PrismDisplayMode mode;
+    pixman_image_t *shadow;             //copy of a directly scanned out primary
+    pixman_image_t *compose;            //composition target while overlays are on
+    PrismScanoutDmabuf dmabuf[PRISM_SIM_DMABUF_POOL];
+    uint64_t dmabuf_clock;
+    bool dmabuf_on;                     //the console scans out one of them
+    PrismPlane plane_shown[PRISM_SIM_OVERLAYS];
+    uint32_t cursor_reg[PRISM_SIM_CURSOR_REG_NUMBER];
+    bool cursor_defined;    //an image has been handed to the UI
+    unsigned long *pending_rows;    //rows whose dirty bits another head cleared
+};
+
+typedef struct PrismSimHead PrismSimHead;
+
 struct PrismSimState {
     PCIDevice pci;
-    QemuConsole *con;
     MemoryRegion vram;
     MemoryRegion mmio;
-    MemoryRegion preg;
+    MemoryRegion treg;
+    MemoryRegion rreg;
+    MemoryRegion creg;
+    MemoryRegion freg;
 
     uint64_t vgamem; //vram size
-    uint32_t prism_reg[PRISM_SIM_REG_NUMBER];
-    PrismDisplayMode mode;
+    bool vram_hugepages;
+    bool scanout_dmabuf;
+    bool dmabuf_failed;     //the host can not export, scanout copies
+    PrismSimHead head[PRISM_SIM_MAX_HEADS];
+    uint32_t heads;
     bool big_endian_fb;
-};
 
-typedef struct PrismSimState PrismSimState;
+    PrismTextureUnit tex;
+    PrismRaster raster;
+    uint32_t raster_threads;
+    PrismCompute compute;
+    uint32_t compute_threads;
+    PrismFbc fbc;
+    VMChangeStateEntry *vm_change;
+};
 
 struct PrismSimClass
 {
@@ -0,0 +1,202 @@
+#include "qemu/osdep.h"
+#include "prism_texture.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* lanes filtered per batch, one wave */
+#define PRISM_TEX_BATCH 16
+
+/*
+ * prism texture init
+ *
+ * bind the unit to VRAM, clear descriptors, cache and counters
+ */
+void prism_tex_init(PrismTextureUnit *tu, const uint8_t *vram,
+                    uint64_t vram_size)
+{
+    memset(tu->desc, 0, sizeof(tu->desc));
+    tu->vram = vram;
+    tu->vram_size = vram_size;
+    tu->hits = 0;
+    tu->misses = 0;
+    prism_tex_invalidate(tu);
+}
+
+/*
+ * prism texture invalidate
+ *
+ * drop every cached tile, e.g. after the guest rewrote a texture
+ */
+void prism_tex_invalidate(PrismTextureUnit *tu)
+{
+    int i;
+
+    for (i = 0; i < PRISM_TEX_CACHE_LINES; i++) {
+        tu->cache[i].tag = PRISM_TEX_TAG_INVALID;
+    }
+}
+
+/* low 3 bits of a coordinate spread to the even bits of a Morton index */
+static const uint8_t prism_tex_morton_spread[PRISM_TEX_TILE] = {
+    0x00, 0x01, 0x04, 0x05, 0x10, 0x11, 0x14, 0x15
+};
+
+static inline uint32_t prism_tex_morton(uint32_t x, uint32_t y)
+{
+    return prism_tex_morton_spread[x & (PRISM_TEX_TILE - 1)] |
+           prism_tex_morton_spread[y & (PRISM_TEX_TILE - 1)] << 1;
+}
+
+static inline uint64_t prism_tex_tile_offset(const PrismTexDesc *desc,
+                                             uint32_t tx, uint32_t ty)
+{
+    uint32_t tiles_per_row = DIV_ROUND_UP(desc->width, PRISM_TEX_TILE);
+
+    return desc->base +
+           ((uint64_t)ty * tiles_per_row + tx) * PRISM_TEX_TILE_BYTES;
+}
+
+/*
+ * prism texture texel offset
+ *
+ * VRAM offset of texel (x, y), for whoever lays out texture data
+ */
+uint64_t prism_tex_texel_offset(const PrismTexDesc *desc,
+                                uint32_t x, uint32_t y)
+{
+    return prism_tex_tile_offset(desc, x >> PRISM_TEX_TILE_SHIFT,
+                                 y >> PRISM_TEX_TILE_SHIFT) +
+           prism_tex_morton(x, y) * 4;
+}
+
+/*
+ * prism texture fetch
+ *
+ * one texel through the cache; a miss fills the whole tile,
+ * tiles outside VRAM read as zero
+ */
+static uint32_t prism_tex_fetch(PrismTextureUnit *tu, const PrismTexDesc *desc,
+                                uint32_t x, uint32_t y)
+{
+    uint32_t tx = x >> PRISM_TEX_TILE_SHIFT, ty = y >> PRISM_TEX_TILE_SHIFT;
+    uint64_t addr = prism_tex_tile_offset(desc, tx, ty);
+    /* direct mapped, a 4x4 block of neighbouring tiles never conflicts */
+    PrismTexCacheLine *line = &tu->cache[(tx & 3) | (ty & 3) << 2];
+    int i;
+
+    if (line->tag == addr) {
+        tu->hits++;
+    } else {
+        tu->misses++;
+        line->tag = addr;
+        if (tu->vram && addr + PRISM_TEX_TILE_BYTES <= tu->vram_size) {
+            for (i = 0; i < PRISM_TEX_TILE_TEXELS; i++) {
+                line->texel[i] = ldl_le_p(tu->vram + addr + i * 4);
+            }
+        } else {
+            memset(line->texel, 0, sizeof(line->texel));
+        }
+    }
+    return line->texel[prism_tex_morton(x, y)];
+}
+
+/*
+ * texel address
+ *
+ * wrap a normalized coordinate (repeat), return the left/top texel of the
+ * bilinear footprint, the one after it and the weight of the second
+ */
+static inline void prism_tex_wrap(float c, uint32_t size,
+                                  uint32_t *i0, uint32_t *i1, float *frac)
+{
+    float x, fl;
+    int32_t i;
+
+    if (isnan(c)) {
+        c = 0.0f;
+    }
+    x = (c - floorf(c)) * size - 0.5f;
+    fl = floorf(x);
+    i = (int32_t)fl;
+    *frac = x - fl;
+    *i0 = i < 0 ? size - 1 : MIN((uint32_t)i, size - 1);
+    *i1 = *i0 + 1 >= size ? 0 : *i0 + 1;
+}
+
+/*
+ * bilinear filter
+ *
+ * the four corners are gathered into separate arrays (one lane per
+ * element), so the weights are applied four lanes per SSE operation
+ */
+static void prism_tex_filter(const float *c00, const float *c10,
+                             const float *c01, const float *c11,
+                             const float *fx, const float *fy,
+                             float *out, int n)
+{
+    const float scale = 1.0f / 255.0f;
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128 vscale = _mm_set1_ps(scale);
+
+    for (; i + 4 <= n; i += 4) {
+        __m128 a = _mm_loadu_ps(c00 + i), b = _mm_loadu_ps(c10 + i);
+        __m128 c = _mm_loadu_ps(c01 + i), d = _mm_loadu_ps(c11 + i);
+        __m128 wx = _mm_loadu_ps(fx + i), wy = _mm_loadu_ps(fy + i);
+        __m128 top = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), wx));
+        __m128 bot = _mm_add_ps(c, _mm_mul_ps(_mm_sub_ps(d, c), wx));
+        __m128 r = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bot, top), wy));
+
+        _mm_storeu_ps(out + i, _mm_mul_ps(r, vscale));
+    }
+#endif
+    for (; i < n; i++) {
+        float top = c00[i] + (c10[i] - c00[i]) * fx[i];
+        float bot = c01[i] + (c11[i] - c01[i]) * fx[i];
+
+        out[i] = (top + (bot - top) * fy[i]) * scale;
+    }
+}
+
+/*
+ * prism texture sample
+ *
+ * bilinear sample of one component (0-3 = rgba) of the texture in a
+ * descriptor slot at n normalized coordinates; an unset or unsupported
+ * descriptor samples as zero
+ */
+void prism_tex_sample(PrismTextureUnit *tu, unsigned slot, unsigned comp,
+                      const float *u, const float *v, float *out, int n)
+{
+    float c00[PRISM_TEX_BATCH], c10[PRISM_TEX_BATCH];
+    float c01[PRISM_TEX_BATCH], c11[PRISM_TEX_BATCH];
+    float fx[PRISM_TEX_BATCH], fy[PRISM_TEX_BATCH];
+    const PrismTexDesc *desc;
+    unsigned shift = (comp & 3) * 8;
+    int base, i, m;
+
+    desc = slot < PRISM_TEX_SLOTS ? &tu->desc[slot] : NULL;
+    if (!desc || !desc->width || !desc->height ||
+        desc->format != PRISM_TEX_FMT_RGBA8888) {
+        memset(out, 0, n * sizeof(*out));
+        return;
+    }
+
+    for (base = 0; base < n; base += PRISM_TEX_BATCH) {
+        m = MIN(n - base, PRISM_TEX_BATCH);
+        for (i = 0; i < m; i++) {
+            uint32_t x0, x1, y0, y1;
+
+            prism_tex_wrap(u[base + i], desc->width, &x0, &x1, &fx[i]);
+            prism_tex_wrap(v[base + i], desc->height, &y0, &y1, &fy[i]);
+            c00[i] = (prism_tex_fetch(tu, desc, x0, y0) >> shift) & 0xff;
+            c10[i] = (prism_tex_fetch(tu, desc, x1, y0) >> shift) & 0xff;
+            c01[i] = (prism_tex_fetch(tu, desc, x0, y1) >> shift) & 0xff;
+            c11[i] = (prism_tex_fetch(tu, desc, x1, y1) >> shift) & 0xff;
+        }
+        prism_tex_filter(c00, c10, c01, c11, fx, fy, out + base, m);
+    }
+}
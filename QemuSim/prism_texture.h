@@ -0,0 +1,62 @@
+#ifndef PRISM_TEXTURE_H
+#define PRISM_TEXTURE_H
+
+/*
+ * texture unit
+ *
+ * Texels are RGBA8888 (byte 0 is red) and stored in 8x8 tiles of 256 bytes.
+ * Inside a tile the texels are in Morton (Z) order, so a 2x2 bilinear
+ * footprint nearly always lands in one tile; tiles are row-major and a
+ * tile row holds DIV_ROUND_UP(width, 8) tiles.
+ * Each unit caches whole tiles, tagged by their VRAM offset. The cache is
+ * not coherent with CPU writes to VRAM: the driver invalidates it through
+ * the control register after uploading a texture.
+ */
+
+#define PRISM_TEX_SLOTS         4       /* descriptor slots, Compiler/gpu_linker.h */
+#define PRISM_TEX_TILE_SHIFT    3
+#define PRISM_TEX_TILE          (1 << PRISM_TEX_TILE_SHIFT)
+#define PRISM_TEX_TILE_TEXELS   (PRISM_TEX_TILE * PRISM_TEX_TILE)
+#define PRISM_TEX_TILE_BYTES    (PRISM_TEX_TILE_TEXELS * 4)
+#define PRISM_TEX_CACHE_LINES   16      /* one tile per line, 4 KiB */
+#define PRISM_TEX_TAG_INVALID   UINT64_MAX
+
+#define PRISM_TEX_FMT_RGBA8888  0
+
+struct PrismTexDesc {
+    uint32_t base;          //VRAM offset of the first tile
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;
+};
+
+typedef struct PrismTexDesc PrismTexDesc;
+
+struct PrismTexCacheLine {
+    uint64_t tag;           //VRAM offset of the cached tile
+    uint32_t texel[PRISM_TEX_TILE_TEXELS];
+};
+
+typedef struct PrismTexCacheLine PrismTexCacheLine;
+
+struct PrismTextureUnit {
+    const uint8_t *vram;
+    uint64_t vram_size;
+    PrismTexDesc desc[PRISM_TEX_SLOTS];
+    PrismTexCacheLine cache[PRISM_TEX_CACHE_LINES];
+
+    uint64_t hits;          //texel lookups served by the cache
+    uint64_t misses;        //texel lookups that filled a line from VRAM
+};
+
+typedef struct PrismTextureUnit PrismTextureUnit;
+
+void prism_tex_init(PrismTextureUnit *tu, const uint8_t *vram,
+                    uint64_t vram_size);
+void prism_tex_invalidate(PrismTextureUnit *tu);
+uint64_t prism_tex_texel_offset(const PrismTexDesc *desc,
+                                uint32_t x, uint32_t y);
+void prism_tex_sample(PrismTextureUnit *tu, unsigned slot, unsigned comp,
+                      const float *u, const float *v, float *out, int n);
+
+#endif /* PRISM_TEXTURE_H */